@@ -0,0 +1,994 @@
+/***************************************************************************//**
+ * \file    biblioteca.c
+ *
+ * \brief   ndice persistente de la biblioteca de msica de la tarjeta SD.
+ *
+ *          El ndice guarda para cada fichero MP3 su ruta, tamao, fecha de
+ *          modificacin, duracin, tasa de bits y etiquetas (ledas con
+ *          etiq_leer). Est formado por una tabla de entradas de tamao fijo
+ *          y una arena con todas las cadenas, ambas en la SDRAM, y se guarda
+ *          en la tarjeta en el fichero BIBLIO_FICHERO_INDICE como una
+ *          cabecera seguida de la tabla, de la arena y de las vistas
+ *          ordenadas, tal como estn en memoria.
+ *
+ *          Al arrancar se carga el fichero con biblio_cargar y despus
+ *          biblio_actualizar recorre la tarjeta con explo_recorrer, hasta
+ *          BIBLIO_PROFUNDIDAD_MAXIMA niveles de subdirectorios. Los ficheros
+ *          cuyo tamao y fecha coinciden con los de su entrada se conservan
+ *          sin abrirlos; slo se analizan los nuevos o modificados. El ndice
+ *          se vuelve a escribir nicamente si ha cambiado algo.
+ *
+ *          Hay dos juegos de tabla y arena. La actualizacin construye el
+ *          nuevo ndice en el juego libre, buscando cada fichero en el actual
+ *          mediante una tabla de listas indexada por el hash de la ruta, y al
+ *          terminar intercambia los juegos. As las cadenas de las pistas
+ *          eliminadas no ocupan sitio en la arena.
+ *
+ *          Cada vista ordenada (por nombre de fichero, artista, lbum y
+ *          nmero de pista) es una permutacin de los nmeros de las pistas.
+ *          Se calculan con orden_ordenar cuando el ndice cambia, de modo que
+ *          en un arranque sin cambios se cargan ya hechas.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include <ctype.h>
+#include "biblioteca.h"
+#include "etiquetas.h"
+#include "ordenacion.h"
+#include "explorador.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define FIRMA_INDICE        0x4C424942u     /* "BIBL" */
+
+/* Versin del formato del ndice. La 2 es la primera con las etiquetas
+ * rellenas y la 3 la primera con las vistas ordenadas; los ndices
+ * anteriores se descartan y se vuelven a construir.
+ */
+#define VERSION_INDICE      3u
+
+#define NINGUNA             0xFFFFu
+
+#if BIBLIO_MAXIMO_PISTAS >= NINGUNA
+#error "BIBLIO_MAXIMO_PISTAS demasiado grande."
+#endif
+
+/* Desplazamiento devuelto por anadir_cadena cuando la cadena no cabe en la
+ * arena.
+ */
+#define NINGUNA_CADENA      0xFFFFFFFFu
+
+/* Bytes del principio del fichero en los que se busca el primer frame MPEG
+ * despus de la etiqueta ID3v2.
+ */
+#define BYTES_BUSQUEDA_FRAME    4096u
+
+/*===== Tipos privados =========================================================
+ */
+
+typedef struct {
+    uint32_t firma;
+    uint32_t version;
+    uint32_t numero_pistas;
+    uint32_t tamano_arena;
+    uint32_t numero_ordenes;
+} cabecera_indice_t;
+
+/* Juego de tabla de entradas y arena de cadenas.
+ */
+typedef struct {
+    biblio_pista_t *pistas;
+    char *arena;
+    uint32_t numero_pistas;
+    uint32_t tamano_arena;          /* Bytes usados. */
+    uint16_t *ordenes[BIBLIO_NUMERO_ORDENES];
+} indice_t;
+
+/*===== Variables privadas =====================================================
+ */
+
+static indice_t indices[2];
+static uint32_t indice_actual = 0;
+
+/* Tabla de bsqueda por ruta del ndice actual, construida al empezar cada
+ * actualizacin.
+ */
+static uint16_t *cubetas = NULL;
+static uint16_t *siguientes;
+
+static biblio_estadisticas_t estadisticas;
+
+/* Juego cuyas pistas comparan las funciones de comparacin de las vistas.
+ */
+static const indice_t *indice_ordenado;
+
+/* Juegos que usa anadir_fichero_explorado durante la actualizacin.
+ */
+static indice_t *indice_nuevo;
+static const indice_t *indice_anterior;
+
+/* Tiempo de la actualizacin en curso. Se suma por tramos (cada fichero
+ * explorado y cada vista ordenada) para que no desborde el contador de
+ * ciclos.
+ */
+static ciclos_acumulador_t tiempo_actualizacion;
+
+/* Buffer para leer el principio de los ficheros al analizarlos.
+ */
+static uint8_t buffer_analisis[512];
+
+/* Tasas de bits de Layer III en kbit/s segn el ndice de la cabecera del
+ * frame, para MPEG-1 y para MPEG-2/2.5.
+ */
+static const uint16_t tasas_bits_mpeg1[16] = {
+    0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0
+};
+
+static const uint16_t tasas_bits_mpeg2[16] = {
+    0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0
+};
+
+static const uint32_t tasas_muestreo_mpeg1[4] = { 44100, 48000, 32000, 0 };
+
+static void vaciar_indice(indice_t *indice);
+static uint32_t anadir_cadena(indice_t *indice, const char *cadena);
+static uint32_t hash_ruta(const char *ruta);
+static void construir_tabla_busqueda(const indice_t *indice);
+static uint32_t buscar_ruta(const indice_t *indice, const char *ruta);
+static bool_t anadir_fichero(indice_t *nuevo,
+                             const indice_t *anterior,
+                             const char *ruta,
+                             const FILINFO *informacion);
+static void analizar_fichero(indice_t *nuevo,
+                             const char *ruta,
+                             biblio_pista_t *pista);
+static bool_t buscar_frame(FIL *fichero, uint32_t *posicion, UINT *leidos);
+static void anadir_fichero_explorado(const char *ruta,
+                                     const FILINFO *informacion);
+static FRESULT guardar_indice(void);
+static FRESULT ordenar_vistas(void);
+static int32_t comparar_cadenas(uint32_t a, uint32_t b);
+static uint32_t desplazamiento_nombre(uint32_t ruta);
+static int32_t comparar_nombre(uint16_t a, uint16_t b);
+static int32_t comparar_artista(uint16_t a, uint16_t b);
+static int32_t comparar_album(uint16_t a, uint16_t b);
+static int32_t comparar_numero_pista(uint16_t a, uint16_t b);
+
+static const orden_funcion_comparar_t funciones_comparar[BIBLIO_NUMERO_ORDENES] = {
+    comparar_nombre, comparar_artista, comparar_album, comparar_numero_pista
+};
+
+/***************************************************************************//**
+ * \brief   Reservar en la SDRAM los dos juegos de tabla y arena y la tabla de
+ *          bsqueda, y dejar el ndice vaco. La SDRAM debe estar ya
+ *          inicializada (lo hace glcd_inicializar).
+ *
+ * \return  FALSE si no hay SDRAM suficiente.
+ */
+bool_t biblio_inicializar(void)
+{
+    uint32_t i;
+    uint32_t j;
+
+    if (cubetas == NULL)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            indices[i].pistas = sdram_reservar(BIBLIO_MAXIMO_PISTAS*sizeof(biblio_pista_t));
+            indices[i].arena = sdram_reservar(BIBLIO_TAMANO_ARENA);
+            if (indices[i].pistas == NULL || indices[i].arena == NULL) return FALSE;
+
+            for (j = 0; j < BIBLIO_NUMERO_ORDENES; j++)
+            {
+                indices[i].ordenes[j] = sdram_reservar(BIBLIO_MAXIMO_PISTAS*sizeof(uint16_t));
+                if (indices[i].ordenes[j] == NULL) return FALSE;
+            }
+        }
+
+        siguientes = sdram_reservar(BIBLIO_MAXIMO_PISTAS*sizeof(uint16_t));
+        cubetas = sdram_reservar(BIBLIO_CUBETAS*sizeof(uint16_t));
+        if (siguientes == NULL || cubetas == NULL)
+        {
+            cubetas = NULL;
+            return FALSE;
+        }
+    }
+
+    vaciar_indice(&indices[0]);
+    vaciar_indice(&indices[1]);
+    indice_actual = 0;
+
+    memset(&estadisticas, 0, sizeof(estadisticas));
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Cargar el ndice guardado en la tarjeta. Si el fichero no existe o
+ *          no es vlido el ndice queda vaco y la siguiente actualizacin
+ *          analiza todos los ficheros.
+ *
+ * \return  Resultado de FatFs. FR_INT_ERR si el fichero no es un ndice
+ *          vlido.
+ */
+FRESULT biblio_cargar(void)
+{
+    indice_t *indice = &indices[indice_actual];
+    cabecera_indice_t cabecera;
+    FIL fichero;
+    FRESULT fr;
+    UINT leidos;
+    UINT bytes_pistas;
+    UINT bytes_orden;
+    const biblio_pista_t *pista;
+    uint32_t i;
+    uint32_t j;
+    ciclos_acumulador_t tiempo;
+
+    ASSERT(cubetas != NULL, "Biblioteca no inicializada.");
+
+    ciclos_acumulador_iniciar(&tiempo);
+    vaciar_indice(indice);
+    estadisticas.pistas_cargadas = 0;
+
+    fr = f_open(&fichero, BIBLIO_FICHERO_INDICE, FA_READ);
+    if (fr != FR_OK) return fr;
+
+    fr = f_read(&fichero, &cabecera, sizeof(cabecera), &leidos);
+    if (fr == FR_OK &&
+        (leidos != sizeof(cabecera) ||
+         cabecera.firma != FIRMA_INDICE ||
+         cabecera.version != VERSION_INDICE ||
+         cabecera.numero_pistas > BIBLIO_MAXIMO_PISTAS ||
+         cabecera.tamano_arena == 0 ||
+         cabecera.tamano_arena > BIBLIO_TAMANO_ARENA ||
+         cabecera.numero_ordenes != BIBLIO_NUMERO_ORDENES))
+    {
+        fr = FR_INT_ERR;
+    }
+
+    if (fr == FR_OK)
+    {
+        bytes_pistas = cabecera.numero_pistas*sizeof(biblio_pista_t);
+        fr = f_read(&fichero, indice->pistas, bytes_pistas, &leidos);
+        if (fr == FR_OK && leidos != bytes_pistas) fr = FR_INT_ERR;
+        ciclos_acumulador_sumar(&tiempo);
+    }
+
+    if (fr == FR_OK)
+    {
+        fr = f_read(&fichero, indice->arena, cabecera.tamano_arena, &leidos);
+        if (fr == FR_OK && leidos != cabecera.tamano_arena) fr = FR_INT_ERR;
+        ciclos_acumulador_sumar(&tiempo);
+    }
+
+    bytes_orden = cabecera.numero_pistas*sizeof(uint16_t);
+    for (j = 0; fr == FR_OK && j < BIBLIO_NUMERO_ORDENES; j++)
+    {
+        fr = f_read(&fichero, indice->ordenes[j], bytes_orden, &leidos);
+        if (fr == FR_OK && leidos != bytes_orden) fr = FR_INT_ERR;
+
+        for (i = 0; fr == FR_OK && i < cabecera.numero_pistas; i++)
+        {
+            if (indice->ordenes[j][i] >= cabecera.numero_pistas) fr = FR_INT_ERR;
+        }
+        ciclos_acumulador_sumar(&tiempo);
+    }
+
+    f_close(&fichero);
+
+    /* Comprobar que todas las cadenas estn dentro de la arena.
+     */
+    for (i = 0; fr == FR_OK && i < cabecera.numero_pistas; i++)
+    {
+        pista = &indice->pistas[i];
+        if (pista->ruta == 0 ||
+            pista->ruta >= cabecera.tamano_arena ||
+            pista->titulo >= cabecera.tamano_arena ||
+            pista->artista >= cabecera.tamano_arena ||
+            pista->album >= cabecera.tamano_arena)
+        {
+            fr = FR_INT_ERR;
+        }
+    }
+
+    if (fr != FR_OK)
+    {
+        vaciar_indice(indice);
+        return fr;
+    }
+
+    /* Asegurar que todas las cadenas de la arena estn terminadas.
+     */
+    indice->arena[0] = '\0';
+    indice->arena[cabecera.tamano_arena - 1] = '\0';
+    indice->numero_pistas = cabecera.numero_pistas;
+    indice->tamano_arena = cabecera.tamano_arena;
+
+    estadisticas.pistas_cargadas = indice->numero_pistas;
+    ciclos_acumulador_sumar(&tiempo);
+    estadisticas.microsegundos_carga = ciclos_acumulador_microsegundos(&tiempo);
+
+    return FR_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Recorrer los ficheros MP3 de la tarjeta y sus subdirectorios y
+ *          poner el ndice al da. Slo se abren los ficheros nuevos o cuyo
+ *          tamao o fecha han cambiado. Si el ndice cambia se guarda en la
+ *          tarjeta.
+ *
+ * \return  Resultado de FatFs del recorrido. Con un error de lectura el
+ *          ndice no cambia. Los errores al ordenar o guardar el ndice no
+ *          se devuelven: se indican en las estadsticas.
+ */
+FRESULT biblio_actualizar(void)
+{
+    indice_t *anterior = &indices[indice_actual];
+    indice_t *nuevo = &indices[indice_actual ^ 1u];
+    explo_estadisticas_t exploracion;
+    FRESULT fr;
+
+    ASSERT(cubetas != NULL, "Biblioteca no inicializada.");
+
+    ciclos_acumulador_iniciar(&tiempo_actualizacion);
+    estadisticas.pistas_conservadas = 0;
+    estadisticas.pistas_analizadas = 0;
+    estadisticas.pistas_eliminadas = 0;
+    estadisticas.pistas_descartadas = 0;
+    estadisticas.error_ordenacion = FR_OK;
+    estadisticas.error_guardado = FR_OK;
+
+    construir_tabla_busqueda(anterior);
+    vaciar_indice(nuevo);
+
+    indice_nuevo = nuevo;
+    indice_anterior = anterior;
+
+    fr = explo_recorrer("", BIBLIO_PROFUNDIDAD_MAXIMA, ".mp3",
+                        anadir_fichero_explorado, &exploracion);
+
+    estadisticas.entradas_exploradas = exploracion.entradas;
+    estadisticas.directorios_explorados = exploracion.directorios;
+    estadisticas.entradas_por_segundo = exploracion.entradas_por_segundo;
+    estadisticas.directorios_ilegibles = exploracion.directorios_ilegibles;
+
+    if (fr != FR_OK) return fr;
+
+    estadisticas.pistas_eliminadas = anterior->numero_pistas -
+                                     estadisticas.pistas_conservadas;
+    indice_actual ^= 1u;
+
+    /* El ndice en memoria ya es vlido aunque no se pueda ordenar o
+     * guardar (tarjeta llena o protegida contra escritura): esos fallos slo
+     * se anotan. Sin las vistas ordenadas no se guarda, para que el prximo
+     * arranque las calcule.
+     */
+    if (estadisticas.pistas_analizadas != 0 ||
+        estadisticas.pistas_eliminadas != 0)
+    {
+        estadisticas.error_ordenacion = ordenar_vistas();
+        if (estadisticas.error_ordenacion == FR_OK)
+        {
+            estadisticas.error_guardado = guardar_indice();
+        }
+    }
+
+    ciclos_acumulador_sumar(&tiempo_actualizacion);
+    estadisticas.microsegundos_actualizacion =
+        ciclos_acumulador_microsegundos(&tiempo_actualizacion);
+
+    return FR_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de pistas del ndice.
+ */
+uint32_t biblio_numero_pistas(void)
+{
+    return indices[indice_actual].numero_pistas;
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una entrada del ndice.
+ *
+ * \param[in]   indice  nmero de la pista.
+ *
+ * \return      puntero a la entrada o NULL si el nmero no es vlido. Es
+ *              vlido hasta la siguiente actualizacin.
+ */
+const biblio_pista_t *biblio_leer_pista(uint32_t indice)
+{
+    if (indice >= indices[indice_actual].numero_pistas) return NULL;
+
+    return &indices[indice_actual].pistas[indice];
+}
+
+/***************************************************************************//**
+ * \brief       Obtener la pista que ocupa una posicin en una vista ordenada.
+ *
+ * \param[in]   orden       BIBLIO_ORDEN_NOMBRE, BIBLIO_ORDEN_ARTISTA,
+ *                          BIBLIO_ORDEN_ALBUM o BIBLIO_ORDEN_PISTA.
+ * \param[in]   posicion    posicin en la vista (de 0 a
+ *                          biblio_numero_pistas() - 1).
+ *
+ * \return      nmero de la pista para biblio_leer_pista.
+ */
+uint32_t biblio_pista_ordenada(uint32_t orden, uint32_t posicion)
+{
+    const indice_t *indice = &indices[indice_actual];
+
+    ASSERT(orden < BIBLIO_NUMERO_ORDENES && posicion < indice->numero_pistas,
+           "Posicion de la vista incorrecta.");
+
+    return indice->ordenes[orden][posicion];
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una cadena de la arena a partir del desplazamiento
+ *              guardado en una entrada.
+ *
+ * \param[in]   desplazamiento  desplazamiento de la cadena en la arena.
+ *
+ * \return      puntero a la cadena (vaca si el desplazamiento no es vlido).
+ */
+const char *biblio_cadena(uint32_t desplazamiento)
+{
+    const indice_t *indice = &indices[indice_actual];
+
+    if (desplazamiento >= indice->tamano_arena) desplazamiento = 0;
+
+    return &indice->arena[desplazamiento];
+}
+
+/***************************************************************************//**
+ * \brief       Copiar los resultados de la ltima carga y actualizacin.
+ *
+ * \param[out]  destino     estructura donde se copian.
+ */
+void biblio_leer_estadisticas(biblio_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Dejar un juego sin pistas y con la cadena vaca como nica cadena
+ *          de la arena.
+ */
+static void vaciar_indice(indice_t *indice)
+{
+    indice->numero_pistas = 0;
+    indice->arena[0] = '\0';
+    indice->tamano_arena = 1;
+}
+
+/***************************************************************************//**
+ * \brief   Copiar una cadena al final de la arena.
+ *
+ * \return  Desplazamiento de la cadena, 0 si la cadena es vaca o
+ *          NINGUNA_CADENA si no cabe.
+ */
+static uint32_t anadir_cadena(indice_t *indice, const char *cadena)
+{
+    uint32_t longitud = strlen(cadena) + 1;
+    uint32_t desplazamiento = indice->tamano_arena;
+
+    if (longitud == 1) return 0;
+    if (longitud > BIBLIO_TAMANO_ARENA - desplazamiento) return NINGUNA_CADENA;
+
+    memcpy(&indice->arena[desplazamiento], cadena, longitud);
+    indice->tamano_arena += longitud;
+
+    return desplazamiento;
+}
+
+/***************************************************************************//**
+ * \brief   Hash FNV-1a de una ruta.
+ */
+static uint32_t hash_ruta(const char *ruta)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*ruta != '\0')
+    {
+        hash = (hash ^ (uint8_t)*ruta++)*16777619u;
+    }
+
+    return hash;
+}
+
+/***************************************************************************//**
+ * \brief   Enlazar cada entrada de un juego en la lista de la cubeta de su
+ *          ruta.
+ */
+static void construir_tabla_busqueda(const indice_t *indice)
+{
+    uint32_t i;
+    uint32_t cubeta;
+
+    for (i = 0; i < BIBLIO_CUBETAS; i++)
+    {
+        cubetas[i] = NINGUNA;
+    }
+
+    for (i = 0; i < indice->numero_pistas; i++)
+    {
+        cubeta = hash_ruta(&indice->arena[indice->pistas[i].ruta]) &
+                 (BIBLIO_CUBETAS - 1u);
+        siguientes[i] = cubetas[cubeta];
+        cubetas[cubeta] = (uint16_t)i;
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Buscar una ruta en el juego para el que se construy la tabla de
+ *          bsqueda.
+ *
+ * \return  Nmero de la entrada o NINGUNA si no est.
+ */
+static uint32_t buscar_ruta(const indice_t *indice, const char *ruta)
+{
+    uint32_t i = cubetas[hash_ruta(ruta) & (BIBLIO_CUBETAS - 1u)];
+
+    while (i != NINGUNA)
+    {
+        if (strcmp(&indice->arena[indice->pistas[i].ruta], ruta) == 0) break;
+        i = siguientes[i];
+    }
+
+    return i;
+}
+
+/***************************************************************************//**
+ * \brief       Aadir un fichero al ndice en construccin. Si el fichero
+ *              est en el ndice anterior con el mismo tamao y fecha se
+ *              copia su entrada; si no, se analiza el fichero.
+ *
+ * \param[in]   nuevo       juego en construccin.
+ * \param[in]   anterior    juego actual.
+ * \param[in]   ruta        ruta del fichero desde la raz.
+ * \param[in]   informacion datos del fichero devueltos por FatFs.
+ *
+ * \return      FALSE si no hay sitio en el ndice.
+ */
+static bool_t anadir_fichero(indice_t *nuevo,
+                             const indice_t *anterior,
+                             const char *ruta,
+                             const FILINFO *informacion)
+{
+    biblio_pista_t *pista;
+    const biblio_pista_t *pista_anterior = NULL;
+    uint32_t i;
+    uint32_t tamano_arena = nuevo->tamano_arena;
+
+    if (nuevo->numero_pistas >= BIBLIO_MAXIMO_PISTAS) return FALSE;
+
+    pista = &nuevo->pistas[nuevo->numero_pistas];
+
+    i = buscar_ruta(anterior, ruta);
+    if (i != NINGUNA &&
+        anterior->pistas[i].tamano == (uint32_t)informacion->fsize &&
+        anterior->pistas[i].fecha == informacion->fdate &&
+        anterior->pistas[i].hora == informacion->ftime)
+    {
+        pista_anterior = &anterior->pistas[i];
+        *pista = *pista_anterior;
+        pista->titulo = anadir_cadena(nuevo, &anterior->arena[pista_anterior->titulo]);
+        pista->artista = anadir_cadena(nuevo, &anterior->arena[pista_anterior->artista]);
+        pista->album = anadir_cadena(nuevo, &anterior->arena[pista_anterior->album]);
+    }
+    else
+    {
+        memset(pista, 0, sizeof(*pista));
+        pista->tamano = (uint32_t)informacion->fsize;
+        pista->fecha = informacion->fdate;
+        pista->hora = informacion->ftime;
+        analizar_fichero(nuevo, ruta, pista);
+    }
+
+    pista->ruta = anadir_cadena(nuevo, ruta);
+
+    if (pista->ruta == NINGUNA_CADENA ||
+        pista->titulo == NINGUNA_CADENA ||
+        pista->artista == NINGUNA_CADENA ||
+        pista->album == NINGUNA_CADENA)
+    {
+        /* Deshacer las cadenas que s se copiaron.
+         */
+        nuevo->tamano_arena = tamano_arena;
+        return FALSE;
+    }
+
+    nuevo->numero_pistas++;
+
+    if (pista_anterior != NULL)
+    {
+        estadisticas.pistas_conservadas++;
+    }
+    else
+    {
+        estadisticas.pistas_analizadas++;
+    }
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Funcin a la que llama explo_recorrer con cada fichero MP3
+ *          durante la actualizacin.
+ */
+static void anadir_fichero_explorado(const char *ruta,
+                                     const FILINFO *informacion)
+{
+    if (!anadir_fichero(indice_nuevo, indice_anterior, ruta, informacion))
+    {
+        estadisticas.pistas_descartadas++;
+    }
+
+    ciclos_acumulador_sumar(&tiempo_actualizacion);
+}
+
+/***************************************************************************//**
+ * \brief       Obtener las etiquetas de un fichero MP3 y su duracin y tasa
+ *              de bits a partir de la cabecera del primer frame de audio, que
+ *              se busca a continuacin de la etiqueta ID3v2. En ficheros VBR
+ *              con cabecera Xing o Info se usa el nmero de frames que
+ *              indica; en el resto se supone tasa de bits constante. Si no se
+ *              encuentra un frame Layer III vlido los campos quedan a 0.
+ *
+ * \param[in]   nuevo   juego en construccin, donde se aaden los textos de
+ *                      las etiquetas.
+ * \param[in]   ruta    ruta del fichero.
+ * \param[out]  pista   entrada donde se guardan los datos.
+ */
+static void analizar_fichero(indice_t *nuevo,
+                             const char *ruta,
+                             biblio_pista_t *pista)
+{
+    FIL fichero;
+    UINT leidos;
+    etiq_informacion_t etiquetas;
+    uint32_t inicio_audio;
+    uint32_t bytes_audio;
+    uint8_t *b;
+    uint32_t version;
+    uint32_t tasa_bits;
+    uint32_t tasa_muestreo;
+    uint32_t muestras_por_frame;
+    uint32_t desplazamiento_xing;
+    uint32_t numero_frames = 0;
+    uint32_t duracion;
+
+    if (f_open(&fichero, ruta, FA_READ) != FR_OK) return;
+
+    etiq_leer(&fichero, &etiquetas);
+
+    pista->titulo = anadir_cadena(nuevo, etiquetas.titulo);
+    pista->artista = anadir_cadena(nuevo, etiquetas.artista);
+    pista->album = anadir_cadena(nuevo, etiquetas.album);
+    pista->numero_pista = etiquetas.numero_pista;
+
+    /* Al volver buscar_frame el buffer empieza por la cabecera del frame.
+     */
+    inicio_audio = etiquetas.inicio_audio;
+    if (!buscar_frame(&fichero, &inicio_audio, &leidos) ||
+        etiquetas.fin_audio <= inicio_audio)
+    {
+        f_close(&fichero);
+        return;
+    }
+
+    f_close(&fichero);
+
+    bytes_audio = etiquetas.fin_audio - inicio_audio;
+
+    b = buffer_analisis;
+    version = (b[1] >> 3) & 3u;     /* 3 => MPEG-1, 2 => MPEG-2, 0 => 2.5 */
+
+    if (version == 3u)
+    {
+        tasa_bits = tasas_bits_mpeg1[b[2] >> 4];
+        tasa_muestreo = tasas_muestreo_mpeg1[(b[2] >> 2) & 3u];
+        muestras_por_frame = 1152u;
+        desplazamiento_xing = (b[3] >> 6) == 3u ? 4u + 17u : 4u + 32u;
+    }
+    else
+    {
+        tasa_bits = tasas_bits_mpeg2[b[2] >> 4];
+        tasa_muestreo = tasas_muestreo_mpeg1[(b[2] >> 2) & 3u]/
+                        (version == 2u ? 2u : 4u);
+        muestras_por_frame = 576u;
+        desplazamiento_xing = (b[3] >> 6) == 3u ? 4u + 9u : 4u + 17u;
+    }
+
+    /* Cabecera Xing/Info: etiqueta, 4 bytes de indicadores y, si el bit 0
+     * est activo, el nmero de frames.
+     */
+    b = &buffer_analisis[desplazamiento_xing];
+    if (desplazamiento_xing + 12u <= leidos &&
+        (memcmp(b, "Xing", 4) == 0 || memcmp(b, "Info", 4) == 0) &&
+        (b[7] & 1u))
+    {
+        numero_frames = (uint32_t)b[8] << 24 | (uint32_t)b[9] << 16 |
+                        (uint32_t)b[10] << 8 | (uint32_t)b[11];
+    }
+
+    if (numero_frames != 0)
+    {
+        duracion = (uint32_t)((uint64_t)numero_frames*muestras_por_frame/tasa_muestreo);
+        if (duracion != 0)
+        {
+            tasa_bits = (uint32_t)((uint64_t)bytes_audio*8u/1000u/duracion);
+        }
+    }
+    else
+    {
+        duracion = bytes_audio/(tasa_bits*1000u/8u);
+    }
+
+    pista->duracion = duracion > 0xFFFFu ? 0xFFFFu : (uint16_t)duracion;
+    pista->tasa_bits = (uint16_t)tasa_bits;
+}
+
+/***************************************************************************//**
+ * \brief           Buscar la cabecera del primer frame MPEG-1/2/2.5 Layer III
+ *                  en los BYTES_BUSQUEDA_FRAME bytes siguientes a una
+ *                  posicin. Los bloques ledos se solapan 4 bytes para no
+ *                  perder una cabecera partida entre dos lecturas.
+ *
+ * \param[in]       fichero     fichero abierto.
+ * \param[in,out]   posicion    posicin donde empezar a buscar; al volver,
+ *                              posicin de la cabecera.
+ * \param[out]      leidos      bytes vlidos en buffer_analisis, que al
+ *                              volver empieza por la cabecera.
+ *
+ * \return          TRUE si se ha encontrado.
+ */
+static bool_t buscar_frame(FIL *fichero, uint32_t *posicion, UINT *leidos)
+{
+    uint32_t inicio;
+    uint32_t i;
+    const uint8_t *b;
+
+    for (inicio = *posicion;
+         inicio < *posicion + BYTES_BUSQUEDA_FRAME;
+         inicio += sizeof(buffer_analisis) - 4u)
+    {
+        if (f_lseek(fichero, inicio) != FR_OK ||
+            f_read(fichero, buffer_analisis, sizeof(buffer_analisis), leidos) != FR_OK ||
+            *leidos < 4)
+        {
+            return FALSE;
+        }
+
+        for (i = 0; i + 4 <= *leidos; i++)
+        {
+            b = &buffer_analisis[i];
+            if (b[0] == 0xFF && (b[1] & 0xE0) == 0xE0 &&
+                ((b[1] >> 1) & 3u) == 1u &&         /* Layer III. */
+                ((b[1] >> 3) & 3u) != 1u &&         /* Versin vlida. */
+                (b[2] >> 4) != 0 && (b[2] >> 4) != 15 &&
+                ((b[2] >> 2) & 3u) != 3u)
+            {
+                /* Releer desde la cabecera para tener el frame entero en
+                 * el buffer.
+                 */
+                *posicion = inicio + i;
+                return f_lseek(fichero, *posicion) == FR_OK &&
+                       f_read(fichero, buffer_analisis, sizeof(buffer_analisis),
+                              leidos) == FR_OK &&
+                       *leidos >= 4;
+            }
+        }
+
+        if (*leidos < sizeof(buffer_analisis)) break;
+    }
+
+    return FALSE;
+}
+
+/***************************************************************************//**
+ * \brief   Escribir el ndice actual en la tarjeta.
+ */
+static FRESULT guardar_indice(void)
+{
+    const indice_t *indice = &indices[indice_actual];
+    cabecera_indice_t cabecera;
+    FIL fichero;
+    FRESULT fr;
+    UINT escritos;
+    UINT bytes_pistas = indice->numero_pistas*sizeof(biblio_pista_t);
+    UINT bytes_orden = indice->numero_pistas*sizeof(uint16_t);
+    uint32_t i;
+
+    cabecera.firma = FIRMA_INDICE;
+    cabecera.version = VERSION_INDICE;
+    cabecera.numero_pistas = indice->numero_pistas;
+    cabecera.tamano_arena = indice->tamano_arena;
+    cabecera.numero_ordenes = BIBLIO_NUMERO_ORDENES;
+
+    fr = f_open(&fichero, BIBLIO_FICHERO_INDICE, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK) return fr;
+
+    fr = f_write(&fichero, &cabecera, sizeof(cabecera), &escritos);
+    if (fr == FR_OK && escritos != sizeof(cabecera)) fr = FR_DENIED;
+
+    if (fr == FR_OK)
+    {
+        fr = f_write(&fichero, indice->pistas, bytes_pistas, &escritos);
+        if (fr == FR_OK && escritos != bytes_pistas) fr = FR_DENIED;
+    }
+
+    if (fr == FR_OK)
+    {
+        fr = f_write(&fichero, indice->arena, indice->tamano_arena, &escritos);
+        if (fr == FR_OK && escritos != indice->tamano_arena) fr = FR_DENIED;
+    }
+
+    for (i = 0; fr == FR_OK && i < BIBLIO_NUMERO_ORDENES; i++)
+    {
+        fr = f_write(&fichero, indice->ordenes[i], bytes_orden, &escritos);
+        if (fr == FR_OK && escritos != bytes_orden) fr = FR_DENIED;
+    }
+
+    if (f_close(&fichero) != FR_OK && fr == FR_OK) fr = FR_DISK_ERR;
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Calcular las vistas ordenadas del ndice actual. Se mide el tiempo
+ *          por cada 1000 pistas y el nmero de tramos en que orden_ordenar
+ *          ha tenido que dividir las listas. Si falla la ordenacin las
+ *          vistas quedan en el orden del directorio.
+ */
+static FRESULT ordenar_vistas(void)
+{
+    indice_t *indice = &indices[indice_actual];
+    FRESULT fr = FR_OK;
+    uint32_t orden;
+    uint32_t i;
+    uint32_t numero_tramos = 0;
+    ciclos_acumulador_t tiempo;
+
+    ciclos_acumulador_iniciar(&tiempo);
+    indice_ordenado = indice;
+
+    for (orden = 0; fr == FR_OK && orden < BIBLIO_NUMERO_ORDENES; orden++)
+    {
+        for (i = 0; i < indice->numero_pistas; i++)
+        {
+            indice->ordenes[orden][i] = (uint16_t)i;
+        }
+
+        fr = orden_ordenar(indice->ordenes[orden], indice->numero_pistas,
+                           funciones_comparar[orden], &numero_tramos);
+
+        ciclos_acumulador_sumar(&tiempo);
+        ciclos_acumulador_sumar(&tiempo_actualizacion);
+    }
+
+    if (fr != FR_OK)
+    {
+        for (orden = 0; orden < BIBLIO_NUMERO_ORDENES; orden++)
+        {
+            for (i = 0; i < indice->numero_pistas; i++)
+            {
+                indice->ordenes[orden][i] = (uint16_t)i;
+            }
+        }
+    }
+
+    estadisticas.tramos_ordenacion = numero_tramos;
+    estadisticas.microsegundos_ordenacion_por_mil =
+        indice->numero_pistas == 0 ? 0 :
+        (uint32_t)((uint64_t)ciclos_acumulador_microsegundos(&tiempo)*1000u/
+                   BIBLIO_NUMERO_ORDENES/indice->numero_pistas);
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Comparar dos cadenas de la arena sin distinguir maysculas. Las
+ *          cadenas vacas van detrs de las dems.
+ */
+static int32_t comparar_cadenas(uint32_t a, uint32_t b)
+{
+    const uint8_t *ca = (const uint8_t *)&indice_ordenado->arena[a];
+    const uint8_t *cb = (const uint8_t *)&indice_ordenado->arena[b];
+    if (*ca == '\0' || *cb == '\0')
+    {
+        return (int32_t)(*ca == '\0') - (int32_t)(*cb == '\0');
+    }
+
+    while (*ca != '\0' && tolower(*ca) == tolower(*cb))
+    {
+        ca++;
+        cb++;
+    }
+
+    return tolower(*ca) - tolower(*cb);
+}
+
+/***************************************************************************//**
+ * \brief   Desplazamiento en la arena del nombre de fichero de una ruta (lo
+ *          que sigue a la ltima '/').
+ */
+static uint32_t desplazamiento_nombre(uint32_t ruta)
+{
+    const char *inicio = &indice_ordenado->arena[ruta];
+    const char *barra = strrchr(inicio, '/');
+
+    return barra != NULL ? ruta + (uint32_t)(barra - inicio) + 1u : ruta;
+}
+
+/***************************************************************************//**
+ * \brief   Orden por nombre del fichero (sin los directorios) y, a igualdad,
+ *          por la ruta completa.
+ */
+static int32_t comparar_nombre(uint16_t a, uint16_t b)
+{
+    const biblio_pista_t *pa = &indice_ordenado->pistas[a];
+    const biblio_pista_t *pb = &indice_ordenado->pistas[b];
+    int32_t diferencia;
+
+    diferencia = comparar_cadenas(desplazamiento_nombre(pa->ruta),
+                                  desplazamiento_nombre(pb->ruta));
+    if (diferencia != 0) return diferencia;
+
+    return comparar_cadenas(pa->ruta, pb->ruta);
+}
+
+/***************************************************************************//**
+ * \brief   Orden por artista, lbum, nmero de pista y ttulo.
+ */
+static int32_t comparar_artista(uint16_t a, uint16_t b)
+{
+    const biblio_pista_t *pa = &indice_ordenado->pistas[a];
+    const biblio_pista_t *pb = &indice_ordenado->pistas[b];
+    int32_t diferencia;
+
+    diferencia = comparar_cadenas(pa->artista, pb->artista);
+    if (diferencia != 0) return diferencia;
+
+    return comparar_album(a, b);
+}
+
+/***************************************************************************//**
+ * \brief   Orden por lbum, nmero de pista y ttulo.
+ */
+static int32_t comparar_album(uint16_t a, uint16_t b)
+{
+    const biblio_pista_t *pa = &indice_ordenado->pistas[a];
+    const biblio_pista_t *pb = &indice_ordenado->pistas[b];
+    int32_t diferencia;
+
+    diferencia = comparar_cadenas(pa->album, pb->album);
+    if (diferencia != 0) return diferencia;
+
+    return comparar_numero_pista(a, b);
+}
+
+/***************************************************************************//**
+ * \brief   Orden por nmero de pista (las que no lo tienen al final) y
+ *          ttulo.
+ */
+static int32_t comparar_numero_pista(uint16_t a, uint16_t b)
+{
+    const biblio_pista_t *pa = &indice_ordenado->pistas[a];
+    const biblio_pista_t *pb = &indice_ordenado->pistas[b];
+
+    if (pa->numero_pista != pb->numero_pista)
+    {
+        if (pa->numero_pista == 0) return 1;
+        if (pb->numero_pista == 0) return -1;
+        return (int32_t)pa->numero_pista - (int32_t)pb->numero_pista;
+    }
+
+    return comparar_cadenas(pa->titulo, pb->titulo);
+}
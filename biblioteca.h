@@ -0,0 +1,107 @@
+/***************************************************************************//**
+ * \file    biblioteca.h
+ *
+ * \brief   ndice persistente de la biblioteca de msica de la tarjeta SD.
+ */
+
+#ifndef BIBLIOTECA_H
+#define BIBLIOTECA_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Fichero de la tarjeta donde se guarda el ndice.
+ */
+#define BIBLIO_FICHERO_INDICE       "/BIBLIO.IDX"
+
+/* Nmero mximo de pistas del ndice. Debe ser menor que 65535.
+ */
+#define BIBLIO_MAXIMO_PISTAS        32768u
+
+/* Tamao en bytes de la arena donde se guardan las cadenas (rutas y
+ * etiquetas) de todas las pistas.
+ */
+#define BIBLIO_TAMANO_ARENA         (2048u*1024u)
+
+/* Nmero de listas de la tabla de bsqueda por ruta. Debe ser una potencia
+ * de 2.
+ */
+#define BIBLIO_CUBETAS              8192u
+
+/* Longitud mxima de una ruta, incluido el terminador.
+ */
+#define BIBLIO_MAXIMO_RUTA          256u
+
+/* Niveles de subdirectorios que se recorren por debajo del raz (por
+ * ejemplo Artista/lbum/pista.mp3 necesita 2).
+ */
+#define BIBLIO_PROFUNDIDAD_MAXIMA   4u
+
+/* Vistas ordenadas de la biblioteca.
+ */
+#define BIBLIO_ORDEN_NOMBRE         0u      /* Nombre del fichero. */
+#define BIBLIO_ORDEN_ARTISTA        1u      /* Artista, lbum y pista. */
+#define BIBLIO_ORDEN_ALBUM          2u      /* lbum y pista. */
+#define BIBLIO_ORDEN_PISTA          3u      /* Nmero de pista. */
+#define BIBLIO_NUMERO_ORDENES       4u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Entrada del ndice. Las cadenas se indican con su desplazamiento en la
+ * arena; el desplazamiento 0 corresponde a la cadena vaca. La estructura se
+ * escribe tal cual en el fichero del ndice.
+ */
+typedef struct {
+    uint32_t ruta;
+    uint32_t titulo;
+    uint32_t artista;
+    uint32_t album;
+    uint32_t tamano;            /* Bytes. */
+    uint16_t fecha;             /* Fecha y hora de modificacin en formato */
+    uint16_t hora;              /* FAT. */
+    uint16_t duracion;          /* Segundos. */
+    uint16_t tasa_bits;         /* kbit/s (media en ficheros VBR). */
+    uint16_t numero_pista;      /* 0 => desconocido. */
+    uint16_t reservado;
+} biblio_pista_t;
+
+/* Resultado de la ltima carga y actualizacin del ndice.
+ */
+typedef struct {
+    uint32_t pistas_cargadas;   /* Ledas del fichero del ndice. */
+    uint32_t pistas_conservadas;    /* Sin cambios en la tarjeta. */
+    uint32_t pistas_analizadas;     /* Nuevas o modificadas. */
+    uint32_t pistas_eliminadas;
+    uint32_t pistas_descartadas;    /* Sin sitio en el ndice. */
+    uint32_t microsegundos_carga;
+    uint32_t microsegundos_actualizacion;
+    uint32_t microsegundos_ordenacion_por_mil;  /* Por vista y cada 1000
+                                                 * pistas. */
+    uint32_t tramos_ordenacion;     /* Tramos volcados a la tarjeta (1 => la
+                                     * lista cupo en memoria). */
+    uint32_t entradas_exploradas;   /* Entradas de directorio ledas. */
+    uint32_t directorios_explorados;
+    uint32_t entradas_por_segundo;  /* Sin contar el anlisis de ficheros. */
+    uint32_t directorios_ilegibles; /* Saltados en la exploracin. */
+    FRESULT error_ordenacion;       /* Las vistas se dejan sin ordenar. */
+    FRESULT error_guardado;         /* El ndice sirve, pero se volver a
+                                     * construir en el prximo arranque. */
+} biblio_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+bool_t biblio_inicializar(void);
+FRESULT biblio_cargar(void);
+FRESULT biblio_actualizar(void);
+uint32_t biblio_numero_pistas(void);
+const biblio_pista_t *biblio_leer_pista(uint32_t indice);
+uint32_t biblio_pista_ordenada(uint32_t orden, uint32_t posicion);
+const char *biblio_cadena(uint32_t desplazamiento);
+void biblio_leer_estadisticas(biblio_estadisticas_t *destino);
+
+#endif  /* BIBLIOTECA_H */
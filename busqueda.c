@@ -0,0 +1,406 @@
+/***************************************************************************//**
+ * \file    busqueda.c
+ *
+ * \brief   Bsqueda incremental de pistas con el teclado numrico al estilo
+ *          T9 (cada tecla representa sus letras).
+ *
+ *          Cada texto se convierte en una secuencia de teclas: '2' para
+ *          "abc", ..., '9' para "wxyz", '0' para el espacio, los dgitos
+ *          para s mismos y '1' para el resto de signos. Las vocales
+ *          acentuadas y dems letras de ISO-8859-1 cuentan como su letra
+ *          base.
+ *
+ *          El ndice tiene una clave por ttulo (o nombre de fichero si la
+ *          pista no tiene ttulo) y otra por artista. Cada clave se
+ *          identifica con el nmero de la pista y el campo, y guarda
+ *          precalculadas sus 8 primeras teclas en una palabra de 32 bits
+ *          (4 bits por tecla, 0 si el texto termina antes). La lista de
+ *          claves se ordena por su secuencia de teclas con orden_ordenar, de
+ *          modo que las que empiezan por una secuencia son siempre un tramo
+ *          contiguo de la lista.
+ *
+ *          Al pulsar una tecla el tramo de resultados se reduce con dos
+ *          bsquedas binarias dentro del tramo anterior, comparando slo la
+ *          tecla nueva. Los tramos de cada paso se guardan, as que borrar
+ *          la ltima tecla no cuesta nada. Las 8 primeras teclas se leen de
+ *          la palabra precalculada; a partir de ah se convierte el texto.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include "busqueda.h"
+#include "biblioteca.h"
+#include "ordenacion.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define MAXIMO_CLAVES           (2u*BIBLIO_MAXIMO_PISTAS)
+
+#if MAXIMO_CLAVES > 65536u
+#error "BIBLIO_MAXIMO_PISTAS demasiado grande para la bsqueda."
+#endif
+
+/* Teclas precalculadas en cada palabra de la clave.
+ */
+#define TECLAS_PALABRA          8u
+
+#define CAMPO_TITULO            0u
+#define CAMPO_ARTISTA           1u
+
+/*===== Variables privadas =====================================================
+ */
+
+/* Teclas precalculadas de cada clave, indexadas por nmero de pista*2 +
+ * campo, y lista de claves ordenada por teclas.
+ */
+static uint32_t *palabras = NULL;
+static uint16_t *claves;
+static uint32_t numero_claves = 0;
+
+/* Valor de 1 a 10 (tecla + 1) de cada carcter de ISO-8859-1.
+ */
+static uint8_t valores[256];
+
+/* Letra base de los caracteres de ISO-8859-1 desde 0xC0.
+ */
+static const char letras_base[64 + 1] =
+    "AAAAAAACEEEEIIII" "DNOOOOO/OUUUUYTS" "aaaaaaaceeeeiiii" "dnooooo/ouuuuyty";
+
+/* Teclas pulsadas y tramo de resultados despus de cada una (el 0 es la
+ * lista entera).
+ */
+static char teclas[BUSQ_MAXIMO_DIGITOS + 1];
+static uint32_t numero_teclas = 0;
+static uint32_t inicios[BUSQ_MAXIMO_DIGITOS + 1];
+static uint32_t finales[BUSQ_MAXIMO_DIGITOS + 1];
+
+static busq_estadisticas_t estadisticas;
+
+static uint8_t valor_letra(char letra);
+static const char *texto_clave(uint16_t clave);
+static uint32_t tecla_clave(uint16_t clave, uint32_t posicion);
+static int32_t comparar_claves(uint16_t a, uint16_t b);
+static uint32_t primera_con_tecla(uint32_t inicio,
+                                  uint32_t final,
+                                  uint32_t posicion,
+                                  uint32_t valor);
+
+/***************************************************************************//**
+ * \brief   Reservar la memoria del ndice en la SDRAM y preparar la tabla de
+ *          conversin a teclas.
+ *
+ * \return  FALSE si no hay SDRAM suficiente.
+ */
+bool_t busq_inicializar(void)
+{
+    uint32_t i;
+
+    if (palabras == NULL)
+    {
+        claves = sdram_reservar(MAXIMO_CLAVES*sizeof(uint16_t));
+        palabras = sdram_reservar(MAXIMO_CLAVES*sizeof(uint32_t));
+        if (claves == NULL || palabras == NULL)
+        {
+            palabras = NULL;
+            return FALSE;
+        }
+    }
+
+    for (i = 0; i < 256u; i++)
+    {
+        valores[i] = valor_letra(i >= 0xC0u ? letras_base[i - 0xC0u] : (char)i);
+    }
+
+    numero_claves = 0;
+    memset(&estadisticas, 0, sizeof(estadisticas));
+    busq_reiniciar();
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Construir el ndice de bsqueda a partir de la biblioteca. Debe
+ *          llamarse cada vez que cambia la biblioteca.
+ *
+ * \return  Resultado de FatFs de la ordenacin. Si no es FR_OK el ndice
+ *          queda vaco.
+ */
+FRESULT busq_construir(void)
+{
+    const char *texto;
+    uint32_t numero_pistas = biblio_numero_pistas();
+    uint32_t inicio = ciclos_leer();
+    uint32_t pista_actual;
+    uint32_t clave;
+    uint32_t palabra;
+    uint32_t i;
+    FRESULT fr;
+
+    ASSERT(palabras != NULL, "Bsqueda no inicializada.");
+
+    numero_claves = 0;
+
+    for (pista_actual = 0; pista_actual < numero_pistas; pista_actual++)
+    {
+        for (clave = 2u*pista_actual; clave <= 2u*pista_actual + CAMPO_ARTISTA; clave++)
+        {
+            texto = texto_clave((uint16_t)clave);
+            if (texto[0] == '\0') continue;
+
+            palabra = 0;
+            for (i = 0; i < TECLAS_PALABRA && texto[i] != '\0'; i++)
+            {
+                palabra |= (uint32_t)valores[(uint8_t)texto[i]] << (28u - 4u*i);
+            }
+
+            palabras[clave] = palabra;
+            claves[numero_claves++] = (uint16_t)clave;
+        }
+    }
+
+    fr = orden_ordenar(claves, numero_claves, comparar_claves,
+                       &estadisticas.tramos_ordenacion);
+    if (fr != FR_OK) numero_claves = 0;
+
+    estadisticas.claves = numero_claves;
+    estadisticas.microsegundos_construccion =
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+
+    busq_reiniciar();
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Borrar las teclas pulsadas. Los resultados pasan a ser todas las
+ *          claves.
+ */
+void busq_reiniciar(void)
+{
+    numero_teclas = 0;
+    teclas[0] = '\0';
+    inicios[0] = 0;
+    finales[0] = numero_claves;
+}
+
+/***************************************************************************//**
+ * \brief       Aadir una tecla a la bsqueda y reducir los resultados a las
+ *              claves que empiezan por la nueva secuencia.
+ *
+ * \param[in]   tecla   '0'...'9'.
+ *
+ * \return      FALSE si la tecla no es un dgito o ya se han pulsado
+ *              BUSQ_MAXIMO_DIGITOS.
+ */
+bool_t busq_anadir_tecla(char tecla)
+{
+    uint32_t inicio = ciclos_leer();
+    uint32_t valor;
+    uint32_t primera;
+    uint32_t ultima;
+
+    if (tecla < '0' || tecla > '9' || numero_teclas >= BUSQ_MAXIMO_DIGITOS)
+    {
+        return FALSE;
+    }
+
+    valor = (uint32_t)(tecla - '0') + 1u;
+
+    primera = primera_con_tecla(inicios[numero_teclas], finales[numero_teclas],
+                                numero_teclas, valor);
+    ultima = primera_con_tecla(primera, finales[numero_teclas],
+                               numero_teclas, valor + 1u);
+
+    teclas[numero_teclas++] = tecla;
+    teclas[numero_teclas] = '\0';
+    inicios[numero_teclas] = primera;
+    finales[numero_teclas] = ultima;
+
+    estadisticas.microsegundos_ultima_tecla =
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+    if (estadisticas.microsegundos_ultima_tecla > estadisticas.microsegundos_maximo_tecla)
+    {
+        estadisticas.microsegundos_maximo_tecla = estadisticas.microsegundos_ultima_tecla;
+    }
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Quitar la ltima tecla de la bsqueda.
+ */
+void busq_borrar_tecla(void)
+{
+    if (numero_teclas == 0) return;
+
+    teclas[--numero_teclas] = '\0';
+}
+
+/***************************************************************************//**
+ * \brief   Teclas pulsadas, como cadena.
+ */
+const char *busq_teclas(void)
+{
+    return teclas;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de claves que empiezan por las teclas pulsadas. Una pista
+ *          puede aparecer dos veces si coinciden su ttulo y su artista.
+ */
+uint32_t busq_numero_resultados(void)
+{
+    return finales[numero_teclas] - inicios[numero_teclas];
+}
+
+/***************************************************************************//**
+ * \brief       Obtener un resultado de la bsqueda.
+ *
+ * \param[in]   posicion    posicin en los resultados, ordenados por teclas.
+ *
+ * \return      Nmero de la pista (para biblio_leer_pista).
+ */
+uint32_t busq_resultado(uint32_t posicion)
+{
+    ASSERT(posicion < busq_numero_resultados(), "Resultado fuera de rango.");
+
+    return claves[inicios[numero_teclas] + posicion]/2u;
+}
+
+/***************************************************************************//**
+ * \brief       Leer el resultado de la construccin y de las bsquedas.
+ *
+ * \param[out]  destino     donde se copian las estadsticas.
+ */
+void busq_leer_estadisticas(busq_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Valor (tecla + 1) de una letra sin acentuar, un dgito o un signo.
+ */
+static uint8_t valor_letra(char letra)
+{
+    static const char * const letras_teclas[10] = {
+        " ", "", "abc", "def", "ghi", "jkl", "mno", "pqrs", "tuv", "wxyz"
+    };
+    uint32_t i;
+
+    if (letra >= 'A' && letra <= 'Z') letra = (char)(letra - 'A' + 'a');
+    if (letra >= '0' && letra <= '9') return (uint8_t)(letra - '0' + 1);
+
+    for (i = 0; i < 10u; i++)
+    {
+        if (letra != '\0' && strchr(letras_teclas[i], letra) != NULL)
+        {
+            return (uint8_t)(i + 1u);
+        }
+    }
+
+    return 2u;      /* Tecla '1'. */
+}
+
+/***************************************************************************//**
+ * \brief   Texto de una clave: el ttulo de la pista (o el nombre del
+ *          fichero sin directorio si no tiene) o el artista.
+ */
+static const char *texto_clave(uint16_t clave)
+{
+    const biblio_pista_t *pista = biblio_leer_pista(clave/2u);
+    const char *ruta;
+    const char *barra;
+
+    if (clave % 2u == CAMPO_ARTISTA) return biblio_cadena(pista->artista);
+    if (pista->titulo != 0) return biblio_cadena(pista->titulo);
+
+    ruta = biblio_cadena(pista->ruta);
+    barra = strrchr(ruta, '/');
+
+    return barra != NULL ? barra + 1 : ruta;
+}
+
+/***************************************************************************//**
+ * \brief   Valor (tecla + 1) de una posicin de una clave, o 0 si el texto
+ *          termina antes.
+ */
+static uint32_t tecla_clave(uint16_t clave, uint32_t posicion)
+{
+    const char *texto;
+    uint32_t i;
+
+    if (posicion < TECLAS_PALABRA)
+    {
+        return (palabras[clave] >> (28u - 4u*posicion)) & 0xFu;
+    }
+
+    texto = texto_clave(clave);
+    for (i = 0; i < posicion; i++)
+    {
+        if (texto[i] == '\0') return 0;
+    }
+
+    return texto[i] != '\0' ? valores[(uint8_t)texto[i]] : 0u;
+}
+
+/***************************************************************************//**
+ * \brief   Orden de las claves por su secuencia de teclas. Primero se
+ *          comparan las palabras precalculadas y, slo si coinciden y los
+ *          dos textos son ms largos, el resto del texto.
+ */
+static int32_t comparar_claves(uint16_t a, uint16_t b)
+{
+    const char *texto_a;
+    const char *texto_b;
+    uint32_t valor_a;
+    uint32_t valor_b;
+    uint32_t i;
+
+    if (palabras[a] != palabras[b]) return palabras[a] < palabras[b] ? -1 : 1;
+    if ((palabras[a] & 0xFu) == 0) return 0;
+
+    texto_a = texto_clave(a);
+    texto_b = texto_clave(b);
+
+    for (i = TECLAS_PALABRA; ; i++)
+    {
+        valor_a = texto_a[i] != '\0' ? valores[(uint8_t)texto_a[i]] : 0u;
+        valor_b = texto_b[i] != '\0' ? valores[(uint8_t)texto_b[i]] : 0u;
+
+        if (valor_a != valor_b) return (int32_t)valor_a - (int32_t)valor_b;
+        if (valor_a == 0) return 0;
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Buscar en un tramo de la lista de claves, que comparten las teclas
+ *          anteriores a una posicin, la primera cuya tecla en esa posicin
+ *          es mayor o igual que un valor.
+ */
+static uint32_t primera_con_tecla(uint32_t inicio,
+                                  uint32_t final,
+                                  uint32_t posicion,
+                                  uint32_t valor)
+{
+    uint32_t medio;
+
+    while (inicio < final)
+    {
+        medio = inicio + (final - inicio)/2u;
+
+        if (tecla_clave(claves[medio], posicion) < valor)
+        {
+            inicio = medio + 1u;
+        }
+        else
+        {
+            final = medio;
+        }
+    }
+
+    return inicio;
+}
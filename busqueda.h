@@ -0,0 +1,47 @@
+/***************************************************************************//**
+ * \file    busqueda.h
+ *
+ * \brief   Bsqueda incremental de pistas con el teclado numrico al estilo
+ *          T9 (cada tecla representa sus letras).
+ */
+
+#ifndef BUSQUEDA_H
+#define BUSQUEDA_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero mximo de teclas de una bsqueda.
+ */
+#define BUSQ_MAXIMO_DIGITOS     16u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Resultado de la construccin del ndice y de la ltima bsqueda.
+ */
+typedef struct {
+    uint32_t claves;                /* Ttulos y artistas indexados. */
+    uint32_t microsegundos_construccion;
+    uint32_t tramos_ordenacion;
+    uint32_t microsegundos_ultima_tecla;
+    uint32_t microsegundos_maximo_tecla;
+} busq_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+bool_t busq_inicializar(void);
+FRESULT busq_construir(void);
+void busq_reiniciar(void);
+bool_t busq_anadir_tecla(char tecla);
+void busq_borrar_tecla(void);
+const char *busq_teclas(void);
+uint32_t busq_numero_resultados(void);
+uint32_t busq_resultado(uint32_t posicion);
+void busq_leer_estadisticas(busq_estadisticas_t *destino);
+
+#endif  /* BUSQUEDA_H */
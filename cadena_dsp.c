@@ -0,0 +1,335 @@
+/***************************************************************************//**
+ * \file    cadena_dsp.c
+ *
+ * \brief   Cadena esttica de etapas de procesado de audio por bloques que se
+ *          ejecuta entre el decodificador y la salida de audio.
+ *
+ *          Cada implementacin de la salida de audio configura en
+ *          salaud_inicializar las etapas que necesita (mezcla a mono,
+ *          conversin a 16 bits, ...). En salaud_encolar_bloque_muestras las
+ *          muestras de libmad se copian entrelazadas a un buffer de trabajo y
+ *          se pasan por las etapas activas en el orden en que se aadieron.
+ *          Las etapas desactivadas se saltan sin ningn coste.
+ *
+ *          Para cada etapa se lleva la cuenta de los ciclos de CPU consumidos
+ *          en el ltimo bloque y acumulados desde el ltimo reinicio de los
+ *          contadores.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include "mad.h"
+#include "cadena_dsp.h"
+#include "contador_ciclos.h"
+#include "error.h"
+
+/*===== Variables privadas =====================================================
+ */
+
+static dsp_etapa_t *etapas[DSP_MAXIMO_ETAPAS];
+static uint32_t numero_etapas = 0;
+
+/* Buffer de trabajo donde las etapas procesan los bloques. Tiene capacidad
+ * para un bloque estreo de tamao mximo.
+ */
+static int32_t muestras_trabajo[2*DSP_MAXIMO_MUESTRAS_POR_CANAL];
+static dsp_bloque_t bloque_trabajo;
+
+/*===== Etapas predefinidas ====================================================
+ */
+
+static void procesar_mezcla_mono(dsp_etapa_t *etapa, dsp_bloque_t *bloque);
+static void procesar_mono_a_estereo(dsp_etapa_t *etapa, dsp_bloque_t *bloque);
+static void procesar_conversion_16_bits(dsp_etapa_t *etapa,
+                                        dsp_bloque_t *bloque);
+static void procesar_rampa_subida(dsp_etapa_t *etapa, dsp_bloque_t *bloque);
+
+dsp_etapa_t dsp_etapa_mezcla_mono = {
+    "mezcla mono", procesar_mezcla_mono, NULL, TRUE, 0, 0, 0
+};
+
+dsp_etapa_t dsp_etapa_mono_a_estereo = {
+    "mono a estereo", procesar_mono_a_estereo, NULL, TRUE, 0, 0, 0
+};
+
+dsp_parametros_conversion_t dsp_parametros_conversion_16_bits = {
+    MAD_F_FRACBITS + 1u - 16u
+};
+
+dsp_etapa_t dsp_etapa_conversion_16_bits = {
+    "conversion 16 bits", procesar_conversion_16_bits,
+    &dsp_parametros_conversion_16_bits, TRUE, 0, 0, 0
+};
+
+static dsp_parametros_rampa_t parametros_rampa_subida = { 32768, 0 };
+
+dsp_etapa_t dsp_etapa_rampa_subida = {
+    "rampa subida", procesar_rampa_subida, &parametros_rampa_subida,
+    FALSE, 0, 0, 0
+};
+
+/***************************************************************************//**
+ * \brief   Dejar la cadena sin etapas.
+ */
+void dsp_inicializar(void)
+{
+    numero_etapas = 0;
+}
+
+/***************************************************************************//**
+ * \brief       Aadir una etapa al final de la cadena y poner a 0 sus
+ *              contadores de ciclos.
+ *
+ * \param[in]   etapa   puntero a la etapa a aadir.
+ */
+void dsp_anadir_etapa(dsp_etapa_t *etapa)
+{
+    ASSERT(etapa != NULL && etapa->procesar != NULL, "Etapa DSP incorrecta.");
+    ASSERT(numero_etapas < DSP_MAXIMO_ETAPAS, "Demasiadas etapas DSP.");
+
+    etapa->ciclos_ultimo_bloque = 0;
+    etapa->ciclos_acumulados = 0;
+    etapa->bloques_procesados = 0;
+
+    etapas[numero_etapas++] = etapa;
+}
+
+/***************************************************************************//**
+ * \brief       Activar o desactivar (saltar) una etapa de la cadena. Puede
+ *              llamarse en cualquier momento.
+ *
+ * \param[in]   etapa   puntero a la etapa.
+ * \param[in]   activa  TRUE => la etapa procesa los bloques.
+ *                      FALSE => la etapa se salta.
+ */
+void dsp_activar_etapa(dsp_etapa_t *etapa, bool_t activa)
+{
+    ASSERT(etapa != NULL, "Etapa DSP incorrecta.");
+
+    etapa->activa = activa;
+}
+
+/***************************************************************************//**
+ * \brief   Poner a 0 los contadores de ciclos de todas las etapas.
+ */
+void dsp_reiniciar_contadores(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < numero_etapas; i++)
+    {
+        etapas[i]->ciclos_ultimo_bloque = 0;
+        etapas[i]->ciclos_acumulados = 0;
+        etapas[i]->bloques_procesados = 0;
+    }
+}
+
+/***************************************************************************//**
+ * \brief       Copiar un bloque de muestras de libmad al buffer de trabajo y
+ *              pasarlo por las etapas activas de la cadena.
+ *
+ * \param[in]   ptr_muestras_izquierda  muestras del canal izquierdo.
+ * \param[in]   ptr_muestras_derecha    muestras del canal derecho (no se usa
+ *                                      si numero_canales es 1).
+ * \param[in]   longitud                nmero de muestras por canal.
+ * \param[in]   numero_canales          1 o 2.
+ *
+ * \return      puntero al bloque procesado. Es vlido hasta la siguiente
+ *              llamada a dsp_procesar.
+ */
+dsp_bloque_t *dsp_procesar(int32_t *ptr_muestras_izquierda,
+                           int32_t *ptr_muestras_derecha,
+                           uint16_t longitud,
+                           uint16_t numero_canales)
+{
+    uint32_t i;
+    uint32_t inicio;
+    int32_t *ptr_destino = muestras_trabajo;
+    dsp_etapa_t *etapa;
+
+    ASSERT(longitud <= DSP_MAXIMO_MUESTRAS_POR_CANAL,
+           "Bloque de muestras demasiado largo.");
+
+    if (numero_canales == 1)
+    {
+        for (i = 0; i < longitud; i++)
+        {
+            *ptr_destino++ = *ptr_muestras_izquierda++;
+        }
+    }
+    else if (numero_canales == 2)
+    {
+        for (i = 0; i < longitud; i++)
+        {
+            *ptr_destino++ = *ptr_muestras_izquierda++;
+            *ptr_destino++ = *ptr_muestras_derecha++;
+        }
+    }
+    else
+    {
+        ERROR("Numero de canales incorrecto.");
+    }
+
+    bloque_trabajo.muestras = muestras_trabajo;
+    bloque_trabajo.longitud = longitud;
+    bloque_trabajo.numero_canales = numero_canales;
+
+    for (i = 0; i < numero_etapas; i++)
+    {
+        etapa = etapas[i];
+
+        if (!etapa->activa) continue;
+
+        inicio = ciclos_leer();
+        etapa->procesar(etapa, &bloque_trabajo);
+        etapa->ciclos_ultimo_bloque = ciclos_leer() - inicio;
+        etapa->ciclos_acumulados += etapa->ciclos_ultimo_bloque;
+        etapa->bloques_procesados++;
+    }
+
+    return &bloque_trabajo;
+}
+
+/***************************************************************************//**
+ * \brief       Arrancar la rampa de subida de la ganancia. Los siguientes
+ *              bloques que pasen por la etapa dsp_etapa_rampa_subida empiezan
+ *              en silencio y alcanzan la ganancia unidad en el nmero de
+ *              muestras indicado.
+ *
+ * \param[in]   longitud    duracin de la rampa en muestras por canal.
+ */
+void dsp_iniciar_rampa_subida(uint32_t longitud)
+{
+    ASSERT(longitud > 0 && longitud <= 32768, "Longitud de rampa incorrecta.");
+
+    dsp_etapa_rampa_subida.activa = FALSE;
+    parametros_rampa_subida.ganancia = 0;
+    parametros_rampa_subida.incremento = 32768/(int32_t)longitud;
+    dsp_etapa_rampa_subida.activa = TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de etapas de la cadena.
+ */
+uint32_t dsp_numero_etapas(void)
+{
+    return numero_etapas;
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una etapa de la cadena, por ejemplo para consultar sus
+ *              contadores de ciclos.
+ *
+ * \param[in]   indice  posicin de la etapa en la cadena.
+ *
+ * \return      puntero a la etapa o NULL si el ndice no es vlido.
+ */
+dsp_etapa_t *dsp_leer_etapa(uint32_t indice)
+{
+    if (indice >= numero_etapas) return NULL;
+
+    return etapas[indice];
+}
+
+/***************************************************************************//**
+ * \brief   Etapa de mezcla a mono. Promedia las muestras de ambos canales. Si
+ *          el bloque ya es mono no hace nada.
+ */
+static void procesar_mezcla_mono(dsp_etapa_t *etapa, dsp_bloque_t *bloque)
+{
+    uint32_t i;
+    int32_t *ptr_origen = bloque->muestras;
+    int32_t *ptr_destino = bloque->muestras;
+
+    if (bloque->numero_canales != 2) return;
+
+    for (i = 0; i < bloque->longitud; i++)
+    {
+        *ptr_destino++ = (ptr_origen[0] + ptr_origen[1])/2;
+        ptr_origen += 2;
+    }
+
+    bloque->numero_canales = 1;
+}
+
+/***************************************************************************//**
+ * \brief   Etapa de conversin de mono a estreo. Duplica cada muestra en los
+ *          dos canales. Se recorre el bloque desde el final para poder
+ *          trabajar en el mismo buffer. Si el bloque ya es estreo no hace
+ *          nada.
+ */
+static void procesar_mono_a_estereo(dsp_etapa_t *etapa, dsp_bloque_t *bloque)
+{
+    uint32_t i;
+    int32_t *ptr_origen;
+    int32_t *ptr_destino;
+
+    if (bloque->numero_canales != 1) return;
+
+    ptr_origen = &bloque->muestras[bloque->longitud];
+    ptr_destino = &bloque->muestras[2*bloque->longitud];
+
+    for (i = 0; i < bloque->longitud; i++)
+    {
+        ptr_origen--;
+        *--ptr_destino = *ptr_origen;
+        *--ptr_destino = *ptr_origen;
+    }
+
+    bloque->numero_canales = 2;
+}
+
+/***************************************************************************//**
+ * \brief   Etapa de conversin a 16 bits. libmad genera muestras en coma
+ *          fija con MAD_F_FRACBITS (28) bits fraccionarios, de modo que el
+ *          fondo de escala (+-1.0) es +-2^28, aunque la muestra puede pasarse
+ *          algo de l. Aqu se desplazan a la derecha el nmero de bits
+ *          indicado en los parmetros de la etapa (por defecto
+ *          MAD_F_FRACBITS + 1 - 16, que lleva el fondo de escala a +-32768)
+ *          y se saturan a 16 bits en lugar de dejar que den la vuelta.
+ */
+static void procesar_conversion_16_bits(dsp_etapa_t *etapa,
+                                        dsp_bloque_t *bloque)
+{
+    dsp_parametros_conversion_t *parametros = etapa->parametros;
+    uint32_t desplazamiento = parametros->desplazamiento;
+    uint32_t n = (uint32_t)bloque->longitud*bloque->numero_canales;
+    int32_t *ptr = bloque->muestras;
+    uint32_t i;
+    int32_t muestra;
+
+    for (i = 0; i < n; i++)
+    {
+        muestra = ptr[i] >> desplazamiento;
+        if (muestra > 32767) muestra = 32767;
+        else if (muestra < -32768) muestra = -32768;
+        ptr[i] = muestra;
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Etapa de rampa de subida. Multiplica cada muestra (de todos los
+ *          canales) por una ganancia que crece linealmente y se desactiva
+ *          cuando la ganancia llega a la unidad.
+ */
+static void procesar_rampa_subida(dsp_etapa_t *etapa, dsp_bloque_t *bloque)
+{
+    dsp_parametros_rampa_t *parametros = etapa->parametros;
+    int32_t ganancia = parametros->ganancia;
+    int32_t *ptr = bloque->muestras;
+    uint32_t i;
+    uint32_t c;
+
+    for (i = 0; i < bloque->longitud && ganancia < 32768; i++)
+    {
+        for (c = 0; c < bloque->numero_canales; c++)
+        {
+            *ptr = (int32_t)(((int64_t)*ptr*ganancia) >> 15);
+            ptr++;
+        }
+        ganancia += parametros->incremento;
+    }
+
+    parametros->ganancia = ganancia;
+
+    if (ganancia >= 32768) etapa->activa = FALSE;
+}
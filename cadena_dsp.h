@@ -0,0 +1,109 @@
+/***************************************************************************//**
+ * \file    cadena_dsp.h
+ *
+ * \brief   Cadena esttica de etapas de procesado de audio por bloques que se
+ *          ejecuta entre el decodificador y la salida de audio.
+ */
+
+#ifndef CADENA_DSP_H
+#define CADENA_DSP_H
+
+#include "tipos.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero mximo de etapas que puede tener la cadena.
+ */
+#define DSP_MAXIMO_ETAPAS                   8u
+
+/* Nmero mximo de muestras por canal de un bloque. Coincide con el nmero de
+ * muestras por canal de un frame MPEG-1 Layer III.
+ */
+#define DSP_MAXIMO_MUESTRAS_POR_CANAL       1152u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Bloque de muestras sobre el que trabajan las etapas. Las muestras de los
+ * distintos canales estn entrelazadas (I, D, I, D, ...). Las etapas trabajan
+ * sobre el bloque en el mismo sitio y pueden cambiar el nmero de canales
+ * siempre que no se supere la capacidad del buffer de trabajo.
+ */
+typedef struct {
+    int32_t *muestras;
+    uint16_t longitud;          /* Muestras por canal. */
+    uint16_t numero_canales;
+} dsp_bloque_t;
+
+typedef struct dsp_etapa dsp_etapa_t;
+
+/* Etapa de la cadena. La funcin procesar recibe un puntero a la propia
+ * etapa para poder acceder a sus parmetros. Si activa es FALSE la etapa se
+ * salta sin llamar a su funcin procesar.
+ */
+struct dsp_etapa {
+    const char *nombre;
+    void (*procesar)(dsp_etapa_t *etapa, dsp_bloque_t *bloque);
+    void *parametros;
+    volatile bool_t activa;
+    uint32_t ciclos_ultimo_bloque;
+    uint64_t ciclos_acumulados;
+    uint32_t bloques_procesados;
+};
+
+/* Parmetros de la etapa de conversin a 16 bits.
+ */
+typedef struct {
+    uint32_t desplazamiento;
+} dsp_parametros_conversion_t;
+
+/* Parmetros de la etapa de rampa de subida. La ganancia est en formato Q15
+ * (32768 => ganancia unidad).
+ */
+typedef struct {
+    int32_t ganancia;
+    int32_t incremento;
+} dsp_parametros_rampa_t;
+
+/*===== Etapas predefinidas ====================================================
+ */
+
+/* Mezcla de los dos canales en un nico canal promediando las muestras.
+ */
+extern dsp_etapa_t dsp_etapa_mezcla_mono;
+
+/* Duplicacin de un canal mono en los dos canales de una salida estreo.
+ */
+extern dsp_etapa_t dsp_etapa_mono_a_estereo;
+
+/* Conversin de las muestras de libmad a 16 bits mediante un desplazamiento
+ * aritmtico a la derecha (MAD_F_FRACBITS + 1 - 16 bits por defecto, de modo
+ * que +-1.0 pasa a +-32768) con saturacin.
+ */
+extern dsp_etapa_t dsp_etapa_conversion_16_bits;
+extern dsp_parametros_conversion_t dsp_parametros_conversion_16_bits;
+
+/* Rampa lineal de subida de la ganancia desde 0 hasta la unidad para evitar
+ * chasquidos al empezar a reproducir o al recuperarse de un vaciado del
+ * buffer de salida. Se arranca con dsp_iniciar_rampa_subida y se desactiva
+ * sola al terminar la rampa.
+ */
+extern dsp_etapa_t dsp_etapa_rampa_subida;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void dsp_inicializar(void);
+void dsp_anadir_etapa(dsp_etapa_t *etapa);
+void dsp_activar_etapa(dsp_etapa_t *etapa, bool_t activa);
+void dsp_reiniciar_contadores(void);
+dsp_bloque_t *dsp_procesar(int32_t *ptr_muestras_izquierda,
+                           int32_t *ptr_muestras_derecha,
+                           uint16_t longitud,
+                           uint16_t numero_canales);
+void dsp_iniciar_rampa_subida(uint32_t longitud);
+uint32_t dsp_numero_etapas(void);
+dsp_etapa_t *dsp_leer_etapa(uint32_t indice);
+
+#endif  /* CADENA_DSP_H */
@@ -0,0 +1,101 @@
+/***************************************************************************//**
+ * \file    contador_ciclos.c
+ *
+ * \brief   Medida de tiempos de ejecucin en ciclos de CPU usando el contador
+ *          CYCCNT de la unidad DWT del Cortex-M4.
+ *
+ *          El contador es de 32 bits y a 120 MHz desborda cada 35 segundos
+ *          aproximadamente. Las diferencias entre dos lecturas calculadas con
+ *          aritmtica sin signo de 32 bits son correctas aunque entre ambas
+ *          lecturas se haya producido un desbordamiento. Para operaciones
+ *          ms largas se usa un acumulador, al que se suma cada tramo.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include "contador_ciclos.h"
+
+/***************************************************************************//**
+ * \brief   Habilitar la unidad DWT y poner en marcha el contador de ciclos.
+ *          Puede llamarse varias veces; el contador no se pone a 0.
+ */
+void ciclos_inicializar(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/***************************************************************************//**
+ * \brief   Leer el contador de ciclos.
+ *
+ * \return  Valor actual del registro CYCCNT.
+ */
+uint32_t ciclos_leer(void)
+{
+    return DWT->CYCCNT;
+}
+
+/***************************************************************************//**
+ * \brief       Convertir a microsegundos una diferencia entre dos lecturas del
+ *              contador. Es la base de tiempos comn para medir duraciones
+ *              (sirve para intervalos de hasta unos 35 segundos).
+ *
+ * \param[in]   ciclos  nmero de ciclos de CPU.
+ *
+ * \return      Tiempo equivalente en microsegundos.
+ */
+uint32_t ciclos_a_microsegundos(uint32_t ciclos)
+{
+    return ciclos/(SystemCoreClock/1000000u);
+}
+
+/***************************************************************************//**
+ * \brief       Poner a 0 un acumulador y tomar la lectura actual del contador
+ *              como referencia.
+ *
+ * \param[out]  acumulador  acumulador a iniciar.
+ */
+void ciclos_acumulador_iniciar(ciclos_acumulador_t *acumulador)
+{
+    acumulador->ciclos = 0;
+    acumulador->referencia = ciclos_leer();
+}
+
+/***************************************************************************//**
+ * \brief       Sumar al acumulador los ciclos transcurridos desde la
+ *              referencia y tomar la lectura actual como nueva referencia.
+ *              Debe llamarse al menos una vez cada 35 segundos.
+ *
+ * \param[in,out]   acumulador  acumulador.
+ */
+void ciclos_acumulador_sumar(ciclos_acumulador_t *acumulador)
+{
+    uint32_t ahora = ciclos_leer();
+
+    acumulador->ciclos += ahora - acumulador->referencia;
+    acumulador->referencia = ahora;
+}
+
+/***************************************************************************//**
+ * \brief       Tomar la lectura actual como referencia sin sumar el tiempo
+ *              transcurrido, para excluir de la medida el tramo que termina.
+ *
+ * \param[in,out]   acumulador  acumulador.
+ */
+void ciclos_acumulador_reanudar(ciclos_acumulador_t *acumulador)
+{
+    acumulador->referencia = ciclos_leer();
+}
+
+/***************************************************************************//**
+ * \brief       Tiempo acumulado en microsegundos.
+ *
+ * \param[in]   acumulador  acumulador.
+ *
+ * \return      Tiempo acumulado (satura a 0xFFFFFFFF, unos 71 minutos).
+ */
+uint32_t ciclos_acumulador_microsegundos(const ciclos_acumulador_t *acumulador)
+{
+    uint64_t microsegundos = acumulador->ciclos/(SystemCoreClock/1000000u);
+
+    return microsegundos > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)microsegundos;
+}
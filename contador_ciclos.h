@@ -0,0 +1,36 @@
+/***************************************************************************//**
+ * \file    contador_ciclos.h
+ *
+ * \brief   Medida de tiempos de ejecucin en ciclos de CPU usando el contador
+ *          CYCCNT de la unidad DWT del Cortex-M4.
+ */
+
+#ifndef CONTADOR_CICLOS_H
+#define CONTADOR_CICLOS_H
+
+#include "tipos.h"
+
+/*===== Tipos exportados =======================================================
+ */
+
+/* Acumulador de tiempos para operaciones que pueden durar ms de lo que
+ * tarda en desbordar el contador: se suman en 64 bits los ciclos de tramos
+ * cortos, cada uno medido desde la referencia.
+ */
+typedef struct {
+    uint64_t ciclos;
+    uint32_t referencia;
+} ciclos_acumulador_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void ciclos_inicializar(void);
+uint32_t ciclos_leer(void);
+uint32_t ciclos_a_microsegundos(uint32_t ciclos);
+void ciclos_acumulador_iniciar(ciclos_acumulador_t *acumulador);
+void ciclos_acumulador_sumar(ciclos_acumulador_t *acumulador);
+void ciclos_acumulador_reanudar(ciclos_acumulador_t *acumulador);
+uint32_t ciclos_acumulador_microsegundos(const ciclos_acumulador_t *acumulador);
+
+#endif  /* CONTADOR_CICLOS_H */
@@ -0,0 +1,738 @@
+/***************************************************************************//**
+ * \file    disco.c
+ *
+ * \brief   Capa de acceso a disco entre FatFs y los drivers de tarjeta SD
+ *          (MCI o SPI).
+ *
+ *          Al inicializar se busca la tarjeta primero en la ranura del MCI y,
+ *          si no est, en la conectada al SSP en modo SPI. Los accesos se
+ *          hacen a travs de la tabla de funciones del driver elegido.
+ *
+ *          Los sectores ledos y escritos se guardan en una cach de
+ *          DISCO_CACHE_KB KB en la SDRAM con reemplazo LRU. Los sectores se
+ *          localizan mediante una tabla de listas indexada por los bits bajos
+ *          del nmero de sector. As los recorridos de directorios y las
+ *          consultas repetidas a la FAT no vuelven a leer la tarjeta.
+ *
+ *          Las escrituras de un solo sector, que son las que hace FatFs para
+ *          la FAT, los directorios y el sector de informacin del sistema de
+ *          ficheros, slo se hacen en la cach. Los sectores modificados se
+ *          escriben en la tarjeta al reemplazarlos o con CTRL_SYNC, que FatFs
+ *          enva en f_sync y f_close. Las escrituras de varios sectores, que
+ *          son datos de ficheros, van directamente a la tarjeta.
+ *
+ *          Cuando se detectan DISCO_LECTURAS_SECUENCIALES lecturas seguidas,
+ *          cada una empezando donde termin la anterior, se lanza la lectura
+ *          de los DISCO_SECTORES_ADELANTO sectores siguientes a un buffer
+ *          propio. Esto slo se hace con el driver del MCI, el nico que
+ *          tiene lectura asncrona: el DMA lleva los datos al buffer mientras
+ *          la CPU sigue decodificando. En el siguiente acceso se completa la
+ *          lectura y esos sectores se copian a la cach. Con el driver SPI
+ *          no hay lectura adelantada y todas las lecturas son sncronas.
+ *
+ *          Slo hay una lectura adelantada en curso como mximo. Cualquier
+ *          otro acceso a la tarjeta espera a que termine.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include "disco.h"
+#include "sd_lpc40xx_mci.h"
+#include "sd_spi_lpc40xx.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define NUMERO_ENTRADAS     (DISCO_CACHE_KB*2u)
+#define NINGUNA             0xFFFFu
+
+#if NUMERO_ENTRADAS >= NINGUNA
+#error "DISCO_CACHE_KB demasiado grande."
+#endif
+
+/* Estado de una entrada de la cach.
+ */
+#define ENTRADA_LIBRE       0u
+#define ENTRADA_VALIDA      1u
+#define ENTRADA_MODIFICADA  2u
+
+/*===== Tipos privados =========================================================
+ */
+
+/* Funciones de un driver de tarjeta. leer_asincrono y esperar_lectura son
+ * NULL si el driver no admite lecturas asncronas.
+ */
+typedef struct {
+    uint32_t interfaz;
+    uint32_t (*inicializar)(void);
+    uint32_t (*estado)(void);
+    uint32_t (*leer)(uint8_t *buff, int32_t sector, int32_t count);
+    uint32_t (*escribir)(const uint8_t *buff, int32_t sector, int32_t count);
+    uint32_t (*ioctl)(int32_t ctrl, void *buff);
+    uint32_t (*leer_asincrono)(uint8_t *buff, int32_t sector, int32_t count,
+                               sd_funcion_fin_t funcion_fin);
+    void (*esperar_lectura)(void);
+    uint32_t (*frecuencia_bus)(void);
+} driver_t;
+
+/* Entrada de la cach. Las entradas forman una lista doblemente enlazada en
+ * orden de uso (la cabeza es la usada ms recientemente) y cada entrada
+ * vlida est adems en la lista de su cubeta.
+ */
+typedef struct {
+    DWORD sector;
+    uint16_t anterior;
+    uint16_t siguiente;
+    uint16_t siguiente_cubeta;
+    uint8_t estado;
+    uint8_t adelantada;             /* Trada por la lectura adelantada y
+                                     * todava no pedida. */
+} entrada_t;
+
+/*===== Variables privadas =====================================================
+ */
+
+static const driver_t driver_mci = {
+    DISCO_INTERFAZ_MCI,
+    sd_init, sd_status, sd_read, sd_write, sd_ioctl,
+    sd_read_async, sd_esperar_lectura, sd_frecuencia_bus
+};
+
+static const driver_t driver_spi = {
+    DISCO_INTERFAZ_SPI,
+    sdspi_init, sdspi_status, sdspi_read, sdspi_write, sdspi_ioctl,
+    NULL, NULL, sdspi_frecuencia_bus
+};
+
+static const driver_t *driver = &driver_mci;
+
+/* Cach en la SDRAM. numero_entradas es 0 si no se ha podido reservar.
+ */
+static entrada_t *entradas = NULL;
+static uint16_t *cubetas;
+static uint8_t *datos_cache;
+static uint32_t numero_entradas = 0;
+static uint16_t cabeza_lru = NINGUNA;
+static uint16_t cola_lru = NINGUNA;
+
+/* Buffer de la lectura adelantada. Se declara como uint32_t para que quede
+ * alineado a palabra.
+ */
+static uint32_t buffer_adelanto[DISCO_SECTORES_ADELANTO*512u/4u];
+
+static DWORD sector_adelanto;
+static volatile bool_t adelanto_en_curso = FALSE;
+static volatile bool_t adelanto_valido = FALSE;
+
+/* Deteccin del acceso secuencial.
+ */
+static DWORD fin_ultima_lectura = 0;
+static uint32_t lecturas_seguidas = 0;
+
+static disco_estadisticas_t estadisticas;
+
+/* Velocidad de lectura secuencial medida al inicializar, en KB/s.
+ */
+static uint32_t velocidad_lectura_kb_s = 0;
+
+/***************************************************************************//**
+ * \brief   Direccin de los datos de una entrada de la cach.
+ */
+static uint8_t *datos_entrada(uint32_t e)
+{
+    return datos_cache + 512u*e;
+}
+
+/***************************************************************************//**
+ * \brief   Reservar la cach en la SDRAM. Si no hay sitio se trabaja sin
+ *          cach.
+ */
+static void reservar_cache(void)
+{
+    if (NUMERO_ENTRADAS == 0) return;
+
+    entradas = sdram_reservar(NUMERO_ENTRADAS*sizeof(entrada_t));
+    cubetas = sdram_reservar(DISCO_CACHE_CUBETAS*sizeof(uint16_t));
+    datos_cache = sdram_reservar(NUMERO_ENTRADAS*512u);
+
+    if (entradas == NULL || cubetas == NULL || datos_cache == NULL) return;
+
+    numero_entradas = NUMERO_ENTRADAS;
+}
+
+/***************************************************************************//**
+ * \brief   Dejar todas las entradas libres, encadenadas en la lista LRU.
+ */
+static void vaciar_cache(void)
+{
+    uint32_t e;
+
+    if (numero_entradas == 0) return;
+
+    for (e = 0; e < DISCO_CACHE_CUBETAS; e++)
+    {
+        cubetas[e] = NINGUNA;
+    }
+
+    for (e = 0; e < numero_entradas; e++)
+    {
+        entradas[e].estado = ENTRADA_LIBRE;
+        entradas[e].adelantada = 0;
+        entradas[e].anterior = e == 0 ? NINGUNA : (uint16_t)(e - 1);
+        entradas[e].siguiente = e == numero_entradas - 1 ? NINGUNA : (uint16_t)(e + 1);
+        entradas[e].siguiente_cubeta = NINGUNA;
+    }
+
+    cabeza_lru = 0;
+    cola_lru = (uint16_t)(numero_entradas - 1);
+}
+
+/***************************************************************************//**
+ * \brief       Buscar un sector en la cach.
+ *
+ * \return      ndice de la entrada o NINGUNA si no est.
+ */
+static uint32_t buscar(DWORD sector)
+{
+    uint32_t e;
+
+    if (numero_entradas == 0) return NINGUNA;
+
+    for (e = cubetas[sector & (DISCO_CACHE_CUBETAS - 1)];
+         e != NINGUNA;
+         e = entradas[e].siguiente_cubeta)
+    {
+        if (entradas[e].sector == sector) return e;
+    }
+
+    return NINGUNA;
+}
+
+/***************************************************************************//**
+ * \brief   Mover una entrada a la cabeza de la lista LRU.
+ */
+static void usar(uint32_t e)
+{
+    entrada_t *entrada = &entradas[e];
+
+    if (e == cabeza_lru) return;
+
+    /* Sacarla de su posicin.
+     */
+    entradas[entrada->anterior].siguiente = entrada->siguiente;
+    if (entrada->siguiente != NINGUNA)
+    {
+        entradas[entrada->siguiente].anterior = entrada->anterior;
+    }
+    else
+    {
+        cola_lru = entrada->anterior;
+    }
+
+    /* Ponerla en la cabeza.
+     */
+    entrada->anterior = NINGUNA;
+    entrada->siguiente = cabeza_lru;
+    entradas[cabeza_lru].anterior = (uint16_t)e;
+    cabeza_lru = (uint16_t)e;
+}
+
+/***************************************************************************//**
+ * \brief   Sacar una entrada vlida de la lista de su cubeta.
+ */
+static void quitar_de_cubeta(uint32_t e)
+{
+    uint16_t *ptr = &cubetas[entradas[e].sector & (DISCO_CACHE_CUBETAS - 1)];
+
+    while (*ptr != e)
+    {
+        ptr = &entradas[*ptr].siguiente_cubeta;
+    }
+
+    *ptr = entradas[e].siguiente_cubeta;
+}
+
+/***************************************************************************//**
+ * \brief       Funcin llamada por el driver al completar la lectura
+ *              adelantada.
+ *
+ * \param[in]   resultado   RES_OK o RES_ERROR.
+ */
+static void fin_adelanto(uint32_t resultado)
+{
+    adelanto_valido = (resultado == RES_OK);
+    adelanto_en_curso = FALSE;
+}
+
+/***************************************************************************//**
+ * \brief   Esperar a que termine la lectura adelantada en curso, si la hay,
+ *          contando los ciclos de espera.
+ */
+static void esperar_adelanto(void)
+{
+    uint32_t inicio;
+
+    if (!adelanto_en_curso) return;
+
+    inicio = ciclos_leer();
+    driver->esperar_lectura();
+    estadisticas.ciclos_espera += ciclos_leer() - inicio;
+}
+
+/***************************************************************************//**
+ * \brief       Descartar la lectura adelantada si incluye alguno de los
+ *              sectores indicados, que se van a escribir en la tarjeta: sus
+ *              datos ya no seran los actuales. Si la lectura est en curso
+ *              se espera antes a que termine, para que fin_adelanto no la
+ *              vuelva a dar por vlida.
+ *
+ * \param[in]   sector  primer sector.
+ * \param[in]   count   nmero de sectores.
+ */
+static void descartar_adelanto(DWORD sector, UINT count)
+{
+    esperar_adelanto();
+
+    if (sector < sector_adelanto + DISCO_SECTORES_ADELANTO &&
+        sector + count > sector_adelanto)
+    {
+        adelanto_valido = FALSE;
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Escribir en la tarjeta una entrada modificada.
+ *
+ * \return  RES_OK o RES_ERROR.
+ */
+static DRESULT volcar_entrada(uint32_t e)
+{
+    /* Una entrada modificada puede estar en el rango de la lectura
+     * adelantada, que tiene los datos anteriores de la tarjeta. Si no se
+     * descartara, al reemplazar la entrada (incluso mientras se incorpora
+     * la propia lectura adelantada) sus datos antiguos volveran a la cach.
+     */
+    descartar_adelanto(entradas[e].sector, 1);
+
+    if (driver->escribir(datos_entrada(e), (int32_t)entradas[e].sector, 1) != RES_OK)
+    {
+        return RES_ERROR;
+    }
+
+    entradas[e].estado = ENTRADA_VALIDA;
+    estadisticas.sectores_volcados++;
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief       Asignar a un sector la entrada usada menos recientemente. Si
+ *              estaba modificada se escribe antes en la tarjeta. La entrada
+ *              queda en la cabeza de la lista LRU, vlida y sin datos.
+ *
+ * \return      ndice de la entrada o NINGUNA si no hay cach o no se ha
+ *              podido escribir la entrada reemplazada.
+ */
+static uint32_t asignar_entrada(DWORD sector)
+{
+    uint32_t e = cola_lru;
+    entrada_t *entrada;
+
+    if (numero_entradas == 0) return NINGUNA;
+
+    entrada = &entradas[e];
+
+    if (entrada->estado == ENTRADA_MODIFICADA &&
+        volcar_entrada(e) != RES_OK)
+    {
+        return NINGUNA;
+    }
+
+    if (entrada->estado != ENTRADA_LIBRE) quitar_de_cubeta(e);
+
+    entrada->sector = sector;
+    entrada->estado = ENTRADA_VALIDA;
+    entrada->adelantada = 0;
+    entrada->siguiente_cubeta = cubetas[sector & (DISCO_CACHE_CUBETAS - 1)];
+    cubetas[sector & (DISCO_CACHE_CUBETAS - 1)] = (uint16_t)e;
+
+    usar(e);
+
+    return e;
+}
+
+/***************************************************************************//**
+ * \brief       Copiar a la cach un sector ledo de la tarjeta, si no estaba
+ *              ya.
+ */
+static void guardar_en_cache(DWORD sector, const uint8_t *datos, bool_t adelantado)
+{
+    uint32_t e;
+
+    if (buscar(sector) != NINGUNA) return;
+
+    e = asignar_entrada(sector);
+    if (e == NINGUNA) return;
+
+    memcpy(datos_entrada(e), datos, 512u);
+    entradas[e].adelantada = adelantado ? 1 : 0;
+}
+
+/***************************************************************************//**
+ * \brief   Copiar a la cach los sectores de la ltima lectura adelantada, si
+ *          ha terminado bien y no se han copiado ya.
+ */
+static void incorporar_adelanto(void)
+{
+    uint32_t i;
+
+    /* guardar_en_cache puede volcar una entrada modificada del rango, y
+     * entonces la lectura deja de ser vlida.
+     */
+    for (i = 0; adelanto_valido && i < DISCO_SECTORES_ADELANTO; i++)
+    {
+        if (buscar(sector_adelanto + i) != NINGUNA) continue;
+
+        guardar_en_cache(sector_adelanto + i,
+                         (uint8_t *)buffer_adelanto + 512u*i,
+                         TRUE);
+        estadisticas.sectores_adelantados++;
+    }
+
+    adelanto_valido = FALSE;
+}
+
+/***************************************************************************//**
+ * \brief       Lanzar la lectura adelantada a partir de un sector.
+ */
+static void lanzar_adelanto(DWORD sector)
+{
+    if (driver->leer_asincrono == NULL) return;
+
+    adelanto_valido = FALSE;
+    sector_adelanto = sector;
+    adelanto_en_curso = TRUE;
+
+    if (driver->leer_asincrono((uint8_t *)buffer_adelanto,
+                      (int32_t)sector,
+                      DISCO_SECTORES_ADELANTO,
+                      fin_adelanto) != RES_OK)
+    {
+        adelanto_en_curso = FALSE;
+        return;
+    }
+
+    estadisticas.lecturas_adelantadas++;
+}
+
+/***************************************************************************//**
+ * \brief   Medir la velocidad de lectura secuencial leyendo los primeros
+ *          DISCO_SECTORES_MEDIDA sectores de la tarjeta en grupos del tamao
+ *          de la lectura adelantada. El tiempo se mide con el contador de
+ *          ciclos, que main pone en marcha antes de montar la tarjeta.
+ */
+static void medir_velocidad_lectura(void)
+{
+    uint32_t sector;
+    uint32_t inicio;
+    uint32_t microsegundos;
+
+    inicio = ciclos_leer();
+
+    for (sector = 0; sector < DISCO_SECTORES_MEDIDA; sector += DISCO_SECTORES_ADELANTO)
+    {
+        if (driver->leer((uint8_t *)buffer_adelanto,
+                    (int32_t)sector,
+                    DISCO_SECTORES_ADELANTO) != RES_OK)
+        {
+            velocidad_lectura_kb_s = 0;
+            return;
+        }
+    }
+
+    microsegundos = ciclos_a_microsegundos(ciclos_leer() - inicio);
+    if (microsegundos == 0) microsegundos = 1;
+
+    velocidad_lectura_kb_s = (uint32_t)((uint64_t)DISCO_SECTORES_MEDIDA*512u*
+                                        1000000u/1024u/microsegundos);
+}
+
+/***************************************************************************//**
+ * \brief   Buscar la tarjeta en la ranura del MCI y, si no est, en la SPI,
+ *          vaciar la cach y medir la velocidad de
+ *          lectura secuencial conseguida. La primera vez se reserva la cach
+ *          en la SDRAM, que debe estar ya inicializada. Los sectores
+ *          modificados que hubiera en la cach se pierden: la tarjeta puede
+ *          haber cambiado.
+ */
+DSTATUS disco_inicializar(void)
+{
+    DSTATUS estado;
+
+    esperar_adelanto();
+    adelanto_valido = FALSE;
+
+    if (entradas == NULL) reservar_cache();
+    vaciar_cache();
+    lecturas_seguidas = 0;
+
+    driver = &driver_mci;
+    estado = (DSTATUS)driver->inicializar();
+
+    if (estado & STA_NOINIT)
+    {
+        driver = &driver_spi;
+        estado = (DSTATUS)driver->inicializar();
+    }
+
+    if (!(estado & STA_NOINIT)) medir_velocidad_lectura();
+
+    return estado;
+}
+
+/***************************************************************************//**
+ * \brief   Estado de la tarjeta (STA_NOINIT, ...).
+ */
+DSTATUS disco_estado(void)
+{
+    return (DSTATUS)driver->estado();
+}
+
+/***************************************************************************//**
+ * \brief       Leer sectores. Los que estn en la cach se copian de ella;
+ *              cada tramo de sectores consecutivos que no estn se lee de la
+ *              tarjeta y se guarda en la cach. Si el acceso es secuencial se
+ *              lanza despus la lectura adelantada de los sectores siguientes.
+ *
+ * \param[out]  buff    buffer destino (count*512 bytes).
+ * \param[in]   sector  primer sector a leer.
+ * \param[in]   count   nmero de sectores.
+ *
+ * \return      RES_OK o RES_ERROR.
+ */
+DRESULT disco_leer(BYTE *buff, DWORD sector, UINT count)
+{
+    DWORD siguiente = sector + count;
+    uint32_t i;
+    uint32_t n;
+    uint32_t e;
+
+    esperar_adelanto();
+    incorporar_adelanto();
+
+    i = 0;
+    while (i < count)
+    {
+        e = buscar(sector + i);
+
+        if (e != NINGUNA)
+        {
+            memcpy(buff + 512u*i, datos_entrada(e), 512u);
+            usar(e);
+            if (entradas[e].adelantada)
+            {
+                entradas[e].adelantada = 0;
+                estadisticas.sectores_adelantados_usados++;
+            }
+            estadisticas.sectores_acertados++;
+            i++;
+            continue;
+        }
+
+        n = 1;
+        while (i + n < count && buscar(sector + i + n) == NINGUNA) n++;
+
+        if (driver->leer(buff + 512u*i, (int32_t)(sector + i), (int32_t)n) != RES_OK)
+        {
+            return RES_ERROR;
+        }
+        estadisticas.sectores_fallados += n;
+
+        while (n--)
+        {
+            guardar_en_cache(sector + i, buff + 512u*i, FALSE);
+            i++;
+        }
+    }
+
+    if (sector == fin_ultima_lectura)
+    {
+        lecturas_seguidas++;
+    }
+    else
+    {
+        lecturas_seguidas = 0;
+    }
+    fin_ultima_lectura = siguiente;
+
+    if (lecturas_seguidas >= DISCO_LECTURAS_SECUENCIALES &&
+        numero_entradas != 0 &&
+        buscar(siguiente) == NINGUNA)
+    {
+        lanzar_adelanto(siguiente);
+    }
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief       Escribir sectores. Un sector suelto se escribe slo en la
+ *              cach y queda marcado como modificado. Varios sectores se
+ *              escriben en la tarjeta y se actualizan las copias que hubiera
+ *              en la cach. Si se escribe alguno de los sectores de la lectura
+ *              adelantada, sta se descarta.
+ *
+ * \param[in]   buff    datos a escribir (count*512 bytes).
+ * \param[in]   sector  primer sector a escribir.
+ * \param[in]   count   nmero de sectores.
+ *
+ * \return      RES_OK o RES_ERROR.
+ */
+DRESULT disco_escribir(const BYTE *buff, DWORD sector, UINT count)
+{
+    uint32_t i;
+    uint32_t e;
+
+    descartar_adelanto(sector, count);
+
+    if (count == 1)
+    {
+        e = buscar(sector);
+        if (e == NINGUNA)
+        {
+            e = asignar_entrada(sector);
+        }
+        else
+        {
+            usar(e);
+        }
+
+        if (e != NINGUNA)
+        {
+            memcpy(datos_entrada(e), buff, 512u);
+            entradas[e].estado = ENTRADA_MODIFICADA;
+            entradas[e].adelantada = 0;
+            estadisticas.escrituras_diferidas++;
+            return RES_OK;
+        }
+    }
+
+    if (driver->escribir(buff, (int32_t)sector, (int32_t)count) != RES_OK)
+    {
+        return RES_ERROR;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        e = buscar(sector + i);
+        if (e == NINGUNA) continue;
+
+        memcpy(datos_entrada(e), buff + 512u*i, 512u);
+        entradas[e].estado = ENTRADA_VALIDA;
+    }
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Escribir en la tarjeta todos los sectores modificados de la cach.
+ *
+ * \return  RES_OK o RES_ERROR si alguno no se ha podido escribir (sigue
+ *          marcado como modificado).
+ */
+DRESULT disco_volcar_cache(void)
+{
+    uint32_t e;
+    DRESULT resultado = RES_OK;
+
+    esperar_adelanto();
+
+    for (e = 0; e < numero_entradas; e++)
+    {
+        if (entradas[e].estado == ENTRADA_MODIFICADA &&
+            volcar_entrada(e) != RES_OK)
+        {
+            resultado = RES_ERROR;
+        }
+    }
+
+    return resultado;
+}
+
+/***************************************************************************//**
+ * \brief       Operaciones de control de FatFs (CTRL_SYNC, GET_SECTOR_COUNT,
+ *              ...). CTRL_SYNC escribe antes en la tarjeta los sectores
+ *              modificados de la cach.
+ */
+DRESULT disco_ioctl(BYTE cmd, void *buff)
+{
+    esperar_adelanto();
+
+    if (cmd == CTRL_SYNC && disco_volcar_cache() != RES_OK) return RES_ERROR;
+
+    return (DRESULT)driver->ioctl(cmd, buff);
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una copia de los contadores de la cach.
+ *
+ * \param[out]  destino     estructura donde se copian los contadores.
+ */
+void disco_leer_estadisticas(disco_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Poner a 0 los contadores de la cach.
+ */
+void disco_reiniciar_estadisticas(void)
+{
+    memset(&estadisticas, 0, sizeof(estadisticas));
+}
+
+/***************************************************************************//**
+ * \brief   Velocidad de lectura secuencial medida en disco_inicializar.
+ *
+ * \return  KB/s o 0 si no se ha podido medir.
+ */
+uint32_t disco_velocidad_lectura(void)
+{
+    return velocidad_lectura_kb_s;
+}
+
+/***************************************************************************//**
+ * \brief   Eficiencia de la lectura adelantada: porcentaje de los sectores
+ *          trados por adelantado que se han pedido despus.
+ *
+ * \return  0..100 o 0 si todava no se ha adelantado ningn sector.
+ */
+uint32_t disco_eficiencia_adelanto(void)
+{
+    if (estadisticas.sectores_adelantados == 0) return 0;
+
+    return (uint32_t)((uint64_t)estadisticas.sectores_adelantados_usados*100u/
+                      estadisticas.sectores_adelantados);
+}
+
+/***************************************************************************//**
+ * \brief   Interfaz por el que se accede a la tarjeta.
+ *
+ * \return  DISCO_INTERFAZ_MCI o DISCO_INTERFAZ_SPI.
+ */
+uint32_t disco_interfaz(void)
+{
+    return driver->interfaz;
+}
+
+/***************************************************************************//**
+ * \brief   Frecuencia del reloj del bus de la tarjeta.
+ *
+ * \return  Hz.
+ */
+uint32_t disco_frecuencia_bus(void)
+{
+    return driver->frecuencia_bus();
+}
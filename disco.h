@@ -0,0 +1,86 @@
+/***************************************************************************//**
+ * \file    disco.h
+ *
+ * \brief   Capa de acceso a disco entre FatFs y los drivers de tarjeta SD
+ *          (MCI o SPI).
+ *
+ *          Las funciones tienen la misma forma que las disk_* que FatFs
+ *          espera. diskio.c les reenva las llamadas para la unidad 0.
+ */
+
+#ifndef DISCO_H
+#define DISCO_H
+
+#include "tipos.h"
+#include "diskio.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Interfaz por el que se accede a la tarjeta.
+ */
+#define DISCO_INTERFAZ_MCI          0u
+#define DISCO_INTERFAZ_SPI          1u
+
+/* Tamao de la cach de sectores en la SDRAM, en KB. Cada KB son dos
+ * sectores. Con 0 no se usa cach (ni lectura adelantada).
+ */
+#define DISCO_CACHE_KB              1024u
+
+/* Nmero de listas de la tabla de bsqueda de la cach. Debe ser una
+ * potencia de 2.
+ */
+#define DISCO_CACHE_CUBETAS         1024u
+
+/* Nmero de sectores que se leen por adelantado, mientras el decodificador
+ * trabaja, a continuacin del ltimo sector pedido cuando se detecta un
+ * acceso secuencial.
+ */
+#define DISCO_SECTORES_ADELANTO     8u
+
+/* Nmero de lecturas consecutivas, cada una empezando donde termin la
+ * anterior, a partir del cual se considera que el acceso es secuencial.
+ */
+#define DISCO_LECTURAS_SECUENCIALES 2u
+
+/* Nmero de sectores que se leen al inicializar la tarjeta para medir la
+ * velocidad de lectura secuencial.
+ */
+#define DISCO_SECTORES_MEDIDA       256u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Contadores de la cach y de la lectura adelantada.
+ */
+typedef struct {
+    uint32_t sectores_acertados;    /* Servidos desde la cach. */
+    uint32_t sectores_fallados;     /* Ledos directamente de la tarjeta. */
+    uint32_t lecturas_adelantadas;  /* Lecturas asncronas lanzadas. */
+    uint32_t sectores_adelantados;  /* Sectores llevados a la cach por la
+                                     * lectura adelantada. */
+    uint32_t sectores_adelantados_usados;   /* De ellos, pedidos despus. */
+    uint32_t escrituras_diferidas;  /* Sectores escritos slo en la cach. */
+    uint32_t sectores_volcados;     /* Sectores modificados escritos despus
+                                     * en la tarjeta. */
+    uint32_t ciclos_espera;         /* Ciclos de CPU esperando a que terminara
+                                     * una lectura adelantada. */
+} disco_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+DSTATUS disco_inicializar(void);
+DSTATUS disco_estado(void);
+DRESULT disco_leer(BYTE *buff, DWORD sector, UINT count);
+DRESULT disco_escribir(const BYTE *buff, DWORD sector, UINT count);
+DRESULT disco_ioctl(BYTE cmd, void *buff);
+void disco_leer_estadisticas(disco_estadisticas_t *destino);
+void disco_reiniciar_estadisticas(void);
+uint32_t disco_velocidad_lectura(void);
+uint32_t disco_eficiencia_adelanto(void);
+uint32_t disco_interfaz(void);
+uint32_t disco_frecuencia_bus(void);
+DRESULT disco_volcar_cache(void);
+
+#endif  /* DISCO_H */
@@ -0,0 +1,95 @@
+/***************************************************************************//**
+ * \file    diskio.c
+ *
+ * \brief   Funciones de acceso a disco que necesita FatFs. Slo hay una
+ *          unidad fsica, la 0, y todas sus llamadas se reenvan a la capa
+ *          disco, que elige el driver (MCI o SPI) y mantiene la cach y la
+ *          lectura adelantada.
+ */
+
+#include "diskio.h"
+#include "disco.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define UNIDAD_TARJETA      0u
+
+/***************************************************************************//**
+ * \brief       Estado de una unidad.
+ *
+ * \param[in]   pdrv    nmero de unidad fsica.
+ *
+ * \return      estado de la unidad (STA_NOINIT si no es la 0).
+ */
+DSTATUS disk_status(BYTE pdrv)
+{
+    if (pdrv != UNIDAD_TARJETA) return STA_NOINIT;
+
+    return disco_estado();
+}
+
+/***************************************************************************//**
+ * \brief       Inicializar una unidad.
+ *
+ * \param[in]   pdrv    nmero de unidad fsica.
+ *
+ * \return      estado de la unidad tras inicializarla.
+ */
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    if (pdrv != UNIDAD_TARJETA) return STA_NOINIT;
+
+    return disco_inicializar();
+}
+
+/***************************************************************************//**
+ * \brief       Leer sectores de una unidad.
+ *
+ * \param[in]   pdrv    nmero de unidad fsica.
+ * \param[out]  buff    destino de los datos.
+ * \param[in]   sector  primer sector a leer.
+ * \param[in]   count   nmero de sectores.
+ *
+ * \return      resultado de la lectura.
+ */
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    if (pdrv != UNIDAD_TARJETA || count == 0) return RES_PARERR;
+
+    return disco_leer(buff, sector, count);
+}
+
+/***************************************************************************//**
+ * \brief       Escribir sectores en una unidad.
+ *
+ * \param[in]   pdrv    nmero de unidad fsica.
+ * \param[in]   buff    datos a escribir.
+ * \param[in]   sector  primer sector a escribir.
+ * \param[in]   count   nmero de sectores.
+ *
+ * \return      resultado de la escritura.
+ */
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    if (pdrv != UNIDAD_TARJETA || count == 0) return RES_PARERR;
+
+    return disco_escribir(buff, sector, count);
+}
+
+/***************************************************************************//**
+ * \brief       Operaciones de control de una unidad (CTRL_SYNC,
+ *              GET_SECTOR_COUNT, etc.).
+ *
+ * \param[in]   pdrv    nmero de unidad fsica.
+ * \param[in]   cmd     cdigo de la operacin.
+ * \param[inout] buff   parmetros o resultado de la operacin.
+ *
+ * \return      resultado de la operacin.
+ */
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    if (pdrv != UNIDAD_TARJETA) return RES_PARERR;
+
+    return disco_ioctl(cmd, buff);
+}
@@ -0,0 +1,279 @@
+/***************************************************************************//**
+ * \file    efectos_sonido.c
+ *
+ * \brief   Mezclador de efectos de sonido cortos (clics de teclado, pitidos de
+ *          men) sobre la msica en reproduccin.
+ *
+ *          Los efectos se generan una sola vez en efecto_inicializar como
+ *          muestras mono de 16 bits y se guardan en la SDRAM. La mezcla se
+ *          hace en la etapa efecto_etapa_mezcla de la cadena DSP, es decir,
+ *          en la misma pasada que prepara cada bloque antes de escribirlo en
+ *          el buffer de la salida de audio. La etapa slo est activa mientras
+ *          suena algn efecto, as que la reproduccin de msica sin efectos
+ *          no tiene ningn coste aadido.
+ *
+ *          La latencia desde efecto_disparar hasta que el efecto se oye es el
+ *          tiempo hasta que se procesa el siguiente bloque ms el tiempo que
+ *          tardan en reproducirse las muestras que ya esperan en el buffer de
+ *          salida. Est acotada por la duracin de un frame MP3 ms la
+ *          capacidad de ese buffer (unos 26 ms a 44100 Hz en cada caso). Cada
+ *          vez que un efecto empieza a mezclarse se mide esta latencia.
+ *
+ *          efecto_disparar debe llamarse desde el mismo contexto que el
+ *          decodificador (por ejemplo desde la funcin input del reproductor),
+ *          no desde una interrupcin.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include "efectos_sonido.h"
+#include "salida_audio.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define AMPLITUD                2048
+
+/* Clic: rfaga de 4 ms de una onda cuadrada de unos 5,5 kHz que decae
+ * linealmente.
+ */
+#define LONGITUD_CLIC           176u
+#define SEMIPERIODO_CLIC        4u
+
+/* Pitido: 80 ms de una onda triangular de unos 1000 Hz con rampas de subida y
+ * bajada para que no produzca chasquidos.
+ */
+#define LONGITUD_PITIDO         3528u
+#define PERIODO_PITIDO          44u
+#define SUBIDA_PITIDO           88u
+#define BAJADA_PITIDO           441u
+
+/*===== Tipos privados =========================================================
+ */
+
+typedef struct {
+    const int16_t *muestras;    /* NULL => voz libre. */
+    uint32_t longitud;
+    uint32_t posicion;
+    uint32_t instante_disparo;  /* Ciclos de CPU. */
+    bool_t latencia_pendiente;
+} voz_t;
+
+/*===== Variables privadas =====================================================
+ */
+
+static int16_t *muestras_efectos[EFECTO_NUMERO_EFECTOS];
+static uint32_t longitudes_efectos[EFECTO_NUMERO_EFECTOS];
+
+static voz_t voces[EFECTO_NUMERO_VOCES];
+
+static uint32_t latencia_ultima_us = 0;
+static uint32_t latencia_maxima_us = 0;
+
+static void procesar_mezcla(dsp_etapa_t *etapa, dsp_bloque_t *bloque);
+
+dsp_etapa_t efecto_etapa_mezcla = {
+    "efectos", procesar_mezcla, NULL, FALSE, 0, 0, 0
+};
+
+/***************************************************************************//**
+ * \brief   Reservar espacio para los efectos en la SDRAM y generarlos. La
+ *          SDRAM debe estar ya inicializada (lo hace glcd_inicializar).
+ */
+void efecto_inicializar(void)
+{
+    uint32_t i;
+    uint32_t fase;
+    int32_t valor;
+    int32_t envolvente;
+    int16_t *ptr;
+
+    /* Clic.
+     */
+    ptr = sdram_reservar(LONGITUD_CLIC*sizeof(int16_t));
+    ASSERT(ptr != NULL, "No hay SDRAM para los efectos de sonido.");
+
+    for (i = 0; i < LONGITUD_CLIC; i++)
+    {
+        valor = AMPLITUD*(int32_t)(LONGITUD_CLIC - i)/(int32_t)LONGITUD_CLIC;
+        ptr[i] = (int16_t)((i/SEMIPERIODO_CLIC) & 1 ? -valor : valor);
+    }
+
+    muestras_efectos[EFECTO_CLIC] = ptr;
+    longitudes_efectos[EFECTO_CLIC] = LONGITUD_CLIC;
+
+    /* Pitido.
+     */
+    ptr = sdram_reservar(LONGITUD_PITIDO*sizeof(int16_t));
+    ASSERT(ptr != NULL, "No hay SDRAM para los efectos de sonido.");
+
+    for (i = 0; i < LONGITUD_PITIDO; i++)
+    {
+        fase = i % PERIODO_PITIDO;
+        if (fase < PERIODO_PITIDO/2)
+        {
+            valor = -AMPLITUD + 4*AMPLITUD*(int32_t)fase/(int32_t)PERIODO_PITIDO;
+        }
+        else
+        {
+            valor = 3*AMPLITUD - 4*AMPLITUD*(int32_t)fase/(int32_t)PERIODO_PITIDO;
+        }
+
+        if (i < SUBIDA_PITIDO)
+        {
+            envolvente = 256*(int32_t)i/(int32_t)SUBIDA_PITIDO;
+        }
+        else if (i >= LONGITUD_PITIDO - BAJADA_PITIDO)
+        {
+            envolvente = 256*(int32_t)(LONGITUD_PITIDO - i)/(int32_t)BAJADA_PITIDO;
+        }
+        else
+        {
+            envolvente = 256;
+        }
+
+        ptr[i] = (int16_t)(valor*envolvente/256);
+    }
+
+    muestras_efectos[EFECTO_PITIDO] = ptr;
+    longitudes_efectos[EFECTO_PITIDO] = LONGITUD_PITIDO;
+
+    for (i = 0; i < EFECTO_NUMERO_VOCES; i++)
+    {
+        voces[i].muestras = NULL;
+    }
+
+    efecto_etapa_mezcla.activa = FALSE;
+}
+
+/***************************************************************************//**
+ * \brief       Hacer sonar un efecto sobre la msica. El efecto empieza a
+ *              mezclarse en el siguiente bloque que pase por la cadena DSP.
+ *
+ * \param[in]   efecto  EFECTO_CLIC o EFECTO_PITIDO.
+ */
+void efecto_disparar(uint32_t efecto)
+{
+    uint32_t i;
+    voz_t *voz = &voces[0];
+
+    ASSERT(efecto < EFECTO_NUMERO_EFECTOS, "Efecto de sonido incorrecto.");
+
+    if (muestras_efectos[efecto] == NULL) return;
+
+    /* Buscar una voz libre o, si no la hay, la que ms ha avanzado.
+     */
+    for (i = 0; i < EFECTO_NUMERO_VOCES; i++)
+    {
+        if (voces[i].muestras == NULL)
+        {
+            voz = &voces[i];
+            break;
+        }
+        if (voces[i].posicion > voz->posicion) voz = &voces[i];
+    }
+
+    voz->muestras = muestras_efectos[efecto];
+    voz->longitud = longitudes_efectos[efecto];
+    voz->posicion = 0;
+    voz->instante_disparo = ciclos_leer();
+    voz->latencia_pendiente = TRUE;
+
+    efecto_etapa_mezcla.activa = TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Latencia medida para el ltimo efecto disparado.
+ *
+ * \return  Microsegundos desde el disparo hasta que el efecto se oye.
+ */
+uint32_t efecto_latencia_ultima_us(void)
+{
+    return latencia_ultima_us;
+}
+
+/***************************************************************************//**
+ * \brief   Mayor latencia medida desde el arranque.
+ *
+ * \return  Microsegundos desde el disparo hasta que el efecto se oye.
+ */
+uint32_t efecto_latencia_maxima_us(void)
+{
+    return latencia_maxima_us;
+}
+
+/***************************************************************************//**
+ * \brief   Medir la latencia de una voz que empieza a mezclarse: tiempo
+ *          transcurrido desde el disparo ms el tiempo de reproduccin de las
+ *          muestras que esperan en el buffer de salida por delante de este
+ *          bloque.
+ */
+static void medir_latencia(voz_t *voz)
+{
+    uint32_t ciclos = ciclos_leer() - voz->instante_disparo;
+    uint32_t latencia_us;
+
+    latencia_us = ciclos_a_microsegundos(ciclos) + salaud_latencia_us();
+
+    latencia_ultima_us = latencia_us;
+    if (latencia_us > latencia_maxima_us) latencia_maxima_us = latencia_us;
+
+    voz->latencia_pendiente = FALSE;
+}
+
+/***************************************************************************//**
+ * \brief   Etapa de mezcla. Suma las voces activas a todos los canales del
+ *          bloque con saturacin a 16 bits y se desactiva cuando terminan
+ *          todas.
+ */
+static void procesar_mezcla(dsp_etapa_t *etapa, dsp_bloque_t *bloque)
+{
+    uint32_t v;
+    uint32_t i;
+    uint32_t c;
+    uint32_t n;
+    int32_t muestra;
+    int32_t *ptr;
+    const int16_t *ptr_efecto;
+    bool_t alguna_activa = FALSE;
+
+    for (v = 0; v < EFECTO_NUMERO_VOCES; v++)
+    {
+        voz_t *voz = &voces[v];
+
+        if (voz->muestras == NULL) continue;
+
+        if (voz->latencia_pendiente) medir_latencia(voz);
+
+        n = voz->longitud - voz->posicion;
+        if (n > bloque->longitud) n = bloque->longitud;
+
+        ptr = bloque->muestras;
+        ptr_efecto = &voz->muestras[voz->posicion];
+
+        for (i = 0; i < n; i++)
+        {
+            for (c = 0; c < bloque->numero_canales; c++)
+            {
+                muestra = *ptr + ptr_efecto[i];
+                if (muestra > 32767) muestra = 32767;
+                else if (muestra < -32768) muestra = -32768;
+                *ptr++ = muestra;
+            }
+        }
+
+        voz->posicion += n;
+        if (voz->posicion >= voz->longitud)
+        {
+            voz->muestras = NULL;
+        }
+        else
+        {
+            alguna_activa = TRUE;
+        }
+    }
+
+    if (!alguna_activa) etapa->activa = FALSE;
+}
@@ -0,0 +1,49 @@
+/***************************************************************************//**
+ * \file    efectos_sonido.h
+ *
+ * \brief   Mezclador de efectos de sonido cortos (clics de teclado, pitidos de
+ *          men) sobre la msica en reproduccin.
+ */
+
+#ifndef EFECTOS_SONIDO_H
+#define EFECTOS_SONIDO_H
+
+#include "tipos.h"
+#include "cadena_dsp.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Identificadores de los efectos disponibles.
+ */
+#define EFECTO_CLIC             0u
+#define EFECTO_PITIDO           1u
+#define EFECTO_NUMERO_EFECTOS   2u
+
+/* Nmero mximo de efectos que pueden sonar a la vez. Si se dispara un efecto
+ * con todas las voces ocupadas se sustituye el ms antiguo.
+ */
+#define EFECTO_NUMERO_VOCES     2u
+
+/* Tasa de muestreo con la que se generan los efectos.
+ */
+#define EFECTO_TASA_MUESTREO    44100u
+
+/*===== Etapa de la cadena DSP =================================================
+ */
+
+/* Etapa que suma los efectos activos a las muestras de 16 bits de la msica,
+ * con saturacin. Debe aadirse a la cadena detrs de la conversin a 16 bits.
+ * Permanece desactivada mientras no hay ningn efecto sonando.
+ */
+extern dsp_etapa_t efecto_etapa_mezcla;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void efecto_inicializar(void);
+void efecto_disparar(uint32_t efecto);
+uint32_t efecto_latencia_ultima_us(void);
+uint32_t efecto_latencia_maxima_us(void);
+
+#endif  /* EFECTOS_SONIDO_H */
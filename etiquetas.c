@@ -0,0 +1,521 @@
+/***************************************************************************//**
+ * \file    etiquetas.c
+ *
+ * \brief   Lectura de las etiquetas ID3v2, ID3v1 y APEv2 de un fichero MP3 y
+ *          localizacin de la zona de audio entre ellas.
+ *
+ *          De la etiqueta ID3v2 del principio (versiones 2.2, 2.3 y 2.4) slo
+ *          se lee la cabecera de cada frame; se leen los datos de los frames
+ *          de ttulo, artista, lbum y nmero de pista y el resto (portadas,
+ *          letras, ...) se saltan con f_lseek sin leerlos. Al final del
+ *          fichero se buscan la etiqueta ID3v1 y, delante de ella o en su
+ *          lugar, la APEv2. Los campos que no estn en la ID3v2 se toman de
+ *          los elementos de texto de la APEv2 y, si tampoco estn en ella,
+ *          de la ID3v1.
+ *
+ *          El reproductor empieza a leer en inicio_audio y termina en
+ *          fin_audio, as que libmad no recibe los bytes de las etiquetas ni
+ *          tiene que resincronizarse a travs de ellos.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include <ctype.h>
+#include "etiquetas.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define TAMANO_ID3V1            128u
+#define TAMANO_PIE_APE          32u
+
+/* Indicadores de la cabecera ID3v2.
+ */
+#define ID3V2_CABECERA_EXTENDIDA    0x40u
+#define ID3V2_PIE                   0x10u
+
+/* Indicador de la APEv2 de que hay cabecera adems de pie.
+ */
+#define APE_HAY_CABECERA            0x80000000u
+
+/* Tipo de un elemento APEv2 en sus indicadores. Slo se leen los de texto
+ * (UTF-8).
+ */
+#define APE_TIPO_ELEMENTO           0x06u
+#define APE_TIPO_TEXTO              0x00u
+
+/* Bytes de cada elemento APEv2 antes de la clave: tamao del valor e
+ * indicadores.
+ */
+#define TAMANO_CABECERA_ELEMENTO    8u
+
+/*===== Variables privadas =====================================================
+ */
+
+static uint8_t buffer[TAMANO_ID3V1];
+
+static void leer_id3v2(FIL *fichero, etiq_informacion_t *informacion);
+static void leer_etiquetas_finales(FIL *fichero, etiq_informacion_t *informacion);
+static void leer_ape(FIL *fichero,
+                     etiq_informacion_t *informacion,
+                     uint32_t posicion,
+                     uint32_t fin,
+                     uint32_t numero_elementos);
+static bool_t clave_igual(const uint8_t *clave, const char *nombre);
+static uint16_t leer_numero_pista(const char *texto);
+static void copiar_texto(char *destino, const uint8_t *origen, uint32_t longitud);
+static void copiar_texto_id3v1(char *destino, const uint8_t *origen);
+static uint32_t leer_entero_sincronizado(const uint8_t *b);
+static uint32_t leer_entero_be(const uint8_t *b, uint32_t numero_bytes);
+static uint32_t leer_entero_le(const uint8_t *b);
+
+/***************************************************************************//**
+ * \brief       Leer las etiquetas de un fichero abierto y calcular los
+ *              lmites de la zona de audio. Al volver el fichero queda
+ *              posicionado en inicio_audio.
+ *
+ * \param[in]   fichero         fichero abierto para lectura.
+ * \param[out]  informacion     etiquetas y lmites encontrados.
+ *
+ * \return      Resultado de FatFs del posicionamiento final.
+ */
+FRESULT etiq_leer(FIL *fichero, etiq_informacion_t *informacion)
+{
+    memset(informacion, 0, sizeof(*informacion));
+    informacion->fin_audio = (uint32_t)f_size(fichero);
+
+    leer_id3v2(fichero, informacion);
+    leer_etiquetas_finales(fichero, informacion);
+
+    if (informacion->inicio_audio > informacion->fin_audio)
+    {
+        informacion->inicio_audio = informacion->fin_audio;
+    }
+
+    return f_lseek(fichero, informacion->inicio_audio);
+}
+
+/***************************************************************************//**
+ * \brief   Leer la etiqueta ID3v2 del principio del fichero, si la hay. La
+ *          cabecera ocupa 10 bytes y lleva el tamao del resto en 4 bytes de
+ *          7 bits. Cada frame tiene una cabecera de 10 bytes (6 en la versin
+ *          2.2) con un identificador y el tamao de los datos, que en la 2.4
+ *          tambin va en bytes de 7 bits.
+ */
+static void leer_id3v2(FIL *fichero, etiq_informacion_t *informacion)
+{
+    UINT leidos;
+    uint32_t version;
+    uint32_t fin_etiqueta;
+    uint32_t posicion;
+    uint32_t tamano_cabecera_frame;
+    uint32_t tamano_frame;
+    uint32_t longitud;
+    char *destino;
+    char numero_pista[ETIQ_LONGITUD_CAMPO];
+
+    if (f_lseek(fichero, 0) != FR_OK ||
+        f_read(fichero, buffer, 10, &leidos) != FR_OK ||
+        leidos != 10 || memcmp(buffer, "ID3", 3) != 0)
+    {
+        return;
+    }
+
+    version = buffer[3];
+    fin_etiqueta = 10u + leer_entero_sincronizado(&buffer[6]);
+    informacion->inicio_audio = fin_etiqueta;
+    if (buffer[5] & ID3V2_PIE) informacion->inicio_audio += 10u;
+
+    if (version < 2u || version > 4u) return;
+
+    posicion = 10u;
+    tamano_cabecera_frame = version == 2u ? 6u : 10u;
+
+    /* Saltar la cabecera extendida. En la 2.3 su tamao no incluye los 4
+     * bytes del propio tamao.
+     */
+    if (version > 2u && (buffer[5] & ID3V2_CABECERA_EXTENDIDA))
+    {
+        if (f_read(fichero, buffer, 4, &leidos) != FR_OK || leidos != 4) return;
+        posicion += version == 4u ? leer_entero_sincronizado(buffer) :
+                                    4u + leer_entero_be(buffer, 4);
+    }
+
+    while (posicion + tamano_cabecera_frame <= fin_etiqueta)
+    {
+        if (f_lseek(fichero, posicion) != FR_OK ||
+            f_read(fichero, buffer, tamano_cabecera_frame, &leidos) != FR_OK ||
+            leidos != tamano_cabecera_frame)
+        {
+            return;
+        }
+
+        /* Relleno al final de la etiqueta.
+         */
+        if (buffer[0] == 0) return;
+
+        if (version == 2u)
+        {
+            tamano_frame = leer_entero_be(&buffer[3], 3);
+        }
+        else if (version == 3u)
+        {
+            tamano_frame = leer_entero_be(&buffer[4], 4);
+        }
+        else
+        {
+            tamano_frame = leer_entero_sincronizado(&buffer[4]);
+        }
+
+        posicion += tamano_cabecera_frame;
+        if (tamano_frame > fin_etiqueta - posicion) return;
+
+        destino = NULL;
+        if (version == 2u)
+        {
+            if (memcmp(buffer, "TT2", 3) == 0) destino = informacion->titulo;
+            else if (memcmp(buffer, "TP1", 3) == 0) destino = informacion->artista;
+            else if (memcmp(buffer, "TAL", 3) == 0) destino = informacion->album;
+            else if (memcmp(buffer, "TRK", 3) == 0) destino = numero_pista;
+        }
+        else
+        {
+            if (memcmp(buffer, "TIT2", 4) == 0) destino = informacion->titulo;
+            else if (memcmp(buffer, "TPE1", 4) == 0) destino = informacion->artista;
+            else if (memcmp(buffer, "TALB", 4) == 0) destino = informacion->album;
+            else if (memcmp(buffer, "TRCK", 4) == 0) destino = numero_pista;
+        }
+
+        /* Slo se leen los datos de los frames que interesan, y como mucho
+         * lo que cabe en el buffer. El resto se salta.
+         */
+        if (destino != NULL && tamano_frame > 1u)
+        {
+            longitud = tamano_frame < sizeof(buffer) - 1u ?
+                       tamano_frame : sizeof(buffer) - 1u;
+            if (f_read(fichero, buffer, longitud, &leidos) != FR_OK ||
+                leidos != longitud)
+            {
+                return;
+            }
+
+            copiar_texto(destino, buffer, longitud);
+
+            if (destino == numero_pista)
+            {
+                informacion->numero_pista = leer_numero_pista(numero_pista);
+            }
+        }
+
+        posicion += tamano_frame;
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Buscar las etiquetas del final del fichero: ID3v1 (128 bytes que
+ *          empiezan por "TAG") y APEv2 (pie de 32 bytes que empieza por
+ *          "APETAGEX", delante de la ID3v1 si la hay). fin_audio se deja en
+ *          el primer byte de la primera de ellas.
+ *
+ *          Los campos vacos se rellenan primero con la APEv2, que no recorta
+ *          los textos, y despus con la ID3v1, que se vuelve a leer al final
+ *          porque el buffer se usa tambin para la APEv2.
+ */
+static void leer_etiquetas_finales(FIL *fichero, etiq_informacion_t *informacion)
+{
+    UINT leidos;
+    uint32_t tamano_ape;
+    uint32_t indicadores_ape;
+    uint32_t inicio_elementos;
+    uint32_t posicion_id3v1 = 0;
+    bool_t hay_id3v1 = FALSE;
+
+    if (informacion->fin_audio >= TAMANO_ID3V1 &&
+        f_lseek(fichero, informacion->fin_audio - TAMANO_ID3V1) == FR_OK &&
+        f_read(fichero, buffer, TAMANO_ID3V1, &leidos) == FR_OK &&
+        leidos == TAMANO_ID3V1 && memcmp(buffer, "TAG", 3) == 0)
+    {
+        informacion->fin_audio -= TAMANO_ID3V1;
+        posicion_id3v1 = informacion->fin_audio;
+        hay_id3v1 = TRUE;
+    }
+
+    if (informacion->fin_audio >= TAMANO_PIE_APE &&
+        f_lseek(fichero, informacion->fin_audio - TAMANO_PIE_APE) == FR_OK &&
+        f_read(fichero, buffer, TAMANO_PIE_APE, &leidos) == FR_OK &&
+        leidos == TAMANO_PIE_APE && memcmp(buffer, "APETAGEX", 8) == 0)
+    {
+        /* El tamao incluye los elementos y el pie pero no la cabecera.
+         */
+        tamano_ape = leer_entero_le(&buffer[12]);
+        indicadores_ape = leer_entero_le(&buffer[20]);
+
+        if (tamano_ape >= TAMANO_PIE_APE && tamano_ape <= informacion->fin_audio)
+        {
+            inicio_elementos = informacion->fin_audio - tamano_ape;
+            leer_ape(fichero, informacion,
+                     inicio_elementos,
+                     informacion->fin_audio - TAMANO_PIE_APE,
+                     leer_entero_le(&buffer[16]));
+
+            informacion->fin_audio = inicio_elementos;
+            if ((indicadores_ape & APE_HAY_CABECERA) &&
+                informacion->fin_audio >= TAMANO_PIE_APE)
+            {
+                informacion->fin_audio -= TAMANO_PIE_APE;
+            }
+        }
+    }
+
+    if (hay_id3v1 &&
+        f_lseek(fichero, posicion_id3v1) == FR_OK &&
+        f_read(fichero, buffer, TAMANO_ID3V1, &leidos) == FR_OK &&
+        leidos == TAMANO_ID3V1)
+    {
+        if (informacion->titulo[0] == '\0') copiar_texto_id3v1(informacion->titulo, &buffer[3]);
+        if (informacion->artista[0] == '\0') copiar_texto_id3v1(informacion->artista, &buffer[33]);
+        if (informacion->album[0] == '\0') copiar_texto_id3v1(informacion->album, &buffer[63]);
+
+        /* ID3v1.1: nmero de pista en el ltimo byte del comentario. */
+        if (informacion->numero_pista == 0 && buffer[125] == 0)
+        {
+            informacion->numero_pista = buffer[126];
+        }
+    }
+}
+
+/***************************************************************************//**
+ * \brief       Rellenar los campos vacos con los elementos de texto Title,
+ *              Artist, Album y Track de una etiqueta APEv2. Cada elemento
+ *              lleva el tamao del valor y sus indicadores (4 bytes little
+ *              endian cada uno), la clave terminada en 0 y el valor en UTF-8
+ *              sin terminador. Las claves no distinguen maysculas.
+ *
+ * \param[in]   fichero             fichero abierto para lectura.
+ * \param[out]  informacion         etiquetas a completar.
+ * \param[in]   posicion            primer byte del primer elemento.
+ * \param[in]   fin                 primer byte del pie.
+ * \param[in]   numero_elementos    nmero de elementos segn el pie.
+ */
+static void leer_ape(FIL *fichero,
+                     etiq_informacion_t *informacion,
+                     uint32_t posicion,
+                     uint32_t fin,
+                     uint32_t numero_elementos)
+{
+    UINT leidos;
+    uint32_t longitud;
+    uint32_t longitud_clave;
+    uint32_t tamano_valor;
+    char *destino;
+    char numero_pista[ETIQ_LONGITUD_CAMPO];
+
+    while (numero_elementos-- > 0 && posicion + TAMANO_CABECERA_ELEMENTO < fin)
+    {
+        /* Leer la cabecera del elemento y su clave. Una clave que no cabe en
+         * el buffer no es ninguna de las buscadas, pero sin su final no se
+         * puede seguir.
+         */
+        longitud = fin - posicion < sizeof(buffer) ? fin - posicion : sizeof(buffer);
+        if (f_lseek(fichero, posicion) != FR_OK ||
+            f_read(fichero, buffer, longitud, &leidos) != FR_OK ||
+            leidos != longitud)
+        {
+            return;
+        }
+
+        for (longitud_clave = 0;
+             TAMANO_CABECERA_ELEMENTO + longitud_clave < longitud &&
+             buffer[TAMANO_CABECERA_ELEMENTO + longitud_clave] != 0;
+             longitud_clave++);
+        if (TAMANO_CABECERA_ELEMENTO + longitud_clave >= longitud) return;
+
+        tamano_valor = leer_entero_le(buffer);
+        posicion += TAMANO_CABECERA_ELEMENTO + longitud_clave + 1u;
+        if (tamano_valor > fin - posicion) return;
+
+        destino = NULL;
+        if ((leer_entero_le(&buffer[4]) & APE_TIPO_ELEMENTO) == APE_TIPO_TEXTO)
+        {
+            const uint8_t *clave = &buffer[TAMANO_CABECERA_ELEMENTO];
+
+            if (clave_igual(clave, "title")) destino = informacion->titulo;
+            else if (clave_igual(clave, "artist")) destino = informacion->artista;
+            else if (clave_igual(clave, "album")) destino = informacion->album;
+            else if (clave_igual(clave, "track") &&
+                     informacion->numero_pista == 0)
+            {
+                numero_pista[0] = '\0';
+                destino = numero_pista;
+            }
+        }
+
+        /* El valor se lee detrs de un primer byte que indica a copiar_texto
+         * que el texto est en UTF-8, como en un frame ID3v2.
+         */
+        if (destino != NULL && destino[0] == '\0' && tamano_valor > 0)
+        {
+            longitud = tamano_valor < sizeof(buffer) - 1u ?
+                       tamano_valor : sizeof(buffer) - 1u;
+            if (f_lseek(fichero, posicion) != FR_OK ||
+                f_read(fichero, &buffer[1], longitud, &leidos) != FR_OK ||
+                leidos != longitud)
+            {
+                return;
+            }
+
+            buffer[0] = 3u;
+            copiar_texto(destino, buffer, longitud + 1u);
+
+            if (destino == numero_pista)
+            {
+                informacion->numero_pista = leer_numero_pista(numero_pista);
+            }
+        }
+
+        posicion += tamano_valor;
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Comparar una clave APEv2 terminada en 0 con un nombre en
+ *          minsculas sin distinguir maysculas.
+ */
+static bool_t clave_igual(const uint8_t *clave, const char *nombre)
+{
+    while (*nombre != '\0')
+    {
+        if (tolower(*clave++) != *nombre++) return FALSE;
+    }
+
+    return *clave == 0;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de pista de un texto "n" o "n/total".
+ */
+static uint16_t leer_numero_pista(const char *texto)
+{
+    uint16_t numero = 0;
+
+    for (; *texto >= '0' && *texto <= '9'; texto++)
+    {
+        numero = numero*10u + (uint16_t)(*texto - '0');
+    }
+
+    return numero;
+}
+
+/***************************************************************************//**
+ * \brief       Copiar el texto de un frame ID3v2 convirtindolo a ISO-8859-1.
+ *              El primer byte indica la codificacin: 0 => ISO-8859-1,
+ *              1 => UTF-16 con BOM, 2 => UTF-16BE, 3 => UTF-8.
+ *
+ * \param[out]  destino     campo de ETIQ_LONGITUD_CAMPO bytes.
+ * \param[in]   origen      datos del frame.
+ * \param[in]   longitud    bytes de datos del frame.
+ */
+static void copiar_texto(char *destino, const uint8_t *origen, uint32_t longitud)
+{
+    uint32_t codificacion = origen[0];
+    bool_t big_endian = TRUE;
+    uint32_t i = 1;
+    uint32_t n = 0;
+    uint32_t c;
+
+    if (codificacion == 1u && longitud >= 3u)
+    {
+        big_endian = origen[1] == 0xFE;
+        i = 3;
+    }
+
+    while (i < longitud && n < ETIQ_LONGITUD_CAMPO - 1u)
+    {
+        if (codificacion == 1u || codificacion == 2u)
+        {
+            if (i + 1u >= longitud) break;
+            c = big_endian ? (uint32_t)origen[i] << 8 | origen[i + 1] :
+                             (uint32_t)origen[i + 1] << 8 | origen[i];
+            i += 2;
+        }
+        else if (codificacion == 3u && origen[i] >= 0x80u)
+        {
+            /* Secuencias de 2 bytes (hasta U+07FF); las ms largas se
+             * sustituyen por '?'.
+             */
+            if ((origen[i] & 0xE0u) == 0xC0u && i + 1u < longitud)
+            {
+                c = (uint32_t)(origen[i] & 0x1Fu) << 6 | (origen[i + 1] & 0x3Fu);
+                i += 2;
+            }
+            else
+            {
+                c = '?';
+                for (i++; i < longitud && (origen[i] & 0xC0u) == 0x80u; i++);
+            }
+        }
+        else
+        {
+            c = origen[i++];
+        }
+
+        if (c == 0) break;
+        destino[n++] = c < 0x100u ? (char)c : '?';
+    }
+
+    /* Quitar los espacios del final.
+     */
+    while (n > 0 && destino[n - 1] == ' ') n--;
+    destino[n] = '\0';
+}
+
+/***************************************************************************//**
+ * \brief   Copiar un campo de 30 caracteres de la ID3v1, que va relleno con
+ *          ceros o espacios.
+ */
+static void copiar_texto_id3v1(char *destino, const uint8_t *origen)
+{
+    uint32_t n = 0;
+
+    while (n < 30u && origen[n] != 0)
+    {
+        destino[n] = (char)origen[n];
+        n++;
+    }
+
+    while (n > 0 && destino[n - 1] == ' ') n--;
+    destino[n] = '\0';
+}
+
+/***************************************************************************//**
+ * \brief   Entero de 28 bits guardado en 4 bytes de 7 bits.
+ */
+static uint32_t leer_entero_sincronizado(const uint8_t *b)
+{
+    return (uint32_t)(b[0] & 0x7Fu) << 21 | (uint32_t)(b[1] & 0x7Fu) << 14 |
+           (uint32_t)(b[2] & 0x7Fu) << 7 | (uint32_t)(b[3] & 0x7Fu);
+}
+
+/***************************************************************************//**
+ * \brief   Entero big endian de 1 a 4 bytes.
+ */
+static uint32_t leer_entero_be(const uint8_t *b, uint32_t numero_bytes)
+{
+    uint32_t valor = 0;
+
+    while (numero_bytes-- > 0)
+    {
+        valor = valor << 8 | *b++;
+    }
+
+    return valor;
+}
+
+/***************************************************************************//**
+ * \brief   Entero little endian de 4 bytes.
+ */
+static uint32_t leer_entero_le(const uint8_t *b)
+{
+    return (uint32_t)b[3] << 24 | (uint32_t)b[2] << 16 |
+           (uint32_t)b[1] << 8 | (uint32_t)b[0];
+}
@@ -0,0 +1,44 @@
+/***************************************************************************//**
+ * \file    etiquetas.h
+ *
+ * \brief   Lectura de las etiquetas ID3v2, ID3v1 y APEv2 de un fichero MP3 y
+ *          localizacin de la zona de audio entre ellas.
+ */
+
+#ifndef ETIQUETAS_H
+#define ETIQUETAS_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Longitud mxima de cada campo de texto, incluido el terminador. Los textos
+ * ms largos se recortan.
+ */
+#define ETIQ_LONGITUD_CAMPO     64u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Etiquetas de un fichero y lmites de la zona de audio. Los textos se
+ * guardan en ISO-8859-1; los caracteres que no existen en l se sustituyen
+ * por '?'. Los campos que no aparecen en ninguna etiqueta quedan vacos.
+ */
+typedef struct {
+    char titulo[ETIQ_LONGITUD_CAMPO];
+    char artista[ETIQ_LONGITUD_CAMPO];
+    char album[ETIQ_LONGITUD_CAMPO];
+    uint16_t numero_pista;          /* 0 => desconocido. */
+    uint32_t inicio_audio;          /* Primer byte tras la etiqueta ID3v2. */
+    uint32_t fin_audio;             /* Primer byte de las etiquetas finales
+                                     * (o tamao del fichero). */
+} etiq_informacion_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+FRESULT etiq_leer(FIL *fichero, etiq_informacion_t *informacion);
+
+#endif  /* ETIQUETAS_H */
@@ -0,0 +1,220 @@
+/***************************************************************************//**
+ * \file    explorador.c
+ *
+ * \brief   Recorrido iterativo de un rbol de directorios de FatFs.
+ *
+ *          El recorrido es en profundidad y sin recursin: se mantiene una
+ *          pila explcita con un objeto DIR abierto por cada nivel y una nica
+ *          ruta a la que cada nivel aade su nombre. Al terminar de leer un
+ *          directorio se cierra, se desapila y se recorta la ruta a la
+ *          longitud que tena en el nivel anterior. As la memoria usada est
+ *          acotada por EXPLO_MAXIMA_PROFUNDIDAD y no depende del nmero de
+ *          entradas.
+ *
+ *          Se saltan las entradas ocultas, de sistema y las que empiezan por
+ *          '.'. Los ficheros cuya extensin coincide (sin distinguir
+ *          maysculas) se pasan a la funcin indicada. Los subdirectorios que
+ *          no se pueden abrir se cuentan y se saltan; slo un error de la
+ *          tarjeta termina el recorrido.
+ *
+ *          El tiempo del recorrido no incluye el que pasa dentro de la
+ *          funcin, de modo que las entradas por segundo miden slo la
+ *          lectura de los directorios.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include <ctype.h>
+#include "explorador.h"
+#include "contador_ciclos.h"
+#include "error.h"
+
+/*===== Tipos privados =========================================================
+ */
+
+typedef struct {
+    DIR directorio;
+    uint32_t longitud_ruta;         /* Longitud de la ruta del directorio. */
+} nivel_t;
+
+/*===== Variables privadas =====================================================
+ */
+
+static nivel_t pila[EXPLO_MAXIMA_PROFUNDIDAD + 1u];
+static char ruta[EXPLO_MAXIMO_RUTA];
+static FILINFO informacion;
+
+static bool_t extension_coincide(const char *nombre, const char *extension);
+
+/***************************************************************************//**
+ * \brief       Recorrer un directorio y sus subdirectorios hasta una
+ *              profundidad dada llamando a una funcin con cada fichero de
+ *              una extensin.
+ *
+ * \param[in]   directorio          directorio de partida ("" => directorio
+ *                                  actual).
+ * \param[in]   profundidad_maxima  niveles de subdirectorios que se recorren
+ *                                  (0 => slo el de partida). Como mucho
+ *                                  EXPLO_MAXIMA_PROFUNDIDAD.
+ * \param[in]   extension           extensin de los ficheros buscados, con
+ *                                  el punto (por ejemplo ".mp3").
+ * \param[in]   funcion             funcin a la que se llama con cada
+ *                                  fichero.
+ * \param[out]  estadisticas        resultado del recorrido. Puede ser NULL.
+ *
+ * \return      Resultado de FatFs. Si falla la lectura de un directorio o
+ *              la tarjeta da un error al abrir un subdirectorio, el recorrido
+ *              termina con ese error. Los subdirectorios que no se pueden
+ *              abrir por otros motivos se saltan.
+ */
+FRESULT explo_recorrer(const char *directorio,
+                       uint32_t profundidad_maxima,
+                       const char *extension,
+                       explo_funcion_fichero_t funcion,
+                       explo_estadisticas_t *estadisticas)
+{
+    explo_estadisticas_t resultado;
+    FRESULT fr;
+    int32_t nivel = 0;
+    uint32_t longitud;
+    uint32_t longitud_nombre;
+    ciclos_acumulador_t tiempo;
+
+    ASSERT(profundidad_maxima <= EXPLO_MAXIMA_PROFUNDIDAD,
+           "Profundidad de recorrido excesiva.");
+
+    memset(&resultado, 0, sizeof(resultado));
+    ciclos_acumulador_iniciar(&tiempo);
+
+    longitud = strlen(directorio);
+    if (longitud >= EXPLO_MAXIMO_RUTA) return FR_INVALID_NAME;
+    memcpy(ruta, directorio, longitud + 1u);
+
+    fr = f_opendir(&pila[0].directorio, ruta);
+    if (fr != FR_OK) return fr;
+    pila[0].longitud_ruta = longitud;
+    resultado.directorios = 1;
+
+    while (nivel >= 0)
+    {
+        /* El tiempo se suma entrada a entrada para que el contador de ciclos
+         * no desborde en recorridos largos.
+         */
+        ciclos_acumulador_sumar(&tiempo);
+
+        fr = f_readdir(&pila[nivel].directorio, &informacion);
+
+        if (fr != FR_OK || informacion.fname[0] == '\0')
+        {
+            /* Fin del directorio: volver al nivel anterior. Con un error
+             * el directorio se cierra al salir, con los dems.
+             */
+            if (fr != FR_OK) break;
+            f_closedir(&pila[nivel].directorio);
+
+            nivel--;
+            if (nivel >= 0) ruta[pila[nivel].longitud_ruta] = '\0';
+            continue;
+        }
+
+        resultado.entradas++;
+
+        if (informacion.fname[0] == '.' ||
+            (informacion.fattrib & (AM_HID | AM_SYS)))
+        {
+            continue;
+        }
+
+        /* Aadir el nombre a la ruta del directorio del nivel actual.
+         */
+        longitud = pila[nivel].longitud_ruta;
+        longitud_nombre = strlen(informacion.fname);
+        if (longitud + 1u + longitud_nombre >= EXPLO_MAXIMO_RUTA)
+        {
+            resultado.rutas_largas++;
+            continue;
+        }
+
+        if (longitud > 0) ruta[longitud++] = '/';
+        memcpy(&ruta[longitud], informacion.fname, longitud_nombre + 1u);
+        longitud += longitud_nombre;
+
+        if (informacion.fattrib & AM_DIR)
+        {
+            if ((uint32_t)nivel < profundidad_maxima)
+            {
+                fr = f_opendir(&pila[nivel + 1].directorio, ruta);
+                if (fr == FR_OK)
+                {
+                    nivel++;
+                    pila[nivel].longitud_ruta = longitud;
+                    resultado.directorios++;
+                    continue;
+                }
+
+                if (fr == FR_DISK_ERR || fr == FR_INT_ERR || fr == FR_NOT_READY)
+                {
+                    break;
+                }
+
+                /* Un subdirectorio daado o con un nombre que FatFs no
+                 * acepta no impide recorrer el resto.
+                 */
+                resultado.directorios_ilegibles++;
+                fr = FR_OK;
+            }
+            else
+            {
+                resultado.directorios_omitidos++;
+            }
+        }
+        else if (extension_coincide(informacion.fname, extension))
+        {
+            resultado.ficheros++;
+            ciclos_acumulador_sumar(&tiempo);
+            funcion(ruta, &informacion);
+            ciclos_acumulador_reanudar(&tiempo);
+        }
+
+        ruta[pila[nivel].longitud_ruta] = '\0';
+    }
+
+    /* Si se ha salido por un error, cerrar el directorio que se estaba
+     * leyendo y los que quedan abiertos por debajo.
+     */
+    for (; nivel >= 0; nivel--)
+    {
+        f_closedir(&pila[nivel].directorio);
+    }
+
+    ciclos_acumulador_sumar(&tiempo);
+    resultado.microsegundos = ciclos_acumulador_microsegundos(&tiempo);
+    if (resultado.microsegundos == 0) resultado.microsegundos = 1;
+    resultado.entradas_por_segundo =
+        (uint32_t)((uint64_t)resultado.entradas*1000000u/resultado.microsegundos);
+
+    if (estadisticas != NULL) *estadisticas = resultado;
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Comprobar si un nombre de fichero termina en una extensin, sin
+ *          distinguir maysculas.
+ */
+static bool_t extension_coincide(const char *nombre, const char *extension)
+{
+    uint32_t longitud_nombre = strlen(nombre);
+    uint32_t longitud_extension = strlen(extension);
+    const char *final;
+
+    if (longitud_nombre <= longitud_extension) return FALSE;
+
+    final = &nombre[longitud_nombre - longitud_extension];
+    while (*final != '\0')
+    {
+        if (tolower((uint8_t)*final++) != tolower((uint8_t)*extension++)) return FALSE;
+    }
+
+    return TRUE;
+}
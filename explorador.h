@@ -0,0 +1,57 @@
+/***************************************************************************//**
+ * \file    explorador.h
+ *
+ * \brief   Recorrido iterativo de un rbol de directorios de FatFs.
+ */
+
+#ifndef EXPLORADOR_H
+#define EXPLORADOR_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero mximo de niveles de subdirectorios por debajo del directorio de
+ * partida. Cada nivel tiene un objeto DIR abierto en la pila del recorrido.
+ */
+#define EXPLO_MAXIMA_PROFUNDIDAD    8u
+
+/* Longitud mxima de una ruta, incluido el terminador. Las entradas con
+ * rutas ms largas se saltan.
+ */
+#define EXPLO_MAXIMO_RUTA           256u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Funcin a la que se llama con cada fichero encontrado. La ruta es relativa
+ * al directorio actual de FatFs y slo es vlida durante la llamada.
+ */
+typedef void (*explo_funcion_fichero_t)(const char *ruta,
+                                        const FILINFO *informacion);
+
+/* Resultado de un recorrido.
+ */
+typedef struct {
+    uint32_t entradas;              /* Ledas con f_readdir. */
+    uint32_t directorios;           /* Recorridos, incluido el de partida. */
+    uint32_t ficheros;              /* Pasados a la funcin. */
+    uint32_t directorios_omitidos;  /* Por debajo de la profundidad mxima. */
+    uint32_t directorios_ilegibles; /* Saltados por no poder abrirlos. */
+    uint32_t rutas_largas;          /* Saltadas por superar EXPLO_MAXIMO_RUTA. */
+    uint32_t microsegundos;
+    uint32_t entradas_por_segundo;
+} explo_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+FRESULT explo_recorrer(const char *directorio,
+                       uint32_t profundidad_maxima,
+                       const char *extension,
+                       explo_funcion_fichero_t funcion,
+                       explo_estadisticas_t *estadisticas);
+
+#endif  /* EXPLORADOR_H */
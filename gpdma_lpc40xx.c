@@ -0,0 +1,244 @@
+/***************************************************************************//**
+ * \file    gpdma_lpc40xx.c
+ *
+ * \brief   Gestin de los canales del controlador DMA GPDMA del LPC40xx.
+ *
+ *          Cada mdulo que necesita DMA reserva un canal con
+ *          gpdma_reservar_canal indicando una prioridad, describe la
+ *          transferencia con uno o varios elementos de lista enlazada (LLI)
+ *          y la lanza con gpdma_iniciar. DMA_IRQHandler atiende las
+ *          interrupciones de fin y de error de todos los canales y llama a la
+ *          funcin indicada al lanzar la transferencia de cada uno.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include "gpdma_lpc40xx.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define CONFIG_HABILITAR            (1u << 0)
+#define CONFIG_MASCARA_INT_ERROR    (1u << 14)
+#define CONFIG_MASCARA_INT_FIN      (1u << 15)
+
+/*===== Variables privadas =====================================================
+ */
+
+static LPC_GPDMACH_TypeDef * const registros_canales[GPDMA_NUMERO_CANALES] = {
+    LPC_GPDMACH0, LPC_GPDMACH1, LPC_GPDMACH2, LPC_GPDMACH3,
+    LPC_GPDMACH4, LPC_GPDMACH5, LPC_GPDMACH6, LPC_GPDMACH7
+};
+
+static bool_t canal_reservado[GPDMA_NUMERO_CANALES];
+static gpdma_funcion_fin_t funciones_fin[GPDMA_NUMERO_CANALES];
+static gpdma_estadisticas_t estadisticas[GPDMA_NUMERO_CANALES];
+static bool_t inicializado = FALSE;
+
+/***************************************************************************//**
+ * \brief   Alimentar y habilitar el GPDMA y su interrupcin. Puede llamarse
+ *          varias veces; slo la primera tiene efecto.
+ */
+void gpdma_inicializar(void)
+{
+    if (inicializado) return;
+
+    LPC_SC->PCONP |= 1u << 29;
+
+    LPC_GPDMA->IntTCClear = 0xFF;
+    LPC_GPDMA->IntErrClr = 0xFF;
+
+    LPC_GPDMA->Config = 0x01;
+    while (!(LPC_GPDMA->Config & 0x01));
+
+    NVIC_ClearPendingIRQ(DMA_IRQn);
+    NVIC_EnableIRQ(DMA_IRQn);
+
+    inicializado = TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Reservar un canal libre.
+ *
+ * \param[in]   prioridad   GPDMA_PRIORIDAD_ALTA => se busca desde el canal 0
+ *                          (el ms prioritario).
+ *                          GPDMA_PRIORIDAD_BAJA => se busca desde el canal 7.
+ *
+ * \return      nmero de canal o -1 si no queda ninguno libre.
+ */
+int32_t gpdma_reservar_canal(uint32_t prioridad)
+{
+    uint32_t i;
+    uint32_t canal;
+
+    ASSERT(prioridad == GPDMA_PRIORIDAD_ALTA || prioridad == GPDMA_PRIORIDAD_BAJA,
+           "Prioridad de canal DMA incorrecta.");
+
+    gpdma_inicializar();
+
+    for (i = 0; i < GPDMA_NUMERO_CANALES; i++)
+    {
+        canal = prioridad == GPDMA_PRIORIDAD_ALTA ?
+                i : GPDMA_NUMERO_CANALES - 1 - i;
+
+        if (!canal_reservado[canal])
+        {
+            canal_reservado[canal] = TRUE;
+            funciones_fin[canal] = NULL;
+            estadisticas[canal].transferencias_iniciadas = 0;
+            estadisticas[canal].transferencias_terminadas = 0;
+            estadisticas[canal].errores = 0;
+            return (int32_t)canal;
+        }
+    }
+
+    return -1;
+}
+
+/***************************************************************************//**
+ * \brief       Parar y liberar un canal reservado.
+ */
+void gpdma_liberar_canal(uint32_t canal)
+{
+    ASSERT(canal < GPDMA_NUMERO_CANALES, "Canal DMA incorrecto.");
+
+    gpdma_parar(canal);
+    canal_reservado[canal] = FALSE;
+}
+
+/***************************************************************************//**
+ * \brief       Rellenar un elemento de lista enlazada.
+ *
+ * \param[out]  lli         elemento a rellenar.
+ * \param[in]   origen      direccin de origen.
+ * \param[in]   destino     direccin de destino.
+ * \param[in]   control     valor del registro CControl para este elemento
+ *                          (macros GPDMA_CONTROL_...).
+ * \param[in]   siguiente   siguiente elemento de la lista o NULL si es el
+ *                          ltimo.
+ */
+void gpdma_construir_lli(gpdma_lli_t *lli,
+                         uint32_t origen,
+                         uint32_t destino,
+                         uint32_t control,
+                         const gpdma_lli_t *siguiente)
+{
+    ASSERT(((uint32_t)siguiente & 0x03) == 0, "LLI no alineado.");
+
+    lli->origen = origen;
+    lli->destino = destino;
+    lli->siguiente = siguiente;
+    lli->control = control;
+}
+
+/***************************************************************************//**
+ * \brief       Lanzar una transferencia en un canal reservado. El primer
+ *              elemento de la lista se copia a los registros del canal, as
+ *              que puede estar en la pila; el resto debe seguir en memoria
+ *              hasta que termine la transferencia.
+ *
+ * \param[in]   canal           canal reservado con gpdma_reservar_canal.
+ * \param[in]   primero         primer elemento de la lista enlazada.
+ * \param[in]   configuracion   valor del registro CConfig (macros
+ *                              GPDMA_CONFIG_...) sin el bit de habilitacin.
+ * \param[in]   funcion_fin     funcin a llamar al terminar o NULL.
+ */
+void gpdma_iniciar(uint32_t canal,
+                   const gpdma_lli_t *primero,
+                   uint32_t configuracion,
+                   gpdma_funcion_fin_t funcion_fin)
+{
+    LPC_GPDMACH_TypeDef *regs;
+
+    ASSERT(canal < GPDMA_NUMERO_CANALES && canal_reservado[canal],
+           "Canal DMA no reservado.");
+
+    regs = registros_canales[canal];
+
+    regs->CConfig = 0;
+    LPC_GPDMA->IntTCClear = 1u << canal;
+    LPC_GPDMA->IntErrClr = 1u << canal;
+
+    funciones_fin[canal] = funcion_fin;
+    estadisticas[canal].transferencias_iniciadas++;
+
+    regs->CSrcAddr = primero->origen;
+    regs->CDestAddr = primero->destino;
+    regs->CLLI = (uint32_t)primero->siguiente;
+    regs->CControl = primero->control;
+    regs->CConfig = configuracion |
+                    CONFIG_MASCARA_INT_ERROR |
+                    CONFIG_MASCARA_INT_FIN |
+                    CONFIG_HABILITAR;
+}
+
+/***************************************************************************//**
+ * \brief       Parar la transferencia en curso en un canal.
+ */
+void gpdma_parar(uint32_t canal)
+{
+    ASSERT(canal < GPDMA_NUMERO_CANALES, "Canal DMA incorrecto.");
+
+    registros_canales[canal]->CConfig = 0;
+    LPC_GPDMA->IntTCClear = 1u << canal;
+    LPC_GPDMA->IntErrClr = 1u << canal;
+}
+
+/***************************************************************************//**
+ * \brief       Consultar si un canal sigue transfiriendo. El GPDMA deshabilita
+ *              el canal al terminar la transferencia (o el ltimo elemento de
+ *              la lista), as que no depende de la interrupcin.
+ */
+bool_t gpdma_canal_activo(uint32_t canal)
+{
+    ASSERT(canal < GPDMA_NUMERO_CANALES, "Canal DMA incorrecto.");
+
+    return (LPC_GPDMA->EnbldChns & (1u << canal)) != 0;
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una copia de los contadores de un canal.
+ */
+void gpdma_leer_estadisticas(uint32_t canal, gpdma_estadisticas_t *destino)
+{
+    ASSERT(canal < GPDMA_NUMERO_CANALES, "Canal DMA incorrecto.");
+
+    *destino = estadisticas[canal];
+}
+
+/***************************************************************************//**
+ * \brief   Manejador de la interrupcin del GPDMA. Para cada canal con una
+ *          interrupcin de fin o de error pendiente la borra, actualiza los
+ *          contadores y llama a la funcin indicada en gpdma_iniciar.
+ */
+void DMA_IRQHandler(void)
+{
+    uint32_t fin = LPC_GPDMA->IntTCStat;
+    uint32_t error = LPC_GPDMA->IntErrStat;
+    uint32_t canal;
+    uint32_t mascara;
+
+    LPC_GPDMA->IntTCClear = fin;
+    LPC_GPDMA->IntErrClr = error;
+
+    for (canal = 0; canal < GPDMA_NUMERO_CANALES; canal++)
+    {
+        mascara = 1u << canal;
+
+        if (!((fin | error) & mascara)) continue;
+
+        if (error & mascara)
+        {
+            estadisticas[canal].errores++;
+        }
+        else
+        {
+            estadisticas[canal].transferencias_terminadas++;
+        }
+
+        if (funciones_fin[canal] != NULL)
+        {
+            funciones_fin[canal](canal, (error & mascara) != 0);
+        }
+    }
+}
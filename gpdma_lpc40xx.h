@@ -0,0 +1,119 @@
+/***************************************************************************//**
+ * \file    gpdma_lpc40xx.h
+ *
+ * \brief   Gestin de los canales del controlador DMA GPDMA del LPC40xx.
+ */
+
+#ifndef GPDMA_LPC40XX_H
+#define GPDMA_LPC40XX_H
+
+#include "tipos.h"
+#include <LPC407x_8x_177x_8x.h>
+
+/*===== Constantes =============================================================
+ */
+
+#define GPDMA_NUMERO_CANALES        8u
+
+/* Prioridad con la que se reserva un canal. En el GPDMA el canal 0 es el de
+ * mayor prioridad y el 7 el de menor.
+ */
+#define GPDMA_PRIORIDAD_ALTA        0u
+#define GPDMA_PRIORIDAD_BAJA        1u
+
+/* Campos del registro CControl de un canal (y de los elementos de una lista
+ * enlazada).
+ */
+#define GPDMA_CONTROL_TAMANO(N)             ((uint32_t)(N) & 0xFFFu)
+#define GPDMA_CONTROL_BURST_ORIGEN(B)       ((uint32_t)(B) << 12)
+#define GPDMA_CONTROL_BURST_DESTINO(B)      ((uint32_t)(B) << 15)
+#define GPDMA_CONTROL_ANCHO_ORIGEN(A)       ((uint32_t)(A) << 18)
+#define GPDMA_CONTROL_ANCHO_DESTINO(A)      ((uint32_t)(A) << 21)
+#define GPDMA_CONTROL_INCREMENTAR_ORIGEN    (1u << 26)
+#define GPDMA_CONTROL_INCREMENTAR_DESTINO   (1u << 27)
+#define GPDMA_CONTROL_INT_FIN               (1u << 31)
+
+#define GPDMA_BURST_1       0u
+#define GPDMA_BURST_4       1u
+#define GPDMA_BURST_8       2u
+#define GPDMA_BURST_16      3u
+#define GPDMA_BURST_32      4u
+
+#define GPDMA_ANCHO_8       0u
+#define GPDMA_ANCHO_16      1u
+#define GPDMA_ANCHO_32      2u
+
+/* Campos del registro CConfig de un canal. Los bits de habilitacin y de
+ * mscara de interrupciones los pone gpdma_iniciar.
+ */
+#define GPDMA_CONFIG_PERIFERICO_ORIGEN(P)   ((uint32_t)(P) << 1)
+#define GPDMA_CONFIG_PERIFERICO_DESTINO(P)  ((uint32_t)(P) << 6)
+#define GPDMA_CONFIG_TIPO(T)                ((uint32_t)(T) << 11)
+#define GPDMA_CONFIG_BLOQUEADO              (1u << 16)
+
+#define GPDMA_TIPO_M2M                      0u
+#define GPDMA_TIPO_M2P                      1u
+#define GPDMA_TIPO_P2M                      2u
+#define GPDMA_TIPO_P2P                      3u
+#define GPDMA_TIPO_M2P_CONTROL_PERIFERICO   5u
+#define GPDMA_TIPO_P2M_CONTROL_PERIFERICO   6u
+
+/* Nmeros de perifrico (solicitudes de DMA) usados en este proyecto.
+ */
+#define GPDMA_PERIFERICO_MCI        1u
+#define GPDMA_PERIFERICO_SSP0_TX    2u
+#define GPDMA_PERIFERICO_SSP0_RX    3u
+#define GPDMA_PERIFERICO_SSP1_TX    4u
+#define GPDMA_PERIFERICO_SSP1_RX    5u
+#define GPDMA_PERIFERICO_SSP2_TX    6u
+#define GPDMA_PERIFERICO_SSP2_RX    7u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Elemento de una lista enlazada (LLI). El orden de los campos es el que
+ * espera el GPDMA. Debe estar alineado a palabra y seguir en memoria hasta
+ * que termine la transferencia.
+ */
+typedef struct gpdma_lli gpdma_lli_t;
+
+struct gpdma_lli {
+    uint32_t origen;
+    uint32_t destino;
+    const gpdma_lli_t *siguiente;
+    uint32_t control;
+};
+
+/* Funcin a la que se llama desde DMA_IRQHandler al terminar la transferencia
+ * de un canal (error == FALSE) o al producirse un error (error == TRUE).
+ */
+typedef void (*gpdma_funcion_fin_t)(uint32_t canal, bool_t error);
+
+/* Contadores por canal.
+ */
+typedef struct {
+    uint32_t transferencias_iniciadas;
+    uint32_t transferencias_terminadas;
+    uint32_t errores;
+} gpdma_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void gpdma_inicializar(void);
+int32_t gpdma_reservar_canal(uint32_t prioridad);
+void gpdma_liberar_canal(uint32_t canal);
+void gpdma_construir_lli(gpdma_lli_t *lli,
+                         uint32_t origen,
+                         uint32_t destino,
+                         uint32_t control,
+                         const gpdma_lli_t *siguiente);
+void gpdma_iniciar(uint32_t canal,
+                   const gpdma_lli_t *primero,
+                   uint32_t configuracion,
+                   gpdma_funcion_fin_t funcion_fin);
+void gpdma_parar(uint32_t canal);
+bool_t gpdma_canal_activo(uint32_t canal);
+void gpdma_leer_estadisticas(uint32_t canal, gpdma_estadisticas_t *destino);
+
+#endif  /* GPDMA_LPC40XX_H */
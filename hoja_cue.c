@@ -0,0 +1,419 @@
+/***************************************************************************//**
+ * \file    hoja_cue.c
+ *
+ * \brief   Pistas virtuales definidas por las hojas CUE de la tarjeta SD.
+ *
+ *          cue_buscar recorre la tarjeta con explo_recorrer y lee cada hoja
+ *          lnea a lnea. De cada TRACK se guarda una pista virtual con el
+ *          fichero del FILE anterior, su TITLE y PERFORMER (o el de la hoja)
+ *          y el instante de su INDEX 01; la pista termina en el INDEX 01 de
+ *          la siguiente del mismo fichero. Las pistas sin INDEX 01 se
+ *          descartan. El resto de comandos se ignoran.
+ *
+ *          Las rutas del FILE son relativas al directorio de la hoja. Como
+ *          las hojas suelen venir de la copia del CD, si el fichero no tiene
+ *          extensin .mp3 se le cambia por .mp3. Si la hoja empieza por la
+ *          marca de orden de bytes de UTF-8 los textos se convierten a
+ *          ISO-8859-1.
+ *
+ *          Las pistas y sus cadenas se guardan en la SDRAM, en una tabla y
+ *          una arena como las del ndice de la biblioteca.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "hoja_cue.h"
+#include "explorador.h"
+#include "texto.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define NINGUNA             0xFFFFFFFFu
+
+/*===== Variables privadas =====================================================
+ */
+
+static cue_pista_t *pistas = NULL;
+static char *arena;
+static uint32_t numero_pistas = 0;
+static uint32_t tamano_arena;
+
+/* Estado de la lectura de la hoja en curso.
+ */
+static FIL fichero;
+static bool_t utf8;
+static char directorio[EXPLO_MAXIMO_RUTA];
+static uint32_t fichero_actual;
+static uint32_t interprete_hoja;
+static uint32_t pista_actual;
+static uint32_t primera_pista_hoja;
+
+static uint8_t buffer[512];
+static char linea[CUE_MAXIMO_LINEA];
+static char ruta[EXPLO_MAXIMO_RUTA];
+
+static cue_estadisticas_t estadisticas;
+
+static void leer_hoja(const char *ruta_hoja, const FILINFO *informacion);
+static void procesar_linea(char *texto);
+static void cerrar_pista(void);
+static char *leer_argumento(char **texto);
+static uint32_t anadir_cadena(const char *cadena);
+static void resolver_fichero(const char *nombre);
+
+/***************************************************************************//**
+ * \brief   Reservar la memoria de las pistas en la SDRAM.
+ *
+ * \return  FALSE si no hay SDRAM suficiente.
+ */
+bool_t cue_inicializar(void)
+{
+    if (pistas == NULL)
+    {
+        arena = sdram_reservar(CUE_TAMANO_ARENA);
+        pistas = sdram_reservar(CUE_MAXIMO_PISTAS*sizeof(cue_pista_t));
+        if (arena == NULL || pistas == NULL)
+        {
+            pistas = NULL;
+            return FALSE;
+        }
+    }
+
+    numero_pistas = 0;
+    arena[0] = '\0';
+    tamano_arena = 1;
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Buscar las hojas .cue de la tarjeta, hasta CUE_PROFUNDIDAD_MAXIMA
+ *          niveles de subdirectorios, y leer sus pistas.
+ *
+ * \return  Resultado de FatFs del recorrido.
+ */
+FRESULT cue_buscar(void)
+{
+    FRESULT fr;
+    uint32_t inicio = ciclos_leer();
+
+    ASSERT(pistas != NULL, "Hojas CUE no inicializadas.");
+
+    numero_pistas = 0;
+    tamano_arena = 1;
+    memset(&estadisticas, 0, sizeof(estadisticas));
+
+    fr = explo_recorrer("", CUE_PROFUNDIDAD_MAXIMA, ".cue", leer_hoja, NULL);
+
+    estadisticas.pistas = numero_pistas;
+    estadisticas.microsegundos = ciclos_a_microsegundos(ciclos_leer() - inicio);
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de pistas virtuales.
+ */
+uint32_t cue_numero_pistas(void)
+{
+    return numero_pistas;
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una pista virtual.
+ *
+ * \param[in]   pista   nmero de la pista.
+ */
+const cue_pista_t *cue_leer_pista(uint32_t pista)
+{
+    ASSERT(pista < numero_pistas, "Pista CUE fuera de rango.");
+
+    return &pistas[pista];
+}
+
+/***************************************************************************//**
+ * \brief       Obtener una cadena de la arena.
+ *
+ * \param[in]   desplazamiento  campo de cadena de una pista.
+ */
+const char *cue_cadena(uint32_t desplazamiento)
+{
+    return &arena[desplazamiento];
+}
+
+/***************************************************************************//**
+ * \brief       Convertir un instante de la hoja en milisegundos.
+ *
+ * \param[in]   sectores    instante en sectores de CD.
+ */
+uint32_t cue_milisegundos(uint32_t sectores)
+{
+    return (uint32_t)((uint64_t)sectores*1000u/CUE_SECTORES_POR_SEGUNDO);
+}
+
+/***************************************************************************//**
+ * \brief       Leer el resultado de la ltima bsqueda.
+ *
+ * \param[out]  destino     donde se copian las estadsticas.
+ */
+void cue_leer_estadisticas(cue_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Funcin a la que llama explo_recorrer con cada hoja. Se lee por
+ *          bloques y se pasa cada lnea a procesar_linea.
+ */
+static void leer_hoja(const char *ruta_hoja, const FILINFO *informacion)
+{
+    const char *barra = strrchr(ruta_hoja, '/');
+    uint32_t longitud = barra != NULL ? (uint32_t)(barra - ruta_hoja) : 0;
+    uint32_t n = 0;
+    uint32_t i;
+    UINT leidos;
+    bool_t primer_bloque = TRUE;
+
+    if (f_open(&fichero, ruta_hoja, FA_READ) != FR_OK) return;
+
+    memcpy(directorio, ruta_hoja, longitud);
+    directorio[longitud] = '\0';
+
+    utf8 = FALSE;
+    fichero_actual = NINGUNA;
+    interprete_hoja = 0;
+    pista_actual = NINGUNA;
+    primera_pista_hoja = numero_pistas;
+    estadisticas.hojas++;
+
+    while (f_read(&fichero, buffer, sizeof(buffer), &leidos) == FR_OK && leidos > 0)
+    {
+        i = 0;
+        if (primer_bloque && leidos >= 3u &&
+            buffer[0] == 0xEFu && buffer[1] == 0xBBu && buffer[2] == 0xBFu)
+        {
+            utf8 = TRUE;
+            i = 3;
+        }
+        primer_bloque = FALSE;
+
+        for (; i < leidos; i++)
+        {
+            if (buffer[i] == '\n' || buffer[i] == '\r')
+            {
+                linea[n] = '\0';
+                procesar_linea(linea);
+                n = 0;
+            }
+            else if (n < sizeof(linea) - 1u)
+            {
+                linea[n++] = (char)buffer[i];
+            }
+        }
+    }
+
+    linea[n] = '\0';
+    procesar_linea(linea);
+    cerrar_pista();
+
+    f_close(&fichero);
+}
+
+/***************************************************************************//**
+ * \brief   Interpretar una lnea de la hoja.
+ */
+static void procesar_linea(char *texto)
+{
+    const char *comando;
+    char *argumento;
+    uint32_t minutos;
+    uint32_t segundos;
+    uint32_t sectores;
+    uint32_t inicio;
+
+    if (utf8) texto_convertir_utf8(texto);
+
+    comando = leer_argumento(&texto);
+
+    if (strcmp(comando, "FILE") == 0)
+    {
+        cerrar_pista();
+        resolver_fichero(leer_argumento(&texto));
+        fichero_actual = anadir_cadena(ruta);
+    }
+    else if (strcmp(comando, "TRACK") == 0)
+    {
+        cerrar_pista();
+
+        if (fichero_actual == 0 || fichero_actual == NINGUNA ||
+            numero_pistas >= CUE_MAXIMO_PISTAS)
+        {
+            estadisticas.pistas_descartadas++;
+            return;
+        }
+
+        pista_actual = numero_pistas++;
+        pistas[pista_actual].fichero = fichero_actual;
+        pistas[pista_actual].titulo = 0;
+        pistas[pista_actual].interprete = interprete_hoja;
+        pistas[pista_actual].inicio = NINGUNA;
+        pistas[pista_actual].fin = CUE_HASTA_FINAL;
+        pistas[pista_actual].numero = (uint16_t)atoi(leer_argumento(&texto));
+        pistas[pista_actual].reservado = 0;
+    }
+    else if (strcmp(comando, "TITLE") == 0)
+    {
+        if (pista_actual != NINGUNA)
+        {
+            pistas[pista_actual].titulo = anadir_cadena(leer_argumento(&texto));
+        }
+    }
+    else if (strcmp(comando, "PERFORMER") == 0)
+    {
+        if (pista_actual != NINGUNA)
+        {
+            pistas[pista_actual].interprete = anadir_cadena(leer_argumento(&texto));
+        }
+        else
+        {
+            interprete_hoja = anadir_cadena(leer_argumento(&texto));
+        }
+    }
+    else if (strcmp(comando, "INDEX") == 0 && pista_actual != NINGUNA)
+    {
+        if (atoi(leer_argumento(&texto)) != 1) return;
+
+        /* mm:ss:ff, con ff en sectores.
+         */
+        argumento = leer_argumento(&texto);
+        minutos = (uint32_t)strtoul(argumento, &argumento, 10);
+        if (*argumento++ != ':') return;
+        segundos = (uint32_t)strtoul(argumento, &argumento, 10);
+        if (*argumento++ != ':') return;
+        sectores = (uint32_t)strtoul(argumento, &argumento, 10);
+
+        inicio = (minutos*60u + segundos)*CUE_SECTORES_POR_SEGUNDO + sectores;
+        pistas[pista_actual].inicio = inicio;
+
+        /* La pista anterior del mismo fichero termina aqu.
+         */
+        if (pista_actual > primera_pista_hoja &&
+            pistas[pista_actual - 1u].fichero == pistas[pista_actual].fichero)
+        {
+            pistas[pista_actual - 1u].fin = inicio;
+        }
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Terminar la pista en curso, descartndola si no tiene INDEX 01.
+ */
+static void cerrar_pista(void)
+{
+    if (pista_actual == NINGUNA) return;
+
+    if (pistas[pista_actual].inicio == NINGUNA)
+    {
+        /* Es siempre la ltima de la tabla.
+         */
+        numero_pistas--;
+        estadisticas.pistas_descartadas++;
+    }
+
+    pista_actual = NINGUNA;
+}
+
+/***************************************************************************//**
+ * \brief   Obtener el siguiente argumento de una lnea, que puede ir entre
+ *          comillas, y avanzar el texto hasta el siguiente. El argumento se
+ *          termina en su sitio.
+ *
+ * \return  Argumento ("" si no quedan).
+ */
+static char *leer_argumento(char **texto)
+{
+    char *p = *texto;
+    char *argumento;
+
+    while (*p == ' ' || *p == '\t') p++;
+
+    if (*p == '"')
+    {
+        argumento = ++p;
+        while (*p != '\0' && *p != '"') p++;
+    }
+    else
+    {
+        argumento = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+    }
+
+    if (*p != '\0') *p++ = '\0';
+    *texto = p;
+
+    return argumento;
+}
+
+/***************************************************************************//**
+ * \brief   Aadir una cadena a la arena.
+ *
+ * \return  Desplazamiento de la cadena, o 0 (cadena vaca) si est vaca o
+ *          no cabe.
+ */
+static uint32_t anadir_cadena(const char *cadena)
+{
+    uint32_t longitud = strlen(cadena) + 1u;
+    uint32_t desplazamiento = tamano_arena;
+
+    if (longitud == 1u || tamano_arena + longitud > CUE_TAMANO_ARENA) return 0;
+
+    memcpy(&arena[desplazamiento], cadena, longitud);
+    tamano_arena += longitud;
+
+    return desplazamiento;
+}
+
+/***************************************************************************//**
+ * \brief   Obtener en ruta la ruta desde el raz del fichero de un FILE,
+ *          cambiando '\' por '/' y la extensin por .mp3. Si no cabe la
+ *          ruta queda vaca.
+ */
+static void resolver_fichero(const char *nombre)
+{
+    uint32_t n = strlen(directorio);
+    uint32_t longitud_nombre = strlen(nombre);
+    char *punto;
+    char *p;
+
+    ruta[0] = '\0';
+    if (longitud_nombre == 0) return;
+    if (n + 1u + longitud_nombre + sizeof(".mp3") > sizeof(ruta)) return;
+
+    memcpy(ruta, directorio, n);
+    if (n > 0) ruta[n++] = '/';
+    memcpy(&ruta[n], nombre, longitud_nombre + 1u);
+
+    for (p = &ruta[n]; *p != '\0'; p++)
+    {
+        if (*p == '\\') *p = '/';
+    }
+
+    punto = strrchr(&ruta[n], '.');
+    if (punto == NULL || strchr(punto, '/') != NULL)
+    {
+        strcat(ruta, ".mp3");
+    }
+    else if (tolower((uint8_t)punto[1]) != 'm' ||
+             tolower((uint8_t)punto[2]) != 'p' ||
+             punto[3] != '3' || punto[4] != '\0')
+    {
+        strcpy(punto, ".mp3");
+    }
+}
+
@@ -0,0 +1,79 @@
+/***************************************************************************//**
+ * \file    hoja_cue.h
+ *
+ * \brief   Pistas virtuales definidas por las hojas CUE de la tarjeta SD.
+ */
+
+#ifndef HOJA_CUE_H
+#define HOJA_CUE_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero mximo de pistas virtuales de todas las hojas.
+ */
+#define CUE_MAXIMO_PISTAS           2048u
+
+/* Tamao en bytes de la arena donde se guardan las cadenas (rutas, ttulos
+ * e intrpretes).
+ */
+#define CUE_TAMANO_ARENA            (128u*1024u)
+
+/* Niveles de subdirectorios por debajo del raz donde se buscan las hojas.
+ */
+#define CUE_PROFUNDIDAD_MAXIMA      4u
+
+/* Longitud mxima de una lnea de la hoja. Las ms largas se recortan.
+ */
+#define CUE_MAXIMO_LINEA            256u
+
+/* Los instantes de las hojas CUE se miden en sectores de CD, 75 por segundo.
+ */
+#define CUE_SECTORES_POR_SEGUNDO    75u
+
+/* Fin de una pista que dura hasta el final del fichero.
+ */
+#define CUE_HASTA_FINAL             0xFFFFFFFFu
+
+/*===== Tipos ==================================================================
+ */
+
+/* Pista virtual. Las cadenas se indican con su desplazamiento en la arena; el
+ * desplazamiento 0 corresponde a la cadena vaca.
+ */
+typedef struct {
+    uint32_t fichero;           /* Ruta del MP3 desde el raz. */
+    uint32_t titulo;
+    uint32_t interprete;        /* El de la pista o, si no tiene, el de la
+                                 * hoja. */
+    uint32_t inicio;            /* INDEX 01, en sectores. */
+    uint32_t fin;               /* INDEX 01 de la siguiente pista del mismo
+                                 * fichero o CUE_HASTA_FINAL. */
+    uint16_t numero;
+    uint16_t reservado;
+} cue_pista_t;
+
+/* Resultado de la ltima bsqueda.
+ */
+typedef struct {
+    uint32_t hojas;
+    uint32_t pistas;
+    uint32_t pistas_descartadas;    /* Sin sitio o sin FILE o INDEX 01. */
+    uint32_t microsegundos;
+} cue_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+bool_t cue_inicializar(void);
+FRESULT cue_buscar(void);
+uint32_t cue_numero_pistas(void);
+const cue_pista_t *cue_leer_pista(uint32_t pista);
+const char *cue_cadena(uint32_t desplazamiento);
+uint32_t cue_milisegundos(uint32_t sectores);
+void cue_leer_estadisticas(cue_estadisticas_t *destino);
+
+#endif  /* HOJA_CUE_H */
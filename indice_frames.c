@@ -0,0 +1,428 @@
+/***************************************************************************//**
+ * \file    indice_frames.c
+ *
+ * \brief   ndice de la posicin de los frames de un fichero MP3 para
+ *          saltar a un instante exacto sin decodificar desde el principio.
+ *
+ *          Para construir el ndice se recorre la zona de audio del fichero
+ *          (entre las etiquetas) leyendo slo las cabeceras de los frames:
+ *          de cada una se obtiene el tamao del frame y se pasa a la
+ *          siguiente. El recorrido no se hace de una vez: frames_construir
+ *          slo busca el primer frame y frames_posicion contina el
+ *          recorrido desde donde se qued hasta el frame pedido, as que
+ *          una pista del principio de un fichero largo no espera a que se
+ *          lea el fichero entero. Se guarda la posicin de uno de cada
+ *          "intervalo" frames. Para situarse en el frame n se parte de la
+ *          marca anterior y se avanzan como mucho intervalo - 1 cabeceras,
+ *          as que el salto es exacto al frame tanto en ficheros CBR como
+ *          VBR.
+ *
+ *          Una vez encontrado el primer frame, slo se aceptan cabeceras con
+ *          la misma versin, capa y tasa de muestreo; los bytes que no
+ *          forman una cabecera vlida se saltan de uno en uno.
+ *
+ *          El ndice es del ltimo fichero construido y se conserva mientras
+ *          no se pida el de otro, de modo que saltar entre las pistas de una
+ *          misma hoja CUE slo recorre cada parte del fichero una vez.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include "indice_frames.h"
+#include "etiquetas.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+/* Bits de la cabecera que deben coincidir en todos los frames: sincronismo,
+ * versin, capa y tasa de muestreo.
+ */
+#define MASCARA_CABECERA    0xFFFE0C00u
+
+/*===== Variables privadas =====================================================
+ */
+
+static uint32_t *marcas = NULL;
+static uint32_t numero_marcas;
+static uint32_t intervalo;
+static uint32_t numero_frames = 0;
+
+/* Fichero indexado, zona de audio y datos del primer frame.
+ */
+static char ruta_indexada[256];
+static uint32_t tamano_indexado;
+static uint32_t fin_audio;
+static uint32_t cabecera_referencia;
+static uint32_t tasa_muestreo;
+static uint32_t muestras_frame;
+
+/* Byte donde contina el recorrido y si ya ha llegado al final del audio.
+ */
+static uint32_t siguiente_posicion;
+static bool_t indice_completo;
+
+/* Ventana del fichero leda en el buffer.
+ */
+static uint8_t buffer[4096];
+static uint32_t inicio_buffer;
+static uint32_t bytes_buffer;
+
+static etiq_informacion_t etiquetas;
+
+static frames_estadisticas_t estadisticas;
+
+/* Tasas de bits de Layer III en kbit/s segn el ndice de la cabecera del
+ * frame, para MPEG-1 y para MPEG-2/2.5.
+ */
+static const uint16_t tasas_bits_mpeg1[16] = {
+    0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0
+};
+
+static const uint16_t tasas_bits_mpeg2[16] = {
+    0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0
+};
+
+static const uint32_t tasas_muestreo_mpeg1[4] = { 44100, 48000, 32000, 0 };
+
+static uint32_t tasa_muestreo_cabecera(uint32_t cabecera);
+static uint32_t tamano_frame(uint32_t cabecera);
+static FRESULT buscar_frame(FIL *fichero,
+                            uint32_t *posicion,
+                            uint32_t *cabecera,
+                            uint32_t *tamano);
+static void anadir_marca(uint32_t posicion);
+static FRESULT indexar_hasta(FIL *fichero, uint32_t frame);
+
+/***************************************************************************//**
+ * \brief   Reservar la memoria del ndice en la SDRAM.
+ *
+ * \return  FALSE si no hay SDRAM suficiente.
+ */
+bool_t frames_inicializar(void)
+{
+    if (marcas == NULL)
+    {
+        marcas = sdram_reservar(FRAMES_MAXIMO_MARCAS*sizeof(uint32_t));
+        if (marcas == NULL) return FALSE;
+    }
+
+    numero_frames = 0;
+    ruta_indexada[0] = '\0';
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Empezar el ndice de frames de un fichero, salvo que sea el
+ *              mismo (con el mismo tamao) que el del ndice actual. Slo se
+ *              leen las etiquetas y se busca el primer frame; el resto del
+ *              ndice se construye en frames_posicion segn se necesita.
+ *
+ * \param[in]   fichero     fichero abierto. Queda en una posicin cualquiera.
+ * \param[in]   ruta        ruta del fichero, para reconocerlo despus.
+ *
+ * \return      Resultado de FatFs de la lectura. Si no es FR_OK el ndice
+ *              queda vaco.
+ */
+FRESULT frames_construir(FIL *fichero, const char *ruta)
+{
+    FRESULT fr;
+
+    ASSERT(marcas != NULL, "Indice de frames no inicializado.");
+
+    if (strcmp(ruta, ruta_indexada) == 0 &&
+        (uint32_t)f_size(fichero) == tamano_indexado)
+    {
+        return FR_OK;
+    }
+
+    ruta_indexada[0] = '\0';
+    numero_frames = 0;
+    numero_marcas = 0;
+    intervalo = FRAMES_INTERVALO_INICIAL;
+    cabecera_referencia = 0;
+    bytes_buffer = 0;
+    memset(&estadisticas, 0, sizeof(estadisticas));
+
+    fr = etiq_leer(fichero, &etiquetas);
+    if (fr != FR_OK) return fr;
+
+    siguiente_posicion = etiquetas.inicio_audio;
+    fin_audio = etiquetas.fin_audio;
+    indice_completo = FALSE;
+
+    fr = indexar_hasta(fichero, 0);
+    if (fr != FR_OK)
+    {
+        numero_frames = 0;
+        return fr;
+    }
+
+    if (strlen(ruta) < sizeof(ruta_indexada)) strcpy(ruta_indexada, ruta);
+    tamano_indexado = (uint32_t)f_size(fichero);
+
+    return FR_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de frames indexados hasta ahora del fichero indexado. Es 0
+ *          si el fichero no tiene ningn frame.
+ */
+uint32_t frames_numero_frames(void)
+{
+    return numero_frames;
+}
+
+/***************************************************************************//**
+ * \brief       Nmero del frame que contiene un instante del fichero
+ *              indexado.
+ *
+ * \param[in]   milisegundos    instante desde el principio del audio.
+ */
+uint32_t frames_frame_en(uint32_t milisegundos)
+{
+    if (numero_frames == 0) return 0;
+
+    return (uint32_t)((uint64_t)milisegundos*tasa_muestreo/
+                      (1000u*muestras_frame));
+}
+
+/***************************************************************************//**
+ * \brief       Duracin de un nmero de frames del fichero indexado. Se
+ *              redondea hacia arriba para que frames_frame_en del resultado
+ *              vuelva a dar el mismo nmero de frames.
+ *
+ * \param[in]   frames  nmero de frames.
+ *
+ * \return      Duracin en milisegundos.
+ */
+uint32_t frames_duracion(uint32_t frames)
+{
+    if (numero_frames == 0) return 0;
+
+    return (uint32_t)(((uint64_t)frames*muestras_frame*1000u +
+                       tasa_muestreo - 1u)/tasa_muestreo);
+}
+
+/***************************************************************************//**
+ * \brief       Obtener la posicin en el fichero indexado del principio de un
+ *              frame, ampliando antes el ndice hasta l si hace falta.
+ *
+ * \param[in]   fichero     fichero indexado, abierto.
+ * \param[in]   frame       nmero del frame. Si no existe se devuelve el final
+ *                          del audio.
+ * \param[out]  posicion    byte del fichero donde empieza el frame.
+ *
+ * \return      Resultado de FatFs de la lectura de las cabeceras.
+ */
+FRESULT frames_posicion(FIL *fichero, uint32_t frame, uint32_t *posicion)
+{
+    FRESULT fr;
+    uint32_t cabecera;
+    uint32_t tamano;
+    uint32_t restantes;
+
+    fr = indexar_hasta(fichero, frame);
+    if (fr != FR_OK) return fr;
+
+    if (frame >= numero_frames)
+    {
+        *posicion = fin_audio;
+        return FR_OK;
+    }
+
+    *posicion = marcas[frame/intervalo];
+    restantes = frame % intervalo;
+
+    /* Se busca tambin la cabecera del propio frame para saltar los bytes
+     * no vlidos que pueda haber delante de l.
+     */
+    while (TRUE)
+    {
+        fr = buscar_frame(fichero, posicion, &cabecera, &tamano);
+        if (fr != FR_OK) return fr;
+        if (tamano == 0)
+        {
+            *posicion = fin_audio;
+            break;
+        }
+        if (restantes == 0) break;
+
+        *posicion += tamano;
+        restantes--;
+    }
+
+    return FR_OK;
+}
+
+/***************************************************************************//**
+ * \brief       Leer el estado del ndice del fichero indexado.
+ *
+ * \param[out]  destino     donde se copian las estadsticas.
+ */
+void frames_leer_estadisticas(frames_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Tasa de muestreo de una cabecera: la de MPEG-1, la mitad en
+ *          MPEG-2 y la cuarta parte en MPEG-2.5.
+ */
+static uint32_t tasa_muestreo_cabecera(uint32_t cabecera)
+{
+    uint32_t tasa = tasas_muestreo_mpeg1[(cabecera >> 10) & 3u];
+
+    if (cabecera & (1u << 19)) return tasa;
+    if (cabecera & (1u << 20)) return tasa/2u;
+
+    return tasa/4u;
+}
+
+/***************************************************************************//**
+ * \brief   Tamao en bytes del frame de una cabecera de Layer III, o 0 si la
+ *          cabecera no es vlida o no coincide con la del primer frame.
+ */
+static uint32_t tamano_frame(uint32_t cabecera)
+{
+    bool_t mpeg1 = (cabecera & (1u << 19)) != 0;
+    uint32_t indice_tasa_bits = (cabecera >> 12) & 0xFu;
+    uint32_t tasa;
+
+    if ((cabecera & 0xFFE00000u) != 0xFFE00000u) return 0;
+    if (((cabecera >> 17) & 3u) != 1u) return 0;            /* Layer III. */
+    if (((cabecera >> 19) & 3u) == 1u) return 0;            /* Reservada. */
+    if (((cabecera >> 10) & 3u) == 3u) return 0;
+
+    if (cabecera_referencia != 0 &&
+        (cabecera & MASCARA_CABECERA) != (cabecera_referencia & MASCARA_CABECERA))
+    {
+        return 0;
+    }
+
+    tasa = mpeg1 ? tasas_bits_mpeg1[indice_tasa_bits] :
+                   tasas_bits_mpeg2[indice_tasa_bits];
+    if (tasa == 0) return 0;
+
+    return (mpeg1 ? 144000u : 72000u)*tasa/tasa_muestreo_cabecera(cabecera) +
+           ((cabecera >> 9) & 1u);
+}
+
+/***************************************************************************//**
+ * \brief   Buscar la primera cabecera de frame vlida a partir de una
+ *          posicin, dentro de la zona de audio. Las cabeceras se leen de
+ *          una ventana del fichero que se vuelve a leer cuando la posicin
+ *          se sale de ella.
+ *
+ * \return  Resultado de FatFs. Si se llega al final del audio sin encontrar
+ *          ninguna, *tamano es 0.
+ */
+static FRESULT buscar_frame(FIL *fichero,
+                            uint32_t *posicion,
+                            uint32_t *cabecera,
+                            uint32_t *tamano)
+{
+    FRESULT fr;
+    UINT leidos;
+    const uint8_t *p;
+
+    *tamano = 0;
+
+    while (*posicion + 4u <= fin_audio)
+    {
+        if (*posicion < inicio_buffer ||
+            *posicion + 4u > inicio_buffer + bytes_buffer)
+        {
+            fr = f_lseek(fichero, *posicion);
+            if (fr == FR_OK) fr = f_read(fichero, buffer, sizeof(buffer), &leidos);
+            if (fr != FR_OK) return fr;
+
+            inicio_buffer = *posicion;
+            bytes_buffer = leidos;
+            if (bytes_buffer < 4u) return FR_OK;
+        }
+
+        p = &buffer[*posicion - inicio_buffer];
+        *cabecera = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                    (uint32_t)p[2] << 8 | p[3];
+        *tamano = tamano_frame(*cabecera);
+        if (*tamano != 0) return FR_OK;
+
+        (*posicion)++;
+        estadisticas.bytes_saltados++;
+    }
+
+    return FR_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Aadir la posicin de un frame al ndice. Si la tabla est llena
+ *          se queda con una de cada dos marcas y se duplica el intervalo.
+ */
+static void anadir_marca(uint32_t posicion)
+{
+    uint32_t i;
+
+    if (numero_marcas == FRAMES_MAXIMO_MARCAS)
+    {
+        for (i = 0; i < FRAMES_MAXIMO_MARCAS/2u; i++)
+        {
+            marcas[i] = marcas[2u*i];
+        }
+
+        numero_marcas = FRAMES_MAXIMO_MARCAS/2u;
+        intervalo *= 2u;
+    }
+
+    marcas[numero_marcas++] = posicion;
+}
+
+/***************************************************************************//**
+ * \brief   Continuar el recorrido de la zona de audio hasta haber indexado un
+ *          frame o llegar al final del audio.
+ *
+ * \return  Resultado de FatFs de la lectura. Si no es FR_OK el ndice se
+ *          queda como estaba y el recorrido se reintenta en la siguiente
+ *          llamada.
+ */
+static FRESULT indexar_hasta(FIL *fichero, uint32_t frame)
+{
+    FRESULT fr = FR_OK;
+    uint32_t inicio = ciclos_leer();
+    uint32_t cabecera;
+    uint32_t tamano;
+
+    while (!indice_completo && numero_frames <= frame)
+    {
+        fr = buscar_frame(fichero, &siguiente_posicion, &cabecera, &tamano);
+        if (fr != FR_OK) break;
+        if (tamano == 0)
+        {
+            indice_completo = TRUE;
+            break;
+        }
+
+        if (cabecera_referencia == 0)
+        {
+            cabecera_referencia = cabecera;
+            muestras_frame = (cabecera & (1u << 19)) ? 1152u : 576u;
+            tasa_muestreo = tasa_muestreo_cabecera(cabecera);
+        }
+
+        if (numero_frames % intervalo == 0) anadir_marca(siguiente_posicion);
+
+        numero_frames++;
+        siguiente_posicion += tamano;
+    }
+
+    estadisticas.frames = numero_frames;
+    estadisticas.marcas = numero_marcas;
+    estadisticas.intervalo = intervalo;
+    estadisticas.microsegundos_construccion +=
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+
+    return fr;
+}
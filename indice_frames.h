@@ -0,0 +1,51 @@
+/***************************************************************************//**
+ * \file    indice_frames.h
+ *
+ * \brief   ndice de la posicin de los frames de un fichero MP3 para
+ *          saltar a un instante exacto sin decodificar desde el principio.
+ */
+
+#ifndef INDICE_FRAMES_H
+#define INDICE_FRAMES_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero mximo de marcas del ndice. Al principio se guarda la posicin de
+ * uno de cada FRAMES_INTERVALO_INICIAL frames; si no caben, el intervalo se
+ * duplica (con 16384 marcas y un intervalo de 16 caben casi 2 horas a
+ * 44,1 kHz sin duplicarlo).
+ */
+#define FRAMES_MAXIMO_MARCAS        16384u
+#define FRAMES_INTERVALO_INICIAL    16u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Estado del ndice del fichero. Como el ndice se construye segn se
+ * necesita, frames es el nmero de frames indexados hasta ahora y
+ * microsegundos_construccion el tiempo total dedicado a indexarlos.
+ */
+typedef struct {
+    uint32_t frames;
+    uint32_t marcas;
+    uint32_t intervalo;
+    uint32_t bytes_saltados;        /* Sin cabecera de frame vlida. */
+    uint32_t microsegundos_construccion;
+} frames_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+bool_t frames_inicializar(void);
+FRESULT frames_construir(FIL *fichero, const char *ruta);
+uint32_t frames_numero_frames(void);
+uint32_t frames_frame_en(uint32_t milisegundos);
+uint32_t frames_duracion(uint32_t frames);
+FRESULT frames_posicion(FIL *fichero, uint32_t frame, uint32_t *posicion);
+void frames_leer_estadisticas(frames_estadisticas_t *destino);
+
+#endif  /* INDICE_FRAMES_H */
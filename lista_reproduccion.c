@@ -0,0 +1,477 @@
+/***************************************************************************//**
+ * \file    lista_reproduccion.c
+ *
+ * \brief   Listas de reproduccin M3U y M3U8 de la tarjeta SD.
+ *
+ *          lista_buscar recorre la tarjeta con explo_recorrer y guarda las
+ *          rutas de las listas que encuentra. Al abrir una lista no se carga
+ *          su contenido: se lee una vez por bloques y se guarda slo el
+ *          desplazamiento en el fichero de cada entrada (las lneas que no
+ *          estn vacas ni empiezan por '#'). El fichero queda abierto y
+ *          leer cualquier entrada cuesta un f_lseek y una lectura, tenga la
+ *          lista las entradas que tenga.
+ *
+ *          Las rutas relativas se resuelven respecto al directorio de la
+ *          lista, admitiendo '\' como separador y los componentes "." y
+ *          "..". Las entradas de las listas M3U8 se convierten de UTF-8 a
+ *          ISO-8859-1; las de M3U se usan tal cual.
+ *
+ *          El orden aleatorio es una permutacin de las entradas que se
+ *          calcula una vez (Fisher-Yates) al activarlo; recorrerla no
+ *          requiere volver a leer la lista.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include <ctype.h>
+#include "lista_reproduccion.h"
+#include "explorador.h"
+#include "texto.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#if LISTA_MAXIMO_ENTRADAS > 65536u
+#error "LISTA_MAXIMO_ENTRADAS demasiado grande."
+#endif
+
+/*===== Variables privadas =====================================================
+ */
+
+/* Rutas de las listas encontradas, de LISTA_MAXIMO_RUTA bytes cada una.
+ */
+static char *nombres = NULL;
+static uint32_t numero_listas = 0;
+
+/* Lista abierta: desplazamiento de cada entrada en el fichero, orden
+ * aleatorio y directorio respecto al que se resuelven las rutas relativas.
+ */
+static FIL fichero;
+static bool_t abierta = FALSE;
+static bool_t utf8;
+static uint32_t *desplazamientos;
+static uint16_t *permutacion;
+static uint32_t numero_entradas = 0;
+static bool_t barajada = FALSE;
+static char directorio[LISTA_MAXIMO_RUTA];
+
+static uint8_t buffer[512];
+static char linea[LISTA_MAXIMO_RUTA];
+
+static uint32_t semilla = 0;
+
+static lista_estadisticas_t estadisticas;
+
+static void anadir_lista(const char *ruta, const FILINFO *informacion);
+static FRESULT indexar(void);
+static bool_t resolver_ruta(char *entrada, char *ruta);
+static uint32_t aleatorio(void);
+
+/***************************************************************************//**
+ * \brief   Reservar la memoria de las listas en la SDRAM.
+ *
+ * \return  FALSE si no hay SDRAM suficiente.
+ */
+bool_t lista_inicializar(void)
+{
+    if (nombres == NULL)
+    {
+        desplazamientos = sdram_reservar(LISTA_MAXIMO_ENTRADAS*sizeof(uint32_t));
+        permutacion = sdram_reservar(LISTA_MAXIMO_ENTRADAS*sizeof(uint16_t));
+        nombres = sdram_reservar(LISTA_MAXIMO_LISTAS*LISTA_MAXIMO_RUTA);
+        if (desplazamientos == NULL || permutacion == NULL || nombres == NULL)
+        {
+            nombres = NULL;
+            return FALSE;
+        }
+    }
+
+    lista_cerrar();
+    numero_listas = 0;
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Buscar los ficheros .m3u y .m3u8 de la tarjeta, hasta
+ *          LISTA_PROFUNDIDAD_MAXIMA niveles de subdirectorios.
+ *
+ * \return  Resultado de FatFs del recorrido.
+ */
+FRESULT lista_buscar(void)
+{
+    FRESULT fr;
+
+    ASSERT(nombres != NULL, "Listas no inicializadas.");
+
+    numero_listas = 0;
+
+    fr = explo_recorrer("", LISTA_PROFUNDIDAD_MAXIMA, ".m3u", anadir_lista, NULL);
+    if (fr == FR_OK)
+    {
+        fr = explo_recorrer("", LISTA_PROFUNDIDAD_MAXIMA, ".m3u8", anadir_lista, NULL);
+    }
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de listas encontradas por lista_buscar.
+ */
+uint32_t lista_numero_listas(void)
+{
+    return numero_listas;
+}
+
+/***************************************************************************//**
+ * \brief       Obtener la ruta de una lista.
+ *
+ * \param[in]   lista   nmero de la lista.
+ */
+const char *lista_nombre(uint32_t lista)
+{
+    ASSERT(lista < numero_listas, "Lista fuera de rango.");
+
+    return &nombres[lista*LISTA_MAXIMO_RUTA];
+}
+
+/***************************************************************************//**
+ * \brief       Abrir una lista e indexar sus entradas. La lista queda en su
+ *              orden original.
+ *
+ * \param[in]   lista   nmero de la lista.
+ *
+ * \return      Resultado de FatFs de la apertura o la lectura.
+ */
+FRESULT lista_abrir(uint32_t lista)
+{
+    const char *ruta = lista_nombre(lista);
+    const char *barra;
+    uint32_t longitud = strlen(ruta);
+    uint32_t inicio = ciclos_leer();
+    FRESULT fr;
+
+    lista_cerrar();
+
+    utf8 = longitud > 0 && ruta[longitud - 1] == '8';
+
+    barra = strrchr(ruta, '/');
+    longitud = barra != NULL ? (uint32_t)(barra - ruta) : 0;
+    memcpy(directorio, ruta, longitud);
+    directorio[longitud] = '\0';
+
+    fr = f_open(&fichero, ruta, FA_READ);
+    if (fr != FR_OK) return fr;
+
+    fr = indexar();
+    if (fr != FR_OK)
+    {
+        f_close(&fichero);
+        numero_entradas = 0;
+        return fr;
+    }
+
+    abierta = TRUE;
+    estadisticas.entradas = numero_entradas;
+    estadisticas.microsegundos_indexado =
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+
+    return FR_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Cerrar la lista abierta, si la hay.
+ */
+void lista_cerrar(void)
+{
+    if (abierta) f_close(&fichero);
+
+    abierta = FALSE;
+    barajada = FALSE;
+    numero_entradas = 0;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de entradas de la lista abierta.
+ */
+uint32_t lista_numero_entradas(void)
+{
+    return numero_entradas;
+}
+
+/***************************************************************************//**
+ * \brief       Leer una entrada de la lista abierta y resolver su ruta.
+ *
+ * \param[in]   posicion    posicin en el orden actual (original o
+ *                          aleatorio).
+ * \param[out]  ruta        buffer de LISTA_MAXIMO_RUTA bytes.
+ *
+ * \return      FALSE si la entrada no se puede leer, es demasiado larga o no
+ *              es un fichero de la tarjeta (por ejemplo una URL).
+ */
+bool_t lista_leer_ruta(uint32_t posicion, char *ruta)
+{
+    uint32_t inicio = ciclos_leer();
+    uint32_t entrada;
+    UINT leidos;
+    uint32_t n;
+    bool_t correcta;
+
+    ASSERT(abierta && posicion < numero_entradas, "Entrada fuera de rango.");
+
+    entrada = barajada ? permutacion[posicion] : posicion;
+
+    if (f_lseek(&fichero, desplazamientos[entrada]) != FR_OK ||
+        f_read(&fichero, linea, sizeof(linea) - 1u, &leidos) != FR_OK)
+    {
+        return FALSE;
+    }
+
+    for (n = 0; n < leidos && linea[n] != '\r' && linea[n] != '\n'; n++);
+
+    /* Si no cabe la lnea entera, la entrada no es vlida.
+     */
+    if (n == sizeof(linea) - 1u) return FALSE;
+
+    while (n > 0 && (linea[n - 1] == ' ' || linea[n - 1] == '\t')) n--;
+    linea[n] = '\0';
+
+    if (utf8) texto_convertir_utf8(linea);
+    correcta = resolver_ruta(linea, ruta);
+
+    estadisticas.microsegundos_ultima_lectura =
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+
+    return correcta;
+}
+
+/***************************************************************************//**
+ * \brief       Activar o desactivar el orden aleatorio de la lista abierta.
+ *              Al activarlo se calcula una permutacin nueva en la que la
+ *              entrada en curso pasa a ser la primera, de modo que la
+ *              reproduccin sigue con entradas que an no han sonado.
+ *
+ * \param[in]   activar         TRUE => orden aleatorio.
+ * \param[in]   posicion_actual posicin de la entrada en curso en el orden
+ *                              actual o LISTA_NINGUNA.
+ *
+ * \return      Posicin de la entrada en curso en el nuevo orden, o
+ *              LISTA_NINGUNA si no haba.
+ */
+uint32_t lista_barajar(bool_t activar, uint32_t posicion_actual)
+{
+    uint32_t actual = LISTA_NINGUNA;
+    uint32_t primera = 0;
+    uint32_t i;
+    uint32_t j;
+    uint16_t aux;
+
+    if (posicion_actual < numero_entradas)
+    {
+        actual = barajada ? permutacion[posicion_actual] : posicion_actual;
+    }
+
+    if (!activar)
+    {
+        barajada = FALSE;
+        return actual;
+    }
+
+    for (i = 0; i < numero_entradas; i++)
+    {
+        permutacion[i] = (uint16_t)i;
+    }
+
+    if (actual != LISTA_NINGUNA)
+    {
+        permutacion[0] = (uint16_t)actual;
+        permutacion[actual] = 0;
+        primera = 1;
+    }
+
+    for (i = numero_entradas; i > primera + 1u; i--)
+    {
+        j = primera + aleatorio() % (i - primera);
+        aux = permutacion[i - 1u];
+        permutacion[i - 1u] = permutacion[j];
+        permutacion[j] = aux;
+    }
+
+    barajada = TRUE;
+
+    return actual != LISTA_NINGUNA ? 0 : LISTA_NINGUNA;
+}
+
+/***************************************************************************//**
+ * \brief   Indicar si la lista abierta est en orden aleatorio.
+ */
+bool_t lista_barajada(void)
+{
+    return barajada;
+}
+
+/***************************************************************************//**
+ * \brief       Leer el resultado de la ltima apertura y lectura.
+ *
+ * \param[out]  destino     donde se copian las estadsticas.
+ */
+void lista_leer_estadisticas(lista_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Funcin a la que llama explo_recorrer con cada lista encontrada.
+ */
+static void anadir_lista(const char *ruta, const FILINFO *informacion)
+{
+    if (numero_listas >= LISTA_MAXIMO_LISTAS) return;
+    if (strlen(ruta) >= LISTA_MAXIMO_RUTA) return;
+
+    strcpy(&nombres[numero_listas*LISTA_MAXIMO_RUTA], ruta);
+    numero_listas++;
+}
+
+/***************************************************************************//**
+ * \brief   Leer la lista por bloques y guardar el desplazamiento del primer
+ *          carcter no blanco de cada lnea que no sea un comentario ni una
+ *          directiva (las que empiezan por '#'). Se salta la marca de orden
+ *          de bytes de UTF-8 si la hay.
+ */
+static FRESULT indexar(void)
+{
+    FRESULT fr;
+    UINT leidos;
+    uint32_t posicion = 0;
+    uint32_t i;
+    bool_t inicio_linea = TRUE;
+    uint8_t c;
+
+    numero_entradas = 0;
+    estadisticas.entradas_descartadas = 0;
+
+    while (TRUE)
+    {
+        fr = f_read(&fichero, buffer, sizeof(buffer), &leidos);
+        if (fr != FR_OK || leidos == 0) return fr;
+
+        i = 0;
+        if (posicion == 0 && leidos >= 3u &&
+            buffer[0] == 0xEFu && buffer[1] == 0xBBu && buffer[2] == 0xBFu)
+        {
+            i = 3;
+        }
+
+        for (; i < leidos; i++)
+        {
+            c = buffer[i];
+
+            if (c == '\n')
+            {
+                inicio_linea = TRUE;
+            }
+            else if (inicio_linea && c != ' ' && c != '\t' && c != '\r')
+            {
+                inicio_linea = FALSE;
+
+                if (c == '#') continue;
+
+                if (numero_entradas < LISTA_MAXIMO_ENTRADAS)
+                {
+                    desplazamientos[numero_entradas++] = posicion + i;
+                }
+                else
+                {
+                    estadisticas.entradas_descartadas++;
+                }
+            }
+        }
+
+        posicion += leidos;
+    }
+}
+
+/***************************************************************************//**
+ * \brief       Obtener la ruta desde el raz de la tarjeta de una entrada de
+ *              la lista. Las rutas que empiezan por '/' o por una letra de
+ *              unidad se toman desde el raz; el resto, desde el directorio
+ *              de la lista.
+ *
+ * \param[in]   entrada     texto de la entrada. Se cambian en l los '\'
+ *                          por '/'.
+ * \param[out]  ruta        buffer de LISTA_MAXIMO_RUTA bytes.
+ *
+ * \return      FALSE si la entrada es una URL, queda vaca o es demasiado
+ *              larga.
+ */
+static bool_t resolver_ruta(char *entrada, char *ruta)
+{
+    char *p;
+    const char *componente = entrada;
+    uint32_t longitud;
+    uint32_t n = 0;
+
+    if (strstr(entrada, "://") != NULL) return FALSE;
+
+    for (p = entrada; *p != '\0'; p++)
+    {
+        if (*p == '\\') *p = '/';
+    }
+
+    if (isalpha((uint8_t)entrada[0]) && entrada[1] == ':')
+    {
+        componente += 2;
+    }
+    else if (entrada[0] != '/')
+    {
+        n = strlen(directorio);
+        memcpy(ruta, directorio, n);
+    }
+
+    /* Aadir los componentes de la entrada uno a uno.
+     */
+    while (*componente != '\0')
+    {
+        for (longitud = 0;
+             componente[longitud] != '\0' && componente[longitud] != '/';
+             longitud++);
+
+        if (longitud == 2 && componente[0] == '.' && componente[1] == '.')
+        {
+            while (n > 0 && ruta[n - 1] != '/') n--;
+            if (n > 0) n--;
+        }
+        else if (longitud > 0 && !(longitud == 1 && componente[0] == '.'))
+        {
+            if (n + 1u + longitud >= LISTA_MAXIMO_RUTA) return FALSE;
+            if (n > 0) ruta[n++] = '/';
+            memcpy(&ruta[n], componente, longitud);
+            n += longitud;
+        }
+
+        componente += longitud;
+        if (*componente == '/') componente++;
+    }
+
+    ruta[n] = '\0';
+
+    return n > 0;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero pseudoaleatorio (xorshift de 32 bits). La semilla se toma
+ *          del contador de ciclos la primera vez.
+ */
+static uint32_t aleatorio(void)
+{
+    if (semilla == 0) semilla = ciclos_leer() | 1u;
+
+    semilla ^= semilla << 13;
+    semilla ^= semilla >> 17;
+    semilla ^= semilla << 5;
+
+    return semilla;
+}
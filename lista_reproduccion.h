@@ -0,0 +1,63 @@
+/***************************************************************************//**
+ * \file    lista_reproduccion.h
+ *
+ * \brief   Listas de reproduccin M3U y M3U8 de la tarjeta SD.
+ */
+
+#ifndef LISTA_REPRODUCCION_H
+#define LISTA_REPRODUCCION_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero mximo de listas que se buscan en la tarjeta y niveles de
+ * subdirectorios por debajo del raz donde se buscan.
+ */
+#define LISTA_MAXIMO_LISTAS         64u
+#define LISTA_PROFUNDIDAD_MAXIMA    1u
+
+/* Nmero mximo de entradas de una lista. Las que pasan de aqu no se
+ * reproducen.
+ */
+#define LISTA_MAXIMO_ENTRADAS       16384u
+
+/* Longitud mxima de una ruta, incluido el terminador.
+ */
+#define LISTA_MAXIMO_RUTA           256u
+
+/* Posicin que indica a lista_barajar que no hay una entrada en curso.
+ */
+#define LISTA_NINGUNA               0xFFFFFFFFu
+
+/*===== Tipos ==================================================================
+ */
+
+/* Resultado de la apertura de la lista y de la ltima lectura de una
+ * entrada.
+ */
+typedef struct {
+    uint32_t entradas;
+    uint32_t entradas_descartadas;  /* Ms all de LISTA_MAXIMO_ENTRADAS. */
+    uint32_t microsegundos_indexado;
+    uint32_t microsegundos_ultima_lectura;
+} lista_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+bool_t lista_inicializar(void);
+FRESULT lista_buscar(void);
+uint32_t lista_numero_listas(void);
+const char *lista_nombre(uint32_t lista);
+FRESULT lista_abrir(uint32_t lista);
+void lista_cerrar(void);
+uint32_t lista_numero_entradas(void);
+bool_t lista_leer_ruta(uint32_t posicion, char *ruta);
+uint32_t lista_barajar(bool_t activar, uint32_t posicion_actual);
+bool_t lista_barajada(void);
+void lista_leer_estadisticas(lista_estadisticas_t *destino);
+
+#endif  /* LISTA_REPRODUCCION_H */
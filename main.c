@@ -14,6 +14,17 @@
 #include "error.h"
 #include "teclado_4x4.h"
 #include <stdlib.h>
+#include "contador_ciclos.h"
+#include "efectos_sonido.h"
+#include "sd_lpc40xx_mci.h"
+#include "disco.h"
+#include "biblioteca.h"
+#include "navegador.h"
+#include "busqueda.h"
+#include "lista_reproduccion.h"
+#include "hoja_cue.h"
+#include "indice_frames.h"
+#include "reanudacion.h"
 
 /* La siguiente definici�n de la funcion _ttywrch es s�lo para quitar el error
  * de linkado que generan las llamadas a printf y fprintf en libmad cuando no
@@ -21,12 +32,221 @@
  */
 void _ttywrch(int ch){}
 
-//Estructura para almacenar informacion de la pista y luego utilizarla junto al teclado
-typedef struct{
-	uint32_t numero;
-	char nombre[255];
-} pista;
+/* Número de frames que se decodifican sin oírse antes de uno para llenar la
+ * reserva de bits: REPRODUCTOR_FRAMES_PREVIOS o los que haya antes.*/
+static uint32_t frames_previos(uint32_t frame)
+{
+    return frame < REPRODUCTOR_FRAMES_PREVIOS ? frame :
+                                                REPRODUCTOR_FRAMES_PREVIOS;
+}
+
+/* Reproducir un tramo de un fichero guardando por dónde va, para poder
+ * reanudarlo si se corta la alimentación antes de que termine. El tramo
+ * empieza a oírse en frame_origen, después de los frames descartados.*/
+static void reproducir(FIL *fichero,
+                       const char *ruta,
+                       uint32_t inicio,
+                       uint32_t fin,
+                       uint32_t frame_origen,
+                       uint32_t frames_descartar)
+{
+    reanud_empezar(ruta, inicio, fin, frame_origen);
+    reproducir_mp3_tramo(fichero, inicio, fin, frames_descartar);
+    reanud_terminar();
+}
+
+/* Reanudar el fichero que se estaba reproduciendo cuando se cortó la
+ * alimentación. Se hace nada más montar la tarjeta, antes de cargar la
+ * biblioteca, para que el tiempo hasta volver a oír la música dependa sólo
+ * de leer el punto guardado y de saltar a él. El frame que se estaba oyendo
+ * se localiza con el índice de frames, que sólo se construye hasta él, y se
+ * empieza REPRODUCTOR_FRAMES_PREVIOS frames antes, que se decodifican sin
+ * oírse para llenar la reserva de bits. Así el tiempo mostrado es el del
+ * primer frame que se oye. Si no se puede localizar, el tramo se reproduce
+ * desde su principio.*/
+static void reanudar(void)
+{
+    static FIL fichero;
+    static reanud_punto_t punto;
+    reanud_estadisticas_t estadisticas_reanudacion;
+    uint32_t frames_oidos = 0;
+    uint32_t posicion;
+    uint32_t milisegundos = 0;
+
+    if (!reanud_inicializar(&punto)) return;
+    if (f_open(&fichero, punto.ruta, FA_READ) != FR_OK) return;
+
+    if (frames_construir(&fichero, punto.ruta) == FR_OK &&
+        frames_numero_frames() != 0)
+    {
+        frames_oidos = frames_frame_en(punto.milisegundos);
+
+        if (frames_posicion(&fichero,
+                            punto.frame_origen + frames_oidos -
+                            frames_previos(punto.frame_origen + frames_oidos),
+                            &posicion) == FR_OK &&
+            posicion > punto.inicio)
+        {
+            milisegundos = frames_duracion(frames_oidos);
+            reproductor_reanudar_en(posicion, milisegundos);
+        }
+        else
+        {
+            frames_oidos = 0;
+        }
+    }
+
+    reanud_leer_estadisticas(&estadisticas_reanudacion);
+
+    glcd_borrar(NEGRO);
+    glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Reanudando...");
+    glcd_xprintf(0, 32, WHITE, BLACK, FONT16X32, "%s", punto.ruta);
+    glcd_xprintf(0, 96, WHITE, BLACK, FONT8X16,
+                 "Reanudado en %02u:%02u (%s), punto leido en %u us",
+                 milisegundos/60000,
+                 milisegundos/1000%60,
+                 estadisticas_reanudacion.posicion_del_rtc ? "RTC" : "log",
+                 estadisticas_reanudacion.microsegundos_lectura);
+
+    reproducir(&fichero, punto.ruta, punto.inicio, punto.fin,
+               punto.frame_origen,
+               frames_previos(punto.frame_origen + frames_oidos));
+    f_close(&fichero);
+
+    glcd_borrar(NEGRO);
+}
+
+/* Reproducir una lista de reproducción de la tarjeta desde el principio. Si
+ * está seleccionado el orden aleatorio se baraja al empezar, y si cambia
+ * durante la reproducción se aplica a partir de la siguiente pista. Con '#'
+ * se pasa a la siguiente y con el joystick a la izquierda se termina la
+ * lista. Las entradas que no se pueden abrir se saltan.*/
+static void reproducir_lista(uint32_t lista)
+{
+    static FIL fichero;
+    static char ruta[LISTA_MAXIMO_RUTA];
+    lista_estadisticas_t estadisticas_lista;
+    uint32_t posicion = 0;
+
+    glcd_borrar(NEGRO);
+
+    if (lista_abrir(lista) != FR_OK)
+    {
+        glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Error en la lista");
+        tec4x4_esperar_pulsacion();
+        glcd_borrar(NEGRO);
+        return;
+    }
+
+    if (reproductor_aleatorio()) lista_barajar(TRUE, LISTA_NINGUNA);
+
+    while (posicion < lista_numero_entradas())
+    {
+        if (lista_leer_ruta(posicion, ruta) &&
+            f_open(&fichero, ruta, FA_READ) == FR_OK)
+        {
+            lista_leer_estadisticas(&estadisticas_lista);
+
+            glcd_borrar(NEGRO);
+            glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Reproduciendo...");
+            glcd_xprintf(0, 32, WHITE, BLACK, FONT16X32, "%s", ruta);
+            glcd_xprintf(0, 96, WHITE, BLACK, FONT8X16,
+                         "Lista: %u/%u, indexada en %u ms, lectura %u us",
+                         posicion + 1,
+                         lista_numero_entradas(),
+                         estadisticas_lista.microsegundos_indexado/1000,
+                         estadisticas_lista.microsegundos_ultima_lectura);
+
+            reproducir(&fichero, ruta, 0, REPRODUCTOR_HASTA_FINAL, 0, 0);
+            f_close(&fichero);
+
+            if (reproductor_motivo_fin() == REPRODUCTOR_FIN_PARADA) break;
+        }
+
+        if (reproductor_aleatorio() != lista_barajada())
+        {
+            posicion = lista_barajar(reproductor_aleatorio(), posicion);
+        }
+        posicion++;
+    }
+
+    lista_cerrar();
+    glcd_borrar(NEGRO);
+}
+
+/* Reproducir una pista de una hoja CUE. Con el índice de frames del fichero
+ * (que se amplía sólo hasta el final de la pista y se conserva mientras se
+ * reproduzca el mismo fichero) se busca el frame de su INDEX 01 y se empieza
+ * REPRODUCTOR_FRAMES_PREVIOS frames antes, que se decodifican sin oírse. Se
+ * muestra lo que ha costado el índice y lo que ha costado localizar el
+ * principio y el final de la pista, que incluye ampliar el índice.*/
+static void reproducir_pista_cue(uint32_t numero)
+{
+    static FIL fichero;
+    const cue_pista_t *pista = cue_leer_pista(numero);
+    const char *ruta = cue_cadena(pista->fichero);
+    frames_estadisticas_t estadisticas_frames;
+    uint32_t frame;
+    uint32_t previos;
+    uint32_t inicio;
+    uint32_t fin = REPRODUCTOR_HASTA_FINAL;
+    uint32_t ciclos;
+    uint32_t salto_us;
+
+    glcd_borrar(NEGRO);
+
+    if (f_open(&fichero, ruta, FA_READ) != FR_OK)
+    {
+        glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Error al abrir");
+        glcd_xprintf(0, 32, WHITE, BLACK, FONT8X16, "%s", ruta);
+        tec4x4_esperar_pulsacion();
+        glcd_borrar(NEGRO);
+        return;
+    }
 
+    glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Indexando frames...");
+    if (frames_construir(&fichero, ruta) != FR_OK ||
+        frames_numero_frames() == 0)
+    {
+        glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Error en los frames");
+        tec4x4_esperar_pulsacion();
+        f_close(&fichero);
+        glcd_borrar(NEGRO);
+        return;
+    }
+
+    ciclos = ciclos_leer();
+    frame = frames_frame_en(cue_milisegundos(pista->inicio));
+    previos = frames_previos(frame);
+    frames_posicion(&fichero, frame - previos, &inicio);
+    if (pista->fin != CUE_HASTA_FINAL)
+    {
+        frames_posicion(&fichero,
+                        frames_frame_en(cue_milisegundos(pista->fin)),
+                        &fin);
+    }
+    salto_us = ciclos_a_microsegundos(ciclos_leer() - ciclos);
+    frames_leer_estadisticas(&estadisticas_frames);
+
+    glcd_borrar(NEGRO);
+    glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Reproduciendo...");
+    glcd_xprintf(0, 32, WHITE, BLACK, FONT16X32, "%s",
+                 cue_cadena(pista->titulo));
+    glcd_xprintf(0, 96, WHITE, BLACK, FONT8X16,
+                 "CUE: pista %u de %s, frame %u",
+                 pista->numero, cue_cadena(pista->interprete), frame);
+    glcd_xprintf(0, 112, WHITE, BLACK, FONT8X16,
+                 "Frames: %u en %u ms (1 de %u), salto %u us",
+                 estadisticas_frames.frames,
+                 estadisticas_frames.microsegundos_construccion/1000,
+                 estadisticas_frames.intervalo,
+                 salto_us);
+
+    reproducir(&fichero, ruta, inicio, fin, frame, previos);
+    f_close(&fichero);
+
+    glcd_borrar(NEGRO);
+}
 
 int main(){
     FATFS fs;           /* Estructura donde FatFs mantendr� la informaci�n
@@ -41,15 +261,18 @@ int main(){
                          * fichero abierto.
                          */
       	
-    DIR dir;            /* Directory search object */
-		
-    FILINFO flinfo;     /* File information */
+    biblio_estadisticas_t estadisticas_biblio;
+    busq_estadisticas_t estadisticas_busqueda;
     
     /* Inicializar y borrar el LCD.*/  
   
     glcd_inicializar();
     glcd_borrar(NEGRO);
 
+    //Generar en la SDRAM (ya inicializada por glcd_inicializar) los efectos
+    //de sonido que se mezclan con la musica al pulsar teclas
+    efecto_inicializar();
+
     //Inicializar teclado
     tec4x4_inicializar();
 
@@ -63,100 +286,138 @@ int main(){
   	rtc_ajustar_fecha(07,06,2021);
   	rtc_ajustar_hora(11,00,00);
 
+    //contador de ciclos usado para medir el coste del procesado de audio y,
+    //como base de tiempos común, la duración de las operaciones con la
+    //tarjeta (la primera es la medida de velocidad al montarla)
+    ciclos_inicializar();
+
     /* Montar el sistema de archivos.*/	
-    fresult = f_mount(&fs, "", 0);
+    /* Se monta inmediatamente para que la tarjeta se inicialice ahora y
+     * poder mostrar la frecuencia del bus y la velocidad de lectura
+     * conseguidas.*/
+    fresult = f_mount(&fs, "", 1);
     ASSERT(fresult == FR_OK, "Error al montar el sistema de ficheros");
+
+    glcd_xprintf(0, GLCD_TAMANO_Y - 16, WHITE, BLACK, FONT8X16,
+                 "SD%s: %u kHz%s, lectura %u KB/s",
+                 disco_interfaz() == DISCO_INTERFAZ_SPI ? " (SPI)" : "",
+                 disco_frecuencia_bus()/1000,
+                 disco_interfaz() == DISCO_INTERFAZ_MCI && sd_alta_velocidad() ?
+                 " (High Speed)" : "",
+                 disco_velocidad_lectura());
 		
 		//inicializamos los timers que harán falta para la reproducción 
 		timer_inicializar(TIMER0);
 		timer_inicializar(TIMER1);
 		timer_inicializar(TIMER2);
 
-    
-    /* Listar los ficheros mp3 en la tarjeta SD y reproducir la seleccionada*/
-    while(TRUE){
+    /* Si se cortó la alimentación a mitad de un fichero, seguir por donde
+     * iba. El índice de frames se reserva antes porque con él se localiza
+     * el punto de reanudación.*/
+    ASSERT(frames_inicializar(), "No hay SDRAM para el indice de frames");
+    reanudar();
 
-        FRESULT fr, fr2;
+    /* Cargar el índice de la biblioteca guardado en la tarjeta y ponerlo al
+     * día. Sólo se analizan los ficheros nuevos o modificados desde el
+     * último arranque. Se muestra el tiempo que ha costado.*/
+    ASSERT(biblio_inicializar(), "No hay SDRAM para la biblioteca");
+    biblio_cargar();
+    fresult = biblio_actualizar();
+    ASSERT(fresult == FR_OK, "Error al actualizar la biblioteca");
 
-        //numero para la siguiente fila en el LCD
-        int32_t y = 96;
+    /* Índice de la búsqueda por teclas de títulos y artistas.*/
+    ASSERT(busq_inicializar(), "No hay SDRAM para la busqueda");
+    busq_construir();
 
-        //numero de la pista
-        uint32_t numPista = 0;
+    /* Buscar las listas de reproducción (.m3u y .m3u8).*/
+    ASSERT(lista_inicializar(), "No hay SDRAM para las listas");
+    lista_buscar();
 
-        //estructura
-        pista p[10];
+    /* Buscar las hojas CUE.*/
+    ASSERT(cue_inicializar(), "No hay SDRAM para las hojas CUE");
+    cue_buscar();
 
-				//valor char de lo que introducimos por teclado
-        char buffOp[2];
+    biblio_leer_estadisticas(&estadisticas_biblio);
+    busq_leer_estadisticas(&estadisticas_busqueda);
+    glcd_xprintf(0, GLCD_TAMANO_Y - 32, WHITE, BLACK, FONT8X16,
+                 "Biblio: %u pistas (%u nuevas) %u ms, orden %u us/1000",
+                 biblio_numero_pistas(),
+                 estadisticas_biblio.pistas_analizadas,
+                 (estadisticas_biblio.microsegundos_carga +
+                  estadisticas_biblio.microsegundos_actualizacion)/1000,
+                 estadisticas_biblio.microsegundos_ordenacion_por_mil);
 
-        //cancion seleccionada
-        char seleccion[255];
-			
-				//numero acorde a la cancion
-				char num[1];
-			
-				//valor entero de lo que introducimos por teclado
-				int op;
+    /* Una tarjeta llena o protegida contra escritura, o una carpeta dañada,
+     * no impiden usar la biblioteca: en lugar de los datos del recorrido se
+     * muestra un aviso.*/
+    if (estadisticas_biblio.error_ordenacion != FR_OK ||
+        estadisticas_biblio.error_guardado != FR_OK ||
+        estadisticas_biblio.directorios_ilegibles != 0)
+    {
+        glcd_xprintf(0, GLCD_TAMANO_Y - 48, YELLOW, BLACK, FONT8X16,
+                     "Aviso: indice %s, %u dirs ilegibles",
+                     estadisticas_biblio.error_ordenacion != FR_OK ?
+                     "sin ordenar" :
+                     estadisticas_biblio.error_guardado != FR_OK ?
+                     "sin guardar" : "correcto",
+                     estadisticas_biblio.directorios_ilegibles);
+    }
+    else
+    {
+        glcd_xprintf(0, GLCD_TAMANO_Y - 48, WHITE, BLACK, FONT8X16,
+                     "Explorado: %u entradas, %u dirs, %u/s; T9 %u ms",
+                     estadisticas_biblio.entradas_exploradas,
+                     estadisticas_biblio.directorios_explorados,
+                     estadisticas_biblio.entradas_por_segundo,
+                     estadisticas_busqueda.microsegundos_construccion/1000);
+    }
 
-        glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "  <-Cancion seleccionada");
+    
+    /* Listar los ficheros mp3 en la tarjeta SD y reproducir la seleccionada*/
+    while(TRUE){
 
-        glcd_xprintf(0, 64, WHITE, BLACK, FONT16X32, "Listado de canciones:");
+        FRESULT fr2;
 
-        //buscamos en la tarjeta SD solo los archivos que tengan extension .mp3
-        fr = f_findfirst(&dir, &flinfo, "", "*.mp3");
+        //numero de la pista elegida en la biblioteca
+        uint32_t indice;
 
-        while (fr == FR_OK && flinfo.fname[0] && y < 225){
-            //guardamos el numero de las pistas
-            p[numPista].numero = numPista + 1;
-            //guardamos el nombre de las pistas
-            strcpy(p[numPista].nombre, flinfo.fname);
-					
-						sprintf(num, "%d", numPista + 1);
-						strcat(num, ".");
-						
-						//imprimimos el numero de la cancion
-						glcd_xprintf(0, y, WHITE, BLACK, FONT16X32, num);
-            //imprimimos el titulo de la cancion.mp3
-            glcd_xprintf(35, y, WHITE, BLACK, FONT16X32, flinfo.fname);
+        //cancion seleccionada (ruta guardada en la biblioteca)
+        const char *seleccion;
 
-            fr = f_findnext(&dir, &flinfo);
+        //lista paginada de la biblioteca; se elige con el teclado
+        indice = nav_elegir_pista();
+        if (indice == NAV_NINGUNA) continue;
 
-            y += 32;
-            numPista++;
+        if (indice & NAV_LISTA)
+        {
+            reproducir_lista(indice & ~NAV_LISTA);
+            continue;
         }
 
-        //Termina la lectura cuando se pulsa '#'
-        tec4x4_leer_cadena_numeros(buffOp, 2);
-
-        //pasamos a entero el valor que hemos leido por teclado
-        op = atoi(buffOp);
-
-        //varible para salir del bucle
-        uint32_t x = 0;
+        if (indice & NAV_CUE)
+        {
+            reproducir_pista_cue(indice & ~NAV_CUE);
+            continue;
+        }
 
-        while (x != 1) {
-            glcd_borrar(NEGRO);
+        seleccion = biblio_cadena(biblio_leer_pista(indice)->ruta);
 
-            //copiamos en la variable seleccion la pista que este en la posicion que hemos leido por teclado
-            strcpy(seleccion, p[op - 1].nombre);
+        glcd_borrar(NEGRO);
 
-            glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Reproduciendo...");
-            //imprimimos la pista que estamos reproduciendo
-            glcd_xprintf(0, 32, WHITE, BLACK, FONT16X32, seleccion);
+        glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "Reproduciendo...");
+        //imprimimos la pista que estamos reproduciendo
+        glcd_xprintf(0, 32, WHITE, BLACK, FONT16X32, "%s", seleccion);
 
-            //FA_OPEN_EXISTING no lo ponemos porque viene por defecto
-            //abrimos el archivo con el nombre de la pista que hemos elegido
-            //y lo guardamos en el fichero vacio
-            fr2 = f_open(&fichero, seleccion, FA_READ);
-            ASSERT(fr2 == FR_OK, "Error al abrir el archivo .mp3");
+        //FA_OPEN_EXISTING no lo ponemos porque viene por defecto
+        //abrimos el archivo con el nombre de la pista que hemos elegido
+        //y lo guardamos en el fichero vacio
+        fr2 = f_open(&fichero, seleccion, FA_READ);
+        ASSERT(fr2 == FR_OK, "Error al abrir el archivo .mp3");
 
-            reproducir_mp3(&fichero);
+        reproducir(&fichero, seleccion, 0, REPRODUCTOR_HASTA_FINAL, 0, 0);
 
-            f_close(&fichero);
+        f_close(&fichero);
 
-            x = 1;
-        }
         glcd_borrar(NEGRO);
     }
 }
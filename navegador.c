@@ -0,0 +1,396 @@
+/***************************************************************************//**
+ * \file    navegador.c
+ *
+ * \brief   Lista paginada de las pistas de la biblioteca para elegir desde el
+ *          teclado la que se va a reproducir.
+ *
+ *          Las pistas se muestran segn una de las vistas ordenadas de la
+ *          biblioteca. Los nombres no se copian: cada fila se obtiene del
+ *          ndice de la biblioteca, que guarda en la SDRAM una tabla de
+ *          entradas con el desplazamiento de cada cadena en una arena comn
+ *          y las vistas como permutaciones de esa tabla. As la lista
+ *          admite tantas pistas como el ndice y cambiar de pgina cuesta
+ *          siempre lo mismo: se redibujan slo las NAV_FILAS filas visibles,
+ *          cada una sobre su propio fondo, sin borrar la pantalla (las lneas
+ *          de debajo de la lista quedan como estaban). Al mover la seleccin
+ *          dentro de la pgina slo se redibujan las dos filas afectadas.
+ *
+ *          Despus de las vistas ordenadas est la de bsqueda, que lista
+ *          las pistas cuyo ttulo o artista empieza por las letras de las
+ *          teclas pulsadas (ver busqueda.c), la de las listas de
+ *          reproduccin de la tarjeta y la de las pistas de las hojas CUE.
+ *
+ *          Teclas:
+ *              'A' / 'B'   fila anterior / siguiente.
+ *              'C' / 'D'   pgina anterior / siguiente.
+ *              '0'...'9'   escribir un nmero de pista o, en la vista de
+ *                          bsqueda, aadir una tecla a la bsqueda.
+ *              '*'         borrar el nmero escrito (o la ltima tecla de la
+ *                          bsqueda) o, si no hay ninguno, pasar a la
+ *                          siguiente vista (nombre, artista, lbum, nmero
+ *                          de pista, bsqueda, listas, CUE).
+ *              '#'         reproducir la pista (o lista) con el nmero
+ *                          escrito o, si no se ha escrito ninguno, la
+ *                          seleccionada.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "navegador.h"
+#include "biblioteca.h"
+#include "busqueda.h"
+#include "lista_reproduccion.h"
+#include "hoja_cue.h"
+#include "teclado_4x4.h"
+#include "glcd.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define MAXIMO_DIGITOS      5u
+
+/* Vistas de bsqueda, de listas de reproduccin y de pistas de las hojas
+ * CUE, a continuacin de las vistas ordenadas de la biblioteca.
+ */
+#define VISTA_BUSQUEDA      BIBLIO_NUMERO_ORDENES
+#define VISTA_LISTAS        (BIBLIO_NUMERO_ORDENES + 1u)
+#define VISTA_CUE           (BIBLIO_NUMERO_ORDENES + 2u)
+#define NUMERO_VISTAS       (BIBLIO_NUMERO_ORDENES + 3u)
+
+/*===== Variables privadas =====================================================
+ */
+
+/* Vista mostrada y posiciones en ella de la pista seleccionada y de la
+ * primera de la pgina visible. Se conservan entre llamadas para volver a la
+ * lista en el mismo sitio.
+ */
+static uint32_t orden = BIBLIO_ORDEN_NOMBRE;
+static uint32_t seleccionada = 0;
+static uint32_t primera_visible = 0;
+
+static const char * const nombres_ordenes[NUMERO_VISTAS] = {
+    "nombre", "artista", "album", "pista", "buscar", "listas", "cue"
+};
+
+/* Nmero de pista que se est escribiendo con el teclado.
+ */
+static char numero[MAXIMO_DIGITOS + 1];
+static uint32_t numero_digitos = 0;
+
+static uint32_t longitud_vista(void);
+static uint32_t pista_en_posicion(uint32_t posicion);
+static void dibujar_cabecera(uint32_t numero_pistas);
+static void dibujar_pagina(uint32_t numero_pistas);
+static void dibujar_fila(uint32_t posicion, uint32_t numero_pistas);
+
+/***************************************************************************//**
+ * \brief   Volver al principio de la lista. Debe llamarse si cambia el
+ *          contenido de la biblioteca.
+ */
+void nav_inicializar(void)
+{
+    seleccionada = 0;
+    primera_visible = 0;
+}
+
+/***************************************************************************//**
+ * \brief   Mostrar la lista de pistas y esperar a que se elija una con el
+ *          teclado.
+ *
+ * \return  Nmero de la pista elegida (para biblio_leer_pista), nmero de
+ *          la lista de reproduccin elegida (para lista_abrir) ms NAV_LISTA,
+ *          nmero de la pista CUE elegida (para cue_leer_pista) ms NAV_CUE
+ *          o NAV_NINGUNA si no hay pistas ni listas (en ese caso se muestra
+ *          un aviso y se espera a que se pulse una tecla).
+ */
+uint32_t nav_elegir_pista(void)
+{
+    uint32_t numero_pistas;
+    uint32_t anterior;
+    uint32_t valor;
+    char tecla;
+
+    if (biblio_numero_pistas() == 0 && lista_numero_listas() == 0 &&
+        cue_numero_pistas() == 0)
+    {
+        glcd_borrar(NEGRO);
+        glcd_xprintf(0, 0, WHITE, BLACK, FONT16X32, "No hay canciones");
+        tec4x4_esperar_pulsacion();
+        return NAV_NINGUNA;
+    }
+
+    numero_pistas = longitud_vista();
+    if (seleccionada >= numero_pistas) nav_inicializar();
+
+    numero_digitos = 0;
+    numero[0] = '\0';
+    dibujar_pagina(numero_pistas);
+
+    while (TRUE)
+    {
+        tecla = tec4x4_esperar_pulsacion();
+        anterior = seleccionada;
+
+        switch (tecla)
+        {
+        case 'A':
+            if (numero_pistas == 0) break;
+            seleccionada = seleccionada > 0 ? seleccionada - 1 : numero_pistas - 1;
+            break;
+
+        case 'B':
+            seleccionada = seleccionada + 1 < numero_pistas ? seleccionada + 1 : 0;
+            break;
+
+        case 'C':
+            seleccionada = seleccionada >= NAV_FILAS ? seleccionada - NAV_FILAS : 0;
+            break;
+
+        case 'D':
+            if (numero_pistas == 0) break;
+            seleccionada = seleccionada + NAV_FILAS < numero_pistas ?
+                           seleccionada + NAV_FILAS : numero_pistas - 1;
+            break;
+
+        case '*':
+            if (orden == VISTA_BUSQUEDA && busq_teclas()[0] != '\0')
+            {
+                busq_borrar_tecla();
+                numero_pistas = longitud_vista();
+                nav_inicializar();
+                dibujar_pagina(numero_pistas);
+                anterior = seleccionada;
+            }
+            else if (numero_digitos == 0)
+            {
+                orden = (orden + 1u) % NUMERO_VISTAS;
+                if (orden == VISTA_BUSQUEDA) busq_reiniciar();
+                numero_pistas = longitud_vista();
+                nav_inicializar();
+                dibujar_pagina(numero_pistas);
+                anterior = seleccionada;
+            }
+            else
+            {
+                numero_digitos = 0;
+                numero[0] = '\0';
+                dibujar_cabecera(numero_pistas);
+            }
+            break;
+
+        case '#':
+            if (numero_digitos == 0)
+            {
+                if (numero_pistas == 0) break;
+                return pista_en_posicion(seleccionada);
+            }
+
+            valor = (uint32_t)atoi(numero);
+            numero_digitos = 0;
+            numero[0] = '\0';
+
+            if (valor >= 1 && valor <= numero_pistas)
+            {
+                /* La pgina de la pista elegida es la que se dibuja al
+                 * volver al navegador.
+                 */
+                seleccionada = valor - 1;
+                primera_visible = seleccionada - seleccionada % NAV_FILAS;
+                return pista_en_posicion(seleccionada);
+            }
+
+            dibujar_cabecera(numero_pistas);
+            break;
+
+        default:
+            if (tecla < '0' || tecla > '9') break;
+
+            if (orden == VISTA_BUSQUEDA)
+            {
+                if (busq_anadir_tecla(tecla))
+                {
+                    numero_pistas = longitud_vista();
+                    nav_inicializar();
+                    dibujar_pagina(numero_pistas);
+                    anterior = seleccionada;
+                }
+            }
+            else if (numero_digitos < MAXIMO_DIGITOS)
+            {
+                numero[numero_digitos++] = tecla;
+                numero[numero_digitos] = '\0';
+                dibujar_cabecera(numero_pistas);
+            }
+            break;
+        }
+
+        /* Si la vista se ha redibujado entera, anterior se iguala a
+         * seleccionada para no volver a dibujar filas que pueden no existir
+         * en la vista nueva.
+         */
+        if (seleccionada == anterior) continue;
+
+        if (seleccionada >= primera_visible &&
+            seleccionada < primera_visible + NAV_FILAS)
+        {
+            dibujar_fila(anterior, numero_pistas);
+            dibujar_fila(seleccionada, numero_pistas);
+        }
+        else
+        {
+            primera_visible = seleccionada - seleccionada % NAV_FILAS;
+            dibujar_pagina(numero_pistas);
+        }
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de filas de la vista mostrada: todas las pistas en las
+ *          vistas ordenadas, los resultados en la de bsqueda, las listas
+ *          de reproduccin o las pistas de las hojas CUE.
+ */
+static uint32_t longitud_vista(void)
+{
+    if (orden == VISTA_BUSQUEDA) return busq_numero_resultados();
+    if (orden == VISTA_LISTAS) return lista_numero_listas();
+    if (orden == VISTA_CUE) return cue_numero_pistas();
+
+    return biblio_numero_pistas();
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de la pista (para biblio_leer_pista) de una posicin de la
+ *          vista mostrada o, en la de listas, nmero de la lista ms
+ *          NAV_LISTA y, en la de hojas CUE, nmero de la pista ms NAV_CUE.
+ */
+static uint32_t pista_en_posicion(uint32_t posicion)
+{
+    if (orden == VISTA_BUSQUEDA) return busq_resultado(posicion);
+    if (orden == VISTA_LISTAS) return NAV_LISTA | posicion;
+    if (orden == VISTA_CUE) return NAV_CUE | posicion;
+
+    return biblio_pista_ordenada(orden, posicion);
+}
+
+/***************************************************************************//**
+ * \brief   Dibujar la lnea superior con el nmero de pistas, la vista, la
+ *          pgina visible y el nmero de pista que se est escribiendo. En
+ *          la vista de bsqueda se muestran las teclas pulsadas y lo que ha
+ *          tardado la ltima.
+ */
+static void dibujar_cabecera(uint32_t numero_pistas)
+{
+    busq_estadisticas_t estadisticas;
+
+    if (orden == VISTA_BUSQUEDA)
+    {
+        busq_leer_estadisticas(&estadisticas);
+        glcd_xprintf(0, 0, WHITE, BLACK, FONT8X16,
+                     "%-6u Buscar: %-16s Ultima tecla: %4u us",
+                     numero_pistas,
+                     busq_teclas(),
+                     estadisticas.microsegundos_ultima_tecla);
+        return;
+    }
+
+    glcd_xprintf(0, 0, WHITE, BLACK, FONT8X16,
+                 "%-6u Orden: %-7s Pagina %5u/%-5u Pista: %-5s",
+                 numero_pistas,
+                 nombres_ordenes[orden],
+                 primera_visible/NAV_FILAS + 1,
+                 (numero_pistas + NAV_FILAS - 1)/NAV_FILAS,
+                 numero);
+}
+
+/***************************************************************************//**
+ * \brief   Dibujar la cabecera y todas las filas de la pgina visible.
+ */
+static void dibujar_pagina(uint32_t numero_pistas)
+{
+    uint32_t i;
+
+    dibujar_cabecera(numero_pistas);
+
+    for (i = primera_visible; i < primera_visible + NAV_FILAS; i++)
+    {
+        dibujar_fila(i, numero_pistas);
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Dibujar la fila de una posicin de la pgina visible, o en blanco si
+ *          la pgina no llega a esa fila. La fila se rellena con espacios
+ *          hasta el ancho del LCD para tapar el texto que hubiera antes. Si
+ *          la pista tiene ttulo se muestran artista y ttulo; si no, la
+ *          ruta del fichero. De las listas se muestra la ruta y de las
+ *          pistas CUE el intrprete y el ttulo o, si no tienen, el fichero
+ *          y el nmero de pista.
+ */
+static void dibujar_fila(uint32_t posicion, uint32_t numero_pistas)
+{
+    char texto[NAV_CARACTERES_FILA + 1];
+    const biblio_pista_t *entrada;
+    const cue_pista_t *pista_cue;
+    uint32_t y = NAV_Y_PRIMERA_FILA + (posicion - primera_visible)*NAV_ALTO_FILA;
+    uint32_t n = 0;
+    bool_t marcada = posicion == seleccionada;
+
+    if (posicion < numero_pistas && orden == VISTA_LISTAS)
+    {
+        n = (uint32_t)snprintf(texto, sizeof(texto), "%5u. %s",
+                               posicion + 1, lista_nombre(posicion));
+
+        if (n > NAV_CARACTERES_FILA) n = NAV_CARACTERES_FILA;
+    }
+    else if (posicion < numero_pistas && orden == VISTA_CUE)
+    {
+        pista_cue = cue_leer_pista(posicion);
+
+        if (pista_cue->titulo != 0)
+        {
+            n = (uint32_t)snprintf(texto, sizeof(texto), "%5u. %s - %s",
+                                   posicion + 1,
+                                   cue_cadena(pista_cue->interprete),
+                                   cue_cadena(pista_cue->titulo));
+        }
+        else
+        {
+            n = (uint32_t)snprintf(texto, sizeof(texto), "%5u. %s #%u",
+                                   posicion + 1,
+                                   cue_cadena(pista_cue->fichero),
+                                   pista_cue->numero);
+        }
+
+        if (n > NAV_CARACTERES_FILA) n = NAV_CARACTERES_FILA;
+    }
+    else if (posicion < numero_pistas)
+    {
+        entrada = biblio_leer_pista(pista_en_posicion(posicion));
+
+        if (entrada->titulo != 0)
+        {
+            n = (uint32_t)snprintf(texto, sizeof(texto), "%5u. %s - %s",
+                                   posicion + 1,
+                                   biblio_cadena(entrada->artista),
+                                   biblio_cadena(entrada->titulo));
+        }
+        else
+        {
+            n = (uint32_t)snprintf(texto, sizeof(texto), "%5u. %s",
+                                   posicion + 1,
+                                   biblio_cadena(entrada->ruta));
+        }
+
+        if (n > NAV_CARACTERES_FILA) n = NAV_CARACTERES_FILA;
+    }
+
+    memset(&texto[n], ' ', NAV_CARACTERES_FILA - n);
+    texto[NAV_CARACTERES_FILA] = '\0';
+
+    glcd_texto(0, (int32_t)y,
+               marcada ? BLACK : WHITE,
+               marcada ? WHITE : BLACK,
+               FONT8X16, texto);
+}
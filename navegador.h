@@ -0,0 +1,41 @@
+/***************************************************************************//**
+ * \file    navegador.h
+ *
+ * \brief   Lista paginada de las pistas de la biblioteca para elegir desde el
+ *          teclado la que se va a reproducir.
+ */
+
+#ifndef NAVEGADOR_H
+#define NAVEGADOR_H
+
+#include "tipos.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Filas de la lista que caben en una pgina y posicin de la primera. Por
+ * debajo quedan tres lneas con los datos de la tarjeta y la biblioteca.
+ */
+#define NAV_FILAS               12u
+#define NAV_Y_PRIMERA_FILA      32u
+#define NAV_ALTO_FILA           16u
+
+/* Caracteres de cada fila (el ancho del LCD con el font de 8x16).
+ */
+#define NAV_CARACTERES_FILA     60u
+
+/* Valor devuelto por nav_elegir_pista si no hay nada que elegir y bits que
+ * indican que lo elegido es una lista de reproduccin o una pista de una hoja
+ * CUE.
+ */
+#define NAV_NINGUNA             0xFFFFFFFFu
+#define NAV_LISTA               0x80000000u
+#define NAV_CUE                 0x40000000u
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void nav_inicializar(void);
+uint32_t nav_elegir_pista(void);
+
+#endif  /* NAVEGADOR_H */
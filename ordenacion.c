@@ -0,0 +1,263 @@
+/***************************************************************************//**
+ * \file    ordenacion.c
+ *
+ * \brief   Ordenacin estable de listas de ndices en la SDRAM. Si no hay
+ *          SDRAM para la memoria de trabajo completa se usa una memoria
+ *          acotada y la tarjeta SD como almacenamiento intermedio.
+ *
+ *          La primera vez se intenta reservar una memoria de trabajo de
+ *          ORDEN_MAXIMO_TRAMOS*ORDEN_ELEMENTOS_TRAMO elementos. Si se
+ *          consigue, toda la lista se ordena en su sitio por mezcla usando
+ *          esa memoria como auxiliar y la tarjeta no se usa nunca.
+ *
+ *          Si no, se reservan slo 2*ORDEN_ELEMENTOS_TRAMO elementos. Las
+ *          listas que no caben en ellos se dividen en tramos de
+ *          ORDEN_ELEMENTOS_TRAMO elementos que se ordenan en su sitio por
+ *          mezcla, usando la memoria de trabajo como auxiliar. Despus la
+ *          lista con los tramos ordenados se vuelca al fichero temporal y
+ *          se mezclan todos a la vez: la memoria de trabajo se reparte entre
+ *          los tramos como buffers de lectura, que se rellenan del fichero
+ *          cuando se vacan, y el resultado se escribe de nuevo en la lista
+ *          original. As la memoria necesaria no depende de la longitud de la
+ *          lista.
+ *
+ *          Con elementos iguales se conserva el orden original, tanto dentro
+ *          de los tramos como en la mezcla (a igualdad gana el tramo
+ *          anterior).
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include "ordenacion.h"
+#include "sdram.h"
+#include "error.h"
+
+/*===== Tipos privados =========================================================
+ */
+
+/* Estado de un tramo durante la mezcla.
+ */
+typedef struct {
+    uint16_t *buffer;
+    uint32_t posicion_fichero;      /* Siguiente elemento a leer del fichero. */
+    uint32_t restantes_fichero;
+    uint32_t leidos;                /* Elementos vlidos en el buffer. */
+    uint32_t siguiente;             /* Siguiente elemento del buffer. */
+} tramo_t;
+
+/*===== Variables privadas =====================================================
+ */
+
+/* Memoria de trabajo en la SDRAM, reservada la primera vez, y nmero de
+ * elementos que caben en ella.
+ */
+static uint16_t *trabajo = NULL;
+static uint32_t elementos_trabajo = 0;
+
+static tramo_t tramos[ORDEN_MAXIMO_TRAMOS];
+
+static void ordenar_tramo(uint16_t *elementos,
+                          uint32_t numero_elementos,
+                          orden_funcion_comparar_t comparar);
+static FRESULT rellenar_tramo(FIL *fichero, tramo_t *tramo, uint32_t capacidad);
+
+/***************************************************************************//**
+ * \brief       Ordenar una lista de elementos de 16 bits (normalmente ndices
+ *              a otra tabla) segn una funcin de comparacin.
+ *
+ * \param[in]   elementos           lista a ordenar en su sitio.
+ * \param[in]   numero_elementos    longitud de la lista.
+ * \param[in]   comparar            funcin de comparacin.
+ * \param[out]  numero_tramos       nmero de tramos en que se ha dividido
+ *                                  (1 => se ha ordenado en la SDRAM sin
+ *                                  usar la tarjeta). Puede ser NULL.
+ *
+ * \return      Resultado de FatFs de las operaciones sobre el fichero
+ *              temporal. Si no es FR_OK el contenido de la lista no es
+ *              vlido.
+ */
+FRESULT orden_ordenar(uint16_t *elementos,
+                      uint32_t numero_elementos,
+                      orden_funcion_comparar_t comparar,
+                      uint32_t *numero_tramos)
+{
+    FIL fichero;
+    FRESULT fr;
+    UINT escritos;
+    uint32_t k;
+    uint32_t i;
+    uint32_t t;
+    uint32_t mejor;
+    uint32_t capacidad;
+    uint32_t inicio;
+
+    ASSERT(numero_elementos <= ORDEN_MAXIMO_TRAMOS*ORDEN_ELEMENTOS_TRAMO,
+           "Lista demasiado larga para ordenar.");
+
+    if (trabajo == NULL)
+    {
+        elementos_trabajo = ORDEN_MAXIMO_TRAMOS*ORDEN_ELEMENTOS_TRAMO;
+        trabajo = sdram_reservar(elementos_trabajo*sizeof(uint16_t));
+        if (trabajo == NULL)
+        {
+            elementos_trabajo = 2u*ORDEN_ELEMENTOS_TRAMO;
+            trabajo = sdram_reservar(elementos_trabajo*sizeof(uint16_t));
+        }
+        ASSERT(trabajo != NULL, "No hay SDRAM para ordenar.");
+    }
+
+    /* Si la memoria de trabajo basta como auxiliar, se ordena toda la lista
+     * de una vez.
+     */
+    if (numero_elementos <= elementos_trabajo)
+    {
+        ordenar_tramo(elementos, numero_elementos, comparar);
+        if (numero_tramos != NULL) *numero_tramos = 1;
+        return FR_OK;
+    }
+
+    k = (numero_elementos + ORDEN_ELEMENTOS_TRAMO - 1u)/ORDEN_ELEMENTOS_TRAMO;
+    if (numero_tramos != NULL) *numero_tramos = k;
+
+    for (inicio = 0; inicio < numero_elementos; inicio += ORDEN_ELEMENTOS_TRAMO)
+    {
+        ordenar_tramo(&elementos[inicio],
+                      numero_elementos - inicio < ORDEN_ELEMENTOS_TRAMO ?
+                      numero_elementos - inicio : ORDEN_ELEMENTOS_TRAMO,
+                      comparar);
+    }
+
+    /* Volcar los tramos ordenados al fichero temporal.
+     */
+    fr = f_open(&fichero, ORDEN_FICHERO_TEMPORAL,
+                FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK) return fr;
+
+    fr = f_write(&fichero, elementos, numero_elementos*sizeof(uint16_t), &escritos);
+    if (fr == FR_OK && escritos != numero_elementos*sizeof(uint16_t)) fr = FR_DENIED;
+
+    /* Repartir la memoria de trabajo entre los tramos y mezclarlos. En cada
+     * paso se elige el menor de los primeros elementos de los tramos.
+     */
+    capacidad = elementos_trabajo/k;
+
+    for (t = 0; t < k; t++)
+    {
+        tramos[t].buffer = &trabajo[t*capacidad];
+        tramos[t].posicion_fichero = t*ORDEN_ELEMENTOS_TRAMO;
+        tramos[t].restantes_fichero = t + 1u < k ? ORDEN_ELEMENTOS_TRAMO :
+                                      numero_elementos - t*ORDEN_ELEMENTOS_TRAMO;
+        tramos[t].leidos = 0;
+        tramos[t].siguiente = 0;
+    }
+
+    for (i = 0; fr == FR_OK && i < numero_elementos; i++)
+    {
+        mejor = k;
+
+        for (t = 0; t < k && fr == FR_OK; t++)
+        {
+            if (tramos[t].siguiente == tramos[t].leidos)
+            {
+                if (tramos[t].restantes_fichero == 0) continue;
+                fr = rellenar_tramo(&fichero, &tramos[t], capacidad);
+            }
+
+            if (mejor == k ||
+                comparar(tramos[t].buffer[tramos[t].siguiente],
+                         tramos[mejor].buffer[tramos[mejor].siguiente]) < 0)
+            {
+                mejor = t;
+            }
+        }
+
+        if (fr != FR_OK) break;
+
+        elementos[i] = tramos[mejor].buffer[tramos[mejor].siguiente++];
+    }
+
+    f_close(&fichero);
+    f_unlink(ORDEN_FICHERO_TEMPORAL);
+
+    return fr;
+}
+
+/***************************************************************************//**
+ * \brief   Ordenar un tramo en su sitio por mezcla ascendente (primero
+ *          parejas, luego grupos de 4, ...), usando la memoria de trabajo
+ *          como auxiliar. En cada pasada se mezcla de la lista al auxiliar o
+ *          al revs, y al final se copia a la lista si hace falta.
+ */
+static void ordenar_tramo(uint16_t *elementos,
+                          uint32_t numero_elementos,
+                          orden_funcion_comparar_t comparar)
+{
+    uint16_t *origen = elementos;
+    uint16_t *destino = trabajo;
+    uint16_t *aux;
+    uint32_t ancho;
+    uint32_t inicio;
+    uint32_t medio;
+    uint32_t fin;
+    uint32_t i;
+    uint32_t j;
+    uint32_t n;
+
+    for (ancho = 1; ancho < numero_elementos; ancho *= 2u)
+    {
+        for (inicio = 0; inicio < numero_elementos; inicio += 2u*ancho)
+        {
+            medio = inicio + ancho < numero_elementos ? inicio + ancho : numero_elementos;
+            fin = medio + ancho < numero_elementos ? medio + ancho : numero_elementos;
+
+            i = inicio;
+            j = medio;
+            for (n = inicio; n < fin; n++)
+            {
+                if (i < medio && (j >= fin || comparar(origen[i], origen[j]) <= 0))
+                {
+                    destino[n] = origen[i++];
+                }
+                else
+                {
+                    destino[n] = origen[j++];
+                }
+            }
+        }
+
+        aux = origen;
+        origen = destino;
+        destino = aux;
+    }
+
+    if (origen != elementos)
+    {
+        memcpy(elementos, origen, numero_elementos*sizeof(uint16_t));
+    }
+}
+
+/***************************************************************************//**
+ * \brief   Leer del fichero temporal los siguientes elementos de un tramo.
+ */
+static FRESULT rellenar_tramo(FIL *fichero, tramo_t *tramo, uint32_t capacidad)
+{
+    FRESULT fr;
+    UINT leidos;
+    uint32_t n = tramo->restantes_fichero < capacidad ?
+                 tramo->restantes_fichero : capacidad;
+
+    fr = f_lseek(fichero, tramo->posicion_fichero*sizeof(uint16_t));
+    if (fr == FR_OK)
+    {
+        fr = f_read(fichero, tramo->buffer, n*sizeof(uint16_t), &leidos);
+    }
+    if (fr == FR_OK && leidos != n*sizeof(uint16_t)) fr = FR_INT_ERR;
+    if (fr != FR_OK) return fr;
+
+    tramo->posicion_fichero += n;
+    tramo->restantes_fichero -= n;
+    tramo->leidos = n;
+    tramo->siguiente = 0;
+
+    return FR_OK;
+}
@@ -0,0 +1,52 @@
+/***************************************************************************//**
+ * \file    ordenacion.h
+ *
+ * \brief   Ordenacin estable de listas de ndices en la SDRAM. Si no hay
+ *          SDRAM para la memoria de trabajo completa se usa una memoria
+ *          acotada y la tarjeta SD como almacenamiento intermedio.
+ */
+
+#ifndef ORDENACION_H
+#define ORDENACION_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Nmero de elementos de cada tramo que se ordena en memoria cuando no se ha
+ * podido reservar la memoria de trabajo completa (tantos elementos como la
+ * lista ms larga). En ese caso la memoria de trabajo es de
+ * 2*ORDEN_ELEMENTOS_TRAMO elementos y las listas ms largas se ordenan por
+ * tramos que se vuelcan a la tarjeta y despus se mezclan.
+ */
+#define ORDEN_ELEMENTOS_TRAMO   4096u
+
+/* Nmero mximo de tramos que se pueden mezclar, lo que limita la longitud
+ * de las listas a ORDEN_MAXIMO_TRAMOS*ORDEN_ELEMENTOS_TRAMO elementos.
+ */
+#define ORDEN_MAXIMO_TRAMOS     16u
+
+/* Fichero temporal donde se vuelcan los tramos, slo con la memoria de
+ * trabajo acotada.
+ */
+#define ORDEN_FICHERO_TEMPORAL  "/ORDEN.TMP"
+
+/*===== Tipos ==================================================================
+ */
+
+/* Funcin de comparacin de dos elementos. Debe devolver un valor negativo,
+ * 0 o positivo si a va antes, en la misma posicin o despus que b.
+ */
+typedef int32_t (*orden_funcion_comparar_t)(uint16_t a, uint16_t b);
+
+/*===== Prototipos de funciones ================================================
+ */
+
+FRESULT orden_ordenar(uint16_t *elementos,
+                      uint32_t numero_elementos,
+                      orden_funcion_comparar_t comparar,
+                      uint32_t *numero_tramos);
+
+#endif  /* ORDENACION_H */
@@ -0,0 +1,386 @@
+/***************************************************************************//**
+ * \file    reanudacion.c
+ *
+ * \brief   Punto de reanudacin de la reproduccin tras un corte de
+ *          alimentacin.
+ *
+ *          Mientras se reproduce un fichero se guarda por dnde va en dos
+ *          sitios:
+ *
+ *          - En los registros de propsito general del RTC (GPREG0 a
+ *            GPREG3), que se mantienen con la batera del RTC. Escribirlos
+ *            cuesta unos pocos accesos a registros, as que la posicin se
+ *            copia cada REANUD_INTERVALO_RTC_MS desde la funcin input del
+ *            reproductor sin retrasar la decodificacin. No caben la ruta
+ *            del fichero, slo el nmero del registro del log al que
+ *            corresponden.
+ *
+ *          - En el fichero REANUD_FICHERO_LOG, con la ruta y el tramo, para
+ *            que sirva aunque el RTC no tenga batera. Se escribe al empezar
+ *            y al terminar el fichero, al saltar y, durante la reproduccin,
+ *            cada REANUD_INTERVALO_LOG_MS. Una escritura en la tarjeta puede
+ *            tardar lo bastante como para dejar sin datos la salida de
+ *            audio, as que la copia peridica se aplaza hasta que el buffer
+ *            de salida tiene al menos REANUD_HOLGURA_LOG_US de audio. Cada
+ *            escritura es un sector completo en un registro distinto de los
+ *            REANUD_REGISTROS_LOG del fichero, de modo que el fichero no
+ *            crece y un corte durante la escritura slo estropea ese
+ *            registro.
+ *
+ *          Al arrancar, reanud_inicializar lee los registros del log (unos
+ *          pocos sectores) y se queda con el de nmero de secuencia mayor.
+ *          Si el fichero no termin y los registros del RTC son de ese
+ *          registro, la posicin se toma de ellos, que es ms reciente.
+ *
+ *          La posicin es el tiempo odo desde el frame en que empieza a
+ *          orse el tramo, y no un byte del fichero: en ficheros VBR no
+ *          hay forma de calcular el byte a partir del tiempo sin el ndice
+ *          de frames, con el que se localiza al reanudar.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include <string.h>
+#include "reanudacion.h"
+#include "salida_audio.h"
+#include "contador_ciclos.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define FIRMA_LOG           0x4E414552u     /* "REAN" */
+#define FIRMA_RTC           0x43545252u     /* "RRTC" */
+
+/* Tamao de cada registro del log: un sector.
+ */
+#define TAMANO_REGISTRO     512u
+
+/*===== Tipos privados =========================================================
+ */
+
+typedef struct {
+    uint32_t firma;
+    uint32_t secuencia;
+    uint32_t activo;                /* 0 si el fichero termin. */
+    uint32_t inicio;
+    uint32_t fin;
+    uint32_t frame_origen;
+    uint32_t milisegundos;
+    uint32_t comprobacion;
+    char ruta[REANUD_MAXIMO_RUTA];
+    uint8_t relleno[TAMANO_REGISTRO - 8u*sizeof(uint32_t) - REANUD_MAXIMO_RUTA];
+} registro_t;
+
+/*===== Variables privadas =====================================================
+ */
+
+static registro_t registro;
+static FIL fichero_log;
+static bool_t log_abierto = FALSE;
+static bool_t activo = FALSE;
+
+/* Nmero de secuencia del siguiente registro que se escribe.
+ */
+static uint32_t secuencia = 0;
+
+/* Instante de reproduccin de la ltima copia en el RTC y en el log.
+ */
+static uint32_t ultimo_rtc;
+static uint32_t ultimo_log;
+
+static reanud_estadisticas_t estadisticas;
+
+static uint32_t comprobacion_registro(const registro_t *r);
+static uint32_t comprobacion_rtc(uint32_t secuencia_registro,
+                                 uint32_t milisegundos);
+static void escribir_rtc(void);
+static void escribir_log(void);
+
+/***************************************************************************//**
+ * \brief       Buscar el punto de reanudacin guardado. Debe llamarse una vez
+ *              al arrancar, con el sistema de ficheros montado y antes de
+ *              reanud_empezar.
+ *
+ * \param[out]  punto   punto de reanudacin, si lo hay.
+ *
+ * \return      TRUE si el ltimo fichero reproducido no lleg a terminar.
+ */
+bool_t reanud_inicializar(reanud_punto_t *punto)
+{
+    uint32_t inicio = ciclos_leer();
+    bool_t encontrado = FALSE;
+    bool_t pendiente = FALSE;
+    uint32_t ultima_secuencia = 0;
+    UINT leidos;
+    uint32_t i;
+
+    memset(&estadisticas, 0, sizeof(estadisticas));
+    secuencia = 0;
+
+    if (f_open(&fichero_log, REANUD_FICHERO_LOG, FA_READ) == FR_OK)
+    {
+        for (i = 0; i < REANUD_REGISTROS_LOG; i++)
+        {
+            if (f_read(&fichero_log, &registro, sizeof(registro),
+                       &leidos) != FR_OK ||
+                leidos != sizeof(registro))
+            {
+                break;
+            }
+
+            if (registro.firma != FIRMA_LOG ||
+                registro.comprobacion != comprobacion_registro(&registro) ||
+                registro.ruta[REANUD_MAXIMO_RUTA - 1u] != '\0')
+            {
+                continue;
+            }
+
+            if (encontrado && registro.secuencia < ultima_secuencia) continue;
+
+            encontrado = TRUE;
+            ultima_secuencia = registro.secuencia;
+            pendiente = registro.activo != 0;
+
+            strcpy(punto->ruta, registro.ruta);
+            punto->inicio = registro.inicio;
+            punto->fin = registro.fin;
+            punto->frame_origen = registro.frame_origen;
+            punto->milisegundos = registro.milisegundos;
+        }
+
+        f_close(&fichero_log);
+    }
+
+    if (encontrado) secuencia = ultima_secuencia + 1u;
+
+    if (pendiente &&
+        LPC_RTC->GPREG0 == FIRMA_RTC &&
+        LPC_RTC->GPREG1 == ultima_secuencia &&
+        LPC_RTC->GPREG3 == comprobacion_rtc(LPC_RTC->GPREG1,
+                                            LPC_RTC->GPREG2))
+    {
+        punto->milisegundos = LPC_RTC->GPREG2;
+        estadisticas.posicion_del_rtc = TRUE;
+    }
+
+    estadisticas.microsegundos_lectura =
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+
+    return pendiente;
+}
+
+/***************************************************************************//**
+ * \brief       Empezar a guardar la posicin de un fichero que se va a
+ *              reproducir.
+ *
+ * \param[in]   ruta            ruta del fichero desde el raz.
+ * \param[in]   inicio          principio del tramo que se va a reproducir.
+ * \param[in]   fin             final del tramo.
+ * \param[in]   frame_origen    frame del fichero en el que empieza a orse
+ *                              el tramo.
+ */
+void reanud_empezar(const char *ruta,
+                    uint32_t inicio,
+                    uint32_t fin,
+                    uint32_t frame_origen)
+{
+    if (activo) reanud_terminar();
+    if (strlen(ruta) >= REANUD_MAXIMO_RUTA) return;
+
+    memset(&registro, 0, sizeof(registro));
+    registro.firma = FIRMA_LOG;
+    registro.activo = 1;
+    registro.inicio = inicio;
+    registro.fin = fin;
+    registro.frame_origen = frame_origen;
+    strcpy(registro.ruta, ruta);
+
+    log_abierto = f_open(&fichero_log, REANUD_FICHERO_LOG,
+                         FA_READ | FA_WRITE | FA_OPEN_ALWAYS) == FR_OK;
+
+    escribir_log();
+    escribir_rtc();
+
+    ultimo_rtc = 0;
+    ultimo_log = 0;
+    activo = TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Anotar la posicin de reproduccin. Se llama con frecuencia y
+ *              slo se copia en el RTC o en el log si ha pasado su intervalo
+ *              desde la ltima copia o si se ha retrocedido. La copia en el
+ *              log espera adems a que haya holgura en el buffer de salida.
+ *
+ * \param[in]   milisegundos    tiempo odo desde el principio del tramo
+ *                              (no el de la lectura, que va por delante de
+ *                              lo que se oye).
+ */
+void reanud_actualizar(uint32_t milisegundos)
+{
+    bool_t copiar_rtc;
+    bool_t copiar_log;
+
+    if (!activo) return;
+
+    copiar_rtc = milisegundos < ultimo_rtc ||
+                 milisegundos - ultimo_rtc >= REANUD_INTERVALO_RTC_MS;
+    copiar_log = (milisegundos < ultimo_log ||
+                  milisegundos - ultimo_log >= REANUD_INTERVALO_LOG_MS) &&
+                 salaud_latencia_us() >= REANUD_HOLGURA_LOG_US;
+
+    if (!copiar_rtc && !copiar_log) return;
+
+    registro.milisegundos = milisegundos;
+
+    /* Un registro nuevo del log cambia el nmero de secuencia, as que los
+     * registros del RTC se vuelven a escribir tambin.
+     */
+    if (copiar_log)
+    {
+        escribir_log();
+        ultimo_log = milisegundos;
+    }
+
+    escribir_rtc();
+    ultimo_rtc = milisegundos;
+}
+
+/***************************************************************************//**
+ * \brief       Guardar la posicin en el log y en el RTC sin esperar a los
+ *              intervalos, tras un salto. La salida de audio se acaba de
+ *              vaciar, as que la escritura slo retrasa lo que ya es un
+ *              hueco.
+ *
+ * \param[in]   milisegundos    tiempo desde el principio del tramo en el
+ *                              que sigue la reproduccin.
+ */
+void reanud_guardar(uint32_t milisegundos)
+{
+    if (!activo) return;
+
+    registro.milisegundos = milisegundos;
+
+    escribir_log();
+    escribir_rtc();
+
+    ultimo_log = milisegundos;
+    ultimo_rtc = milisegundos;
+}
+
+/***************************************************************************//**
+ * \brief   Dejar de guardar la posicin porque el fichero ha terminado o se
+ *          ha parado. Al arrancar no se reanudar.
+ */
+void reanud_terminar(void)
+{
+    if (!activo) return;
+
+    activo = FALSE;
+    LPC_RTC->GPREG0 = 0;
+
+    registro.activo = 0;
+    escribir_log();
+
+    if (log_abierto)
+    {
+        f_close(&fichero_log);
+        log_abierto = FALSE;
+    }
+}
+
+/***************************************************************************//**
+ * \brief       Leer el resultado de la lectura del punto al arrancar y de las
+ *              escrituras hechas desde entonces.
+ *
+ * \param[out]  destino     donde se copian las estadsticas.
+ */
+void reanud_leer_estadisticas(reanud_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Suma de las palabras de un registro del log, sin contar el campo
+ *          comprobacion.
+ */
+static uint32_t comprobacion_registro(const registro_t *r)
+{
+    const uint32_t *palabras = (const uint32_t *)r;
+    uint32_t suma = 0;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(registro_t)/sizeof(uint32_t); i++)
+    {
+        suma += palabras[i];
+    }
+
+    return suma - r->comprobacion;
+}
+
+/***************************************************************************//**
+ * \brief   Valor de GPREG3 para el resto de registros del RTC. Si se corta la
+ *          alimentacin a mitad de su escritura no coincide.
+ */
+static uint32_t comprobacion_rtc(uint32_t secuencia_registro,
+                                 uint32_t milisegundos)
+{
+    return ~(FIRMA_RTC ^ secuencia_registro ^
+             (milisegundos << 16 | milisegundos >> 16));
+}
+
+/***************************************************************************//**
+ * \brief   Copiar la posicin del registro actual en los registros del RTC.
+ */
+static void escribir_rtc(void)
+{
+    LPC_RTC->GPREG0 = FIRMA_RTC;
+    LPC_RTC->GPREG1 = registro.secuencia;
+    LPC_RTC->GPREG2 = registro.milisegundos;
+    LPC_RTC->GPREG3 = comprobacion_rtc(registro.secuencia,
+                                       registro.milisegundos);
+
+    estadisticas.escrituras_rtc++;
+}
+
+/***************************************************************************//**
+ * \brief   Escribir el registro actual en el siguiente registro del log. Si
+ *          falla la escritura se deja de usar el log hasta el siguiente
+ *          fichero.
+ */
+static void escribir_log(void)
+{
+    FRESULT fr;
+    UINT escritos;
+    uint32_t inicio = ciclos_leer();
+
+    if (!log_abierto) return;
+
+    registro.secuencia = secuencia++;
+    registro.comprobacion = comprobacion_registro(&registro);
+
+    fr = f_lseek(&fichero_log,
+                 (registro.secuencia % REANUD_REGISTROS_LOG)*sizeof(registro));
+    if (fr == FR_OK)
+    {
+        fr = f_write(&fichero_log, &registro, sizeof(registro), &escritos);
+    }
+    if (fr == FR_OK && escritos != sizeof(registro)) fr = FR_DENIED;
+    if (fr == FR_OK) fr = f_sync(&fichero_log);
+
+    if (fr != FR_OK)
+    {
+        f_close(&fichero_log);
+        log_abierto = FALSE;
+        return;
+    }
+
+    estadisticas.escrituras_log++;
+    estadisticas.microsegundos_ultimo_log =
+        ciclos_a_microsegundos(ciclos_leer() - inicio);
+    if (estadisticas.microsegundos_ultimo_log >
+        estadisticas.microsegundos_maximo_log)
+    {
+        estadisticas.microsegundos_maximo_log =
+            estadisticas.microsegundos_ultimo_log;
+    }
+}
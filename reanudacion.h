@@ -0,0 +1,75 @@
+/***************************************************************************//**
+ * \file    reanudacion.h
+ *
+ * \brief   Punto de reanudacin de la reproduccin tras un corte de
+ *          alimentacin.
+ */
+
+#ifndef REANUDACION_H
+#define REANUDACION_H
+
+#include "tipos.h"
+#include "ff.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Fichero de la tarjeta con los ltimos puntos de reanudacin. Tiene
+ * REANUD_REGISTROS_LOG registros de un sector que se reescriben por turno.
+ */
+#define REANUD_FICHERO_LOG          "/REANUDAR.LOG"
+#define REANUD_REGISTROS_LOG        4u
+
+/* Longitud mxima de la ruta del fichero, incluido el terminador.
+ */
+#define REANUD_MAXIMO_RUTA          256u
+
+/* Milisegundos de reproduccin entre dos copias de la posicin en los
+ * registros del RTC y entre dos copias en el fichero. La copia en el fichero
+ * se aplaza hasta que el buffer de salida tiene al menos
+ * REANUD_HOLGURA_LOG_US de audio, para que una escritura lenta en la tarjeta
+ * no lo deje vaco.
+ */
+#define REANUD_INTERVALO_RTC_MS     2000u
+#define REANUD_INTERVALO_LOG_MS     10000u
+#define REANUD_HOLGURA_LOG_US       30000u
+
+/*===== Tipos ==================================================================
+ */
+
+/* Punto de reanudacin: el tramo del fichero que se estaba reproduciendo (ver
+ * reproducir_mp3_tramo), el frame en el que empieza a orse, desde el que se
+ * cuenta el tiempo, y el tiempo que se haba odo. El byte donde reanudar se
+ * obtiene con el ndice de frames.
+ */
+typedef struct {
+    char ruta[REANUD_MAXIMO_RUTA];
+    uint32_t inicio;
+    uint32_t fin;
+    uint32_t frame_origen;
+    uint32_t milisegundos;          /* Desde frame_origen. */
+} reanud_punto_t;
+
+typedef struct {
+    uint32_t microsegundos_lectura;     /* Del punto al arrancar. */
+    bool_t posicion_del_rtc;            /* FALSE si es la del fichero. */
+    uint32_t escrituras_rtc;
+    uint32_t escrituras_log;
+    uint32_t microsegundos_ultimo_log;
+    uint32_t microsegundos_maximo_log;
+} reanud_estadisticas_t;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+bool_t reanud_inicializar(reanud_punto_t *punto);
+void reanud_empezar(const char *ruta,
+                    uint32_t inicio,
+                    uint32_t fin,
+                    uint32_t frame_origen);
+void reanud_actualizar(uint32_t milisegundos);
+void reanud_guardar(uint32_t milisegundos);
+void reanud_terminar(void);
+void reanud_leer_estadisticas(reanud_estadisticas_t *destino);
+
+#endif  /* REANUDACION_H */
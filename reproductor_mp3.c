@@ -16,6 +16,35 @@
  *          llamar para obtener datos del stream MP3 (funcin input), entregar
  *          bloques de muestras de audio decodificadas (funcin output) e
  *          indicar errores durante el proceso de reproduccin (funcin error).
+ *
+ *          Con '#' se termina la pista (en una lista se pasa a la siguiente)
+ *          y con '*' se activa o desactiva el orden aleatorio, que usan las
+ *          listas de reproduccin a partir de la siguiente pista. La
+ *          reproduccin se para con el joystick a la izquierda.
+ *
+ *          Con las teclas 'C' y 'D' se retrocede o avanza
+ *          REPRODUCTOR_SALTO_SEGUNDOS segundos. Si FatFs est configurado con
+ *          FF_USE_FASTSEEK, al empezar la reproduccin se construye la tabla
+ *          de enlaces de clusters del fichero (CLMT) en la SDRAM y f_lseek
+ *          localiza cualquier posicin sin leer la FAT.
+ *
+ *          Antes de decodificar se leen las etiquetas del fichero con
+ *          etiq_leer y al decodificador slo se le entregan los bytes de
+ *          audio que hay entre ellas. Se mide el tiempo desde que se empieza
+ *          a preparar el fichero hasta que se decodifica la primera muestra.
+ *
+ *          reproducir_mp3_tramo limita adems la zona de audio a un tramo del
+ *          fichero, como una pista de una hoja CUE. Los primeros frames del
+ *          tramo se decodifican sin enviarlos a la salida para que la reserva
+ *          de bits est llena, y el tiempo transcurrido se cuenta desde el
+ *          principio del tramo.
+ *
+ *          Durante la reproduccin se pasa a reanud_actualizar el tiempo que
+ *          se ha odo, para poder reanudarla tras un corte de alimentacin.
+ *          Para reanudar se llama a reproductor_reanudar_en antes de
+ *          reproducir el tramo, con el byte obtenido del ndice de frames:
+ *          el salto se hace con f_lseek usando la tabla de clusters, igual
+ *          que con las teclas 'C' y 'D'.
  */
  
 #include <LPC407x_8x_177x_8x.h>
@@ -27,8 +56,26 @@
 #include <string.h>
 #include "tipos.h"
 #include "joystick.h"
-#include "timer_lpc40xx.h"
 #include "glcd.h"
+#include "teclado_4x4.h"
+#include "wsola.h"
+#include "efectos_sonido.h"
+#include "cadena_dsp.h"
+#include "contador_ciclos.h"
+#include "sdram.h"
+#include "etiquetas.h"
+#include "reanudacion.h"
+
+/* Salto rpido de FatFs (la opcin se llama _USE_FASTSEEK en las versiones
+ * anteriores a R0.12).
+ */
+#if defined(FF_USE_FASTSEEK)
+#define SALTO_RAPIDO    FF_USE_FASTSEEK
+#elif defined(_USE_FASTSEEK)
+#define SALTO_RAPIDO    _USE_FASTSEEK
+#else
+#define SALTO_RAPIDO    0
+#endif
 
 /* El siguiente bffer acta como una FIFO que va siendo rellenada con datos
  * procedentes del fichero MP3 y del que el decodificador los va tomando para
@@ -48,6 +95,61 @@ static FIL *manejador_fichero_mp3;
  */
 static uint32_t tasa_muestreo_actual = 0;
 
+/* Tasa de bits del ltimo frame decodificado, usada para convertir los
+ * segundos de un salto en bytes del fichero.
+ */
+static uint32_t tasa_bits_actual = 0;
+
+/* TRUE si se ha saltado a otra posicin del fichero y el buffer de entrada
+ * debe rellenarse desde cero.
+ */
+static bool_t salto_pendiente = FALSE;
+
+/* Frames que an hay que descartar al principio de un tramo y si hay que
+ * descartar el ltimo cuya cabecera se ha decodificado. Se cuentan en la
+ * funcin header, porque un frame sin su reserva de bits termina en la
+ * funcin error y no llega a output.
+ */
+static uint32_t frames_por_descartar = 0;
+static bool_t descartar_frame = FALSE;
+
+/* Posicin en la que se reanuda la siguiente reproduccin y tiempo que
+ * corresponde a esa posicin, que se aplica a la salida de audio en cuanto se
+ * conoce la tasa de muestreo.
+ */
+static bool_t reanudacion_pendiente = FALSE;
+static uint32_t posicion_reanudacion;
+static uint32_t milisegundos_reanudacion = 0;
+
+/* Etiquetas del fichero en reproduccin. La zona de audio va de
+ * etiquetas.inicio_audio a etiquetas.fin_audio.
+ */
+static etiq_informacion_t etiquetas;
+
+/* Medida del tiempo hasta la primera muestra decodificada.
+ */
+static uint32_t ciclos_inicio_reproduccion;
+static bool_t primera_muestra_pendiente = FALSE;
+static uint32_t tiempo_primera_muestra_us = 0;
+
+/* Motivo por el que ha terminado la ltima reproduccin y orden aleatorio
+ * seleccionado (se mantiene entre ficheros).
+ */
+static uint32_t motivo_fin = REPRODUCTOR_FIN_FICHERO;
+static bool_t aleatorio = FALSE;
+
+/* Tabla de enlaces de clusters en la SDRAM (se reserva una vez y se reutiliza
+ * para cada fichero) y latencias medidas de f_lseek.
+ */
+static DWORD *tabla_clusters = NULL;
+static uint32_t latencia_salto_us = 0;
+static uint32_t latencia_maxima_salto_us = 0;
+
+/* Incremento, en tanto por ciento, de la velocidad de reproduccin con cada
+ * pulsacin de las teclas 'A' (ms rpido) y 'B' (ms lento).
+ */
+#define PASO_VELOCIDAD  25u
+
 /* La estructura buffer_info se usa para guardar informacin sobre un bloque de
  * bytes genrico. Tiene campos para indicar la direccin de comienzo del bloque
  * y su longitud.
@@ -58,17 +160,26 @@ struct buffer_info {
 };
 
 /* Funciones "callback" que libmad llamar para obtener datos del stream MP3
- * (funcin input), entregar bloques de muestras de audio decodificadas
- * (funcin output) e indicar errores durante el proceso de reproduccin
- * (funcin error).
+ * (funcin input), avisar de cada cabecera de frame decodificada (funcin
+ * header), entregar bloques de muestras de audio decodificadas (funcin
+ * output) e indicar errores durante el proceso de reproduccin (funcin
+ * error).
  */
 static enum mad_flow input(void *data, struct mad_stream *stream);
+static enum mad_flow header(void *data, struct mad_header const *header);
 static enum mad_flow output(void *data,
                             struct mad_header const *header,
                             struct mad_pcm *pcm);
 static enum mad_flow error(void *data,
 		                   struct mad_stream *stream,
 		                   struct mad_frame *frame);
+static void mostrar_velocidad(void);
+static void mostrar_aleatorio(void);
+static void construir_tabla_clusters(FIL *manejador_fichero);
+static void saltar(int32_t segundos);
+static uint32_t posicion_en(uint32_t milisegundos);
+static bool_t mover_lectura(uint32_t destino);
+static void leer_audio(void *destino, uint32_t numero_bytes, uint32_t *numero_bytes_leidos);
 
 /***************************************************************************//**
  * \brief       Lanza la reproduccin de un fichero MP3. La funcin no retorna
@@ -80,6 +191,33 @@ static enum mad_flow error(void *data,
  * \return      cdigo de salida de la funcin mad_decoder_run.
  */
 int32_t reproducir_mp3(FIL *manejador_fichero)
+{
+    return reproducir_mp3_tramo(manejador_fichero, 0, REPRODUCTOR_HASTA_FINAL, 0);
+}
+
+/***************************************************************************//**
+ * \brief       Reproducir slo un tramo de un fichero MP3, como las pistas de
+ *              una hoja CUE. El tramo se limita adems a la zona de audio
+ *              entre las etiquetas. La funcin no retorna hasta que no termina
+ *              la reproduccin.
+ *
+ * \param[in]   manejador_fichero   manejador al fichero a reproducir obtenido
+ *                                  mediante una llamada previa a f_open.
+ * \param[in]   inicio              byte del fichero donde empieza el tramo,
+ *                                  que debe ser el principio de un frame.
+ * \param[in]   fin                 byte del fichero donde termina el tramo o
+ *                                  REPRODUCTOR_HASTA_FINAL.
+ * \param[in]   frames_descartar    frames del principio del tramo que se
+ *                                  decodifican pero no se oyen, para llenar
+ *                                  la reserva de bits del primero que se oye
+ *                                  (ver REPRODUCTOR_FRAMES_PREVIOS).
+ *
+ * \return      cdigo de salida de la funcin mad_decoder_run.
+ */
+int32_t reproducir_mp3_tramo(FIL *manejador_fichero,
+                             uint32_t inicio,
+                             uint32_t fin,
+                             uint32_t frames_descartar)
 { 
     struct buffer_info buffer;
     struct mad_decoder decoder;
@@ -99,11 +237,55 @@ int32_t reproducir_mp3(FIL *manejador_fichero)
      * generacin de audio usada.
      */
     salaud_inicializar();
+    ciclos_inicio_reproduccion = ciclos_leer();
+    primera_muestra_pendiente = TRUE;
+    
+    /* Vaciar el estado del estiramiento temporal que se intercala entre el
+     * decodificador y la salida de audio para poder cambiar la velocidad de
+     * reproduccin. La velocidad seleccionada se mantiene entre ficheros.
+     */
+    wsola_inicializar();
+    mostrar_velocidad();
+    mostrar_aleatorio();
+    motivo_fin = REPRODUCTOR_FIN_FICHERO;
     
     /* Inicializar la variable global esttica manejador_fichero_mp3 que la
      * funcin input usar para acceder al fichero en reproduccin.
      */
     manejador_fichero_mp3 = manejador_fichero;
+    tasa_bits_actual = 0;
+    salto_pendiente = FALSE;
+    construir_tabla_clusters(manejador_fichero);
+
+    /* Leer las etiquetas saltando sus datos y dejar el fichero en el primer
+     * byte de audio, de modo que libmad no tenga que atravesarlas.
+     */
+    etiq_leer(manejador_fichero, &etiquetas);
+    if (inicio > etiquetas.inicio_audio && inicio < etiquetas.fin_audio)
+    {
+        etiquetas.inicio_audio = inicio;
+        f_lseek(manejador_fichero, inicio);
+    }
+    if (fin < etiquetas.fin_audio) etiquetas.fin_audio = fin;
+    frames_por_descartar = frames_descartar;
+    descartar_frame = FALSE;
+
+    /* Al reanudar, libmad empieza directamente en la posicin guardada.
+     */
+    if (!reanudacion_pendiente ||
+        posicion_reanudacion <= etiquetas.inicio_audio ||
+        posicion_reanudacion >= etiquetas.fin_audio ||
+        !mover_lectura(posicion_reanudacion))
+    {
+        milisegundos_reanudacion = 0;
+    }
+    reanudacion_pendiente = FALSE;
+
+    if (etiquetas.titulo[0] != '\0')
+    {
+        glcd_xprintf(0, 64, WHITE, BLACK, FONT8X16, "%s - %s",
+                     etiquetas.artista, etiquetas.titulo);
+    }
 
     /* Se inicializan los campos de buffer (de tipo buffer_info) para que
      * inicialmente indique la disponibilidad de todo el buffer_stream_mp3
@@ -122,7 +304,7 @@ int32_t reproducir_mp3(FIL *manejador_fichero)
     mad_decoder_init(&decoder, 
                      &buffer,
                      input, 
-                     NULL, /* header callback */
+                     header,
                      NULL, /* filter callback */
                      output,
                      error, 
@@ -136,6 +318,12 @@ int32_t reproducir_mp3(FIL *manejador_fichero)
      */
     mad_decoder_finish(&decoder);
 
+#if SALTO_RAPIDO
+    /* La tabla se reutiliza para el siguiente fichero.
+     */
+    manejador_fichero->cltbl = NULL;
+#endif
+
     /* Retornar el valor que devolvi mad_decoder_run.
      */
     return resultado;    
@@ -168,18 +356,85 @@ static enum mad_flow input(void *data, struct mad_stream *stream)
      * buffer_info.
      */
     struct buffer_info *buffer = data;
-    uint32_t segundos_totales_reproduccion = timer_leer(TIMER2);    
+    uint32_t milisegundos_reproduccion = salaud_posicion_ms();
+    uint32_t segundos_totales_reproduccion = milisegundos_reproduccion/1000;
     uint32_t rb = 0;
     uint32_t numero_bytes_leidos;    
     uint32_t segundos_reproduccion = segundos_totales_reproduccion % 60;
     uint16_t minutos_reproduccion = segundos_totales_reproduccion / 60;
 
+    /* El tiempo mostrado se obtiene de las muestras que la salida de audio
+     * ha reproducido realmente, as que no avanza durante los vaciados del
+     * buffer de salida.
+     */
     glcd_xprintf(325, 0, WHITE, BLACK, FONT8X16, "Duracion: %02u:%02u",
                  minutos_reproduccion, segundos_reproduccion);
 
+    /* Slo cada cierto tiempo se guarda de verdad. Se guarda el tiempo que
+     * se ha odo y no la posicin de f_tell, que va por delante en lo que
+     * hay en el buffer de entrada, en WSOLA y en el buffer de salida.
+     */
+    reanud_actualizar(milisegundos_reproduccion);
+
     if(leer_joystick() == JOYSTICK_IZQUIERDA)
     {
+        /* Parar con una rampa de bajada en lugar de cortar el sonido.
+         */
+        salaud_parar();
+        motivo_fin = REPRODUCTOR_FIN_PARADA;
+        return MAD_FLOW_STOP;
+    }
+
+    /* Cambiar la velocidad de reproduccin con las teclas 'A' y 'B'. Cada
+     * pulsacin suena con un clic; si la velocidad ya est en el lmite suena
+     * un pitido.
+     */
+    switch (tec4x4_leer())
+    {
+    case 'A':
+        if (wsola_leer_velocidad() < WSOLA_VELOCIDAD_MAXIMA)
+        {
+            efecto_disparar(EFECTO_CLIC);
+            wsola_ajustar_velocidad(wsola_leer_velocidad() + PASO_VELOCIDAD);
+            mostrar_velocidad();
+        }
+        else
+        {
+            efecto_disparar(EFECTO_PITIDO);
+        }
+        break;
+
+    case 'B':
+        if (wsola_leer_velocidad() > WSOLA_VELOCIDAD_MINIMA)
+        {
+            efecto_disparar(EFECTO_CLIC);
+            wsola_ajustar_velocidad(wsola_leer_velocidad() - PASO_VELOCIDAD);
+            mostrar_velocidad();
+        }
+        else
+        {
+            efecto_disparar(EFECTO_PITIDO);
+        }
+        break;
+
+    case 'C':
+        saltar(-REPRODUCTOR_SALTO_SEGUNDOS);
+        break;
+
+    case 'D':
+        saltar(REPRODUCTOR_SALTO_SEGUNDOS);
+        break;
+
+    case '#':
+        salaud_parar();
+        motivo_fin = REPRODUCTOR_FIN_SIGUIENTE;
         return MAD_FLOW_STOP;
+
+    case '*':
+        efecto_disparar(EFECTO_CLIC);
+        aleatorio = !aleatorio;
+        mostrar_aleatorio();
+        break;
     }
 			
     /* Si el hueco en buffer_stream_mp3 es 0, error.
@@ -192,32 +447,43 @@ static enum mad_flow input(void *data, struct mad_stream *stream)
     /* Rellenar el buffer de entrada con el nmero de bytes solicitado.
      * (Explicar mejor).
      */
-    if (stream->this_frame != NULL && stream->next_frame != NULL)
+    if (salto_pendiente)
+    {
+        /* Descartar los datos anteriores al salto.
+         */
+        buffer->longitud = sizeof(buffer_stream_mp3);
+        leer_audio((void *)buffer->comienzo,
+                   buffer->longitud,
+                   &numero_bytes_leidos);
+        salto_pendiente = FALSE;
+    }
+    else if (stream->this_frame != NULL && stream->next_frame != NULL)
     {
         rb = buffer->longitud -
             ((uint32_t)stream->next_frame - (uint32_t)stream->buffer);
 
         memmove((void *)stream->buffer, (void *)stream->next_frame, rb);
-        f_read(manejador_fichero_mp3,
-               (void *)(stream->buffer + rb),
-               buffer->longitud - rb,
-               &numero_bytes_leidos);
+        leer_audio((void *)(stream->buffer + rb),
+                   buffer->longitud - rb,
+                   &numero_bytes_leidos);
     }
     else
     {
-        f_read(manejador_fichero_mp3,
-               (void *)buffer->comienzo,
-               buffer->longitud,
-               &numero_bytes_leidos);
+        leer_audio((void *)buffer->comienzo,
+                   buffer->longitud,
+                   &numero_bytes_leidos);
     }
 
     if (numero_bytes_leidos == 0)
     {
         /* Si no se pudieron obtener nuevos datos del fichero, terminar la reproduccin de
          * los muestras de audio decodificadas hasta el momento e indicar parar la
-         * reproduccin.
+         * reproduccin. El final del buffer de salida se reproduce mientras
+         * se vuelve al men; salaud_inicializar espera a que termine antes de
+         * empezar el siguiente fichero.
          */
-        salaud_esperar_fin_fragmento();
+        wsola_vaciar();
+        salaud_vaciar(NULL);
         buffer->longitud = 0;
         return MAD_FLOW_STOP;
     }
@@ -237,6 +503,26 @@ static enum mad_flow input(void *data, struct mad_stream *stream)
     return MAD_FLOW_CONTINUE;
 }
 
+/***************************************************************************//**
+ * \brief       Esta es la funcin a la que libmad llamar cada vez que
+ *              decodifique la cabecera de un frame, antes de decodificar sus
+ *              datos. Se usa para contar los frames que hay que descartar al
+ *              principio de un tramo, se puedan decodificar o no.
+ *
+ * \param[in]   data    puntero a datos de usuario que libmad pasa a la funcin.
+ *
+ *              header  cabecera del frame.
+ *
+ * \return      MAD_FLOW_CONTINUE => decodificar el frame.
+ */
+static enum mad_flow header(void *data, struct mad_header const *header)
+{
+    descartar_frame = frames_por_descartar > 0;
+    if (descartar_frame) frames_por_descartar--;
+
+    return MAD_FLOW_CONTINUE;
+}
+
 /***************************************************************************//**
  * \brief       Esta es la funcin a la que libmad llamar cada vez que haya
  *              decodificado un nuevo frame MP3 para que las muestras de
@@ -267,10 +553,30 @@ static enum mad_flow output(void *data,
         tasa_muestreo_actual = pcm->samplerate;
     }
 
-    salaud_encolar_bloque_muestras(pcm->samples[0],
-                                   pcm->samples[1],
-                                   pcm->length,
-                                   pcm->channels);
+    tasa_bits_actual = header->bitrate;
+
+    if (descartar_frame) return MAD_FLOW_CONTINUE;
+
+    if (milisegundos_reanudacion != 0)
+    {
+        salaud_ajustar_posicion((uint64_t)milisegundos_reanudacion*
+                                pcm->samplerate/1000u);
+        milisegundos_reanudacion = 0;
+    }
+
+    if (primera_muestra_pendiente)
+    {
+        tiempo_primera_muestra_us =
+            ciclos_a_microsegundos(ciclos_leer() - ciclos_inicio_reproduccion);
+        primera_muestra_pendiente = FALSE;
+        glcd_xprintf(325, 48, WHITE, BLACK, FONT8X16, "Inicio: %u us",
+                     tiempo_primera_muestra_us);
+    }
+
+    wsola_procesar(pcm->samples[0],
+                   pcm->samples[1],
+                   pcm->length,
+                   pcm->channels);
     
     return MAD_FLOW_CONTINUE;
 }
@@ -305,3 +611,247 @@ static enum mad_flow error(void *data,
      */
     return MAD_FLOW_CONTINUE;
 }
+
+/***************************************************************************//**
+ * \brief       Mostrar en el LCD la velocidad de reproduccin seleccionada.
+ */
+static void mostrar_velocidad(void)
+{
+    uint32_t velocidad = wsola_leer_velocidad();
+
+    glcd_xprintf(325, 16, WHITE, BLACK, FONT8X16, "Velocidad: x%u.%02u",
+                 velocidad/100, velocidad%100);
+}
+
+/***************************************************************************//**
+ * \brief       Mostrar en el LCD si est seleccionado el orden aleatorio.
+ */
+static void mostrar_aleatorio(void)
+{
+    glcd_xprintf(325, 80, WHITE, BLACK, FONT8X16, "Aleatorio: %s",
+                 aleatorio ? "si" : "no");
+}
+
+/***************************************************************************//**
+ * \brief   Motivo por el que termin la ltima reproduccin.
+ *
+ * \return  REPRODUCTOR_FIN_FICHERO, REPRODUCTOR_FIN_SIGUIENTE o
+ *          REPRODUCTOR_FIN_PARADA.
+ */
+uint32_t reproductor_motivo_fin(void)
+{
+    return motivo_fin;
+}
+
+/***************************************************************************//**
+ * \brief   Indicar si est seleccionado el orden aleatorio.
+ */
+bool_t reproductor_aleatorio(void)
+{
+    return aleatorio;
+}
+
+/***************************************************************************//**
+ * \brief       Hacer que la siguiente reproduccin empiece en una posicin
+ *              del tramo en lugar de en su principio, para reanudarla.
+ *
+ * \param[in]   posicion        byte del fichero donde se reanuda, que debe
+ *                              ser el principio de un frame.
+ * \param[in]   milisegundos    tiempo desde el principio del tramo que
+ *                              corresponde a la posicin.
+ */
+void reproductor_reanudar_en(uint32_t posicion, uint32_t milisegundos)
+{
+    reanudacion_pendiente = TRUE;
+    posicion_reanudacion = posicion;
+    milisegundos_reanudacion = milisegundos;
+}
+
+/***************************************************************************//**
+ * \brief       Construir la tabla de enlaces de clusters del fichero para que
+ *              f_lseek no tenga que recorrer la cadena de clusters en la FAT.
+ *              Primero se pide a FatFs el tamao necesario, que depende del
+ *              nmero de fragmentos del fichero; si no cabe en la tabla
+ *              reservada los saltos se hacen sin ella.
+ */
+static void construir_tabla_clusters(FIL *manejador_fichero)
+{
+#if SALTO_RAPIDO
+    DWORD tabla_minima[1];
+
+    manejador_fichero->cltbl = NULL;
+
+    if (tabla_clusters == NULL)
+    {
+        tabla_clusters = sdram_reservar(REPRODUCTOR_TAMANO_TABLA_CLUSTERS*sizeof(DWORD));
+        if (tabla_clusters == NULL) return;
+    }
+
+    /* Con una tabla de un elemento f_lseek falla con FR_NOT_ENOUGH_CORE y
+     * devuelve en l el tamao necesario.
+     */
+    tabla_minima[0] = 1;
+    manejador_fichero->cltbl = tabla_minima;
+    f_lseek(manejador_fichero, CREATE_LINKMAP);
+    manejador_fichero->cltbl = NULL;
+
+    if (tabla_minima[0] > REPRODUCTOR_TAMANO_TABLA_CLUSTERS) return;
+
+    tabla_clusters[0] = REPRODUCTOR_TAMANO_TABLA_CLUSTERS;
+    manejador_fichero->cltbl = tabla_clusters;
+
+    if (f_lseek(manejador_fichero, CREATE_LINKMAP) != FR_OK)
+    {
+        manejador_fichero->cltbl = NULL;
+    }
+#endif
+}
+
+/***************************************************************************//**
+ * \brief       Avanzar o retroceder en el fichero desde la posicin que se
+ *              est oyendo. La posicin en bytes se calcula con la tasa de
+ *              bits del ltimo frame (exacta en ficheros CBR, aproximada en
+ *              VBR); libmad se resincroniza solo con el siguiente frame.
+ *
+ *              Primero se mueve la lectura; si f_lseek falla la reproduccin
+ *              sigue sin cambios. Si no, se atena con una rampa de bajada el
+ *              audio que espera en el buffer de salida, se descarta el resto y
+ *              se vaca el estado de wsola, de modo que no se oye nada de la
+ *              posicin anterior. Despus se ajusta la posicin de la salida
+ *              de audio a la nueva y se aplica una rampa de subida. La
+ *              duracin de f_lseek se muestra en el LCD.
+ *
+ * \param[in]   segundos    segundos a avanzar (positivo) o retroceder
+ *                          (negativo).
+ */
+static void saltar(int32_t segundos)
+{
+    uint32_t bytes_por_segundo = tasa_bits_actual/8;
+    int64_t milisegundos;
+    uint32_t destino;
+
+    if (bytes_por_segundo == 0 || tasa_muestreo_actual == 0) return;
+
+    milisegundos = (int64_t)salaud_posicion_ms() + (int64_t)segundos*1000;
+    if (milisegundos < 0) milisegundos = 0;
+
+    destino = posicion_en((uint32_t)milisegundos);
+
+    /* Mientras se ejecuta saltar no se lee del fichero, as que mover antes
+     * la lectura no afecta a lo que ya est en los buffers.
+     */
+    if (!mover_lectura(destino)) return;
+
+    /* Terminar con una rampa de bajada lo que se est oyendo y esperar a que
+     * suene (como mucho SALAUD_MUESTRAS_RAMPA muestras).
+     */
+    salaud_parar();
+    salaud_esperar_fin_fragmento();
+    wsola_inicializar();
+
+    salto_pendiente = TRUE;
+    salaud_ajustar_posicion((uint64_t)(destino - etiquetas.inicio_audio)*
+                            tasa_muestreo_actual/bytes_por_segundo);
+    reanud_guardar(salaud_posicion_ms());
+    dsp_iniciar_rampa_subida(SALAUD_MUESTRAS_RAMPA);
+}
+
+/***************************************************************************//**
+ * \brief       Byte del fichero que corresponde a un instante del tramo,
+ *              segn la tasa de bits del ltimo frame decodificado. Mientras
+ *              no se conoce es el principio del tramo.
+ *
+ * \param[in]   milisegundos    instante desde el principio del tramo.
+ */
+static uint32_t posicion_en(uint32_t milisegundos)
+{
+    uint64_t posicion = (uint64_t)etiquetas.inicio_audio +
+                        (uint64_t)milisegundos*(tasa_bits_actual/8u)/1000u;
+
+    if (posicion > etiquetas.fin_audio) posicion = etiquetas.fin_audio;
+
+    return (uint32_t)posicion;
+}
+
+/***************************************************************************//**
+ * \brief       Mover la lectura del fichero en reproduccin midiendo lo que
+ *              tarda f_lseek.
+ *
+ * \param[in]   destino     byte del fichero.
+ *
+ * \return      FALSE si falla f_lseek.
+ */
+static bool_t mover_lectura(uint32_t destino)
+{
+    uint32_t inicio = ciclos_leer();
+
+    if (f_lseek(manejador_fichero_mp3, (FSIZE_t)destino) != FR_OK) return FALSE;
+    latencia_salto_us = ciclos_a_microsegundos(ciclos_leer() - inicio);
+    if (latencia_salto_us > latencia_maxima_salto_us)
+    {
+        latencia_maxima_salto_us = latencia_salto_us;
+    }
+
+    glcd_xprintf(325, 32, WHITE, BLACK, FONT8X16, "Salto: %u us (max. %u)",
+                 latencia_salto_us, latencia_maxima_salto_us);
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Duracin de la ltima llamada a f_lseek hecha por un salto.
+ *
+ * \return  Microsegundos.
+ */
+uint32_t reproductor_latencia_salto_us(void)
+{
+    return latencia_salto_us;
+}
+
+/***************************************************************************//**
+ * \brief   Mayor duracin de f_lseek medida desde el arranque.
+ *
+ * \return  Microsegundos.
+ */
+uint32_t reproductor_latencia_maxima_salto_us(void)
+{
+    return latencia_maxima_salto_us;
+}
+
+/***************************************************************************//**
+ * \brief   Tiempo desde que se empez a preparar el ltimo fichero hasta que
+ *          se decodific su primera muestra, incluida la lectura de las
+ *          etiquetas.
+ *
+ * \return  Microsegundos.
+ */
+uint32_t reproductor_tiempo_primera_muestra_us(void)
+{
+    return tiempo_primera_muestra_us;
+}
+
+/***************************************************************************//**
+ * \brief       Leer del fichero en reproduccin sin pasar del final de la
+ *              zona de audio, para que las etiquetas finales no lleguen al
+ *              decodificador.
+ *
+ * \param[out]  destino                 buffer donde se leen los datos.
+ * \param[in]   numero_bytes            bytes a leer.
+ * \param[out]  numero_bytes_leidos     bytes ledos (0 al final del audio).
+ */
+static void leer_audio(void *destino, uint32_t numero_bytes, uint32_t *numero_bytes_leidos)
+{
+    uint32_t posicion = (uint32_t)f_tell(manejador_fichero_mp3);
+    UINT leidos = 0;
+
+    *numero_bytes_leidos = 0;
+    if (posicion >= etiquetas.fin_audio) return;
+
+    if (numero_bytes > etiquetas.fin_audio - posicion)
+    {
+        numero_bytes = etiquetas.fin_audio - posicion;
+    }
+
+    f_read(manejador_fichero_mp3, destino, numero_bytes, &leidos);
+    *numero_bytes_leidos = leidos;
+}
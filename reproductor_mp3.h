@@ -4,6 +4,42 @@
 #include "ff.h"
 #include "tipos.h"
 
+/* Nmero mximo de elementos (DWORD) de la tabla de enlaces de clusters que
+ * se reserva en la SDRAM para el salto rpido de FatFs. Cada fragmento del
+ * fichero ocupa 2 elementos, ms 1 para el tamao de la tabla.
+ */
+#define REPRODUCTOR_TAMANO_TABLA_CLUSTERS   8192u
+
+/* Segundos que se avanza o retrocede con las teclas 'D' y 'C'.
+ */
+#define REPRODUCTOR_SALTO_SEGUNDOS          10
+
+/* Fin de un tramo que dura hasta el final del audio del fichero.
+ */
+#define REPRODUCTOR_HASTA_FINAL             0xFFFFFFFFu
+
+/* Frames que se decodifican sin orse antes del principio de un tramo. Un
+ * frame puede tomar datos de la reserva de bits de los anteriores, as que
+ * si se empieza a decodificar justo en l sus primeras muestras salen mal.
+ */
+#define REPRODUCTOR_FRAMES_PREVIOS          2u
+
+/* Motivos por los que termina reproducir_mp3.
+ */
+#define REPRODUCTOR_FIN_FICHERO             0u  /* Fin del audio o error. */
+#define REPRODUCTOR_FIN_SIGUIENTE           1u  /* Tecla '#'. */
+#define REPRODUCTOR_FIN_PARADA              2u  /* Joystick a la izquierda. */
+
 int32_t reproducir_mp3(FIL *manejador_fichero);     
+int32_t reproducir_mp3_tramo(FIL *manejador_fichero,
+                             uint32_t inicio,
+                             uint32_t fin,
+                             uint32_t frames_descartar);
+uint32_t reproductor_latencia_salto_us(void);
+uint32_t reproductor_latencia_maxima_salto_us(void);
+uint32_t reproductor_tiempo_primera_muestra_us(void);
+uint32_t reproductor_motivo_fin(void);
+bool_t reproductor_aleatorio(void);
+void reproductor_reanudar_en(uint32_t posicion, uint32_t milisegundos);
      
 #endif
@@ -9,14 +9,35 @@
 
 #include "tipos.h"
 
+/* Duracin, en muestras por canal, de las rampas de subida y bajada que se
+ * aplican al arrancar, al parar y al recuperarse de un vaciado del buffer de
+ * salida (unos 6 ms a 44100 Hz).
+ */
+#define SALAUD_MUESTRAS_RAMPA   256u
+
+/* Funcin a la que se llama (desde la interrupcin de la salida de audio)
+ * cuando termina un vaciado iniciado con salaud_vaciar.
+ */
+typedef void (*salaud_funcion_fin_t)(void);
+
 void salaud_habilitar(void);
 void salaud_deshabilitar(void);
 void salaud_esperar_fin_fragmento(void);
+void salaud_vaciar(salaud_funcion_fin_t funcion_fin);
+bool_t salaud_vaciado_terminado(void);
+void salaud_parar(void);
 void salaud_encolar_bloque_muestras(int32_t *ptr_muestras_izquierda,
                                     int32_t *ptr_muestras_derecha,
                                     uint16_t longitud,
                                     uint16_t numero_canales);
 void salaud_ajustar_tasa_muestreo(uint32_t sample_rate);
 void salaud_inicializar(void);
+uint32_t salaud_muestras_pendientes(void);
+uint32_t salaud_leer_tasa_muestreo(void);
+uint64_t salaud_muestras_reproducidas(void);
+uint32_t salaud_posicion_ms(void);
+void salaud_ajustar_posicion(uint64_t muestras);
+void salaud_ajustar_velocidad(uint32_t velocidad);
+uint32_t salaud_latencia_us(void);
 
 #endif  /* SALIDA_AUDIO_H */
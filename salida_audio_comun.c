@@ -0,0 +1,366 @@
+/***************************************************************************//**
+ * \file    salida_audio_comun.c
+ *
+ * \brief   Parte de la salida de audio comn a las implementaciones con DAC y
+ *          con UDA1380: el buffer de salida, el recuento de lo reproducido,
+ *          el vaciado y la parada. Cada implementacin programa su hardware
+ *          y, desde su interrupcin, saca las muestras del buffer con
+ *          salcom_siguiente_muestra.
+ *
+ *          En el buffer cada muestra ocupa 1 valor de 16 bits en mono y 2
+ *          (izquierdo y derecho entrelazados) en estreo, segn se indique
+ *          en salcom_inicializar.
+ *
+ *          La posicin de reproduccin se cuenta en muestras del fichero, no
+ *          de la salida: con el estiramiento temporal de wsola cada muestra
+ *          que sale corresponde a velocidad/100 muestras del fichero, as que
+ *          la interrupcin suma ese incremento en formato Q16.16.
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include "salida_audio.h"
+#include "salida_audio_comun.h"
+#include "cadena_dsp.h"
+#include "contador_ciclos.h"
+
+/*===== Variables pblicas =====================================================
+ */
+
+bool_t generando_audio = FALSE;
+
+/*===== Variables privadas =====================================================
+ */
+
+static uint32_t valores_muestra = 1;
+
+/* Posicin de reproduccin en muestras del fichero, en formato Q16.16, y lo
+ * que avanza por cada muestra que sale. La posicin la incrementa la
+ * interrupcin de la salida.
+ */
+static volatile uint64_t posicion_q16 = 0;
+static volatile uint32_t incremento_q16 = 65536u;
+
+/* Estado del vaciado asncrono del buffer de salida (ver salaud_vaciar).
+ */
+static volatile bool_t vaciando = FALSE;
+static volatile salaud_funcion_fin_t funcion_fin_vaciado = NULL;
+
+/* TRUE si el buffer se ha quedado vaco durante la reproduccin. El siguiente
+ * bloque encolado empezar con una rampa de subida.
+ */
+static volatile bool_t hubo_vaciado = FALSE;
+
+typedef struct {
+  short int raw[SALCOM_TAMANO_BUFFER];	/* 16 bit PCM output samples [ch][sample] */
+  volatile  unsigned short wr_idx;
+  volatile  unsigned short rd_idx;
+}decoded_stream_t;
+
+static decoded_stream_t     DecodedBuff;
+
+#define IS_DFIFO_EMPTY()   (DecodedBuff.wr_idx == DecodedBuff.rd_idx)
+
+#define DFIFO_WRITE(S)     do {                                                                    \
+                             DecodedBuff.raw[DecodedBuff.wr_idx] = S;                              \
+                             DecodedBuff.wr_idx = ( (DecodedBuff.wr_idx+1)%SALCOM_TAMANO_BUFFER ); \
+                           }while(0)
+
+#define DFIFO_READ(S)      do {                                                                    \
+                             S = DecodedBuff.raw[DecodedBuff.rd_idx];                              \
+                             DecodedBuff.rd_idx = ( (DecodedBuff.rd_idx+1)%SALCOM_TAMANO_BUFFER ); \
+                           }while(0)
+
+#define FIFO_LEN()        ( DecodedBuff.wr_idx >= DecodedBuff.rd_idx ? \
+                            DecodedBuff.wr_idx - DecodedBuff.rd_idx  : \
+                            DecodedBuff.wr_idx + (SALCOM_TAMANO_BUFFER - DecodedBuff.rd_idx) )
+
+static void esperar_vaciado(void);
+
+/***************************************************************************//**
+ * \brief       Esperar a que termine de sonar el fichero anterior y vaciar el
+ *              buffer. La llama salaud_inicializar antes de programar el
+ *              hardware.
+ *
+ * \param[in]   valores_por_muestra     1 si el buffer es mono, 2 si es
+ *                                      estreo.
+ */
+void salcom_inicializar(uint32_t valores_por_muestra)
+{
+    esperar_vaciado();
+
+    valores_muestra = valores_por_muestra;
+    DecodedBuff.wr_idx = DecodedBuff.rd_idx = 0;
+    generando_audio = FALSE;
+    hubo_vaciado = FALSE;
+    posicion_q16 = 0;
+}
+
+/***************************************************************************//**
+ * \brief       Sacar la siguiente muestra del buffer. Se llama desde la
+ *              interrupcin de la salida.
+ *
+ *              Si el buffer est vaco, las ltimas muestras enviadas decaen
+ *              hacia 0 para evitar un chasquido. Si adems se est vaciando
+ *              el buffer (salaud_vaciar), se deshabilita la salida de audio y
+ *              se avisa del final del vaciado.
+ *
+ * \param[out]  valores     valores de la muestra a enviar (1 o 2).
+ */
+void salcom_siguiente_muestra(int16_t *valores)
+{
+    static int16_t ultima[SALCOM_MAXIMO_VALORES];
+    salaud_funcion_fin_t funcion_fin;
+    uint32_t i;
+
+    if (!IS_DFIFO_EMPTY())
+    {
+        for (i = 0; i < valores_muestra; i++)
+        {
+            DFIFO_READ(ultima[i]);
+        }
+        posicion_q16 += incremento_q16;
+    }
+    else if (vaciando)
+    {
+        salaud_deshabilitar();
+        funcion_fin = funcion_fin_vaciado;
+        vaciando = FALSE;
+        if (funcion_fin != NULL) funcion_fin();
+        for (i = 0; i < valores_muestra; i++)
+        {
+            ultima[i] = 0;
+        }
+    }
+    else
+    {
+        for (i = 0; i < valores_muestra; i++)
+        {
+            ultima[i] -= ultima[i]/16;
+        }
+        hubo_vaciado = TRUE;
+    }
+
+    for (i = 0; i < valores_muestra; i++)
+    {
+        valores[i] = ultima[i];
+    }
+}
+
+/***************************************************************************//**
+ *
+ */
+void salaud_esperar_fin_fragmento(void)
+{
+    salaud_vaciar(NULL);
+    esperar_vaciado();
+}
+
+/***************************************************************************//**
+ * \brief       Terminar de reproducir las muestras que quedan en el buffer de
+ *              salida sin esperar a que acaben. Cuando el buffer se vaca la
+ *              interrupcin deshabilita la salida de audio y llama a
+ *              funcion_fin.
+ *
+ * \param[in]   funcion_fin     funcin a llamar al terminar el vaciado (desde
+ *                              la interrupcin) o NULL. El final tambin
+ *                              puede consultarse con salaud_vaciado_terminado.
+ */
+void salaud_vaciar(salaud_funcion_fin_t funcion_fin)
+{
+    funcion_fin_vaciado = funcion_fin;
+
+    if (!generando_audio)
+    {
+        if (funcion_fin != NULL) funcion_fin();
+        return;
+    }
+
+    vaciando = TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Consultar si ha terminado el ltimo vaciado del buffer de salida.
+ */
+bool_t salaud_vaciado_terminado(void)
+{
+    return !vaciando;
+}
+
+/***************************************************************************//**
+ * \brief   Parar la reproduccin sin chasquido: las primeras muestras que
+ *          esperan en el buffer de salida se atenan con una rampa de bajada,
+ *          el resto se descarta y se vaca el buffer de forma asncrona.
+ */
+void salaud_parar(void)
+{
+    uint32_t i;
+    uint32_t n;
+    uint16_t indice;
+    bool_t habilitada = generando_audio;
+
+    salaud_deshabilitar();
+
+    n = FIFO_LEN()/valores_muestra;
+    if (n > SALAUD_MUESTRAS_RAMPA) n = SALAUD_MUESTRAS_RAMPA;
+
+    indice = DecodedBuff.rd_idx;
+    for (i = 0; i < valores_muestra*n; i++)
+    {
+        DecodedBuff.raw[indice] = (int16_t)(DecodedBuff.raw[indice]*
+                                            (int32_t)(n - i/valores_muestra)/
+                                            (int32_t)n);
+        indice = (indice + 1)%SALCOM_TAMANO_BUFFER;
+    }
+    DecodedBuff.wr_idx = indice;
+
+    if (habilitada) salaud_habilitar();
+
+    salaud_vaciar(NULL);
+}
+
+/***************************************************************************//**
+ *
+ */
+void salaud_encolar_bloque_muestras(int32_t *ptr_muestras_izquierda,
+                                    int32_t *ptr_muestras_derecha,
+                                    uint16_t longitud,
+                                    uint16_t numero_canales)
+{
+    uint32_t i;
+    uint32_t j;
+    dsp_bloque_t *bloque;
+
+    /* Si el buffer se qued vaco, volver a entrar con una rampa de subida.
+     */
+    if (hubo_vaciado)
+    {
+        hubo_vaciado = FALSE;
+        dsp_iniciar_rampa_subida(SALAUD_MUESTRAS_RAMPA);
+    }
+
+    /* Pasar el bloque por la cadena DSP configurada en salaud_inicializar.
+     * A la salida el bloque tiene valores_muestra valores de 16 bits por
+     * muestra, entrelazados si es estreo.
+     */
+    bloque = dsp_procesar(ptr_muestras_izquierda,
+                          ptr_muestras_derecha,
+                          longitud,
+                          numero_canales);
+
+    /* Los valores de una muestra se escriben juntos, as que hay que esperar
+     * a que haya sitio para todos.
+     */
+    for (i = 0; i < valores_muestra*bloque->longitud; i += valores_muestra)
+    {
+        while ((uint32_t)FIFO_LEN() >= SALCOM_TAMANO_BUFFER - valores_muestra);
+        for (j = 0; j < valores_muestra; j++)
+        {
+            DFIFO_WRITE((int16_t)bloque->muestras[i + j]);
+        }
+    }
+
+    vaciando = FALSE;
+    if (!generando_audio) salaud_habilitar();
+}
+
+/***************************************************************************//**
+ *
+ */
+uint32_t salaud_muestras_pendientes(void)
+{
+    return FIFO_LEN()/valores_muestra;
+}
+
+/***************************************************************************//**
+ * \brief       Indicar la velocidad de reproduccin para que la posicin
+ *              avance en muestras del fichero. La llama wsola al cambiar de
+ *              velocidad.
+ *
+ * \param[in]   velocidad   tanto por ciento de la velocidad original.
+ */
+void salaud_ajustar_velocidad(uint32_t velocidad)
+{
+    incremento_q16 = velocidad*65536u/100u;
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de muestras del fichero (por canal) realmente reproducidas
+ *          desde el ltimo salaud_inicializar o salaud_ajustar_posicion. Las
+ *          muestras a 0 que se generan cuando el buffer est vaco no se
+ *          cuentan.
+ *
+ *          El contador de 64 bits se actualiza en la interrupcin y su lectura
+ *          no es atmica, as que se lee hasta obtener dos veces el mismo
+ *          valor.
+ */
+uint64_t salaud_muestras_reproducidas(void)
+{
+    uint64_t posicion;
+
+    do {
+        posicion = posicion_q16;
+    } while (posicion != posicion_q16);
+
+    return posicion >> 16;
+}
+
+/***************************************************************************//**
+ * \brief   Posicin de reproduccin, en milisegundos del fichero, de lo que se
+ *          est oyendo en este momento.
+ */
+uint32_t salaud_posicion_ms(void)
+{
+    uint32_t tasa = salaud_leer_tasa_muestreo();
+
+    if (tasa == 0) return 0;
+
+    return (uint32_t)(salaud_muestras_reproducidas()*1000u/tasa);
+}
+
+/***************************************************************************//**
+ * \brief       Fijar el contador de muestras reproducidas, por ejemplo despus
+ *              de un salto dentro del fichero.
+ *
+ * \param[in]   muestras    nueva posicin en muestras del fichero por canal.
+ */
+void salaud_ajustar_posicion(uint64_t muestras)
+{
+    __disable_irq();
+    posicion_q16 = muestras << 16;
+    __enable_irq();
+}
+
+/***************************************************************************//**
+ * \brief   Latencia de la salida: tiempo, en microsegundos, que tardarn en
+ *          orse las muestras que ya esperan en el buffer de salida.
+ */
+uint32_t salaud_latencia_us(void)
+{
+    uint32_t tasa = salaud_leer_tasa_muestreo();
+
+    if (tasa == 0) return 0;
+
+    return (uint32_t)((uint64_t)salaud_muestras_pendientes()*1000000u/tasa);
+}
+
+/***************************************************************************//**
+ * \brief   Esperar a que termine el vaciado en curso, como mucho
+ *          SALCOM_ESPERA_MAXIMA_MS. Si no termina (por ejemplo porque la
+ *          interrupcin de la salida no llega a producirse) se deshabilita la
+ *          salida y se da por terminado.
+ */
+static void esperar_vaciado(void)
+{
+    uint32_t inicio = ciclos_leer();
+    uint32_t limite = SystemCoreClock/1000u*SALCOM_ESPERA_MAXIMA_MS;
+
+    while (!salaud_vaciado_terminado())
+    {
+        if (ciclos_leer() - inicio > limite)
+        {
+            salaud_deshabilitar();
+            vaciando = FALSE;
+            break;
+        }
+    }
+}
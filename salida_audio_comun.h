@@ -0,0 +1,44 @@
+/***************************************************************************//**
+ * \file    salida_audio_comun.h
+ *
+ * \brief   Parte de la salida de audio comn a las implementaciones con DAC y
+ *          con UDA1380. Slo la usan salida_audio_con_dac.c y
+ *          salida_audio_con_uda1380.c.
+ */
+
+#ifndef SALIDA_AUDIO_COMUN_H
+#define SALIDA_AUDIO_COMUN_H
+
+#include "tipos.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Tamao del buffer de salida en valores de 16 bits.
+ */
+#define SALCOM_TAMANO_BUFFER        (2*1152)
+
+/* Tiempo mximo que se espera a que termine un vaciado del buffer. Con el
+ * buffer lleno y mono a 8 kHz el vaciado dura menos de 300 ms.
+ */
+#define SALCOM_ESPERA_MAXIMA_MS     500u
+
+/* Valores de 16 bits de cada muestra en el buffer: 1 en mono, 2 en estreo.
+ */
+#define SALCOM_MAXIMO_VALORES       2u
+
+/*===== Variables ==============================================================
+ */
+
+/* TRUE mientras la salida de audio est habilitada. La actualizan
+ * salaud_habilitar y salaud_deshabilitar.
+ */
+extern bool_t generando_audio;
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void salcom_inicializar(uint32_t valores_por_muestra);
+void salcom_siguiente_muestra(int16_t *valores);
+
+#endif  /* SALIDA_AUDIO_COMUN_H */
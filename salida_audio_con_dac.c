@@ -1,40 +1,15 @@
 #include <LPC407x_8x_177x_8x.h>
-#include <string.h>
 #include "salida_audio.h"
+#include "salida_audio_comun.h"
 #include "dac_lpc40xx.h"
 #include "tipos.h"
 #include "error.h"
+#include "cadena_dsp.h"
+#include "efectos_sonido.h"
 
-#define  STREAM_DECODED_SIZE     (2*1152)
-#define  ENABLED                  1
-#define  DISABLED                 0
-
-bool_t generando_audio = FALSE;
-
-typedef struct {
-  short int raw[STREAM_DECODED_SIZE];	/* 16 bit PCM output samples [ch][sample] */
-  volatile  unsigned short wr_idx;
-  volatile  unsigned short rd_idx;
-}decoded_stream_t;
-
-static decoded_stream_t     DecodedBuff;
-
-#define IS_DFIFO_FULL()    ((DecodedBuff.wr_idx+1)%STREAM_DECODED_SIZE == DecodedBuff.rd_idx)
-#define IS_DFIFO_EMPTY()   (DecodedBuff.wr_idx == DecodedBuff.rd_idx)
-
-#define DFIFO_WRITE(S)     do {                                                                   \
-                             DecodedBuff.raw[DecodedBuff.wr_idx] = S;                             \
-                             DecodedBuff.wr_idx = ( (DecodedBuff.wr_idx+1)%STREAM_DECODED_SIZE ); \
-                           }while(0)
-
-#define DFIFO_READ(S)      do {                                                                   \
-                             S = DecodedBuff.raw[DecodedBuff.rd_idx];                             \
-                             DecodedBuff.rd_idx = ( (DecodedBuff.rd_idx+1)%STREAM_DECODED_SIZE ); \
-                           }while(0)
-
-#define FIFO_LEN()        ( DecodedBuff.wr_idx >= DecodedBuff.rd_idx ? \
-                            DecodedBuff.wr_idx - DecodedBuff.rd_idx  : \
-                            DecodedBuff.wr_idx + (STREAM_DECODED_SIZE - DecodedBuff.rd_idx) )
+/* Tasa de muestreo programada en el timer 0.
+ */
+static uint32_t tasa_muestreo = 44100;
 
 /***************************************************************************//**
  *
@@ -54,52 +29,6 @@ void salaud_deshabilitar(void)
     generando_audio = FALSE;
 }
 
-/***************************************************************************//**
- *
- */
-void salaud_esperar_fin_fragmento(void)
-{
-    while (!IS_DFIFO_EMPTY());
-    salaud_deshabilitar();
-}
-
-/***************************************************************************//**
- *
- */
-void salaud_encolar_bloque_muestras(int32_t *ptr_muestras_izquierda,
-                                    int32_t *ptr_muestras_derecha,
-                                    uint16_t longitud,
-                                    uint16_t numero_canales)
-{
-    uint16_t i;
-    
-    if (numero_canales == 1)
-    {
-        for (i = 0; i < longitud; i++)
-        {
-            while (IS_DFIFO_FULL());
-            DFIFO_WRITE(*ptr_muestras_izquierda);
-            ptr_muestras_izquierda++;
-        }
-    }
-    else if (numero_canales == 2)
-    {
-        for (i = 0; i < longitud; i++)
-        {
-            while (IS_DFIFO_FULL());
-            DFIFO_WRITE((int16_t)(((int32_t)*ptr_muestras_izquierda + (int32_t)*ptr_muestras_derecha)/2));
-            ptr_muestras_izquierda++;
-            ptr_muestras_derecha++;
-        }
-    }
-    else
-    {
-        ERROR("Numero de canales incorrecto.");
-    }
-
-    if (!generando_audio) salaud_habilitar();
-}
-
 /***************************************************************************//**
  *
  */
@@ -112,6 +41,15 @@ void salaud_ajustar_tasa_muestreo(uint32_t sample_rate)
     LPC_TIM0->MCR = 3;
     LPC_TIM0->MR0 = ((uint32_t)PeripheralClock/sample_rate) - 1;
     LPC_TIM0->TCR = 1;
+    tasa_muestreo = sample_rate;
+}
+
+/***************************************************************************//**
+ *
+ */
+uint32_t salaud_leer_tasa_muestreo(void)
+{
+    return tasa_muestreo;
 }
 
 /***************************************************************************//**
@@ -119,8 +57,21 @@ void salaud_ajustar_tasa_muestreo(uint32_t sample_rate)
  */
 void salaud_inicializar(void)
 {    
-    DecodedBuff.wr_idx = DecodedBuff.rd_idx = 0;
-    generando_audio = FALSE;
+    /* Esperar a que termine de sonar el final del fichero anterior. El
+     * buffer es mono.
+     */
+    salcom_inicializar(1);
+
+    /* El DAC tiene un nico canal: mezclar a mono, convertir a 16 bits,
+     * aplicar la rampa de subida del comienzo y sumar los efectos de sonido
+     * que estn sonando.
+     */
+    dsp_inicializar();
+    dsp_anadir_etapa(&dsp_etapa_mezcla_mono);
+    dsp_anadir_etapa(&dsp_etapa_conversion_16_bits);
+    dsp_anadir_etapa(&dsp_etapa_rampa_subida);
+    dsp_anadir_etapa(&efecto_etapa_mezcla);
+    dsp_iniciar_rampa_subida(SALAUD_MUESTRAS_RAMPA);
 
     LPC_TIM0->TCR = 0;    
     LPC_TIM0->IR = 1;
@@ -142,18 +93,16 @@ void salaud_inicializar(void)
  */
 void TIMER0_IRQHandler(void)
 {
+    /* Si el buffer se vaca, salcom_siguiente_muestra hace decaer la ltima
+     * muestra hacia 0 en lugar de saltar bruscamente a 0. La muestra de 16
+     * bits ocupa todo su rango (ver dsp_etapa_conversion_16_bits), as que
+     * dividida entre 64 y centrada en 512 ocupa los 10 bits del DAC.
+     */
     int16_t muestra;
 
     LPC_TIM0->IR = 1;
-        
-    if (!IS_DFIFO_EMPTY())
-    {
-        DFIFO_READ(muestra);
-    }
-    else
-    {
-        muestra = 0;  
-    }
-   
+
+    salcom_siguiente_muestra(&muestra);
+
     dac_convertir(muestra/64 + 512);
 }
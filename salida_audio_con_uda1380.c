@@ -1,39 +1,12 @@
 #include <LPC407x_8x_177x_8x.h>
-#include <string.h>
 #include "salida_audio.h"
+#include "salida_audio_comun.h"
 #include "i2s_lpc40xx.h"
 #include "tipos.h"
 #include "error.h"
 #include "uda1380.h"
-
-#define  STREAM_DECODED_SIZE   (2*1152)
-
-bool_t generando_audio = FALSE;
-
-typedef struct {
-  short int raw[STREAM_DECODED_SIZE];	/* 16 bit PCM output samples [ch][sample] */
-  volatile  unsigned short wr_idx;
-  volatile  unsigned short rd_idx;
-}decoded_stream_t;
-
-static decoded_stream_t     DecodedBuff;
-
-#define IS_DFIFO_FULL()    ((DecodedBuff.wr_idx+1)%STREAM_DECODED_SIZE == DecodedBuff.rd_idx)
-#define IS_DFIFO_EMPTY()   (DecodedBuff.wr_idx == DecodedBuff.rd_idx)
-
-#define DFIFO_WRITE(S)     do {                                                                   \
-                             DecodedBuff.raw[DecodedBuff.wr_idx] = S;                             \
-                             DecodedBuff.wr_idx = ( (DecodedBuff.wr_idx+1)%STREAM_DECODED_SIZE ); \
-                           }while(0)
-
-#define DFIFO_READ(S)      do {                                                                   \
-                             S = DecodedBuff.raw[DecodedBuff.rd_idx];                             \
-                             DecodedBuff.rd_idx = ( (DecodedBuff.rd_idx+1)%STREAM_DECODED_SIZE ); \
-                           }while(0)
-
-#define FIFO_LEN()        ( DecodedBuff.wr_idx >= DecodedBuff.rd_idx ? \
-                            DecodedBuff.wr_idx - DecodedBuff.rd_idx  : \
-                            DecodedBuff.wr_idx + (STREAM_DECODED_SIZE - DecodedBuff.rd_idx) )
+#include "cadena_dsp.h"
+#include "efectos_sonido.h"
 
 /***************************************************************************//**
  *
@@ -57,65 +30,22 @@ void salaud_deshabilitar(void)
 /***************************************************************************//**
  *
  */
-void salaud_esperar_fin_fragmento(void)
-{
-    salaud_deshabilitar();
-    //while (!IS_DFIFO_EMPTY());
-}
-
-/***************************************************************************//**
- *
- */
-void salaud_encolar_bloque_muestras(int32_t *ptr_muestras_izquierda,
-                                    int32_t *ptr_muestras_derecha,
-                                    uint16_t longitud,
-                                    uint16_t numero_canales)
+void salaud_ajustar_tasa_muestreo(uint32_t sample_rate)
 {
-    uint16_t i;
-    
-    /* libmad genera muestras de 24 bits tiles en los 24 bits ms significativos
-     * de datos de 32 bits. Aqu se convierten a 16 bits antes de enviarlos al
-     * buffer de muestras.
+    /* ESTA FUNCIN PUEDE DEJARSE VACA SI TODOS LOS FICHEROS MP3 QUE VAMOS
+     * A REPRODUCIR TIENEN UNA FRECUENCIA DE MUESTREO DE 44100 Hz. DE MOMENTO
+     * PODEMOS DEJARLA SIN COMPLETAR.
      */
-          
-    if (numero_canales == 1)
-    {
-        for (i = 0; i < longitud; i++)
-        {
-            while (IS_DFIFO_FULL());
-            DFIFO_WRITE((int16_t)((*ptr_muestras_izquierda) >> 16));
-            DFIFO_WRITE((int16_t)((*ptr_muestras_izquierda) >> 16));
-            ptr_muestras_izquierda++;
-        }
-    }
-    else if (numero_canales == 2)
-    {
-        for (i = 0; i < longitud; i++)
-        {
-            while (IS_DFIFO_FULL());
-            DFIFO_WRITE((int16_t)((*ptr_muestras_izquierda) >> 16));
-            ptr_muestras_izquierda++;
-            DFIFO_WRITE((int16_t)((*ptr_muestras_derecha) >> 16));
-            ptr_muestras_derecha++;
-        }
-    }
-    else
-    {
-        ERROR("Numero de canales incorrecto.");
-    }
-
-    if (!generando_audio) salaud_habilitar();
 }
 
 /***************************************************************************//**
  *
  */
-void salaud_ajustar_tasa_muestreo(uint32_t sample_rate)
+uint32_t salaud_leer_tasa_muestreo(void)
 {
-    /* ESTA FUNCIN PUEDE DEJARSE VACA SI TODOS LOS FICHEROS MP3 QUE VAMOS
-     * A REPRODUCIR TIENEN UNA FRECUENCIA DE MUESTREO DE 44100 Hz. DE MOMENTO
-     * PODEMOS DEJARLA SIN COMPLETAR.
+    /* El interfaz I2S est programado para 44100 Hz en i2s_inicializar.
      */
+    return 44100;
 }
 
 /***************************************************************************//**
@@ -123,8 +53,21 @@ void salaud_ajustar_tasa_muestreo(uint32_t sample_rate)
  */
 void salaud_inicializar(void)
 {    
-    DecodedBuff.wr_idx = DecodedBuff.rd_idx = 0;
-    generando_audio = FALSE;
+    /* Esperar a que termine de sonar el final del fichero anterior. El
+     * buffer es estreo.
+     */
+    salcom_inicializar(2);
+
+    /* El UDA1380 recibe siempre estreo de 16 bits: duplicar los bloques
+     * mono, convertir las muestras de libmad a 16 bits, aplicar la rampa de
+     * subida del comienzo y sumar los efectos de sonido que estn sonando.
+     */
+    dsp_inicializar();
+    dsp_anadir_etapa(&dsp_etapa_mono_a_estereo);
+    dsp_anadir_etapa(&dsp_etapa_conversion_16_bits);
+    dsp_anadir_etapa(&dsp_etapa_rampa_subida);
+    dsp_anadir_etapa(&efecto_etapa_mezcla);
+    dsp_iniciar_rampa_subida(SALAUD_MUESTRAS_RAMPA);
 
     i2s_inicializar();
     uda1380_inicializar();
@@ -142,16 +85,18 @@ void salaud_inicializar(void)
  *          igual a 4 (la mitad de su capacidad de 8 o menos).
  *
  *          La funcin manejadora de interrupcin sacar del buffer de salida
- *          dos muestras mediante la macro DFIFO_READ, una para el canal
- *          izquierdo y otra para el canal derecho. Si la macro IS_DFIFO_EMPTY
- *          indica que el buffer de salida est vaco, dar valor 0 a ambas
- *          muestras.
+ *          dos muestras mediante salcom_siguiente_muestra, una para el canal
+ *          izquierdo y otra para el canal derecho. Si el buffer de salida
+ *          est vaco, salcom_siguiente_muestra hace decaer hacia 0 las
+ *          ltimas muestras enviadas para evitar un chasquido y, si adems se
+ *          est vaciando el buffer (salaud_vaciar), deshabilita la salida de
+ *          audio y avisa del final del vaciado.
  *
- *          NOTA: las macros DFIFO_READ y IS_DFIFO_EMPTY no se refieren a la
- *                FIFO de transmisin del I2S sino a la FIFO o buffer en la
- *                que el decodificador coloca las muestras de audio generadas.
- *                En esta funcin, recogemos las muestras de esta FIFO, las
- *                combinamos y las enviamos a la FIFO de transmisin del I2S.
+ *          NOTA: el buffer de salida no es la FIFO de transmisin del I2S
+ *                sino el buffer en el que el decodificador coloca las
+ *                muestras de audio generadas. En esta funcin, recogemos las
+ *                muestras de ese buffer, las combinamos y las enviamos a la
+ *                FIFO de transmisin del I2S.
  *
  *          Las dos muestras de 16 bits deben ser combinadas en un nico dato de
  *          32 bits que es el que se enviar a la FIFO de transmisin del I2S.
@@ -176,27 +121,10 @@ void salaud_inicializar(void)
  */
 void I2S_IRQHandler(void)
 {
-    int16_t muestra_izquierda;
-    int16_t muestra_derecha;
-        
-    if (!IS_DFIFO_EMPTY())
-    {
-        DFIFO_READ(muestra_izquierda);
-    }
-    else
-    {
-        muestra_izquierda = 0;  
-    }
-    
-    if (!IS_DFIFO_EMPTY())
-    {
-        DFIFO_READ(muestra_derecha);
-    }
-    else
-    {
-        muestra_derecha = 0;  
-    }
-   
-    LPC_I2S->TXFIFO = ((uint32_t)muestra_izquierda << 16) |
-                      ((uint32_t)muestra_derecha & 0xFFFF);
+    int16_t muestras[2];
+
+    salcom_siguiente_muestra(muestras);
+
+    LPC_I2S->TXFIFO = ((uint32_t)muestras[0] << 16) |
+                      ((uint32_t)muestras[1] & 0xFFFF);
 }
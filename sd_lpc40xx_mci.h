@@ -6,6 +6,7 @@
 #define SD_LPC40XX_MCI_H
 
 #include "tipos.h"
+#include "timer_lpc40xx.h"
 
 #define MCI_CLOCK_ENABLE            (1u<<8)
 #define MCI_CLOCK_PWRSAVE           (1u<<9)
@@ -19,9 +20,15 @@
 #define MCI_COMMAND_ENABLE          (1u<<10)
 
 #define MCI_STATUS_CMDCRCFAIL       (1u<<0)
+#define MCI_STATUS_DATACRCFAIL      (1u<<1)
 #define MCI_STATUS_CMDTIMEOUT       (1u<<2)
+#define MCI_STATUS_DATATIMEOUT      (1u<<3)
+#define MCI_STATUS_TXUNDERRUN       (1u<<4)
+#define MCI_STATUS_RXOVERRUN        (1u<<5)
 #define MCI_STATUS_CMDRESPEND       (1u<<6)
 #define MCI_STATUS_CMDSENT          (1u<<7)
+#define MCI_STATUS_DATAEND          (1u<<8)
+#define MCI_STATUS_STARTBITERR      (1u<<9)
 #define MCI_STATUS_DATABLOCKEND     (1u<<10)
 #define MCI_STATUS_CMDACTIVE        (1u<<11)
 #define MCI_STATUS_TXFIFOHALFEMPTY  (1u<<14)
@@ -33,6 +40,10 @@
 #define MCI_STATUS_TXDATAAVLBL      (1u<<20)
 #define MCI_STATUS_RXDATAAVLBL      (1u<<21)
 
+#define MCI_STATUS_DATAERROR        (MCI_STATUS_DATACRCFAIL | MCI_STATUS_DATATIMEOUT | \
+                                     MCI_STATUS_TXUNDERRUN | MCI_STATUS_RXOVERRUN | \
+                                     MCI_STATUS_STARTBITERR)
+
 #define NO_RESPONSE 0
 #define SHORT_RESPONSE 1
 #define LONG_RESPONSE 2
@@ -46,11 +57,12 @@
 #define SELECT_DESELECT_CARD 7
 #define SET_BUS_WIDTH 6
 #define SEND_IF_COND 8
+#define SWITCH_FUNC 6
  
 #define	CMDREAD             17
 #define	CMDREADMULTIPLE		18
 #define	CMDWRITE            24
-#define	CMDWRITEMULTIPLE    24
+#define	CMDWRITEMULTIPLE    25
 #define	CMDREADCSD          9
 #define CMD55               55
 #define ACMD23              23
@@ -58,6 +70,121 @@
 
 #define MCI_PRESCALE_MIN  5
 
+/* Argumentos de CMD6 para consultar si la tarjeta admite el modo High Speed
+ * (funcin 1 del grupo 1) y para cambiar a l.
+ */
+#define SWITCH_FUNC_CONSULTAR_ALTA_VELOCIDAD    0x00FFFFF1
+#define SWITCH_FUNC_CAMBIAR_ALTA_VELOCIDAD      0x80FFFFF1
+
+/* Frecuencia del bus en modo High Speed y frecuencia mxima de MCICLK que se
+ * programa aunque la tarjeta admita ms.
+ */
+#define SD_FRECUENCIA_ALTA_VELOCIDAD_HZ     50000000u
+#define SD_FRECUENCIA_MAXIMA_MCI_HZ         50000000u
+
+/* Mximo nmero de sectores de una transferencia mltiple. Est limitado por
+ * el registro MCIDataLength, de 16 bits.
+ */
+#define SD_MAXIMO_SECTORES_TRANSFERENCIA    127
+
+/* Capacidad en sectores del buffer intermedio alineado a palabra por el que
+ * pasan los datos cuando el buffer de una lectura o escritura no est
+ * alineado.
+ */
+#define SD_SECTORES_BUFFER_INTERMEDIO       8u
+
+/* Funcin a la que se llama al completar una lectura asncrona, desde
+ * sd_lectura_en_curso o sd_esperar_lectura (nunca desde la interrupcin).
+ * Recibe RES_OK o RES_ERROR.
+ */
+typedef void (*sd_funcion_fin_t)(uint32_t resultado);
+
+/* Timer usado como contador de microsegundos para los retardos y timeouts
+ * del driver.
+ */
+#define SD_TIMER                    TIMER1
+
+/* Tiempo mximo que se espera a que el MCI termine un comando, a que la
+ * tarjeta termine de programar bloques o a que pase al estado "trans", y
+ * nmero de veces que se repite un comando al que la tarjeta no responde.
+ */
+#define SD_TIMEOUT_COMANDO_US       10000u
+#define SD_TIMEOUT_OCUPADO_US       500000u
+#define SD_REINTENTOS_COMANDO       3u
+
+/* Tiempo mximo de la fase de datos por bloque (lmites de la especificacin
+ * SD para lectura y escritura), usado para programar MCIDataTimer y para
+ * acotar las esperas del driver, y tiempo mximo que el DMA puede tardar en
+ * vaciar el FIFO una vez que el MCI ha terminado.
+ */
+#define SD_TIMEOUT_LECTURA_US       100000u
+#define SD_TIMEOUT_ESCRITURA_US     250000u
+#define SD_TIMEOUT_DMA_US           1000u
+
+/* Espera tras cada cambio de la alimentacin de la tarjeta.
+ */
+#define SD_RETARDO_ALIMENTACION_US  1000u
+
+/* Estados de la tarjeta (campo CURRENT_STATE de la respuesta R1).
+ */
+#define SD_ESTADO_IDLE              0u
+#define SD_ESTADO_READY             1u
+#define SD_ESTADO_IDENT             2u
+#define SD_ESTADO_STBY              3u
+#define SD_ESTADO_TRAN              4u
+#define SD_ESTADO_DATA              5u
+#define SD_ESTADO_RCV               6u
+#define SD_ESTADO_PRG               7u
+#define SD_ESTADO_DIS               8u
+#define SD_ESTADO_DESCONOCIDO       0xFFu
+
+/* Con SD_INYECCION_ERRORES a 1 se compila sd_inyectar_error, que permite
+ * provocar en la placa los errores de los que el driver debe recuperarse.
+ */
+#define SD_INYECCION_ERRORES        0
+
+/* Tipos de error que se pueden inyectar.
+ */
+#define SD_ERROR_TIMEOUT_COMANDO    0u  /* El comando no se enva y se
+                                         * trata como si la tarjeta no
+                                         * respondiera. */
+#define SD_ERROR_CRC_COMANDO        1u  /* La respuesta se marca con CRC
+                                         * incorrecto. */
+#define SD_ERROR_CRC_DATOS          2u  /* El bloque de datos ledo se marca
+                                         * con CRC incorrecto. */
+
+/* Resultado de sd_medir_rendimiento.
+ */
+typedef struct {
+    uint32_t sectores;
+    uint32_t comandos;
+    uint32_t microsegundos;
+    uint32_t comandos_por_mb;
+    uint32_t microsegundos_por_mb;
+} sd_rendimiento_t;
+
+/* Contadores de la actividad del interfaz, para medir por ejemplo el nmero
+ * de comandos que se envan por cada MB ledo o la latencia de los comandos.
+ */
+typedef struct {
+    uint32_t comandos;              /* Incluye los reintentos. */
+    uint32_t sectores_leidos;
+    uint32_t sectores_escritos;
+    uint32_t reintentos;
+    uint32_t errores_timeout;
+    uint32_t errores_crc;
+    uint32_t reducciones_frecuencia;    /* Por errores de CRC en los datos. */
+    uint32_t ciclos_ultimo_comando;
+    uint32_t ciclos_maximos_comando;
+    uint64_t ciclos_comandos;
+    uint32_t sectores_alineados;    /* Transferidos por DMA directamente. */
+    uint32_t sectores_desalineados; /* Copiados a travs del buffer
+                                     * intermedio. */
+    uint64_t ciclos_copia_intermedia;   /* Ciclos de CPU copiando entre el
+                                         * buffer intermedio y el de
+                                         * destino u origen. */
+} sd_estadisticas_t;
+
 #define OCR_VOLTAGE_WINDOW 0x00FF8000
 
 #define OCR_HCS (1u<<30)
@@ -66,9 +193,24 @@ uint32_t sd_init(void);
 uint32_t sd_status(void);
 uint32_t sd_read(uint8_t  *buff, int32_t sector, int32_t count);
 uint32_t sd_write(const uint8_t  *buff, int32_t sector, int32_t count);
+uint32_t sd_read_async(uint8_t *buff, int32_t sector, int32_t count,
+                       sd_funcion_fin_t funcion_fin);
+uint32_t sd_lectura_en_curso(void);
+void sd_esperar_lectura(void);
 uint32_t sd_ioctl(int32_t ctrl, void *buff);
 uint32_t sd_getfattime(void);
 void mci_set_speed(int32_t speed);
+uint32_t sd_frecuencia_bus(void);
+bool_t sd_alta_velocidad(void);
 uint32_t sd_command(uint32_t cmd, uint32_t resp_type, uint32_t arg, uint32_t* resp);
+uint32_t sd_comandos_enviados(uint32_t cmd);
+uint32_t sd_estado_tarjeta(void);
+uint32_t sd_medir_rendimiento(uint8_t *buff, int32_t sector, int32_t count,
+                              sd_rendimiento_t *resultado);
+#if SD_INYECCION_ERRORES
+void sd_inyectar_error(uint32_t tipo, uint32_t cmd, uint32_t veces);
+#endif
+void sd_leer_estadisticas(sd_estadisticas_t *destino);
+void sd_reiniciar_estadisticas(void);
 
 #endif  /* SD_LPC40XX_MCI_H */
@@ -3,22 +3,208 @@
  */
 
 #include <LPC407x_8x_177x_8x.h>
+#include <string.h>
 #include "sd_lpc40xx_mci.h"
 #include "ff.h"
 #include "diskio.h"
 #include "rtc_lpc40xx.h"
+#include "timer_lpc40xx.h"
+#include "contador_ciclos.h"
+#include "gpdma_lpc40xx.h"
+#include "error.h"
 
 static volatile DSTATUS Stat = STA_NOINIT;	/* Disk status */
 unsigned int rel_addr = 0;
 static int sdhc_flag = 0;
 static int direcciones_de_bloque = 0;
+static sd_estadisticas_t estadisticas;
+
+/* Canal del GPDMA reservado para las transferencias de datos con el MCI.
+ */
+static int32_t canal_dma = -1;
+
+/* Divisor de MCICLK programado (-1 => bypass, MCICLK = PCLK), frecuencia
+ * resultante del bus y TRUE si la tarjeta est en modo High Speed.
+ */
+static int32_t divisor_bus = -1;
+static uint32_t frecuencia_bus_hz = 0;
+static bool_t alta_velocidad = FALSE;
+
+/* Multiplicadores (x10) y unidades del campo TRAN_SPEED del CSD.
+ */
+static const uint8_t multiplicadores_tran_speed[16] = {
+    0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80
+};
+static const uint32_t unidades_tran_speed[4] = {
+    100000u, 1000000u, 10000000u, 100000000u
+};
+
+static void ajustar_frecuencia_bus(uint32_t frecuencia_hz);
+static void reducir_frecuencia_bus(void);
+static uint32_t frecuencia_tran_speed(uint32_t tran_speed);
+static uint32_t cambiar_a_alta_velocidad(void);
+static void completar_lectura_asincrona(void);
+static bool_t comando_rechazado(uint32_t status, uint32_t resp);
+static uint32_t periodos_bus(uint32_t microsegundos);
+static uint32_t esperar_fin_datos(uint32_t timeout_us);
+static bool_t lectura_asincrona_vencida(void);
+
+/* Estado de la lectura asncrona en curso (ver sd_read_async). La
+ * interrupcin del MCI slo anota el estado con el que terminaron los datos;
+ * el CMD12, el cambio de frecuencia del bus y la copia desde el buffer
+ * intermedio se hacen fuera de la interrupcin, en
+ * completar_lectura_asincrona.
+ */
+static volatile uint32_t lectura_asincrona_en_curso = 0;
+static volatile uint32_t datos_asincronos_recibidos = 0;
+static volatile uint32_t estado_lectura_asincrona;
+static uint32_t sectores_lectura_asincrona;
+static uint32_t inicio_lectura_asincrona;
+static sd_funcion_fin_t funcion_fin_lectura_asincrona;
+
+/* Buffer intermedio para las transferencias con buffers no alineados a
+ * palabra y destino final de la lectura en curso si pasa por l (NULL si la
+ * lectura va directamente al buffer del usuario).
+ */
+static uint32_t buffer_intermedio[SD_SECTORES_BUFFER_INTERMEDIO*512u/4u];
+static uint8_t *destino_desalineado = NULL;
+
+#define ALINEADO_A_PALABRA(p)   (((uint32_t)(p) & 0x03u) == 0)
+
+/* Nmero de veces que se ha enviado cada comando (incluidos los reintentos)
+ * y estado de la tarjeta indicado en la ltima respuesta R1 recibida. El
+ * ndice de comando tiene 6 bits.
+ */
+#define NUMERO_COMANDOS         64u
+
+static uint32_t comandos_enviados[NUMERO_COMANDOS];
+static uint32_t estado_tarjeta = SD_ESTADO_DESCONOCIDO;
+
+/* TRUE si el ltimo comando enviado fue APP_CMD y la tarjeta lo acept, de
+ * modo que el siguiente es un ACMD. Si hay que repetir el ACMD hay que
+ * volver a enviar antes APP_CMD con el mismo argumento.
+ */
+static bool_t ultimo_fue_app_cmd = FALSE;
+static uint32_t argumento_app_cmd;
+
+#if SD_INYECCION_ERRORES
+/* Error pendiente de inyectar (ver sd_inyectar_error).
+ */
+static uint32_t tipo_error_inyectado;
+static uint32_t comando_error_inyectado;
+static uint32_t errores_pendientes = 0;
+
+static bool_t inyectar(uint32_t tipo, uint32_t cmd);
+#endif
+
+/* Lnea DAT0 del bus SD (P1[6]). Mientras la tarjeta est programando un
+ * bloque escrito la mantiene a 0. El registro PIN del GPIO refleja el estado
+ * del pin aunque est configurado como SD_DAT[0].
+ */
+#define SD_PIN_DAT0     (1u << 6)
+
+/* Bits de error de la respuesta R1: OUT_OF_RANGE a ERROR (31-19, salvo
+ * CARD_IS_LOCKED), CSD_OVERWRITE, WP_ERASE_SKIP, CARD_ECC_DISABLED,
+ * ERASE_RESET y AKE_SEQ_ERROR.
+ */
+#define R1_ERRORES      0xFDFFE008u
+
+/***************************************************************************//**
+ * \brief       Esperar el nmero de microsegundos indicado usando el contador
+ *              de SD_TIMER.
+ */
+static void esperar_us(uint32_t microsegundos)
+{
+    uint32_t inicio = timer_leer(SD_TIMER);
+
+    while (timer_leer(SD_TIMER) - inicio < microsegundos);
+}
+
+/***************************************************************************//**
+ * \brief   Esperar a que la tarjeta libere la lnea DAT0 (fin de ocupado).
+ *
+ * \return  RES_OK o RES_ERROR si no la libera en SD_TIMEOUT_OCUPADO_US.
+ */
+static uint32_t esperar_tarjeta_libre(void)
+{
+    uint32_t inicio = timer_leer(SD_TIMER);
+
+    while (!(LPC_GPIO1->PIN & SD_PIN_DAT0))
+    {
+        if (timer_leer(SD_TIMER) - inicio > SD_TIMEOUT_OCUPADO_US)
+        {
+            estadisticas.errores_timeout++;
+            return RES_ERROR;
+        }
+    }
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Esperar a que la tarjeta est en el estado "trans" y lista para
+ *          recibir datos.
+ *
+ * \return  RES_OK o RES_ERROR si no lo est en SD_TIMEOUT_OCUPADO_US.
+ */
+static uint32_t esperar_estado_trans(void)
+{
+    uint32_t inicio = timer_leer(SD_TIMER);
+    uint32_t resp = 0;
+
+    for (;;)
+    {
+        sd_command(SEND_STATUS, SHORT_RESPONSE, rel_addr, &resp);
+
+        if ((resp & 0x00000F00) == 0x00000900) return RES_OK;
+
+        if (timer_leer(SD_TIMER) - inicio > SD_TIMEOUT_OCUPADO_US)
+        {
+            estadisticas.errores_timeout++;
+            return RES_ERROR;
+        }
+    }
+}
 
 /***************************************************************************//**
+ * \brief       Convertir un tiempo en periodos del reloj del bus, para
+ *              programar MCIDataTimer.
+ *
+ * \param[in]   microsegundos   tiempo, mltiplo de 1000.
+ *
+ * \return      Nmero de periodos a la frecuencia actual del bus.
+ */
+static uint32_t periodos_bus(uint32_t microsegundos)
+{
+    return (frecuencia_bus_hz/1000u)*(microsegundos/1000u);
+}
+
+/***************************************************************************//**
+ * \brief       Esperar a que el MCI indique fin de datos o error en la fase de
+ *              datos en curso. Si no lo hace en el tiempo indicado se
+ *              desactiva el camino de datos y se da por terminada con error de
+ *              timeout, igual que si hubiera vencido MCIDataTimer.
+ *
+ * \param[in]   timeout_us  tiempo mximo de espera.
+ *
+ * \return      Valor del registro MCIStatus al terminar.
  */
-void delay(void)
+static uint32_t esperar_fin_datos(uint32_t timeout_us)
 {
-    unsigned int t;
-    for (t = 0; t < 1000; t++);
+    uint32_t inicio = timer_leer(SD_TIMER);
+    uint32_t status;
+
+    while (!((status = LPC_MCI->STATUS) & (MCI_STATUS_DATAEND | MCI_STATUS_DATAERROR)))
+    {
+        if (timer_leer(SD_TIMER) - inicio > timeout_us)
+        {
+            LPC_MCI->DATACTRL = 0;
+            estadisticas.errores_timeout++;
+            return status | MCI_STATUS_DATATIMEOUT;
+        }
+    }
+
+    return status;
 }
 
 /***************************************************************************//**
@@ -28,7 +214,7 @@ uint32_t sd_init(void)
     uint32_t resp;
     uint32_t resp2[4];
     uint32_t retry = 10000;
-    volatile int32_t t;
+    uint32_t frecuencia_maxima;
     
     /* ---- Preparar el interfaz SD/MMC del LPC2378 ----------------------------
     */
@@ -37,9 +223,10 @@ uint32_t sd_init(void)
      */    
     LPC_SC->PCONP |= (1<<28);
     
-    /* Activar alimentacin del controlador DMA (GPDMA).
-     */    
-    LPC_SC->PCONP |= (1<<29);   
+    /* Contador de microsegundos para los retardos y timeouts del driver.
+     */
+    timer_inicializar(SD_TIMER);
+    timer_iniciar_conteo_us(SD_TIMER);
     
     /* Configurar pines de E/S para funcionar como interfaz SD/MMC:
      *
@@ -61,17 +248,15 @@ uint32_t sd_init(void)
             
     LPC_MCI->POWER = 2;   /* Power-up. */
 
-    delay();
+    esperar_us(SD_RETARDO_ALIMENTACION_US);
     
     LPC_MCI->POWER = 3;   /* Power-on. */
 
-    delay();
+    esperar_us(SD_RETARDO_ALIMENTACION_US);
     
     LPC_MCI->DATATMR = 0x1FFFFFFF;
     LPC_MCI->COMMAND = 0;
-    delay();
     LPC_MCI->DATACTRL = 0;
-    delay();
     
     /* Programar el registro MCIClock
     */
@@ -81,10 +266,11 @@ uint32_t sd_init(void)
     
     LPC_MCI->CLOCK = MCI_CLOCK_WIDEBUS | MCI_CLOCK_ENABLE | MCI_CLOCK_CLKDIV;    
     
-    /* Inicializar el controlador de DMA.
+    /* Reservar un canal de alta prioridad del controlador DMA. La tarjeta
+     * no puede esperar: si el FIFO del MCI se desborda la lectura falla.
      */
-    LPC_GPDMA->Config = 0x01;
-    while (!(LPC_GPDMA->Config & 0x01));
+    if (canal_dma < 0) canal_dma = gpdma_reservar_canal(GPDMA_PRIORIDAD_ALTA);
+    ASSERT(canal_dma >= 0, "No quedan canales DMA para la tarjeta SD.");
     
     /* ---- Inicializar la tarjeta SD ------------------------------------------
     */
@@ -168,6 +354,12 @@ uint32_t sd_init(void)
     
     rel_addr = resp & 0xFFFF0000;
     
+    /* Leer el CSD (slo puede hacerse con la tarjeta sin seleccionar) para
+     * conocer la frecuencia mxima del bus en modo normal (TRAN_SPEED).
+     */
+    sd_command(CMDREADCSD, LONG_RESPONSE, rel_addr, resp2);
+    frecuencia_maxima = frecuencia_tran_speed(resp2[3] & 0xFF);
+    
     sd_command(SELECT_DESELECT_CARD, SHORT_RESPONSE, rel_addr, &resp); 
     
     /* Seleccionar bus de datos de 4 bits.
@@ -188,8 +380,13 @@ uint32_t sd_init(void)
         return Stat;
     }
     
-    mci_set_speed(MCI_PRESCALE_MIN);
+    /* Pasar a modo High Speed si la tarjeta lo admite y ajustar la
+     * frecuencia del bus a la mxima de la tarjeta que admita el MCI.
+     */
+    alta_velocidad = (cambiar_a_alta_velocidad() == RES_OK);
+    if (alta_velocidad) frecuencia_maxima = SD_FRECUENCIA_ALTA_VELOCIDAD_HZ;
     
+    ajustar_frecuencia_bus(frecuencia_maxima);
     
     /* Falta comprobar si est protegida contra escritura (STA_PROTECTED)
     *
@@ -209,9 +406,214 @@ void mci_set_speed(int32_t speed)
     speed &= 0xFF;
     if (speed < MCI_PRESCALE_MIN) speed = MCI_PRESCALE_MIN;
     LPC_MCI->CLOCK = (LPC_MCI->CLOCK & (~0xFF)) | speed;
-    delay();	
+
+    /* Tras escribir en MCIClock hay que esperar 3 ciclos de MCICLK antes de
+     * volver a escribir en los registros del MCI. A la velocidad ms baja
+     * son unos 20 us.
+     */
+    esperar_us(50);
+}
+
+
+/***************************************************************************//**
+ * \brief       Programar el divisor de MCICLK.
+ *
+ * \param[in]   divisor     0..255 o -1 para bypass (MCICLK = PCLK).
+ */
+static void programar_divisor_bus(int32_t divisor)
+{
+    uint32_t clock = LPC_MCI->CLOCK & ~(0xFFu | MCI_CLOCK_BYPASS);
+
+    if (divisor < 0)
+    {
+        clock |= MCI_CLOCK_BYPASS;
+        frecuencia_bus_hz = PeripheralClock;
+    }
+    else
+    {
+        clock |= (uint32_t)divisor;
+        frecuencia_bus_hz = PeripheralClock/(2u*((uint32_t)divisor + 1u));
+    }
+
+    divisor_bus = divisor;
+    LPC_MCI->CLOCK = clock;
+
+    /* Esperar 3 ciclos de MCICLK antes de volver a escribir en el MCI.
+     */
+    esperar_us(50);
+}
+
+/***************************************************************************//**
+ * \brief       Programar la mayor frecuencia de MCICLK que no supere la
+ *              indicada ni SD_FRECUENCIA_MAXIMA_MCI_HZ.
+ *
+ *              MCICLK = PCLK/(2*(divisor + 1)) o PCLK con bypass.
+ */
+static void ajustar_frecuencia_bus(uint32_t frecuencia_hz)
+{
+    uint32_t divisor;
+
+    if (frecuencia_hz > SD_FRECUENCIA_MAXIMA_MCI_HZ)
+    {
+        frecuencia_hz = SD_FRECUENCIA_MAXIMA_MCI_HZ;
+    }
+
+    if (frecuencia_hz >= PeripheralClock)
+    {
+        programar_divisor_bus(-1);
+        return;
+    }
+
+    divisor = (PeripheralClock + 2u*frecuencia_hz - 1u)/(2u*frecuencia_hz);
+    if (divisor > 0) divisor--;
+    if (divisor > 255) divisor = 255;
+
+    programar_divisor_bus((int32_t)divisor);
+}
+
+/***************************************************************************//**
+ * \brief   Bajar la frecuencia del bus a la mitad (aproximadamente) tras un
+ *          error de CRC en los datos.
+ */
+static void reducir_frecuencia_bus(void)
+{
+    if (divisor_bus >= 255) return;
+
+    estadisticas.reducciones_frecuencia++;
+
+    if (divisor_bus < 0)
+    {
+        programar_divisor_bus(0);
+    }
+    else
+    {
+        programar_divisor_bus(divisor_bus*2 + 1 > 255 ? 255 : divisor_bus*2 + 1);
+    }
+}
+
+/***************************************************************************//**
+ * \brief       Frecuencia mxima del bus indicada por el campo TRAN_SPEED del
+ *              CSD.
+ */
+static uint32_t frecuencia_tran_speed(uint32_t tran_speed)
+{
+    uint32_t frecuencia = unidades_tran_speed[tran_speed & 0x03]*
+                          multiplicadores_tran_speed[(tran_speed >> 3) & 0x0F]/10u;
+
+    /* Valor no vlido: usar la frecuencia por defecto de 25 MHz.
+     */
+    if (frecuencia == 0 || (tran_speed & 0x04)) frecuencia = 25000000u;
+
+    return frecuencia;
 }
 
+/***************************************************************************//**
+ * \brief       Enviar CMD6 (SWITCH_FUNC) y leer, sin DMA, el bloque de 64
+ *              bytes con el estado de las funciones de la tarjeta.
+ *
+ * \param[in]   argumento   argumento de CMD6 (modo consulta o cambio).
+ * \param[out]  estado      64 bytes en el orden en que los enva la tarjeta.
+ *
+ * \return      RES_OK o RES_ERROR si la tarjeta no admite CMD6 o falla la
+ *              lectura.
+ */
+static uint32_t leer_estado_funciones(uint32_t argumento, uint8_t *estado)
+{
+    uint32_t resp;
+    uint32_t status;
+    uint32_t palabra;
+    uint32_t n = 0;
+    uint32_t inicio;
+
+    LPC_MCI->CLEAR = 0x7FF;
+
+    if (sd_command(SWITCH_FUNC, SHORT_RESPONSE, argumento, &resp) &
+        MCI_STATUS_CMDTIMEOUT)
+    {
+        return RES_ERROR;
+    }
+
+    LPC_MCI->DATATMR = periodos_bus(SD_TIMEOUT_LECTURA_US);
+    LPC_MCI->DATALEN = 64;
+    LPC_MCI->DATACTRL = (6 << 4) | (1 << 1) | 1;    /* Bloques de 64 bytes, lectura, sin DMA. */
+
+    inicio = timer_leer(SD_TIMER);
+
+    while (n < 16)
+    {
+        status = LPC_MCI->STATUS;
+
+        if (status & MCI_STATUS_RXDATAAVLBL)
+        {
+            palabra = LPC_MCI->FIFO[0];
+            estado[4*n]     = (uint8_t)palabra;
+            estado[4*n + 1] = (uint8_t)(palabra >> 8);
+            estado[4*n + 2] = (uint8_t)(palabra >> 16);
+            estado[4*n + 3] = (uint8_t)(palabra >> 24);
+            n++;
+        }
+        else if ((status & MCI_STATUS_DATAERROR) ||
+                 timer_leer(SD_TIMER) - inicio > SD_TIMEOUT_COMANDO_US)
+        {
+            break;
+        }
+    }
+
+    LPC_MCI->DATACTRL = 0;
+    LPC_MCI->CLEAR = 0x7FF;
+
+    return n == 16 ? RES_OK : RES_ERROR;
+}
+
+/***************************************************************************//**
+ * \brief   Consultar con CMD6 si la tarjeta admite el modo High Speed (funcin
+ *          1 del grupo 1) y, si lo admite, cambiar a l. La tarjeta debe
+ *          estar seleccionada, en el estado "trans" y con el bus de 4 bits.
+ *
+ * \return  RES_OK si la tarjeta ha pasado a modo High Speed.
+ */
+static uint32_t cambiar_a_alta_velocidad(void)
+{
+    uint8_t estado[64];
+
+    /* Bits 415:400 del estado: funciones admitidas del grupo 1.
+     */
+    if (leer_estado_funciones(SWITCH_FUNC_CONSULTAR_ALTA_VELOCIDAD, estado) != RES_OK ||
+        !(estado[13] & 0x02))
+    {
+        return RES_ERROR;
+    }
+
+    /* Bits 379:376 del estado: funcin del grupo 1 seleccionada.
+     */
+    if (leer_estado_funciones(SWITCH_FUNC_CAMBIAR_ALTA_VELOCIDAD, estado) != RES_OK ||
+        (estado[16] & 0x0F) != 1)
+    {
+        return RES_ERROR;
+    }
+
+    /* La tarjeta cambia de modo en 8 ciclos de reloj como mximo.
+     */
+    esperar_us(SD_RETARDO_ALIMENTACION_US);
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Frecuencia actual de MCICLK en Hz.
+ */
+uint32_t sd_frecuencia_bus(void)
+{
+    return frecuencia_bus_hz;
+}
+
+/***************************************************************************//**
+ * \brief   TRUE si la tarjeta est funcionando en modo High Speed.
+ */
+bool_t sd_alta_velocidad(void)
+{
+    return alta_velocidad;
+}
 
 /***************************************************************************//**
  *
@@ -225,16 +627,200 @@ uint32_t sd_status(void)
  */
 
 /***************************************************************************//**
+ * \brief       Copiar datos entre el buffer intermedio y un buffer no
+ *              alineado, contando los ciclos empleados.
+ */
+static void copiar_intermedio(void *destino, const void *origen, uint32_t bytes)
+{
+    uint32_t inicio = ciclos_leer();
+
+    memcpy(destino, origen, bytes);
+    estadisticas.ciclos_copia_intermedia += ciclos_leer() - inicio;
+}
+
+/***************************************************************************//**
+ * \brief       Programar el DMA y enviar el comando de lectura de n sectores
+ *              consecutivos (CMD17 si n es 1, CMD18 si es mayor). La
+ *              transferencia queda en marcha al salir.
+ *
+ *              Si buff est alineado a palabra el DMA escribe en l palabras
+ *              de 32 bits. Si no, los datos se leen al buffer intermedio y se
+ *              copian a buff en terminar_lectura.
+ *
+ * \param[out]  buff    buffer destino (n*512 bytes).
+ * \param[in]   place   direccin del primer sector (de byte o de bloque segn
+ *                      la tarjeta).
+ * \param[in]   n       nmero de sectores (1..SD_MAXIMO_SECTORES_TRANSFERENCIA
+ *                      o 1..SD_SECTORES_BUFFER_INTERMEDIO si buff no est
+ *                      alineado).
+ *
+ * \return      RES_OK o RES_ERROR si la tarjeta no est lista o no acepta el
+ *              comando.
+ */
+static uint32_t iniciar_lectura(uint8_t *buff, uint32_t place, uint32_t n)
+{
+    uint32_t resp;
+    gpdma_lli_t lli;
+
+    LPC_MCI->CLEAR = 0x7FF;
+
+    if (ALINEADO_A_PALABRA(buff))
+    {
+        destino_desalineado = NULL;
+    }
+    else
+    {
+        ASSERT(n <= SD_SECTORES_BUFFER_INTERMEDIO,
+               "Lectura no alineada demasiado larga.");
+        destino_desalineado = buff;
+        buff = (uint8_t *)buffer_intermedio;
+    }
+
+    /* ---- Programar el canal DMA ---------------------------------------------
+     *
+     * IMPORTANTE: El controlador DMA GPDMA solo trabaja con
+     * la memoria de 8Kbytes que est en el bus AHB1 (ver pgina
+     * 9 del manual).
+     *
+     * El canal del GPDMA se programa para que cada vez que el MCI
+     * genere una peticin DMA se transfiera un burst de 8 palabras
+     * (la mitad de la profundidad del FIFO del MCI) de 32 bits
+     * desde el MCI a la memoria, tambin en palabras de 32 bits (128
+     * escrituras en memoria por sector en lugar de 512 escrituras de un
+     * byte). El control de flujo lo lleva el MCI, as que una sola
+     * programacin del canal sirve para los n sectores: la transferencia
+     * termina cuando el MCI ha recibido n*512 bytes.
+     */
+
+    gpdma_construir_lli(&lli,
+                        (uint32_t)LPC_MCI->FIFO,    /* Fuente: FIFO del SD controller. */
+                        (uint32_t)buff,             /* Destino: buff. */
+                        GPDMA_CONTROL_INCREMENTAR_DESTINO |
+                        GPDMA_CONTROL_ANCHO_DESTINO(GPDMA_ANCHO_32) |
+                        GPDMA_CONTROL_ANCHO_ORIGEN(GPDMA_ANCHO_32) |
+                        GPDMA_CONTROL_BURST_DESTINO(GPDMA_BURST_8) |
+                        GPDMA_CONTROL_BURST_ORIGEN(GPDMA_BURST_8) |
+                        GPDMA_CONTROL_TAMANO(512),  /* Ignorado: el control de flujo lo lleva el MCI. */
+                        NULL);
+
+    gpdma_iniciar((uint32_t)canal_dma, &lli,
+                  GPDMA_CONFIG_BLOQUEADO |
+                  GPDMA_CONFIG_TIPO(GPDMA_TIPO_P2M_CONTROL_PERIFERICO) |
+                  GPDMA_CONFIG_PERIFERICO_ORIGEN(GPDMA_PERIFERICO_MCI),
+                  NULL);
+
+    if (esperar_estado_trans() != RES_OK ||
+        comando_rechazado(sd_command(n > 1 ? CMDREADMULTIPLE : CMDREAD,
+                                     SHORT_RESPONSE, place, &resp),
+                          resp))
+    {
+        gpdma_parar((uint32_t)canal_dma);
+        return RES_ERROR;
+    }
+     
+    LPC_MCI->DATATMR = periodos_bus(SD_TIMEOUT_LECTURA_US);
+    LPC_MCI->DATALEN = 512*n;
+    LPC_MCI->DATACTRL = (9 << 4) | (1 << 3) | (1 << 1) | 1;            
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief       Terminar una lectura iniciada con iniciar_lectura una vez que
+ *              el MCI indica fin de datos o error.
+ *
+ * \param[in]   n       nmero de sectores de la lectura.
+ * \param[in]   status  valor del registro MCIStatus al terminar.
+ *
+ * \return      RES_OK o RES_ERROR.
+ */
+static uint32_t terminar_lectura(uint32_t n, uint32_t status)
+{
+    uint32_t resp;
+    uint32_t inicio;
+
+    /* Terminar la lectura mltiple. La tarjeta sigue enviando bloques
+     * hasta recibir CMD12.
+     */
+    if (n > 1)
+    {
+        sd_command(CMDSTOPTRANSMISION, SHORT_RESPONSE, 0, &resp);
+    }
+
+#if SD_INYECCION_ERRORES
+    if (inyectar(SD_ERROR_CRC_DATOS, n > 1 ? CMDREADMULTIPLE : CMDREAD))
+    {
+        status |= MCI_STATUS_DATACRCFAIL;
+    }
+#endif
+
+    if (status & MCI_STATUS_DATAERROR)
+    {
+        gpdma_parar((uint32_t)canal_dma);
+
+        /* Un error de CRC indica que el bus no funciona bien a la frecuencia
+         * actual.
+         */
+        if (status & MCI_STATUS_DATACRCFAIL) reducir_frecuencia_bus();
+
+        return RES_ERROR;
+    }
+
+    /* Por precaucin, esperar a que termine la transferencia DMA.
+     * Quizs no sea realmente necesario.
+     */
+    inicio = timer_leer(SD_TIMER);
+
+    while (gpdma_canal_activo((uint32_t)canal_dma))
+    {
+        if (timer_leer(SD_TIMER) - inicio > SD_TIMEOUT_DMA_US)
+        {
+            gpdma_parar((uint32_t)canal_dma);
+            estadisticas.errores_timeout++;
+            return RES_ERROR;
+        }
+    }
+
+    estadisticas.sectores_leidos += n;
+
+    if (destino_desalineado != NULL)
+    {
+        copiar_intermedio(destino_desalineado, buffer_intermedio, 512u*n);
+        estadisticas.sectores_desalineados += n;
+    }
+    else
+    {
+        estadisticas.sectores_alineados += n;
+    }
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief       Leer sectores de la tarjeta. Cada grupo de hasta
+ *              SD_MAXIMO_SECTORES_TRANSFERENCIA sectores se lee con un nico
+ *              comando de lectura mltiple (CMD18) y una nica transferencia
+ *              DMA, terminada con CMD12. Para un solo sector se usa CMD17.
+ *              Si buff no est alineado a palabra los grupos son de hasta
+ *              SD_SECTORES_BUFFER_INTERMEDIO sectores y pasan por el buffer
+ *              intermedio.
+ *
+ * \param[out]  buff    buffer destino (count*512 bytes).
+ * \param[in]   sector  primer sector a leer.
+ * \param[in]   count   nmero de sectores a leer.
  *
+ * \return      RES_OK o RES_ERROR si se produjo un error en la transferencia.
  */
 uint32_t sd_read(uint8_t *buff, int32_t sector, int32_t count)
 {
     uint32_t place;
     uint32_t place_incr;
-    uint32_t resp;
+    uint32_t n;
+    uint32_t status;
+    uint32_t reintentos = 0;
+    uint32_t maximo;
 
-    /* MEJORAR PARA UTILIZAR EL COMANDO DE LECTURA MLTIPLE.
-     */
+    sd_esperar_lectura();
 
     if (direcciones_de_bloque == 0)
     {
@@ -249,83 +835,244 @@ uint32_t sd_read(uint8_t *buff, int32_t sector, int32_t count)
 	
     while (count)
     {
-        LPC_MCI->CLEAR = 0x7FF;
+        maximo = ALINEADO_A_PALABRA(buff) ?
+                 SD_MAXIMO_SECTORES_TRANSFERENCIA : SD_SECTORES_BUFFER_INTERMEDIO;
+        n = (uint32_t)count > maximo ? maximo : (uint32_t)count;
 
-        /* ---- Programar el canal 0 del controlador DMA -----------------------
-         *
-         * IMPORTANTE: El registro GPDMA_CONFIG tiene que estar ya
-         * configurado.
-         *
-         * IMPORTANTE: El controlador DMA GPDMA solo trabaja con
-         * la memoria de 8Kbytes que est en el bus AHB1 (ver pgina
-         * 9 del manual).
-         *
-         * IMPORTANTE: la funcin f_mkfs utiliza un offset 446 dentro de fs->win.
-         * 446 no es divisible entre 4 por tanto la funcin f_mkfs no puede usarse.
-         * Para poder usarla habra que modificar la funcin sd_write para que
-         * las transferencias DMA desde la fuente sean byte a byte.
-         *
-         * El canal 0 del GPDMA se programa para que cada vez que el MCI
-         * genere una peticin DMA se transfiera un burst de 8 palabras
-         * (la mitad de la profundidad del FIFO del MCI) de 32 bits
-         * desde el MCI a la memoria. La longitud total de la transferencia
-         * ser de 512 bytes (un sector de la tarjeta).
-         */
-    
-        LPC_GPDMA->IntTCClear = 0x01;                   /* Borrar ints. Terminal Count pendientes. */
-        LPC_GPDMA->IntErrClr = 0x01;                    /* Borrar errores pendientes. */
-        LPC_GPDMACH0->CSrcAddr = (uint32_t)LPC_MCI->FIFO;  /* Direccin fuente: FIFO del SD controller. */
-        LPC_GPDMACH0->CDestAddr = (unsigned int)buff;   /* Direccin destino: buff. */
-
-        LPC_GPDMACH0->CControl = 0x80000000   | /* Habilitar int. TC. Realmente no se usa. */
-                                 (1 << 27)    | /* Auntoincrementar direccin destino. */
-                                 (0x00 << 21) | /* Ancho de las transferencias destino: 8 bits. */
-                                 (0x02 << 18) | /* Ancho de las transferencias fuente: 32 bits. */
-                                 (0x04 << 15) | /* Nmero de transferencias destino en cada burst: 32. */
-                                 (0x02 << 12) | /* Nmero de transferencias fuente en cada burst: 8. */
-                                 512;           /* Nmero total de bytes a transferir (un sector). */
-
-        LPC_GPDMACH0->CConfig = (1<<16)      |  /* Habilitar "locked transfers". */
-                                (0x06 << 11) |  /* Control de flujo: el periferico (SD controller). */
-                                (0x01 << 1)  |  /* Perifrico fuente: SD controller. */
-                                (1 << 0);       /* Habilitar canal. */
-
-        do
+        if (iniciar_lectura(buff, place, n) != RES_OK) return RES_ERROR;
+
+        status = esperar_fin_datos(n*SD_TIMEOUT_LECTURA_US);
+
+        if (terminar_lectura(n, status) != RES_OK)
         {
-            sd_command(SEND_STATUS, SHORT_RESPONSE, rel_addr, &resp);
+            /* Tras un error de CRC se ha bajado la frecuencia del bus:
+             * repetir la lectura.
+             */
+            if ((status & MCI_STATUS_DATACRCFAIL) && reintentos < SD_REINTENTOS_COMANDO)
+            {
+                reintentos++;
+                continue;
+            }
+            return RES_ERROR;
         }
-        while ((resp & 0x00000F00) != 0x00000900);  /* Tarjeta SD "ready" y en el estado "trans". */
-        
-        sd_command(CMDREAD, SHORT_RESPONSE, place, &resp);
-         
-        LPC_MCI->DATATMR = 0x1FFFFFFF;
-        LPC_MCI->DATALEN = 512;                      
-        LPC_MCI->DATACTRL = (9 << 4) | (1 << 3) | (1 << 1) | 1;            
-                                    
-        while (!(LPC_MCI->STATUS & MCI_STATUS_DATABLOCKEND));
-
-        /* Por precaucin, esperar a que termine la transferencia DMA.
-         * Quizs no sea realmente necesario.
-         */
         
-        while (!(LPC_GPDMA->RawIntTCStat & (1<<0)));
-        
-    
-        place += place_incr;
-        --count;
+        buff += 512*n;
+        place += place_incr*n;
+        count -= n;
     }
 		
-    return 0;
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief       Lanzar la lectura de sectores de la tarjeta y retornar sin
+ *              esperar a que termine. El final de la transferencia lo detecta
+ *              la interrupcin del MCI y la lectura se completa (CMD12, copia
+ *              desde el buffer intermedio y llamada a funcion_fin) en la
+ *              siguiente llamada a sd_lectura_en_curso o sd_esperar_lectura.
+ *              Mientras la lectura est en curso cualquier otra operacin con
+ *              la tarjeta espera a que termine.
+ *
+ * \param[out]  buff        buffer destino (count*512 bytes). No debe usarse
+ *                          hasta que termine la lectura.
+ * \param[in]   sector      primer sector a leer.
+ * \param[in]   count       nmero de sectores a leer (como mximo
+ *                          SD_MAXIMO_SECTORES_TRANSFERENCIA, o
+ *                          SD_SECTORES_BUFFER_INTERMEDIO si buff no est
+ *                          alineado a palabra).
+ * \param[in]   funcion_fin funcin a la que se llama al completar la
+ *                          lectura, con el resultado (RES_OK o RES_ERROR),
+ *                          o NULL.
+ *
+ * \return      RES_OK si la lectura se ha lanzado, RES_PARERR si los
+ *              parmetros no son vlidos o RES_ERROR si la tarjeta no acepta
+ *              la lectura.
+ */
+uint32_t sd_read_async(uint8_t *buff, int32_t sector, int32_t count,
+                       sd_funcion_fin_t funcion_fin)
+{
+    if (count <= 0 || count > SD_MAXIMO_SECTORES_TRANSFERENCIA ||
+        (!ALINEADO_A_PALABRA(buff) && (uint32_t)count > SD_SECTORES_BUFFER_INTERMEDIO))
+    {
+        return RES_PARERR;
+    }
+
+    sd_esperar_lectura();
+
+    if (iniciar_lectura(buff,
+                        direcciones_de_bloque ? sector : 512*sector,
+                        count) != RES_OK)
+    {
+        return RES_ERROR;
+    }
+
+    sectores_lectura_asincrona = count;
+    inicio_lectura_asincrona = timer_leer(SD_TIMER);
+    funcion_fin_lectura_asincrona = funcion_fin;
+    datos_asincronos_recibidos = 0;
+    lectura_asincrona_en_curso = 1;
+
+    /* Interrumpir al terminar los datos o al producirse un error.
+     */
+    LPC_MCI->MASK0 = MCI_STATUS_DATAEND | MCI_STATUS_DATAERROR;
+    NVIC_ClearPendingIRQ(MCI_IRQn);
+    NVIC_EnableIRQ(MCI_IRQn);
+
+    return RES_OK;
+}
+
+/***************************************************************************//**
+ * \brief   Consultar si hay una lectura asncrona en curso. Si sus datos ya
+ *          han llegado, se completa la lectura y se llama a su funcion_fin.
+ */
+uint32_t sd_lectura_en_curso(void)
+{
+    if (datos_asincronos_recibidos || lectura_asincrona_vencida())
+    {
+        completar_lectura_asincrona();
+    }
+
+    return lectura_asincrona_en_curso;
+}
+
+/***************************************************************************//**
+ * \brief   Esperar a que termine la lectura asncrona en curso, si la hay, y
+ *          completarla.
+ */
+void sd_esperar_lectura(void)
+{
+    if (!lectura_asincrona_en_curso) return;
+
+    while (!datos_asincronos_recibidos && !lectura_asincrona_vencida());
+
+    completar_lectura_asincrona();
+}
+
+/***************************************************************************//**
+ * \brief   Comprobar si la lectura asncrona en curso ha superado su tiempo
+ *          mximo sin que llegue la interrupcin del MCI. En ese caso se
+ *          desactivan la interrupcin y el camino de datos y se anota un
+ *          error de timeout, de forma que completar_lectura_asincrona la
+ *          termina con RES_ERROR.
+ *
+ * \return  TRUE si la lectura se ha dado por terminada con error.
+ */
+static bool_t lectura_asincrona_vencida(void)
+{
+    if (!lectura_asincrona_en_curso ||
+        timer_leer(SD_TIMER) - inicio_lectura_asincrona <=
+        sectores_lectura_asincrona*SD_TIMEOUT_LECTURA_US)
+    {
+        return FALSE;
+    }
+
+    NVIC_DisableIRQ(MCI_IRQn);
+    LPC_MCI->MASK0 = 0;
+
+    /* La interrupcin puede haber llegado justo antes de desactivarla.
+     */
+    if (datos_asincronos_recibidos) return FALSE;
+
+    LPC_MCI->DATACTRL = 0;
+    estadisticas.errores_timeout++;
+    estado_lectura_asincrona = LPC_MCI->STATUS | MCI_STATUS_DATATIMEOUT;
+    datos_asincronos_recibidos = 1;
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief   Completar la lectura asncrona cuyos datos ya han llegado: enviar
+ *          CMD12, copiar los datos si pasaron por el buffer intermedio y
+ *          avisar a travs de la funcin indicada en sd_read_async.
+ */
+static void completar_lectura_asincrona(void)
+{
+    uint32_t resultado;
+    sd_funcion_fin_t funcion_fin = funcion_fin_lectura_asincrona;
+
+    if (!lectura_asincrona_en_curso || !datos_asincronos_recibidos) return;
+
+    resultado = terminar_lectura(sectores_lectura_asincrona,
+                                 estado_lectura_asincrona);
+    datos_asincronos_recibidos = 0;
+    lectura_asincrona_en_curso = 0;
+
+    if (funcion_fin != NULL) funcion_fin(resultado);
+}
+
+/***************************************************************************//**
+ * \brief   Manejador de la interrupcin del MCI. Slo anota el estado con el
+ *          que han terminado los datos de la lectura asncrona en curso. El
+ *          resto, que incluye comandos a la tarjeta y esperas, se hace en
+ *          completar_lectura_asincrona.
+ */
+void MCI_IRQHandler(void)
+{
+    uint32_t status = LPC_MCI->STATUS;
+
+    LPC_MCI->MASK0 = 0;
+    NVIC_DisableIRQ(MCI_IRQn);
+
+    if (!lectura_asincrona_en_curso) return;
+
+    estado_lectura_asincrona = status;
+    datos_asincronos_recibidos = 1;
+}
+
+/***************************************************************************//**
+ * \brief       Comprobar si la tarjeta ha rechazado un comando con respuesta
+ *              R1: no ha respondido o la respuesta indica algn error. Si la
+ *              respuesta llega con CRC incorrecto no se puede saber, y como
+ *              la tarjeta s ha recibido el comando se da por aceptado.
+ *
+ * \param[in]   status  valor devuelto por sd_command.
+ * \param[in]   resp    respuesta R1.
+ *
+ * \return      TRUE si el comando no se ha ejecutado.
+ */
+static bool_t comando_rechazado(uint32_t status, uint32_t resp)
+{
+    if (status & MCI_STATUS_CMDTIMEOUT) return TRUE;
+    if (status & MCI_STATUS_CMDCRCFAIL) return FALSE;
+
+    return (resp & R1_ERRORES) != 0;
 }
 
 /***************************************************************************//**
+ * \brief       Escribir sectores en la tarjeta. Cada grupo de hasta
+ *              SD_MAXIMO_SECTORES_TRANSFERENCIA sectores se escribe con un
+ *              nico comando de escritura mltiple (CMD25) y una nica
+ *              transferencia DMA, terminada con CMD12. Antes se indica a la
+ *              tarjeta con ACMD23 cuntos bloques va a recibir para que pueda
+ *              borrarlos por adelantado. Para un solo sector se usa CMD24.
+ *
+ *              El fin de la programacin de la tarjeta se detecta por la lnea
+ *              DAT0 en lugar de consultar repetidamente el estado con
+ *              SEND_STATUS.
  *
+ *              Si buf no est alineado a palabra los datos se copian antes al
+ *              buffer intermedio en grupos de hasta
+ *              SD_SECTORES_BUFFER_INTERMEDIO sectores.
+ *
+ * \param[in]   buf     datos a escribir (count*512 bytes).
+ * \param[in]   sector  primer sector a escribir.
+ * \param[in]   count   nmero de sectores a escribir.
+ *
+ * \return      RES_OK o RES_ERROR si se produjo un error en la transferencia.
  */
 uint32_t sd_write(const uint8_t *buf, int32_t sector, int32_t count)
 {
     uint32_t place;
     uint32_t place_incr;
     uint32_t resp;
+    uint32_t n;
+    uint32_t status;
+    uint32_t reintentos = 0;
+    gpdma_lli_t lli;
+    const uint8_t *origen;
+
+    sd_esperar_lectura();
 
     if (direcciones_de_bloque == 0)
     {
@@ -338,71 +1085,133 @@ uint32_t sd_write(const uint8_t *buf, int32_t sector, int32_t count)
         place_incr = 1;
     }
 	
-     /* MEJORAR PARA UTILIZAR EL COMANDO DE ESCRITURA MLTIPLE.
-      */
-	
     while (count)
     {
+        if (ALINEADO_A_PALABRA(buf))
+        {
+            n = count > SD_MAXIMO_SECTORES_TRANSFERENCIA ?
+                SD_MAXIMO_SECTORES_TRANSFERENCIA : count;
+            origen = buf;
+        }
+        else
+        {
+            n = (uint32_t)count > SD_SECTORES_BUFFER_INTERMEDIO ?
+                SD_SECTORES_BUFFER_INTERMEDIO : (uint32_t)count;
+            copiar_intermedio(buffer_intermedio, buf, 512u*n);
+            origen = (const uint8_t *)buffer_intermedio;
+        }
+
         LPC_MCI->CLEAR = 0x7FF;
 
-        /* ---- Programar el canal 0 del controlador DMA -----------
-         *
-         * IMPORTANTE: El registro GPDMA_CONFIG tiene que estar ya
-         * configurado.
+        /* ---- Programar el canal DMA -----------------------------
          *
          * IMPORTANTE: El controlador DMA GPDMA solo trabaja con
          * la memoria de 8Kbytes que est en el bus AHB1 (ver pgina
          * 9 del manual).
          *
-         * IMPORTANTE: la funcin f_mkfs utiliza un offset 446 dentro de fs->win.
-         * 446 no es divisible entre 4 por tanto la funcin f_mkfs no puede usarse.
-         * Para poder usarla habra que modificar la funcin sd_write para que
-         * las transferencias DMA desde la fuente sean byte a byte.
-         *
-         * El canal 0 del GPDMA se programa para que cada vez que el MCI
+         * El canal del GPDMA se programa para que cada vez que el MCI
          * genere una peticin DMA se transfiera un burst de 8 palabras
          * (la mitad de la profundidad del FIFO del MCI) de 32 bits
-         * desde la memoria hacia el MCI. La longitud total de la transferencia
-         * ser de 512 bytes (un sector del disco).
+         * desde la memoria hacia el MCI. El control de flujo lo lleva el MCI,
+         * as que una sola programacin del canal sirve para los n sectores.
          */
     
-        LPC_GPDMA->IntTCClear = 0x01;               /* Borrar ints. Terminal Count pendientes. */
-        LPC_GPDMA->IntErrClr = 0x01;                /* Borrar errores pendientes. */
-        LPC_GPDMACH0->CSrcAddr = (unsigned int)buf; /* Direccin fuente: buff. */
-        LPC_GPDMACH0->CDestAddr = (uint32_t)LPC_MCI->FIFO; /* Direccin destino: FIFO del SD controller. */
-
-        LPC_GPDMACH0->CControl = 0x80000000   | /* Habilitar int. TC. Realmente no se usa .*/
-                                 (1<<26)      | /* Auntoincrementar direccin fuente. */
-                                 (0x02 << 21) | /* Ancho de las transferencias destino: 32 bits. */
-                                 (0x02 << 18) | /* Ancho de las transferencias fuente: 32 bits. */
-                                 (0x02 << 15) | /* Nmero de transferencias destino en cada burst: 8. */
-                                 (0x02 << 12) | /* Nmero de transferencias fuente en cada burst: 8. */
-                                 512;           /* Nmero total de bytes a transferir (un sector). */
-
-        LPC_GPDMACH0->CConfig = (1 << 16)    |  /* Habilitar "locked transfers". */
-                                (0x05 << 11) |  /* Control de flujo: el periferico (SD controller). */
-                                (0x01 << 6)  |  /* Perifrico destino: SD controller. */
-                                (1 << 0);       /* Habilitar canal. */
-
-        do
+        gpdma_construir_lli(&lli,
+                            (uint32_t)origen,           /* Fuente: buff o el buffer intermedio. */
+                            (uint32_t)LPC_MCI->FIFO,    /* Destino: FIFO del SD controller. */
+                            GPDMA_CONTROL_INCREMENTAR_ORIGEN |
+                            GPDMA_CONTROL_ANCHO_DESTINO(GPDMA_ANCHO_32) |
+                            GPDMA_CONTROL_ANCHO_ORIGEN(GPDMA_ANCHO_32) |
+                            GPDMA_CONTROL_BURST_DESTINO(GPDMA_BURST_8) |
+                            GPDMA_CONTROL_BURST_ORIGEN(GPDMA_BURST_8) |
+                            GPDMA_CONTROL_TAMANO(512),  /* Ignorado: el control de flujo lo lleva el MCI. */
+                            NULL);
+
+        gpdma_iniciar((uint32_t)canal_dma, &lli,
+                      GPDMA_CONFIG_BLOQUEADO |
+                      GPDMA_CONFIG_TIPO(GPDMA_TIPO_M2P_CONTROL_PERIFERICO) |
+                      GPDMA_CONFIG_PERIFERICO_DESTINO(GPDMA_PERIFERICO_MCI),
+                      NULL);
+
+        if (esperar_tarjeta_libre() != RES_OK)
         {
-            sd_command(SEND_STATUS, SHORT_RESPONSE, rel_addr, &resp);
+            gpdma_parar((uint32_t)canal_dma);
+            return RES_ERROR;
+        }
+
+        if (n > 1)
+        {
+            /* Preborrado de los n bloques que se van a escribir. ACMD23 es
+             * slo una indicacin y si falla se escribe igual, pero slo se
+             * enva si la tarjeta ha aceptado APP_CMD.
+             */
+            if (comando_rechazado(sd_command(APP_CMD, SHORT_RESPONSE,
+                                             rel_addr, &resp),
+                                  resp))
+            {
+                gpdma_parar((uint32_t)canal_dma);
+                return RES_ERROR;
+            }
+            sd_command(ACMD23, SHORT_RESPONSE, n, &resp);
+        }
+
+        /* Si la tarjeta no acepta la escritura no se empieza la fase de
+         * datos, que slo terminara por timeout.
+         */
+        if (comando_rechazado(sd_command(n > 1 ? CMDWRITEMULTIPLE : CMDWRITE,
+                                         SHORT_RESPONSE, place, &resp),
+                              resp))
+        {
+            gpdma_parar((uint32_t)canal_dma);
+            return RES_ERROR;
         }
-        while ((resp & 0x00000F00) != 0x00000900);
-        
-        sd_command(CMDWRITE, SHORT_RESPONSE, place, &resp);
             
-        LPC_MCI->DATATMR = 0x1FFFFFFF;
-        LPC_MCI->DATALEN = 512;		
+        LPC_MCI->DATATMR = periodos_bus(SD_TIMEOUT_ESCRITURA_US);
+        LPC_MCI->DATALEN = 512*n;
         LPC_MCI->DATACTRL = (9 << 4) | (1 << 3) | 1;
-    
-        while (!(LPC_MCI->STATUS & MCI_STATUS_DATABLOCKEND));
 
-        place += place_incr;
-        --count;
+        status = esperar_fin_datos(n*SD_TIMEOUT_ESCRITURA_US);
+
+        if (n > 1)
+        {
+            sd_command(CMDSTOPTRANSMISION, SHORT_RESPONSE, 0, &resp);
+        }
+
+        /* Esperar a que la tarjeta termine de programar los bloques.
+         */
+        if (esperar_tarjeta_libre() != RES_OK) status |= MCI_STATUS_DATATIMEOUT;
+
+        if (status & MCI_STATUS_DATAERROR)
+        {
+            gpdma_parar((uint32_t)canal_dma);
+
+            /* Tras un error de CRC bajar la frecuencia del bus y repetir la
+             * escritura.
+             */
+            if ((status & MCI_STATUS_DATACRCFAIL) && reintentos < SD_REINTENTOS_COMANDO)
+            {
+                reducir_frecuencia_bus();
+                reintentos++;
+                continue;
+            }
+            return RES_ERROR;
+        }
+
+        estadisticas.sectores_escritos += n;
+        if (origen == buf)
+        {
+            estadisticas.sectores_alineados += n;
+        }
+        else
+        {
+            estadisticas.sectores_desalineados += n;
+        }
+        buf += 512*n;
+        place += place_incr*n;
+        count -= n;
     }
 
-    return 0;
+    return RES_OK;
 }
 
 /***************************************************************************//**
@@ -418,6 +1227,8 @@ uint32_t sd_ioctl(int32_t ctrl, void *buff)
         return RES_NOTRDY;
     }
 
+    sd_esperar_lectura();
+
     switch (ctrl)
     {
     case CTRL_SYNC:
@@ -446,24 +1257,34 @@ uint32_t sd_ioctl(int32_t ctrl, void *buff)
 }
 
 /***************************************************************************//**
+ * \brief       Enviar un comando a la tarjeta una vez y esperar a que el MCI
+ *              indique que ha terminado: comando enviado (sin respuesta),
+ *              respuesta recibida, respuesta con CRC incorrecto o timeout. Si
+ *              el MCI no indica nada en SD_TIMEOUT_COMANDO_US se aborta el
+ *              comando y se devuelve MCI_STATUS_CMDTIMEOUT.
  *
+ * \return      valor del registro MCIStatus al terminar el comando.
  */
-uint32_t sd_command(uint32_t cmd, uint32_t resp_type, uint32_t arg, uint32_t *resp)
+static uint32_t enviar_comando(uint32_t cmd, uint32_t resp_type, uint32_t arg, uint32_t *resp)
 {
     uint32_t temp;
-    volatile uint32_t i;
     uint32_t CmdStatus;
+    uint32_t eventos;
+    uint32_t inicio = timer_leer(SD_TIMER);
 
-    cmd &= 0x3F;
-
+    /* Esperar a que el MCI termine el comando anterior.
+     */
     while ((CmdStatus = LPC_MCI->STATUS) & MCI_STATUS_CMDACTIVE)
     {
         LPC_MCI->COMMAND = 0;
         LPC_MCI->CLEAR = CmdStatus | MCI_STATUS_CMDACTIVE;
+
+        if (timer_leer(SD_TIMER) - inicio > SD_TIMEOUT_COMANDO_US)
+        {
+            return MCI_STATUS_CMDTIMEOUT;
+        }
     }
 
-    delay();
-    
     if (resp_type != NO_RESPONSE)
     {
         cmd |= MCI_COMMAND_RESPONSE;
@@ -471,43 +1292,293 @@ uint32_t sd_command(uint32_t cmd, uint32_t resp_type, uint32_t arg, uint32_t *re
         {
             cmd |= MCI_COMMAND_LONGRESP;
         }
+        eventos = MCI_STATUS_CMDCRCFAIL | MCI_STATUS_CMDSENT |
+                  MCI_STATUS_CMDRESPEND | MCI_STATUS_CMDTIMEOUT;
+    }
+    else
+    {
+        eventos = MCI_STATUS_CMDCRCFAIL | MCI_STATUS_CMDSENT;
     }
     
     LPC_MCI->ARGUMENT = arg;
     LPC_MCI->COMMAND = MCI_COMMAND_ENABLE | cmd;
     
-    delay();
-    
-    if (resp_type == NO_RESPONSE)
+    inicio = timer_leer(SD_TIMER);
+
+    while (!((temp = LPC_MCI->STATUS) & eventos))
     {
-        while (!(LPC_MCI->STATUS & (MCI_STATUS_CMDCRCFAIL | MCI_STATUS_CMDSENT)));		
+        if (timer_leer(SD_TIMER) - inicio > SD_TIMEOUT_COMANDO_US)
+        {
+            LPC_MCI->COMMAND = 0;
+            temp |= MCI_STATUS_CMDTIMEOUT;
+            break;
+        }
     }
-    else
+
+    if (resp_type == LONG_RESPONSE)
+    {
+        if (resp != 0)
+        {
+            *resp++ = LPC_MCI->RESP3;
+            *resp++ = LPC_MCI->RESP2;
+            *resp++ = LPC_MCI->RESP1;
+            *resp = LPC_MCI->RESP0;
+        }
+    }
+    else if (resp_type == SHORT_RESPONSE)
     {
-        while (!(LPC_MCI->STATUS & (MCI_STATUS_CMDCRCFAIL | MCI_STATUS_CMDSENT
-               | MCI_STATUS_CMDRESPEND | MCI_STATUS_CMDTIMEOUT)));
+        if (resp != 0) *resp = LPC_MCI->RESP0;			
+    }		
 
-        if (resp_type == LONG_RESPONSE)
+    LPC_MCI->CLEAR = 0x7FF;	
+
+    return temp;
+}
+
+/***************************************************************************//**
+ * \brief       Enviar un comando a la tarjeta. Si la tarjeta no responde
+ *              (timeout) el comando se repite hasta SD_REINTENTOS_COMANDO
+ *              veces: en ese caso la tarjeta no lo ha ejecutado. Si la
+ *              respuesta llega con CRC incorrecto no se repite, porque la
+ *              tarjeta s lo ha ejecutado. Un ACMD se repite precedido de
+ *              APP_CMD, porque la tarjeta slo lo reconoce justo despus.
+ *
+ *              Se cuentan los reintentos, los errores y los ciclos de CPU que
+ *              tarda cada comando.
+ *
+ * \param[in]   cmd         ndice del comando.
+ * \param[in]   resp_type   NO_RESPONSE, SHORT_RESPONSE o LONG_RESPONSE.
+ * \param[in]   arg         argumento del comando.
+ * \param[out]  resp        respuesta (1 o 4 palabras) o NULL.
+ *
+ * \return      valor del registro MCIStatus al terminar el comando.
+ *              MCI_STATUS_CMDTIMEOUT indica que la tarjeta no ha respondido.
+ */
+uint32_t sd_command(uint32_t cmd, uint32_t resp_type, uint32_t arg, uint32_t *resp)
+{
+    uint32_t temp;
+    uint32_t intento;
+    uint32_t ciclos;
+    uint32_t inicio = ciclos_leer();
+    bool_t es_acmd = ultimo_fue_app_cmd;
+
+    cmd &= NUMERO_COMANDOS - 1u;
+    ultimo_fue_app_cmd = FALSE;
+
+    for (intento = 0; intento <= SD_REINTENTOS_COMANDO; intento++)
+    {
+        if (intento > 0 && es_acmd)
         {
-            if (resp != 0)
+            estadisticas.comandos++;
+            comandos_enviados[APP_CMD]++;
+            if (enviar_comando(APP_CMD, SHORT_RESPONSE, argumento_app_cmd, NULL) &
+                MCI_STATUS_CMDTIMEOUT)
             {
-                *resp++ = LPC_MCI->RESP3;
-                *resp++ = LPC_MCI->RESP2;
-                *resp++ = LPC_MCI->RESP1;
-                *resp = LPC_MCI->RESP0;
+                temp = MCI_STATUS_CMDTIMEOUT;
+                continue;
             }
         }
-        else
+
+        estadisticas.comandos++;
+        comandos_enviados[cmd]++;
+        if (intento > 0) estadisticas.reintentos++;
+
+#if SD_INYECCION_ERRORES
+        if (inyectar(SD_ERROR_TIMEOUT_COMANDO, cmd))
         {
-            if (resp != 0) *resp = LPC_MCI->RESP0;			
-        }		
+            temp = MCI_STATUS_CMDTIMEOUT;
+            continue;
+        }
+#endif
+
+        temp = enviar_comando(cmd, resp_type, arg, resp);
+
+#if SD_INYECCION_ERRORES
+        if (inyectar(SD_ERROR_CRC_COMANDO, cmd)) temp |= MCI_STATUS_CMDCRCFAIL;
+#endif
+
+        if (!(temp & MCI_STATUS_CMDTIMEOUT)) break;
+    }
+
+    if (cmd == APP_CMD && !(temp & MCI_STATUS_CMDTIMEOUT))
+    {
+        ultimo_fue_app_cmd = TRUE;
+        argumento_app_cmd = arg;
+    }
+
+    /* Las respuestas R1 (y R6) llevan el estado de la tarjeta al recibir el
+     * comando. SEND_IF_COND (R7) y SD_SEND_OP_COND (R3) no.
+     */
+    if (resp_type == SHORT_RESPONSE && resp != NULL &&
+        !(temp & (MCI_STATUS_CMDTIMEOUT | MCI_STATUS_CMDCRCFAIL)) &&
+        cmd != SEND_IF_COND && cmd != SD_SEND_OP_COND)
+    {
+        estado_tarjeta = (resp[0] >> 9) & 0x0F;
+    }
+
+    if (temp & MCI_STATUS_CMDTIMEOUT)
+    {
+        estadisticas.errores_timeout++;
+    }
+    else if ((temp & MCI_STATUS_CMDCRCFAIL) && cmd != SD_SEND_OP_COND)
+    {
+        /* La respuesta R3 de SD_SEND_OP_COND no lleva CRC: el MCI siempre la
+         * marca como incorrecta.
+         */
+        estadisticas.errores_crc++;
+    }
+
+    ciclos = ciclos_leer() - inicio;
+    estadisticas.ciclos_ultimo_comando = ciclos;
+    estadisticas.ciclos_comandos += ciclos;
+    if (ciclos > estadisticas.ciclos_maximos_comando)
+    {
+        estadisticas.ciclos_maximos_comando = ciclos;
     }
-    temp = LPC_MCI->STATUS;
-    LPC_MCI->CLEAR = 0x7FF;	
 
     return temp;
 }
 
+/***************************************************************************//**
+ * \brief       Nmero de veces que se ha enviado un comando (incluidos los
+ *              reintentos) desde el ltimo reinicio de los contadores.
+ *
+ * \param[in]   cmd     ndice del comando (0..63).
+ *
+ * \return      nmero de envos, o 0 si cmd no es un ndice vlido.
+ */
+uint32_t sd_comandos_enviados(uint32_t cmd)
+{
+    if (cmd >= NUMERO_COMANDOS) return 0;
+
+    return comandos_enviados[cmd];
+}
+
+/***************************************************************************//**
+ * \brief   Estado de la tarjeta indicado en la ltima respuesta R1 correcta.
+ *          Es el estado en que estaba la tarjeta al recibir ese comando.
+ *
+ * \return  SD_ESTADO_IDLE, ..., SD_ESTADO_DIS o SD_ESTADO_DESCONOCIDO.
+ */
+uint32_t sd_estado_tarjeta(void)
+{
+    return estado_tarjeta;
+}
+
+/***************************************************************************//**
+ * \brief       Medir el rendimiento de la lectura de un grupo de sectores en
+ *              nmero de comandos y en tiempo, extrapolados a 1 MB.
+ *
+ * \param[out]  buff        buffer donde se leen los sectores (count*512
+ *                          bytes).
+ * \param[in]   sector      primer sector a leer.
+ * \param[in]   count       nmero de sectores a leer.
+ * \param[out]  resultado   medidas.
+ *
+ * \return      RES_OK o RES_ERROR si ha fallado la lectura.
+ */
+uint32_t sd_medir_rendimiento(uint8_t *buff, int32_t sector, int32_t count,
+                              sd_rendimiento_t *resultado)
+{
+    uint32_t comandos;
+    uint32_t inicio;
+
+    ASSERT(count > 0, "Numero de sectores incorrecto.");
+
+    sd_esperar_lectura();
+
+    comandos = estadisticas.comandos;
+    inicio = timer_leer(SD_TIMER);
+
+    if (sd_read(buff, sector, count) != RES_OK) return RES_ERROR;
+
+    resultado->microsegundos = timer_leer(SD_TIMER) - inicio;
+    resultado->comandos = estadisticas.comandos - comandos;
+    resultado->sectores = (uint32_t)count;
+
+    /* 1 MB = 2048 sectores.
+     */
+    resultado->comandos_por_mb = (uint32_t)((uint64_t)resultado->comandos*2048u/
+                                            (uint32_t)count);
+    resultado->microsegundos_por_mb = (uint32_t)((uint64_t)resultado->microsegundos*
+                                                 2048u/(uint32_t)count);
+
+    return RES_OK;
+}
+
+#if SD_INYECCION_ERRORES
+/***************************************************************************//**
+ * \brief       Programar la inyeccin de un error las prximas veces que se
+ *              enve un comando. Sirve para comprobar en la placa los
+ *              reintentos, la bajada de la frecuencia del bus y la respuesta
+ *              de FatFs ante errores.
+ *
+ * \param[in]   tipo    SD_ERROR_TIMEOUT_COMANDO, SD_ERROR_CRC_COMANDO o
+ *                      SD_ERROR_CRC_DATOS (ste slo para CMDREAD y
+ *                      CMDREADMULTIPLE).
+ * \param[in]   cmd     ndice del comando afectado.
+ * \param[in]   veces   nmero de veces que se inyecta el error (0 =>
+ *                      cancelar).
+ */
+void sd_inyectar_error(uint32_t tipo, uint32_t cmd, uint32_t veces)
+{
+    ASSERT(tipo <= SD_ERROR_CRC_DATOS, "Tipo de error incorrecto.");
+
+    tipo_error_inyectado = tipo;
+    comando_error_inyectado = cmd & 0x3F;
+    errores_pendientes = veces;
+}
+
+/***************************************************************************//**
+ * \brief   Decidir si se inyecta un error del tipo indicado en un comando y
+ *          descontarlo de los pendientes.
+ */
+static bool_t inyectar(uint32_t tipo, uint32_t cmd)
+{
+    if (errores_pendientes == 0 ||
+        tipo != tipo_error_inyectado ||
+        cmd != comando_error_inyectado)
+    {
+        return FALSE;
+    }
+
+    errores_pendientes--;
+
+    return TRUE;
+}
+#endif
+
+/***************************************************************************//**
+ * \brief       Obtener una copia de los contadores de actividad del interfaz.
+ *
+ * \param[out]  destino     estructura donde se copian los contadores.
+ */
+void sd_leer_estadisticas(sd_estadisticas_t *destino)
+{
+    *destino = estadisticas;
+}
+
+/***************************************************************************//**
+ * \brief   Poner a 0 los contadores de actividad del interfaz.
+ */
+void sd_reiniciar_estadisticas(void)
+{
+    estadisticas.comandos = 0;
+    estadisticas.sectores_leidos = 0;
+    estadisticas.sectores_escritos = 0;
+    estadisticas.reintentos = 0;
+    estadisticas.errores_timeout = 0;
+    estadisticas.errores_crc = 0;
+    estadisticas.reducciones_frecuencia = 0;
+    estadisticas.ciclos_ultimo_comando = 0;
+    estadisticas.ciclos_maximos_comando = 0;
+    estadisticas.ciclos_comandos = 0;
+    estadisticas.sectores_alineados = 0;
+    estadisticas.sectores_desalineados = 0;
+    estadisticas.ciclos_copia_intermedia = 0;
+    memset(comandos_enviados, 0, sizeof(comandos_enviados));
+}
+
 /***************************************************************************//**
  *
  */
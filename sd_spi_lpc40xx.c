@@ -0,0 +1,520 @@
+/***************************************************************************//**
+ * \file    sd_spi_lpc40xx.c
+ *
+ * \brief   Driver de tarjetas SD en modo SPI a travs de un interfaz SSP del
+ *          LPC40xx, con las transferencias de bloques por DMA.
+ *
+ *          Se usa para la ranura conectada al SSP cuando no hay tarjeta en la
+ *          ranura del MCI. Admite tarjetas SD v1, SDSC v2 y SDHC/SDXC. Los
+ *          comandos y las respuestas se transfieren byte a byte con
+ *          ssp_transferir; los bloques de datos de 512 bytes con
+ *          ssp_transferir_bloque, que usa dos canales del GPDMA. La lectura
+ *          y la escritura de varios sectores se hacen con los comandos
+ *          mltiples CMD18/CMD12 y ACMD23/CMD25.
+ *
+ *          Los CRC de los datos no se comprueban (en modo SPI la tarjeta no
+ *          los exige salvo que se activen con CMD59).
+ */
+
+#include <LPC407x_8x_177x_8x.h>
+#include "sd_spi_lpc40xx.h"
+#include "iocon_lpc40xx.h"
+#include "diskio.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+/* Comandos. Los comandos de aplicacin (ACMD) llevan el bit 7 a 1 para que
+ * enviar_comando los haga preceder de CMD55.
+ */
+#define CMD0        0u      /* GO_IDLE_STATE */
+#define CMD8        8u      /* SEND_IF_COND */
+#define CMD9        9u      /* SEND_CSD */
+#define CMD12       12u     /* STOP_TRANSMISSION */
+#define CMD16       16u     /* SET_BLOCKLEN */
+#define CMD17       17u     /* READ_SINGLE_BLOCK */
+#define CMD18       18u     /* READ_MULTIPLE_BLOCK */
+#define CMD24       24u     /* WRITE_BLOCK */
+#define CMD25       25u     /* WRITE_MULTIPLE_BLOCK */
+#define CMD55       55u     /* APP_CMD */
+#define CMD58       58u     /* READ_OCR */
+#define ACMD23      (0x80u | 23u)   /* SET_WR_BLK_ERASE_COUNT */
+#define ACMD41      (0x80u | 41u)   /* SD_SEND_OP_COND */
+
+/* Bits de la respuesta R1.
+ */
+#define R1_IDLE                 0x01u
+#define R1_COMANDO_ILEGAL       0x04u
+
+/* Tokens de los bloques de datos.
+ */
+#define TOKEN_INICIO_BLOQUE             0xFEu
+#define TOKEN_INICIO_BLOQUE_MULTIPLE    0xFCu
+#define TOKEN_FIN_ESCRITURA_MULTIPLE    0xFDu
+#define RESPUESTA_DATOS_ACEPTADOS       0x05u
+
+/*===== Variables privadas =====================================================
+ */
+
+static volatile DSTATUS Stat = STA_NOINIT;
+static bool_t direcciones_de_bloque = FALSE;
+static uint32_t comandos = 0;
+
+/***************************************************************************//**
+ * \brief   Configurar el SSP con una frecuencia de SCK no mayor que la
+ *          indicada (ni que la mxima del SSP).
+ */
+static void configurar_ssp(uint32_t frecuencia_hz)
+{
+    if (frecuencia_hz > PeripheralClock/2) frecuencia_hz = PeripheralClock/2;
+
+    ssp_inicializar(SDSPI_SSP, SSP_DATOS_8_BITS, frecuencia_hz,
+                    SSP_CPOL_0, SSP_CPHA_0,
+                    SDSPI_PUERTO_SCK, SDSPI_PIN_SCK,
+                    SDSPI_PUERTO_MISO, SDSPI_PIN_MISO,
+                    SDSPI_PUERTO_MOSI, SDSPI_PIN_MOSI);
+}
+
+/***************************************************************************//**
+ * \brief   Enviar un byte y devolver el recibido.
+ */
+static uint8_t transferir(uint8_t dato)
+{
+    return (uint8_t)ssp_transferir(SDSPI_SSP, dato);
+}
+
+/***************************************************************************//**
+ * \brief       Esperar a que la tarjeta deje de estar ocupada (MISO a 1).
+ *
+ * \return      TRUE si la tarjeta est lista, FALSE si se agota el tiempo.
+ */
+static bool_t esperar_lista(uint32_t timeout_us)
+{
+    uint32_t inicio = timer_leer(SDSPI_TIMER);
+
+    do
+    {
+        if (transferir(0xFF) == 0xFF) return TRUE;
+    } while (timer_leer(SDSPI_TIMER) - inicio < timeout_us);
+
+    return FALSE;
+}
+
+/***************************************************************************//**
+ * \brief   Poner CS a 1 y enviar un byte ms para que la tarjeta libere MISO.
+ */
+static void deseleccionar(void)
+{
+    gpio_pin_a_1(SDSPI_PUERTO_CS, SDSPI_PIN_CS);
+    transferir(0xFF);
+}
+
+/***************************************************************************//**
+ * \brief   Poner CS a 0 y esperar a que la tarjeta est lista.
+ *
+ * \return  TRUE si la tarjeta est lista. Si no, se vuelve a deseleccionar.
+ */
+static bool_t seleccionar(void)
+{
+    gpio_pin_a_0(SDSPI_PUERTO_CS, SDSPI_PIN_CS);
+    transferir(0xFF);
+
+    if (esperar_lista(SDSPI_TIMEOUT_OCUPADO_US)) return TRUE;
+
+    deseleccionar();
+    return FALSE;
+}
+
+/***************************************************************************//**
+ * \brief       Enviar un comando y recibir la respuesta R1. La tarjeta queda
+ *              seleccionada para que el llamador pueda leer el resto de la
+ *              respuesta o los datos.
+ *
+ * \param[in]   cmd     ndice del comando (con el bit 7 a 1 si es un ACMD).
+ * \param[in]   arg     argumento.
+ *
+ * \return      respuesta R1 o 0xFF si la tarjeta no responde.
+ */
+static uint8_t enviar_comando(uint32_t cmd, uint32_t arg)
+{
+    uint8_t r1;
+    uint32_t n;
+
+    if (cmd & 0x80)
+    {
+        cmd &= 0x7F;
+        r1 = enviar_comando(CMD55, 0);
+        if (r1 > R1_IDLE) return r1;
+    }
+
+    /* CMD12 se enva mientras la tarjeta est transmitiendo datos: no se
+     * puede esperar a que est lista.
+     */
+    if (cmd != CMD12)
+    {
+        deseleccionar();
+        if (!seleccionar()) return 0xFF;
+    }
+
+    transferir((uint8_t)(0x40 | cmd));
+    transferir((uint8_t)(arg >> 24));
+    transferir((uint8_t)(arg >> 16));
+    transferir((uint8_t)(arg >> 8));
+    transferir((uint8_t)arg);
+
+    /* Slo CMD0 y CMD8 necesitan un CRC correcto en modo SPI.
+     */
+    transferir(cmd == CMD0 ? 0x95 : cmd == CMD8 ? 0x87 : 0x01);
+
+    comandos++;
+
+    /* Descartar el byte que sigue a CMD12.
+     */
+    if (cmd == CMD12) transferir(0xFF);
+
+    n = 10;
+    do
+    {
+        r1 = transferir(0xFF);
+    } while ((r1 & 0x80) && --n);
+
+    return r1;
+}
+
+/***************************************************************************//**
+ * \brief       Recibir un bloque de datos: esperar el token de inicio, leer
+ *              los datos por DMA y descartar el CRC.
+ *
+ * \return      TRUE si se ha recibido el bloque.
+ */
+static bool_t recibir_bloque(uint8_t *buff, uint32_t numero_bytes)
+{
+    uint8_t token;
+    uint32_t inicio = timer_leer(SDSPI_TIMER);
+
+    do
+    {
+        token = transferir(0xFF);
+    } while (token == 0xFF &&
+             timer_leer(SDSPI_TIMER) - inicio < SDSPI_TIMEOUT_LECTURA_US);
+
+    if (token != TOKEN_INICIO_BLOQUE) return FALSE;
+
+    ssp_transferir_bloque(SDSPI_SSP, NULL, buff, numero_bytes);
+
+    transferir(0xFF);
+    transferir(0xFF);
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Enviar un bloque de 512 bytes precedido del token indicado
+ *              y comprobar la respuesta de la tarjeta. Con el token
+ *              TOKEN_FIN_ESCRITURA_MULTIPLE slo se enva el token.
+ *
+ * \return      TRUE si la tarjeta ha aceptado el bloque.
+ */
+static bool_t enviar_bloque(const uint8_t *buff, uint8_t token)
+{
+    if (!esperar_lista(SDSPI_TIMEOUT_OCUPADO_US)) return FALSE;
+
+    transferir(token);
+
+    if (token == TOKEN_FIN_ESCRITURA_MULTIPLE) return TRUE;
+
+    ssp_transferir_bloque(SDSPI_SSP, buff, NULL, 512);
+
+    /* CRC (no se comprueba) y respuesta de datos.
+     */
+    transferir(0xFF);
+    transferir(0xFF);
+
+    return (transferir(0xFF) & 0x1F) == RESPUESTA_DATOS_ACEPTADOS;
+}
+
+/***************************************************************************//**
+ * \brief   Inicializar el SSP y la tarjeta: CMD0, CMD8 para distinguir las
+ *          tarjetas v2, ACMD41 hasta que la tarjeta termina su
+ *          inicializacin y CMD58 para saber si usa direcciones de bloque.
+ *          Las tarjetas MMC (que no aceptan ACMD41) no se admiten.
+ *
+ * \return  estado (STA_NOINIT si no hay tarjeta o no se ha podido
+ *          inicializar).
+ */
+uint32_t sdspi_init(void)
+{
+    uint32_t i;
+    uint32_t inicio;
+    uint8_t r1;
+    uint8_t ocr[4];
+    bool_t version_2;
+
+    Stat = STA_NOINIT;
+
+    timer_inicializar(SDSPI_TIMER);
+    timer_iniciar_conteo_us(SDSPI_TIMER);
+
+    iocon_configurar_pin(SDSPI_PUERTO_CS, SDSPI_PIN_CS, GPIO,
+                         IOCON_NO_PULL_UP_NO_PULL_DOWN);
+    gpio_ajustar_dir(SDSPI_PUERTO_CS, SDSPI_PIN_CS, DIR_SALIDA);
+    gpio_pin_a_1(SDSPI_PUERTO_CS, SDSPI_PIN_CS);
+
+    configurar_ssp(SDSPI_FRECUENCIA_IDENTIFICACION_HZ);
+
+    /* Al menos 74 ciclos de reloj con CS a 1 para que la tarjeta arranque.
+     */
+    for (i = 0; i < 10; i++) transferir(0xFF);
+
+    if (enviar_comando(CMD0, 0) != R1_IDLE)
+    {
+        deseleccionar();
+        return Stat;
+    }
+
+    r1 = enviar_comando(CMD8, 0x1AA);
+    version_2 = (r1 == R1_IDLE);
+
+    if (version_2)
+    {
+        for (i = 0; i < 4; i++) ocr[i] = transferir(0xFF);
+
+        /* La tarjeta debe aceptar 2,7-3,6 V y devolver el patrn 0xAA.
+         */
+        if (ocr[2] != 0x01 || ocr[3] != 0xAA)
+        {
+            deseleccionar();
+            return Stat;
+        }
+    }
+    else if (!(r1 & R1_COMANDO_ILEGAL))
+    {
+        deseleccionar();
+        return Stat;
+    }
+
+    inicio = timer_leer(SDSPI_TIMER);
+    do
+    {
+        r1 = enviar_comando(ACMD41, version_2 ? 1u << 30 : 0);
+    } while (r1 == R1_IDLE &&
+             timer_leer(SDSPI_TIMER) - inicio < SDSPI_TIMEOUT_INICIALIZACION_US);
+
+    if (r1 != 0)
+    {
+        deseleccionar();
+        return Stat;
+    }
+
+    direcciones_de_bloque = FALSE;
+
+    if (version_2)
+    {
+        if (enviar_comando(CMD58, 0) != 0)
+        {
+            deseleccionar();
+            return Stat;
+        }
+
+        for (i = 0; i < 4; i++) ocr[i] = transferir(0xFF);
+
+        /* Bit CCS del OCR.
+         */
+        direcciones_de_bloque = (ocr[0] & 0x40) != 0;
+    }
+
+    if (!direcciones_de_bloque && enviar_comando(CMD16, 512) != 0)
+    {
+        deseleccionar();
+        return Stat;
+    }
+
+    deseleccionar();
+
+    configurar_ssp(SDSPI_FRECUENCIA_TRANSFERENCIA_HZ);
+
+    Stat &= ~STA_NOINIT;
+
+    return Stat;
+}
+
+/***************************************************************************//**
+ * \brief   Estado de la tarjeta (STA_NOINIT, ...).
+ */
+uint32_t sdspi_status(void)
+{
+    return Stat;
+}
+
+/***************************************************************************//**
+ * \brief       Leer sectores de la tarjeta. Un sector se lee con CMD17 y
+ *              varios con un nico CMD18 terminado con CMD12.
+ *
+ * \param[out]  buff    buffer destino (count*512 bytes).
+ * \param[in]   sector  primer sector a leer.
+ * \param[in]   count   nmero de sectores a leer.
+ *
+ * \return      RES_OK, RES_ERROR, RES_NOTRDY o RES_PARERR.
+ */
+uint32_t sdspi_read(uint8_t *buff, int32_t sector, int32_t count)
+{
+    uint32_t direccion;
+
+    if (count <= 0) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+    direccion = direcciones_de_bloque ? (uint32_t)sector : 512u*(uint32_t)sector;
+
+    if (count == 1)
+    {
+        if (enviar_comando(CMD17, direccion) == 0 && recibir_bloque(buff, 512))
+        {
+            count = 0;
+        }
+    }
+    else if (enviar_comando(CMD18, direccion) == 0)
+    {
+        while (count && recibir_bloque(buff, 512))
+        {
+            buff += 512;
+            count--;
+        }
+
+        enviar_comando(CMD12, 0);
+    }
+
+    deseleccionar();
+
+    return count == 0 ? RES_OK : RES_ERROR;
+}
+
+/***************************************************************************//**
+ * \brief       Escribir sectores en la tarjeta. Un sector se escribe con
+ *              CMD24 y varios con ACMD23 (preborrado) y un nico CMD25.
+ *
+ * \param[in]   buff    datos a escribir (count*512 bytes).
+ * \param[in]   sector  primer sector a escribir.
+ * \param[in]   count   nmero de sectores a escribir.
+ *
+ * \return      RES_OK, RES_ERROR, RES_NOTRDY o RES_PARERR.
+ */
+uint32_t sdspi_write(const uint8_t *buff, int32_t sector, int32_t count)
+{
+    uint32_t direccion;
+
+    if (count <= 0) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+    direccion = direcciones_de_bloque ? (uint32_t)sector : 512u*(uint32_t)sector;
+
+    if (count == 1)
+    {
+        if (enviar_comando(CMD24, direccion) == 0 &&
+            enviar_bloque(buff, TOKEN_INICIO_BLOQUE))
+        {
+            count = 0;
+        }
+    }
+    else
+    {
+        enviar_comando(ACMD23, (uint32_t)count);
+
+        if (enviar_comando(CMD25, direccion) == 0)
+        {
+            while (count && enviar_bloque(buff, TOKEN_INICIO_BLOQUE_MULTIPLE))
+            {
+                buff += 512;
+                count--;
+            }
+
+            if (!enviar_bloque(NULL, TOKEN_FIN_ESCRITURA_MULTIPLE) && count == 0)
+            {
+                count = 1;
+            }
+        }
+    }
+
+    deseleccionar();
+
+    return count == 0 ? RES_OK : RES_ERROR;
+}
+
+/***************************************************************************//**
+ * \brief       Operaciones de control de FatFs: CTRL_SYNC espera a que la
+ *              tarjeta termine de programar, GET_SECTOR_COUNT calcula la
+ *              capacidad a partir del CSD (versiones 1 y 2) y GET_BLOCK_SIZE
+ *              devuelve 1 (tamao de borrado desconocido).
+ */
+uint32_t sdspi_ioctl(int32_t ctrl, void *buff)
+{
+    uint8_t csd[16];
+    uint32_t c_size;
+    uint32_t c_size_mult;
+    uint32_t read_bl_len;
+    uint32_t resultado = RES_ERROR;
+
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+    switch (ctrl)
+    {
+    case CTRL_SYNC:
+        if (seleccionar()) resultado = RES_OK;
+        break;
+
+    case GET_SECTOR_COUNT:
+        if (enviar_comando(CMD9, 0) == 0 && recibir_bloque(csd, 16))
+        {
+            if ((csd[0] >> 6) == 1)
+            {
+                c_size = ((uint32_t)(csd[7] & 0x3F) << 16) |
+                         ((uint32_t)csd[8] << 8) | csd[9];
+                *((DWORD *)buff) = (c_size + 1) << 10;
+            }
+            else
+            {
+                read_bl_len = csd[5] & 0x0F;
+                c_size = ((uint32_t)(csd[6] & 0x03) << 10) |
+                         ((uint32_t)csd[7] << 2) | (csd[8] >> 6);
+                c_size_mult = ((uint32_t)(csd[9] & 0x03) << 1) | (csd[10] >> 7);
+                *((DWORD *)buff) = (c_size + 1) << (c_size_mult + 2 + read_bl_len - 9);
+            }
+            resultado = RES_OK;
+        }
+        break;
+
+    case GET_BLOCK_SIZE:
+        *((DWORD *)buff) = 1;
+        resultado = RES_OK;
+        break;
+
+    default:
+        resultado = RES_PARERR;
+        break;
+    }
+
+    deseleccionar();
+
+    return resultado;
+}
+
+/***************************************************************************//**
+ * \brief   Frecuencia de SCK programada en el SSP.
+ *
+ * \return  Hz o 0 si la tarjeta no est inicializada.
+ */
+uint32_t sdspi_frecuencia_bus(void)
+{
+    if (Stat & STA_NOINIT) return 0;
+
+    return PeripheralClock/(SDSPI_SSP->CPSR*(((SDSPI_SSP->CR0 >> 8) & 0xFF) + 1));
+}
+
+/***************************************************************************//**
+ * \brief   Nmero de comandos enviados desde el arranque (incluidos los CMD55
+ *          de los ACMD), para comparar con el driver del MCI.
+ */
+uint32_t sdspi_comandos_enviados(void)
+{
+    return comandos;
+}
@@ -0,0 +1,67 @@
+/***************************************************************************//**
+ * \file    sd_spi_lpc40xx.h
+ *
+ * \brief   Driver de tarjetas SD en modo SPI a travs de un interfaz SSP del
+ *          LPC40xx, con las transferencias de bloques por DMA.
+ *
+ *          Las funciones tienen la misma forma que las del driver del MCI
+ *          (sd_lpc40xx_mci.h) para que la capa de disco pueda usar uno u
+ *          otro.
+ */
+
+#ifndef SD_SPI_LPC40XX_H
+#define SD_SPI_LPC40XX_H
+
+#include "tipos.h"
+#include "ssp_lpc40xx.h"
+#include "gpio_lpc40xx.h"
+#include "timer_lpc40xx.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Interfaz SSP y pines a los que est conectada la ranura SPI. Se usa el
+ * SSP0 en P0.15 a P0.18 porque los pines del SSP1 en el puerto 0 (P0.6 a
+ * P0.9) son los del I2S que usa el UDA1380, y tambin los de la pantalla y
+ * las filas del teclado. Los canales DMA se programan con las peticiones del
+ * interfaz elegido (ssp_lpc40xx.c).
+ */
+#define SDSPI_SSP                   SSP0
+#define SDSPI_PUERTO_SCK            PUERTO0
+#define SDSPI_PIN_SCK               PIN15
+#define SDSPI_PUERTO_MISO           PUERTO0
+#define SDSPI_PIN_MISO              PIN17
+#define SDSPI_PUERTO_MOSI           PUERTO0
+#define SDSPI_PIN_MOSI              PIN18
+#define SDSPI_PUERTO_CS             PUERTO0
+#define SDSPI_PIN_CS                PIN16
+
+/* Frecuencias de SCK durante la identificacin de la tarjeta y despus.
+ */
+#define SDSPI_FRECUENCIA_IDENTIFICACION_HZ  400000u
+#define SDSPI_FRECUENCIA_TRANSFERENCIA_HZ   20000000u
+
+/* Timer usado como contador de microsegundos para los timeouts del driver.
+ */
+#define SDSPI_TIMER                 TIMER2
+
+/* Tiempo mximo que se espera a que la tarjeta termine la inicializacin
+ * (ACMD41), a que enve un bloque de datos y a que termine de programar un
+ * bloque escrito.
+ */
+#define SDSPI_TIMEOUT_INICIALIZACION_US     1000000u
+#define SDSPI_TIMEOUT_LECTURA_US            100000u
+#define SDSPI_TIMEOUT_OCUPADO_US            500000u
+
+/*===== Prototipos de funciones ================================================
+ */
+
+uint32_t sdspi_init(void);
+uint32_t sdspi_status(void);
+uint32_t sdspi_read(uint8_t *buff, int32_t sector, int32_t count);
+uint32_t sdspi_write(const uint8_t *buff, int32_t sector, int32_t count);
+uint32_t sdspi_ioctl(int32_t ctrl, void *buff);
+uint32_t sdspi_frecuencia_bus(void);
+uint32_t sdspi_comandos_enviados(void);
+
+#endif  /* SD_SPI_LPC40XX_H */
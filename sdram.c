@@ -7,6 +7,10 @@
 
 static volatile uint32_t ringosccount[2] = {0, 0};
 
+/* Bytes de la zona libre de la SDRAM ya reservados mediante sdram_reservar.
+ */
+static uint32_t bytes_reservados = 0;
+
 static void pinConfig(void)
 {
   LPC_IOCON->P3_0 |= 1; /* D0 @ P3.0 */
@@ -478,3 +482,39 @@ uint32_t sdram_inicializar(void)
   return 1;
 }
 
+/***************************************************************************//**
+ * \brief       Reservar un bloque de la zona libre de la SDRAM. Las reservas
+ *              se hacen de forma consecutiva y no pueden liberarse: estn
+ *              pensadas para buffers que se crean una vez al arrancar y se
+ *              reutilizan durante toda la ejecucin.
+ *
+ * \param[in]   numero_bytes    tamao del bloque. Se redondea a un mltiplo
+ *                              de 8 bytes.
+ *
+ * \return      puntero al comienzo del bloque (alineado a 8 bytes) o NULL si
+ *              no queda suficiente espacio libre.
+ */
+void *sdram_reservar(uint32_t numero_bytes)
+{
+  void *ptr;
+
+  numero_bytes = (numero_bytes + 7) & ~7u;
+
+  if (numero_bytes > SDRAM_ZONA_LIBRE_TAMANO - bytes_reservados)
+  {
+    return NULL;
+  }
+
+  ptr = (void *)(SDRAM_ZONA_LIBRE_BASE + bytes_reservados);
+  bytes_reservados += numero_bytes;
+
+  return ptr;
+}
+
+/***************************************************************************//**
+ * \brief   Bytes que quedan sin reservar en la zona libre de la SDRAM.
+ */
+uint32_t sdram_bytes_libres(void)
+{
+  return SDRAM_ZONA_LIBRE_TAMANO - bytes_reservados;
+}
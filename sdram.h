@@ -20,6 +20,14 @@
 
 #define SDRAM_BASE               0xA0000000 /*CS0*/
 
+/* Zona de la SDRAM que queda libre para los datos de la aplicacin. El primer
+ * megabyte se deja para el framebuffer del LCD (ver glcd.h).
+ */
+#define SDRAM_ZONA_LIBRE_BASE    (SDRAM_BASE + 0x0100000)
+#define SDRAM_ZONA_LIBRE_TAMANO  (SDRAM_SIZE - 0x0100000)
+
 uint32_t sdram_inicializar(void);
+void *sdram_reservar(uint32_t numero_bytes);
+uint32_t sdram_bytes_libres(void);
 
 #endif /* SDRAM_H */
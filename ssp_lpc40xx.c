@@ -9,6 +9,23 @@
 #include "ssp_lpc40xx.h"
 #include "error.h"
 #include "iocon_lpc40xx.h"
+#include "gpdma_lpc40xx.h"
+
+/*===== Variables privadas =====================================================
+ */
+
+/* Canales DMA de transmisin y recepcin de cada interfaz, reservados la
+ * primera vez que se usa ssp_transferir_bloque (-1 => sin reservar).
+ */
+static int32_t canales_tx[3] = { -1, -1, -1 };
+static int32_t canales_rx[3] = { -1, -1, -1 };
+static bool_t sin_dma[3] = { FALSE, FALSE, FALSE };
+
+/* Origen de los datos que se transmiten cuando no se indica un buffer y
+ * destino de los datos recibidos que se descartan.
+ */
+static const uint8_t byte_relleno = 0xFF;
+static uint8_t byte_descartado;
 
 /***************************************************************************//**
  * \brief       Inicializar un interfaz SSP del LP40xx en modo maestro SPI.
@@ -166,3 +183,143 @@ uint16_t ssp_transferir(LPC_SSP_TypeDef  *ssp_regs, uint16_t dato_a_transmitir)
      */
     return ssp_regs->DR; 
 }
+
+/***************************************************************************//**
+ * \brief       ndice (0, 1 o 2) de un interfaz SSP.
+ */
+static uint32_t indice_ssp(LPC_SSP_TypeDef *ssp_regs)
+{
+    if (ssp_regs == SSP0) return 0;
+    if (ssp_regs == SSP1) return 1;
+    if (ssp_regs == SSP2) return 2;
+
+    ERROR("Interfaz SSP incorrecto.");
+    return 0;
+}
+
+/***************************************************************************//**
+ * \brief       Reservar los canales DMA de un interfaz. Si no quedan dos
+ *              canales libres el interfaz trabaja sin DMA.
+ *
+ * \return      TRUE si el interfaz tiene canales DMA.
+ */
+static bool_t reservar_canales(uint32_t i)
+{
+    if (canales_rx[i] >= 0) return TRUE;
+    if (sin_dma[i]) return FALSE;
+
+    /* El canal de recepcin se reserva primero para que tenga ms prioridad
+     * que el de transmisin y no se desborde la FIFO de recepcin.
+     */
+    canales_rx[i] = gpdma_reservar_canal(GPDMA_PRIORIDAD_ALTA);
+    canales_tx[i] = gpdma_reservar_canal(GPDMA_PRIORIDAD_ALTA);
+
+    if (canales_rx[i] < 0 || canales_tx[i] < 0)
+    {
+        if (canales_rx[i] >= 0) gpdma_liberar_canal((uint32_t)canales_rx[i]);
+        if (canales_tx[i] >= 0) gpdma_liberar_canal((uint32_t)canales_tx[i]);
+        canales_rx[i] = -1;
+        canales_tx[i] = -1;
+        sin_dma[i] = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Transferir un bloque de bytes a travs de un interfaz SSP
+ *              configurado con datos de 8 bits. La transmisin y la recepcin
+ *              las hacen dos canales del GPDMA; la funcin no retorna hasta
+ *              que se ha recibido el ltimo byte. Si no hay canales DMA libres
+ *              se transfiere byte a byte con ssp_transferir.
+ *
+ * \param[in]   ssp_regs                puntero a regs. de interfaz SSP.
+ * \param[in]   ptr_datos_a_transmitir  bytes a enviar o NULL para enviar
+ *                                      0xFF (por ejemplo para leer de una
+ *                                      tarjeta SD).
+ * \param[out]  ptr_datos_recibidos     buffer para los bytes recibidos o NULL
+ *                                      para descartarlos.
+ * \param[in]   numero_bytes            nmero de bytes a transferir.
+ */
+void ssp_transferir_bloque(LPC_SSP_TypeDef *ssp_regs,
+                           const uint8_t   *ptr_datos_a_transmitir,
+                           uint8_t         *ptr_datos_recibidos,
+                           uint32_t         numero_bytes)
+{
+    uint32_t i = indice_ssp(ssp_regs);
+    uint32_t n;
+    uint8_t dato;
+    gpdma_lli_t lli_tx;
+    gpdma_lli_t lli_rx;
+
+    ASSERT((ssp_regs->CR0 & 0x0F) == SSP_DATOS_8_BITS - 1,
+           "Las transferencias por bloques requieren datos de 8 bits.");
+
+    if (!reservar_canales(i))
+    {
+        while (numero_bytes--)
+        {
+            dato = (uint8_t)ssp_transferir(ssp_regs,
+                ptr_datos_a_transmitir != NULL ? *ptr_datos_a_transmitir++ : 0xFF);
+            if (ptr_datos_recibidos != NULL) *ptr_datos_recibidos++ = dato;
+        }
+        return;
+    }
+
+    while (numero_bytes)
+    {
+        n = numero_bytes > SSP_MAXIMO_BYTES_DMA ? SSP_MAXIMO_BYTES_DMA : numero_bytes;
+
+        /* Vaciar la FIFO de recepcin.
+         */
+        while (ssp_regs->SR & (1u << 2))
+        {
+            (void)ssp_regs->DR;
+        }
+
+        gpdma_construir_lli(&lli_rx,
+            (uint32_t)&ssp_regs->DR,
+            ptr_datos_recibidos != NULL ?
+                (uint32_t)ptr_datos_recibidos : (uint32_t)&byte_descartado,
+            (ptr_datos_recibidos != NULL ? GPDMA_CONTROL_INCREMENTAR_DESTINO : 0) |
+            GPDMA_CONTROL_ANCHO_DESTINO(GPDMA_ANCHO_8) |
+            GPDMA_CONTROL_ANCHO_ORIGEN(GPDMA_ANCHO_8) |
+            GPDMA_CONTROL_BURST_DESTINO(GPDMA_BURST_4) |
+            GPDMA_CONTROL_BURST_ORIGEN(GPDMA_BURST_4) |
+            GPDMA_CONTROL_TAMANO(n),
+            NULL);
+
+        gpdma_construir_lli(&lli_tx,
+            ptr_datos_a_transmitir != NULL ?
+                (uint32_t)ptr_datos_a_transmitir : (uint32_t)&byte_relleno,
+            (uint32_t)&ssp_regs->DR,
+            (ptr_datos_a_transmitir != NULL ? GPDMA_CONTROL_INCREMENTAR_ORIGEN : 0) |
+            GPDMA_CONTROL_ANCHO_DESTINO(GPDMA_ANCHO_8) |
+            GPDMA_CONTROL_ANCHO_ORIGEN(GPDMA_ANCHO_8) |
+            GPDMA_CONTROL_BURST_DESTINO(GPDMA_BURST_4) |
+            GPDMA_CONTROL_BURST_ORIGEN(GPDMA_BURST_4) |
+            GPDMA_CONTROL_TAMANO(n),
+            NULL);
+
+        gpdma_iniciar((uint32_t)canales_rx[i], &lli_rx,
+                      GPDMA_CONFIG_TIPO(GPDMA_TIPO_P2M) |
+                      GPDMA_CONFIG_PERIFERICO_ORIGEN(GPDMA_PERIFERICO_SSP0_RX + 2*i),
+                      NULL);
+        gpdma_iniciar((uint32_t)canales_tx[i], &lli_tx,
+                      GPDMA_CONFIG_TIPO(GPDMA_TIPO_M2P) |
+                      GPDMA_CONFIG_PERIFERICO_DESTINO(GPDMA_PERIFERICO_SSP0_TX + 2*i),
+                      NULL);
+
+        /* Habilitar las peticiones DMA de recepcin y transmisin y esperar
+         * a que se haya recibido el ltimo byte.
+         */
+        ssp_regs->DMACR = (1u << 0) | (1u << 1);
+        while (gpdma_canal_activo((uint32_t)canales_rx[i]));
+        ssp_regs->DMACR = 0;
+
+        if (ptr_datos_a_transmitir != NULL) ptr_datos_a_transmitir += n;
+        if (ptr_datos_recibidos != NULL) ptr_datos_recibidos += n;
+        numero_bytes -= n;
+    }
+}
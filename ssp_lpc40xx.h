@@ -43,6 +43,11 @@
 #define SSP_DATOS_15_BITS   15
 #define SSP_DATOS_16_BITS   16
 
+/* Nmero mximo de bytes que se transfieren con una nica programacin del
+ * DMA en ssp_transferir_bloque (lmite del campo TransferSize del GPDMA).
+ */
+#define SSP_MAXIMO_BYTES_DMA    4095u
+
 /*===== Prototipos de funciones ================================================
  */
 
@@ -61,4 +66,9 @@ void ssp_inicializar(LPC_SSP_TypeDef  *ssp_regs,
 uint16_t ssp_transferir(LPC_SSP_TypeDef *ssp_regs,
                         uint16_t         dato_a_transmitir);
 
+void ssp_transferir_bloque(LPC_SSP_TypeDef *ssp_regs,
+                           const uint8_t   *ptr_datos_a_transmitir,
+                           uint8_t         *ptr_datos_recibidos,
+                           uint32_t         numero_bytes);
+
 #endif /* SSP2_LPC40XX_H */
@@ -0,0 +1,44 @@
+/***************************************************************************//**
+ * \file    texto.c
+ *
+ * \brief   Conversin de textos ledos de ficheros a ISO-8859-1, el juego de
+ *          caracteres de la fuente del LCD. La usan las listas de
+ *          reproduccin y las hojas CUE.
+ */
+
+#include "texto.h"
+
+/***************************************************************************//**
+ * \brief       Convertir un texto de UTF-8 a ISO-8859-1 en su sitio. Los
+ *              caracteres que no existen en ISO-8859-1 se sustituyen por '?'.
+ *
+ * \param[in]   texto   texto terminado en 0. El resultado nunca es ms
+ *                      largo que el original.
+ */
+void texto_convertir_utf8(char *texto)
+{
+    const uint8_t *origen = (const uint8_t *)texto;
+    uint32_t c;
+
+    while (*origen != '\0')
+    {
+        if (*origen < 0x80u)
+        {
+            c = *origen++;
+        }
+        else if ((*origen & 0xE0u) == 0xC0u && (origen[1] & 0xC0u) == 0x80u)
+        {
+            c = (uint32_t)(origen[0] & 0x1Fu) << 6 | (origen[1] & 0x3Fu);
+            origen += 2;
+        }
+        else
+        {
+            c = '?';
+            for (origen++; (*origen & 0xC0u) == 0x80u; origen++);
+        }
+
+        *texto++ = c < 0x100u ? (char)c : '?';
+    }
+
+    *texto = '\0';
+}
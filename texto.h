@@ -0,0 +1,18 @@
+/***************************************************************************//**
+ * \file    texto.h
+ *
+ * \brief   Conversin de textos ledos de ficheros a ISO-8859-1, el juego de
+ *          caracteres de la fuente del LCD.
+ */
+
+#ifndef TEXTO_H
+#define TEXTO_H
+
+#include "tipos.h"
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void texto_convertir_utf8(char *texto);
+
+#endif  /* TEXTO_H */
@@ -0,0 +1,490 @@
+/***************************************************************************//**
+ * \file    wsola.c
+ *
+ * \brief   Cambio de la velocidad de reproduccin sin alterar el tono mediante
+ *          estiramiento temporal WSOLA (Waveform Similarity Overlap-Add).
+ *
+ *          Este mdulo se sita entre la funcin output del reproductor y la
+ *          salida de audio. Las muestras decodificadas se acumulan en un
+ *          buffer de entrada y en cada iteracin se generan
+ *          WSOLA_SALTO_SINTESIS muestras de salida mientras la posicin
+ *          nominal de anlisis avanza WSOLA_SALTO_SINTESIS*velocidad/100
+ *          muestras. Para evitar discontinuidades, el segmento que se copia a
+ *          la salida no se toma exactamente en la posicin nominal sino en la
+ *          posicin, dentro de +-WSOLA_TOLERANCIA muestras, cuya forma de onda
+ *          ms se parece a la continuacin natural del segmento anterior. Los
+ *          dos segmentos se funden linealmente a lo largo de WSOLA_SOLAPE
+ *          muestras.
+ *
+ *          El parecido se mide con la correlacin cruzada de la suma de los
+ *          dos canales reducida a 16 bits. La bsqueda se hace en dos pasadas
+ *          para que quepa en el presupuesto de CPU a velocidad 2x, donde
+ *          tambin se duplica la carga del decodificador:
+ *
+ *          - Pasada gruesa: desplazamientos de 4 en 4 muestras, correlando una
+ *            de cada 4 muestras.
+ *          - Pasada fina: desplazamientos contiguos alrededor del mejor
+ *            candidato, correlando una de cada 2 muestras.
+ *
+ *          A velocidad normal y con el buffer de entrada vaco las muestras
+ *          pasan directamente a la salida de audio sin ningn coste aadido.
+ */
+
+#include <string.h>
+#include "wsola.h"
+#include "salida_audio.h"
+#include "contador_ciclos.h"
+#include "error.h"
+
+/*===== Constantes privadas ====================================================
+ */
+
+#define PASO_BUSQUEDA_GRUESA    4u
+#define DIEZMADO_GRUESO         4u
+#define DIEZMADO_FINO           2u
+
+/* Las muestras de libmad tienen 28 bits fraccionarios. Para la correlacin se
+ * suman los dos canales y se reducen a 16 bits con signo.
+ */
+#define DESPLAZAMIENTO_MONO     14
+
+#define LONGITUD_SENAL_BUSQUEDA (2u*WSOLA_TOLERANCIA + WSOLA_SOLAPE + 1u)
+
+/*===== Variables privadas =====================================================
+ */
+
+/* Buffer de entrada con las muestras decodificadas de cada canal pendientes de
+ * procesar. Las muestras ya consumidas se descartan desplazando el contenido
+ * hacia el principio del buffer.
+ */
+static int32_t entrada[2][WSOLA_CAPACIDAD_ENTRADA];
+static uint32_t muestras_entrada = 0;
+
+/* Bloque de salida de cada iteracin.
+ */
+static int32_t salida[2][WSOLA_SALTO_SINTESIS];
+
+/* Versiones reducidas a 16 bits de la plantilla (continuacin natural del
+ * segmento anterior) y de la zona de bsqueda.
+ */
+static int16_t plantilla[WSOLA_SOLAPE];
+static int16_t senal_busqueda[LONGITUD_SENAL_BUSQUEDA];
+
+/* Posicin dentro del buffer de entrada de la continuacin natural del ltimo
+ * segmento copiado a la salida.
+ */
+static uint32_t posicion_continuacion = 0;
+
+/* Posicin nominal de anlisis en formato Q16.16 y su incremento por
+ * iteracin.
+ */
+static uint32_t posicion_analisis_q16 = 0;
+static uint32_t salto_analisis_q16 =
+    (uint32_t)((uint64_t)WSOLA_SALTO_SINTESIS*WSOLA_VELOCIDAD_NORMAL*65536u/100u);
+
+static uint32_t velocidad_actual = WSOLA_VELOCIDAD_NORMAL;
+static uint16_t canales_actuales = 0;
+static bool_t primera_iteracion = TRUE;
+
+/* Contabilidad de ciclos de CPU consumidos por el algoritmo (sin contar el
+ * tiempo de espera en la salida de audio) y de muestras generadas desde el
+ * ltimo cambio de velocidad.
+ */
+static uint64_t ciclos_acumulados = 0;
+static uint32_t muestras_generadas = 0;
+static uint32_t ciclos_en_salida = 0;
+
+/***************************************************************************//**
+ * \brief       Obtener la muestra de la suma de ambos canales, reducida a
+ *              16 bits, en una posicin del buffer de entrada.
+ *
+ * \param[in]   posicion    ndice dentro del buffer de entrada.
+ *
+ * \return      muestra de 16 bits con signo.
+ */
+static int16_t muestra_mono(uint32_t posicion)
+{
+    int32_t muestra;
+
+    if (canales_actuales == 2)
+    {
+        muestra = (entrada[0][posicion] >> DESPLAZAMIENTO_MONO) +
+                  (entrada[1][posicion] >> DESPLAZAMIENTO_MONO);
+    }
+    else
+    {
+        muestra = entrada[0][posicion] >> (DESPLAZAMIENTO_MONO - 1);
+    }
+
+    if (muestra > 32767) muestra = 32767;
+    else if (muestra < -32768) muestra = -32768;
+
+    return (int16_t)muestra;
+}
+
+/***************************************************************************//**
+ * \brief       Correlacin cruzada entre la plantilla y la seal de bsqueda
+ *              desplazada.
+ *
+ * \param[in]   desplazamiento  ndice en senal_busqueda del primer elemento
+ *                              que se compara con la plantilla.
+ * \param[in]   diezmado        se usa una de cada diezmado muestras.
+ *
+ * \return      valor de la correlacin.
+ */
+static int64_t correlacion(uint32_t desplazamiento, uint32_t diezmado)
+{
+    const int16_t *ptr_senal = &senal_busqueda[desplazamiento];
+    int64_t suma = 0;
+    uint32_t i;
+
+    for (i = 0; i < WSOLA_SOLAPE; i += diezmado)
+    {
+        suma += (int32_t)plantilla[i]*ptr_senal[i];
+    }
+
+    return suma;
+}
+
+/***************************************************************************//**
+ * \brief       Buscar alrededor de la posicin nominal de anlisis el segmento
+ *              que mejor contina el segmento anterior.
+ *
+ * \param[in]   nominal     posicin nominal de anlisis.
+ *
+ * \return      posicin elegida dentro del buffer de entrada.
+ */
+static uint32_t buscar_mejor_posicion(uint32_t nominal)
+{
+    uint32_t desde;
+    uint32_t numero_desplazamientos;
+    uint32_t mejor;
+    uint32_t inicio_fino;
+    uint32_t fin_fino;
+    uint32_t i;
+    int64_t valor;
+    int64_t mejor_valor;
+
+    desde = nominal > WSOLA_TOLERANCIA ? nominal - WSOLA_TOLERANCIA : 0;
+    numero_desplazamientos = nominal + WSOLA_TOLERANCIA - desde + 1;
+
+    for (i = 0; i < WSOLA_SOLAPE; i++)
+    {
+        plantilla[i] = muestra_mono(posicion_continuacion + i);
+    }
+
+    for (i = 0; i < numero_desplazamientos + WSOLA_SOLAPE - 1; i++)
+    {
+        senal_busqueda[i] = muestra_mono(desde + i);
+    }
+
+    /* Pasada gruesa.
+     */
+    mejor = nominal - desde;
+    mejor_valor = correlacion(mejor, DIEZMADO_GRUESO);
+
+    for (i = 0; i < numero_desplazamientos; i += PASO_BUSQUEDA_GRUESA)
+    {
+        valor = correlacion(i, DIEZMADO_GRUESO);
+        if (valor > mejor_valor)
+        {
+            mejor_valor = valor;
+            mejor = i;
+        }
+    }
+
+    /* Pasada fina alrededor del mejor candidato de la pasada gruesa.
+     */
+    inicio_fino = mejor >= PASO_BUSQUEDA_GRUESA - 1 ?
+                  mejor - (PASO_BUSQUEDA_GRUESA - 1) : 0;
+    fin_fino = mejor + PASO_BUSQUEDA_GRUESA - 1;
+    if (fin_fino > numero_desplazamientos - 1)
+    {
+        fin_fino = numero_desplazamientos - 1;
+    }
+
+    mejor_valor = correlacion(mejor, DIEZMADO_FINO);
+
+    for (i = inicio_fino; i <= fin_fino; i++)
+    {
+        valor = correlacion(i, DIEZMADO_FINO);
+        if (valor > mejor_valor)
+        {
+            mejor_valor = valor;
+            mejor = i;
+        }
+    }
+
+    return desde + mejor;
+}
+
+/***************************************************************************//**
+ * \brief       Enviar un bloque de muestras a la salida de audio descontando
+ *              de la contabilidad de ciclos el tiempo de espera en la salida.
+ */
+static void enviar_a_salida(int32_t *ptr_izquierda,
+                            int32_t *ptr_derecha,
+                            uint16_t longitud)
+{
+    uint32_t inicio = ciclos_leer();
+
+    salaud_encolar_bloque_muestras(ptr_izquierda,
+                                   ptr_derecha,
+                                   longitud,
+                                   canales_actuales);
+
+    ciclos_en_salida += ciclos_leer() - inicio;
+}
+
+/***************************************************************************//**
+ * \brief       Realizar una iteracin del algoritmo si hay suficientes
+ *              muestras en el buffer de entrada.
+ *
+ * \return      TRUE si se gener un bloque de salida, FALSE si faltan muestras.
+ */
+static bool_t iterar(void)
+{
+    uint32_t nominal = posicion_analisis_q16 >> 16;
+    uint32_t mejor;
+    uint32_t canal;
+    uint32_t i;
+    int32_t *ptr_anterior;
+    int32_t *ptr_nuevo;
+
+    if (nominal + WSOLA_TOLERANCIA + WSOLA_SALTO_SINTESIS > muestras_entrada ||
+        posicion_continuacion + WSOLA_SOLAPE > muestras_entrada)
+    {
+        return FALSE;
+    }
+
+    if (primera_iteracion)
+    {
+        mejor = nominal;
+        for (canal = 0; canal < canales_actuales; canal++)
+        {
+            memcpy(salida[canal], &entrada[canal][mejor],
+                   WSOLA_SALTO_SINTESIS*sizeof(int32_t));
+        }
+        primera_iteracion = FALSE;
+    }
+    else
+    {
+        mejor = buscar_mejor_posicion(nominal);
+
+        for (canal = 0; canal < canales_actuales; canal++)
+        {
+            ptr_anterior = &entrada[canal][posicion_continuacion];
+            ptr_nuevo = &entrada[canal][mejor];
+
+            /* Fundido cruzado lineal. Se desplaza antes de multiplicar para
+             * no desbordar los 32 bits.
+             */
+            for (i = 0; i < WSOLA_SOLAPE; i++)
+            {
+                salida[canal][i] =
+                    (ptr_anterior[i] >> WSOLA_BITS_SOLAPE)*(int32_t)(WSOLA_SOLAPE - i) +
+                    (ptr_nuevo[i] >> WSOLA_BITS_SOLAPE)*(int32_t)i;
+            }
+
+            memcpy(&salida[canal][WSOLA_SOLAPE], &ptr_nuevo[WSOLA_SOLAPE],
+                   (WSOLA_SALTO_SINTESIS - WSOLA_SOLAPE)*sizeof(int32_t));
+        }
+    }
+
+    enviar_a_salida(salida[0], salida[1], WSOLA_SALTO_SINTESIS);
+    muestras_generadas += WSOLA_SALTO_SINTESIS;
+
+    posicion_continuacion = mejor + WSOLA_SALTO_SINTESIS;
+    posicion_analisis_q16 += salto_analisis_q16;
+
+    return TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Descartar del buffer de entrada las muestras que ya no pueden
+ *              volver a usarse.
+ */
+static void compactar(void)
+{
+    uint32_t nominal = posicion_analisis_q16 >> 16;
+    uint32_t descartar;
+    uint32_t canal;
+
+    descartar = nominal > WSOLA_TOLERANCIA ? nominal - WSOLA_TOLERANCIA : 0;
+    if (posicion_continuacion < descartar) descartar = posicion_continuacion;
+    if (descartar > muestras_entrada) descartar = muestras_entrada;
+    if (descartar == 0) return;
+
+    for (canal = 0; canal < canales_actuales; canal++)
+    {
+        memmove(entrada[canal], &entrada[canal][descartar],
+                (muestras_entrada - descartar)*sizeof(int32_t));
+    }
+
+    muestras_entrada -= descartar;
+    posicion_continuacion -= descartar;
+    posicion_analisis_q16 -= descartar << 16;
+}
+
+/***************************************************************************//**
+ * \brief   Vaciar el estado del algoritmo sin tocar la velocidad seleccionada
+ *          ni la contabilidad de ciclos. Se llama al comienzo de cada
+ *          reproduccin.
+ */
+void wsola_inicializar(void)
+{
+    muestras_entrada = 0;
+    posicion_continuacion = 0;
+    posicion_analisis_q16 = 0;
+    canales_actuales = 0;
+    primera_iteracion = TRUE;
+}
+
+/***************************************************************************//**
+ * \brief       Seleccionar la velocidad de reproduccin.
+ *
+ *              Debe llamarse desde el mismo contexto que wsola_procesar (el
+ *              hilo del decodificador). Al volver a la velocidad normal se
+ *              vaca el buffer de entrada.
+ *
+ * \param[in]   velocidad   velocidad en tanto por ciento de la original, entre
+ *                          WSOLA_VELOCIDAD_MINIMA y WSOLA_VELOCIDAD_MAXIMA.
+ */
+void wsola_ajustar_velocidad(uint32_t velocidad)
+{
+    ASSERT(velocidad >= WSOLA_VELOCIDAD_MINIMA &&
+           velocidad <= WSOLA_VELOCIDAD_MAXIMA,
+           "Velocidad de reproduccion fuera de rango.");
+
+    if (velocidad == velocidad_actual) return;
+
+    if (velocidad == WSOLA_VELOCIDAD_NORMAL)
+    {
+        wsola_vaciar();
+    }
+
+    velocidad_actual = velocidad;
+    /* El producto no cabe en 32 bits a partir de x1.28.
+     */
+    salto_analisis_q16 = (uint32_t)((uint64_t)WSOLA_SALTO_SINTESIS*velocidad*
+                                    65536u/100u);
+    salaud_ajustar_velocidad(velocidad);
+
+    ciclos_acumulados = 0;
+    muestras_generadas = 0;
+}
+
+/***************************************************************************//**
+ * \brief   Leer la velocidad de reproduccin seleccionada.
+ *
+ * \return  Velocidad en tanto por ciento de la original.
+ */
+uint32_t wsola_leer_velocidad(void)
+{
+    return velocidad_actual;
+}
+
+/***************************************************************************//**
+ * \brief       Procesar un bloque de muestras decodificadas. Los bloques
+ *              resultantes se envan a la salida de audio mediante
+ *              salaud_encolar_bloque_muestras.
+ *
+ * \param[in]   ptr_muestras_izquierda  muestras del canal izquierdo.
+ * \param[in]   ptr_muestras_derecha    muestras del canal derecho.
+ * \param[in]   longitud                nmero de muestras por canal.
+ * \param[in]   numero_canales          1 o 2.
+ */
+void wsola_procesar(int32_t *ptr_muestras_izquierda,
+                    int32_t *ptr_muestras_derecha,
+                    uint16_t longitud,
+                    uint16_t numero_canales)
+{
+    uint32_t inicio;
+    uint32_t n;
+
+    if (velocidad_actual == WSOLA_VELOCIDAD_NORMAL && muestras_entrada == 0)
+    {
+        salaud_encolar_bloque_muestras(ptr_muestras_izquierda,
+                                       ptr_muestras_derecha,
+                                       longitud,
+                                       numero_canales);
+        return;
+    }
+
+    ASSERT(numero_canales == 1 || numero_canales == 2,
+           "Numero de canales incorrecto.");
+
+    inicio = ciclos_leer();
+    ciclos_en_salida = 0;
+
+    if (numero_canales != canales_actuales)
+    {
+        wsola_inicializar();
+        canales_actuales = numero_canales;
+    }
+
+    while (longitud > 0)
+    {
+        compactar();
+
+        n = WSOLA_CAPACIDAD_ENTRADA - muestras_entrada;
+        if (n > longitud) n = longitud;
+
+        memcpy(&entrada[0][muestras_entrada], ptr_muestras_izquierda,
+               n*sizeof(int32_t));
+        ptr_muestras_izquierda += n;
+
+        if (numero_canales == 2)
+        {
+            memcpy(&entrada[1][muestras_entrada], ptr_muestras_derecha,
+                   n*sizeof(int32_t));
+            ptr_muestras_derecha += n;
+        }
+
+        muestras_entrada += n;
+        longitud -= n;
+
+        while (iterar()) {}
+    }
+
+    ciclos_acumulados += (ciclos_leer() - inicio) - ciclos_en_salida;
+}
+
+/***************************************************************************//**
+ * \brief   Enviar a la salida de audio las muestras que quedan en el buffer de
+ *          entrada a partir de la continuacin del ltimo segmento y dejar el
+ *          buffer vaco. Se llama al terminar el fichero y al volver a la
+ *          velocidad normal.
+ */
+void wsola_vaciar(void)
+{
+    uint32_t posicion = posicion_continuacion;
+    uint32_t n;
+
+    if (primera_iteracion) posicion = posicion_analisis_q16 >> 16;
+
+    while (posicion < muestras_entrada)
+    {
+        n = muestras_entrada - posicion;
+        if (n > WSOLA_SALTO_SINTESIS) n = WSOLA_SALTO_SINTESIS;
+
+        enviar_a_salida(&entrada[0][posicion], &entrada[1][posicion],
+                        (uint16_t)n);
+        posicion += n;
+    }
+
+    wsola_inicializar();
+}
+
+/***************************************************************************//**
+ * \brief   Coste medio del algoritmo desde el ltimo cambio de velocidad.
+ *
+ * \return  Ciclos de CPU por muestra de salida (por canal), o 0 si an no se ha
+ *          generado ninguna muestra a la velocidad actual.
+ */
+uint32_t wsola_ciclos_por_muestra(void)
+{
+    if (muestras_generadas == 0) return 0;
+
+    return (uint32_t)(ciclos_acumulados/muestras_generadas);
+}
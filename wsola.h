@@ -0,0 +1,59 @@
+/***************************************************************************//**
+ * \file    wsola.h
+ *
+ * \brief   Cambio de la velocidad de reproduccin sin alterar el tono mediante
+ *          estiramiento temporal WSOLA (Waveform Similarity Overlap-Add) en
+ *          aritmtica de punto fijo.
+ */
+
+#ifndef WSOLA_H
+#define WSOLA_H
+
+#include "tipos.h"
+
+/*===== Constantes =============================================================
+ */
+
+/* Velocidades de reproduccin admitidas, en tanto por ciento de la velocidad
+ * original.
+ */
+#define WSOLA_VELOCIDAD_MINIMA      75u
+#define WSOLA_VELOCIDAD_NORMAL      100u
+#define WSOLA_VELOCIDAD_MAXIMA      200u
+
+/* Nmero de muestras por canal que se generan en cada iteracin del algoritmo
+ * (salto de sntesis).
+ */
+#define WSOLA_SALTO_SINTESIS        512u
+
+/* Nmero de muestras sobre el que se realiza el fundido cruzado entre el
+ * segmento anterior y el nuevo. Debe ser una potencia de 2 no mayor que el
+ * salto de sntesis.
+ */
+#define WSOLA_BITS_SOLAPE           8u
+#define WSOLA_SOLAPE                (1u << WSOLA_BITS_SOLAPE)
+
+/* Desplazamiento mximo, en muestras, alrededor de la posicin nominal de
+ * anlisis en el que se busca el segmento ms parecido a la continuacin
+ * natural del segmento anterior.
+ */
+#define WSOLA_TOLERANCIA            128u
+
+/* Capacidad en muestras por canal del buffer de entrada.
+ */
+#define WSOLA_CAPACIDAD_ENTRADA     3072u
+
+/*===== Prototipos de funciones ================================================
+ */
+
+void wsola_inicializar(void);
+void wsola_ajustar_velocidad(uint32_t velocidad);
+uint32_t wsola_leer_velocidad(void);
+void wsola_procesar(int32_t *ptr_muestras_izquierda,
+                    int32_t *ptr_muestras_derecha,
+                    uint16_t longitud,
+                    uint16_t numero_canales);
+void wsola_vaciar(void);
+uint32_t wsola_ciclos_por_muestra(void);
+
+#endif  /* WSOLA_H */